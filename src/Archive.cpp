@@ -0,0 +1,586 @@
+#include "Archive.h"
+#include "ByteIO.h"
+#include "Checksum.h"
+#include "CodecSelector.h"
+#include "CompressionEngine.h"
+#include "CompressionExceptions.h"
+#include "DirectFileBuffer.h"
+#include "MemoryStream.h"
+#include "StreamWindow.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <future>
+#include <map>
+#include <mutex>
+
+using EncodingAlgorithms::CodecId;
+
+namespace {
+
+	// Bytes of an entry record besides the name: name length, codec, flags, offset, two sizes and the solid offset.
+	constexpr size_t ENTRY_FIXED_SIZE = 2 + 1 + 1 + 8 + 8 + 8 + 8;
+
+	std::string ToEntryName(const std::filesystem::path& relative) {
+		auto name = relative.generic_u8string();
+		return std::string(name.begin(), name.end());
+	}
+
+	std::filesystem::path FromEntryName(const std::string& name) {
+		return std::filesystem::u8path(name);
+	}
+
+	bool IsKnownCodec(std::uint8_t codec) {
+		return codec == static_cast<std::uint8_t>(CodecId::RLE) || codec == static_cast<std::uint8_t>(CodecId::Huffman) ||
+			codec == static_cast<std::uint8_t>(CodecId::ContextHuffman);
+	}
+
+	std::string SolidGroupKey(const ArchiveSource& source, const ArchiveOptions& options) {
+		if (!options.group_by_extension) {
+			return {};
+		}
+		std::string extension = source.path.extension().string();
+		std::transform(extension.begin(), extension.end(), extension.begin(),
+			[](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+		return extension;
+	}
+
+	// Splits the small sources into solid groups, each holding files of one kind, in a stable order.
+	std::vector<std::vector<const ArchiveSource*>> BuildSolidGroups(const std::vector<const ArchiveSource*>& sources,
+		const ArchiveOptions& options) {
+
+		std::map<std::string, std::vector<const ArchiveSource*>> by_key;
+		for (const auto* source : sources) {
+			by_key[SolidGroupKey(*source, options)].push_back(source);
+		}
+
+		std::vector<std::vector<const ArchiveSource*>> groups;
+		for (const auto& [key, members] : by_key) {
+			std::vector<const ArchiveSource*> group;
+			std::uint64_t group_size = 0;
+			for (const auto* source : members) {
+				if (!group.empty() && group_size + source->size > options.solid_group_size) {
+					groups.push_back(std::move(group));
+					group.clear();
+					group_size = 0;
+				}
+				group.push_back(source);
+				group_size += source->size;
+			}
+			if (!group.empty()) {
+				groups.push_back(std::move(group));
+			}
+		}
+		return groups;
+	}
+
+	// Appends a whole file to a buffer, returning the number of bytes it had when read.
+	std::uint64_t AppendFile(const std::filesystem::path& path, std::vector<std::uint8_t>& data) {
+		std::ifstream input(path, std::ios::binary | std::ios::ate);
+		if (!input) {
+			throw FileOpenException(path.string());
+		}
+
+		std::streamoff size = input.tellg();
+		input.seekg(0);
+		size_t offset = data.size();
+		data.resize(offset + static_cast<size_t>(std::max<std::streamoff>(size, 0)));
+		input.read(reinterpret_cast<char*>(data.data() + offset), static_cast<std::streamsize>(data.size() - offset));
+		if (input.bad()) {
+			throw CompressionException("Failed to read " + path.string());
+		}
+		data.resize(offset + static_cast<size_t>(input.gcount()));
+		return data.size() - offset;
+	}
+
+}
+
+void ArchiveDirectory::Add(ArchiveEntry entry) {
+	if (!by_name_.emplace(entry.name, entries_.size()).second) {
+		throw CompressionException("Duplicate archive entry: " + entry.name);
+	}
+	entries_.push_back(std::move(entry));
+}
+
+const ArchiveEntry* ArchiveDirectory::Find(const std::string& name) const {
+	auto it = by_name_.find(name);
+	return it == by_name_.end() ? nullptr : &entries_[it->second];
+}
+
+std::vector<ArchiveSource> Archive::ListSources(const std::filesystem::path& source_dir) {
+	std::vector<ArchiveSource> sources;
+
+	std::error_code ec;
+	for (std::filesystem::recursive_directory_iterator it(source_dir, ec), end; !ec && it != end; it.increment(ec)) {
+		if (!it->is_regular_file(ec)) {
+			continue;
+		}
+
+		ArchiveSource source;
+		source.path = it->path();
+		source.name = ToEntryName(it->path().lexically_relative(source_dir));
+		source.size = it->file_size(ec);
+		sources.push_back(std::move(source));
+	}
+	if (ec) {
+		throw CompressionException("Failed to read directory " + source_dir.string() + ": " + ec.message());
+	}
+
+	std::sort(sources.begin(), sources.end(),
+		[](const ArchiveSource& a, const ArchiveSource& b) { return a.name < b.name; });
+	return sources;
+}
+
+ArchiveDirectory Archive::Create(const std::vector<ArchiveSource>& sources, std::ostream& output,
+	CodecId codec, const EncodingAlgorithms::CodecSettings& settings, const ArchiveOptions& options,
+	std::optional<EncodingAlgorithms::ProgressCallback> progress_callback) {
+
+	output.write(MAGIC_NUMBER.data(), MAGIC_NUMBER.size());
+	output.write(reinterpret_cast<const char*>(&VERSION_NUMBER), sizeof(VERSION_NUMBER));
+
+	ArchiveDirectory directory;
+	std::mutex output_mutex;
+	std::int64_t total_processed = 0;
+
+	// Called with output_mutex held (or from this thread only), so entries and progress stay consistent.
+	auto record_entry = [&](const ArchiveSource& source, CodecId entry_codec, std::uint64_t offset,
+		std::uint64_t compressed_size, std::uint64_t original_size, std::optional<std::uint64_t> solid_offset = std::nullopt) {
+
+		ArchiveEntry entry;
+		entry.name = source.name;
+		entry.codec = entry_codec;
+		entry.offset = offset;
+		entry.compressed_size = compressed_size;
+		entry.original_size = original_size;
+		entry.solid = solid_offset.has_value();
+		entry.solid_offset = solid_offset.value_or(0);
+		directory.Add(std::move(entry));
+
+		total_processed += static_cast<std::int64_t>(original_size);
+		if (progress_callback) {
+			(*progress_callback)(total_processed);
+		}
+	};
+
+	// Each source gets its own settings, so buffer auto-tuning sees the right file.
+	auto open_source = [&settings](const ArchiveSource& source, EncodingAlgorithms::CodecSettings& resolved) {
+		resolved = settings.ResolvedFor(source.path);
+		auto input = DirectFileBuffer::OpenInput(source.path, resolved);
+		if (!*input) {
+			throw FileOpenException(source.path.string());
+		}
+		return input;
+	};
+
+	// The size is taken from what was actually compressed, in case the file changed since it was listed.
+	auto compress_source = [codec, &options](std::istream& input, std::ostream& stream, const ArchiveSource& source,
+		const EncodingAlgorithms::CodecSettings& resolved, CodecId& entry_codec) {
+
+		entry_codec = options.auto_codec ? EncodingAlgorithms::CodecSelector::Select(input, resolved) : codec;
+
+		std::uint64_t original_size = 0;
+		CompressionEngine::Compress(input, stream, entry_codec, source.path.extension().string(), resolved,
+			[&original_size](std::int64_t processed) { original_size = static_cast<std::uint64_t>(processed); });
+		return original_size;
+	};
+
+	std::vector<const ArchiveSource*> solid_sources;
+	std::vector<const ArchiveSource*> separate_sources;
+	std::vector<const ArchiveSource*> large_sources;
+	for (const auto& source : sources) {
+		if (options.solid && source.size <= options.solid_file_limit) {
+			solid_sources.push_back(&source);
+		}
+		else if (source.size > LARGE_ENTRY_SIZE) {
+			large_sources.push_back(&source);
+		}
+		else {
+			separate_sources.push_back(&source);
+		}
+	}
+
+	// Solid groups always use the block format, extracting one file relies on the block index.
+	auto solid_settings = settings;
+	solid_settings.block_format = true;
+
+	{
+		std::optional<ThreadPool> own_pool;
+		ThreadPool& pool = ThreadPool::Current() ? *ThreadPool::Current() : own_pool.emplace(settings.threads);
+		std::vector<std::future<void>> pending;
+
+		for (auto& group : BuildSolidGroups(solid_sources, options)) {
+			pending.push_back(pool.Submit([&, group = std::move(group)]() {
+				std::vector<std::uint8_t> data;
+				std::vector<std::uint64_t> offsets;
+				std::vector<std::uint64_t> sizes;
+				for (const auto* source : group) {
+					offsets.push_back(data.size());
+					sizes.push_back(AppendFile(source->path, data));
+				}
+
+				std::vector<std::uint8_t> compressed;
+				MemoryOutputBuffer buffer(compressed);
+				std::ostream stream(&buffer);
+				// The whole group is in memory already, so it is analyzed in full rather than sampled.
+				CodecId group_codec = options.auto_codec
+					? EncodingAlgorithms::CodecSelector::Choose(EncodingAlgorithms::CodecSelector::Analyze(data.data(), data.size()),
+						solid_settings)
+					: codec;
+
+				MemoryInputBuffer input_buffer(data.data(), data.size());
+				std::istream input(&input_buffer);
+				CompressionEngine::Compress(input, stream, group_codec, "", solid_settings);
+
+				std::lock_guard<std::mutex> lock(output_mutex);
+				auto offset = static_cast<std::uint64_t>(output.tellp());
+				output.write(reinterpret_cast<const char*>(compressed.data()), compressed.size());
+				for (size_t i = 0; i < group.size(); ++i) {
+					record_entry(*group[i], group_codec, offset, compressed.size(), sizes[i], offsets[i]);
+				}
+			}));
+		}
+
+		for (const auto* source_ptr : separate_sources) {
+			pending.push_back(pool.Submit([&, source_ptr]() {
+				const ArchiveSource& source = *source_ptr;
+				EncodingAlgorithms::CodecSettings resolved;
+				auto input = open_source(source, resolved);
+
+				std::vector<std::uint8_t> compressed;
+				MemoryOutputBuffer buffer(compressed);
+				std::ostream stream(&buffer);
+				CodecId entry_codec;
+				auto original_size = compress_source(*input, stream, source, resolved, entry_codec);
+
+				// Append in completion order, whichever entry finishes first is written first.
+				std::lock_guard<std::mutex> lock(output_mutex);
+				auto offset = static_cast<std::uint64_t>(output.tellp());
+				output.write(reinterpret_cast<const char*>(compressed.data()), compressed.size());
+				record_entry(source, entry_codec, offset, compressed.size(), original_size);
+			}));
+		}
+
+		// Wait for everything before rethrowing, the tasks reference locals of this function.
+		std::exception_ptr failure;
+		for (auto& task : pending) {
+			try {
+				pool.Wait(task);
+				task.get();
+			}
+			catch (...) {
+				if (!failure) {
+					failure = std::current_exception();
+				}
+			}
+		}
+		if (failure) {
+			std::rethrow_exception(failure);
+		}
+	}
+
+	// Large files would need too much memory to buffer, stream them straight into the archive.
+	for (const auto* source : large_sources) {
+		EncodingAlgorithms::CodecSettings resolved;
+		auto input = open_source(*source, resolved);
+
+		auto offset = static_cast<std::uint64_t>(output.tellp());
+		CodecId entry_codec;
+		auto original_size = compress_source(*input, output, *source, resolved, entry_codec);
+		record_entry(*source, entry_codec, offset, static_cast<std::uint64_t>(output.tellp()) - offset, original_size);
+	}
+
+	WriteDirectory(output, directory, static_cast<std::uint64_t>(output.tellp()));
+	if (!output) {
+		throw CompressionException("Failed to write archive");
+	}
+	return directory;
+}
+
+void Archive::WriteDirectory(std::ostream& output, const ArchiveDirectory& directory, std::uint64_t directory_offset) {
+	std::vector<std::uint8_t> buffer;
+	for (const auto& entry : directory.entries()) {
+		if (entry.name.size() > UINT16_MAX) {
+			throw CompressionException("Archive entry name is too long: " + entry.name);
+		}
+
+		size_t pos = buffer.size();
+		buffer.resize(pos + ENTRY_FIXED_SIZE + entry.name.size());
+		std::uint8_t* data = buffer.data() + pos;
+
+		ByteIO::StoreLE(data, static_cast<std::uint16_t>(entry.name.size()));
+		std::copy(entry.name.begin(), entry.name.end(), data + 2);
+		data += 2 + entry.name.size();
+		data[0] = static_cast<std::uint8_t>(entry.codec);
+		data[1] = entry.solid ? ENTRY_FLAG_SOLID : 0;
+		ByteIO::StoreLE(data + 2, entry.offset);
+		ByteIO::StoreLE(data + 10, entry.compressed_size);
+		ByteIO::StoreLE(data + 18, entry.original_size);
+		ByteIO::StoreLE(data + 26, entry.solid_offset);
+	}
+
+	std::uint8_t footer[FOOTER_SIZE];
+	ByteIO::StoreLE(footer, directory_offset);
+	ByteIO::StoreLE(footer + 8, static_cast<std::uint64_t>(directory.size()));
+	ByteIO::StoreLE(footer + 16, Checksum::Crc32c(buffer.data(), buffer.size()));
+	std::copy(FOOTER_MAGIC.begin(), FOOTER_MAGIC.end(), footer + 20);
+
+	output.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+	output.write(reinterpret_cast<const char*>(footer), FOOTER_SIZE);
+}
+
+ArchiveDirectory Archive::ReadDirectory(std::istream& input) {
+	char header[HEADER_SIZE];
+	input.clear();
+	input.seekg(0);
+	input.read(header, HEADER_SIZE);
+	if (input.gcount() != static_cast<std::streamsize>(HEADER_SIZE) ||
+		!std::equal(MAGIC_NUMBER.begin(), MAGIC_NUMBER.end(), header)) {
+		throw InvalidHeaderException("Not an archive");
+	}
+	if (static_cast<std::uint8_t>(header[3]) != VERSION_NUMBER) {
+		throw InvalidHeaderException("Unsupported archive version");
+	}
+
+	input.seekg(0, std::ios::end);
+	std::streamoff file_size = input.tellg();
+	if (file_size < static_cast<std::streamoff>(HEADER_SIZE + FOOTER_SIZE)) {
+		throw CompressionException("Archive directory is missing or truncated");
+	}
+	auto size = static_cast<std::uint64_t>(file_size);
+
+	std::uint8_t footer[FOOTER_SIZE];
+	input.seekg(static_cast<std::streamoff>(size - FOOTER_SIZE));
+	input.read(reinterpret_cast<char*>(footer), FOOTER_SIZE);
+	if (input.gcount() != static_cast<std::streamsize>(FOOTER_SIZE) ||
+		!std::equal(FOOTER_MAGIC.begin(), FOOTER_MAGIC.end(), footer + 20)) {
+		throw CompressionException("Archive directory is missing or truncated");
+	}
+
+	auto directory_offset = ByteIO::LoadLE<std::uint64_t>(footer);
+	auto count = ByteIO::LoadLE<std::uint64_t>(footer + 8);
+	auto checksum = ByteIO::LoadLE<std::uint32_t>(footer + 16);
+	if (directory_offset < HEADER_SIZE || directory_offset > size - FOOTER_SIZE) {
+		throw CompressionException("Corrupt archive directory");
+	}
+
+	// The whole directory is read with one request and checked before anything in it is trusted.
+	std::vector<std::uint8_t> buffer(static_cast<size_t>(size - FOOTER_SIZE - directory_offset));
+	input.seekg(static_cast<std::streamoff>(directory_offset));
+	input.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+	if (input.gcount() != static_cast<std::streamsize>(buffer.size()) ||
+		Checksum::Crc32c(buffer.data(), buffer.size()) != checksum || count > buffer.size() / ENTRY_FIXED_SIZE) {
+		throw CompressionException("Corrupt archive directory");
+	}
+
+	ArchiveDirectory directory;
+	const std::uint8_t* data = buffer.data();
+	const std::uint8_t* end = data + buffer.size();
+	for (std::uint64_t i = 0; i < count; ++i) {
+		auto name_length = static_cast<size_t>(end - data) >= 2 ? ByteIO::LoadLE<std::uint16_t>(data) : 0;
+		if (static_cast<size_t>(end - data) < ENTRY_FIXED_SIZE + name_length) {
+			throw CompressionException("Corrupt archive directory");
+		}
+
+		ArchiveEntry entry;
+		entry.name.assign(reinterpret_cast<const char*>(data + 2), name_length);
+		data += 2 + name_length;
+
+		if (!IsKnownCodec(data[0])) {
+			throw CompressionException("Unknown algorithm for archive entry: " + entry.name);
+		}
+		if ((data[1] & ~ENTRY_FLAG_SOLID) != 0) {
+			throw CompressionException("Unsupported flags for archive entry: " + entry.name);
+		}
+		entry.codec = static_cast<CodecId>(data[0]);
+		entry.solid = (data[1] & ENTRY_FLAG_SOLID) != 0;
+		entry.offset = ByteIO::LoadLE<std::uint64_t>(data + 2);
+		entry.compressed_size = ByteIO::LoadLE<std::uint64_t>(data + 10);
+		entry.original_size = ByteIO::LoadLE<std::uint64_t>(data + 18);
+		entry.solid_offset = ByteIO::LoadLE<std::uint64_t>(data + 26);
+		data += ENTRY_FIXED_SIZE - 2;
+
+		if (entry.offset < HEADER_SIZE || entry.compressed_size > directory_offset - entry.offset) {
+			throw CompressionException("Corrupt archive directory");
+		}
+		directory.Add(std::move(entry));
+	}
+
+	input.clear();
+	return directory;
+}
+
+void Archive::ExtractEntry(std::istream& input, const ArchiveEntry& entry, const std::filesystem::path& output_path,
+	const EncodingAlgorithms::CodecSettings& settings) {
+
+	if (entry.solid) {
+		// The group's block index sits at the end of its stream, not of the archive, so
+		// the range is decoded through a window that makes the group look like a whole file.
+		StreamWindowBuffer window(input, entry.offset, entry.compressed_size);
+		std::istream group(&window);
+
+		std::ofstream output(output_path, std::ios::binary);
+		if (!output) {
+			throw FileOpenException(output_path.string());
+		}
+		auto written = CompressionEngine::DecompressRange(group, output, entry.solid_offset, entry.original_size, settings);
+		if (written != entry.original_size || !output.flush()) {
+			throw CompressionException("Archive entry does not match the directory: " + entry.name);
+		}
+		return;
+	}
+
+	// Entries are complete compressed streams, and the decoder stops at their end-of-stream frame.
+	input.clear();
+	input.seekg(static_cast<std::streamoff>(entry.offset));
+	FileHeader header = CompressionEngine::DecompressToFile(input, output_path, entry.codec, settings);
+
+	if (header.has_original_size() && header.original_size_ != entry.original_size) {
+		throw CompressionException("Archive entry does not match the directory: " + entry.name);
+	}
+}
+
+ArchiveDirectory Archive::ExtractAll(const std::filesystem::path& archive_path, const std::filesystem::path& output_dir,
+	const EncodingAlgorithms::CodecSettings& settings,
+	std::optional<EncodingAlgorithms::ProgressCallback> progress_callback) {
+
+	std::ifstream input(archive_path, std::ios::binary);
+	if (!input) {
+		throw FileOpenException(archive_path.string());
+	}
+	ArchiveDirectory directory = ReadDirectory(input);
+
+	// Resolve every path up front, so a malicious name fails before anything is written.
+	std::vector<std::filesystem::path> output_paths;
+	output_paths.reserve(directory.size());
+	for (const auto& entry : directory.entries()) {
+		output_paths.push_back(EntryPath(output_dir, entry.name));
+	}
+
+	std::mutex progress_mutex;
+	std::int64_t total_processed = 0;
+	auto report = [&](std::uint64_t size) {
+		std::lock_guard<std::mutex> lock(progress_mutex);
+		total_processed += static_cast<std::int64_t>(size);
+		if (progress_callback) {
+			(*progress_callback)(total_processed);
+		}
+	};
+
+	// Small entries are extracted one per thread with serial decoding, each thread
+	// reading through its own stream since they all seek independently.
+	auto entry_settings = settings;
+	entry_settings.threads = 1;
+
+	// Members of a solid group share its stream, which is decoded once for all of them.
+	std::map<std::uint64_t, std::vector<size_t>> solid_groups;
+	std::vector<size_t> separate_entries;
+	std::vector<size_t> large_entries;
+	for (size_t i = 0; i < directory.size(); ++i) {
+		const auto& entry = directory.entries()[i];
+		if (entry.solid) {
+			solid_groups[entry.offset].push_back(i);
+		}
+		else if (entry.original_size > LARGE_ENTRY_SIZE) {
+			large_entries.push_back(i);
+		}
+		else {
+			separate_entries.push_back(i);
+		}
+	}
+
+	{
+		std::optional<ThreadPool> own_pool;
+		ThreadPool& pool = ThreadPool::Current() ? *ThreadPool::Current() : own_pool.emplace(settings.threads);
+		std::vector<std::future<void>> pending;
+
+		for (const auto& group : solid_groups) {
+			pending.push_back(pool.Submit([&, &members = group.second]() {
+				const auto& first = directory.entries()[members.front()];
+				std::ifstream group_input(archive_path, std::ios::binary);
+				if (!group_input) {
+					throw FileOpenException(archive_path.string());
+				}
+
+				StreamWindowBuffer window(group_input, first.offset, first.compressed_size);
+				std::istream stream(&window);
+				std::vector<std::uint8_t> data;
+				MemoryOutputBuffer buffer(data);
+				std::ostream output(&buffer);
+				CompressionEngine::Decompress(stream, output, first.codec, entry_settings);
+
+				for (size_t i : members) {
+					const auto& entry = directory.entries()[i];
+					if (entry.solid_offset > data.size() || entry.original_size > data.size() - entry.solid_offset) {
+						throw CompressionException("Archive entry does not match the directory: " + entry.name);
+					}
+
+					std::filesystem::create_directories(output_paths[i].parent_path());
+					std::ofstream file(output_paths[i], std::ios::binary);
+					file.write(reinterpret_cast<const char*>(data.data() + entry.solid_offset),
+						static_cast<std::streamsize>(entry.original_size));
+					if (!file) {
+						throw FileOpenException(output_paths[i].string());
+					}
+					report(entry.original_size);
+				}
+			}));
+		}
+
+		for (size_t i : separate_entries) {
+			pending.push_back(pool.Submit([&, i]() {
+				const auto& entry = directory.entries()[i];
+				std::filesystem::create_directories(output_paths[i].parent_path());
+
+				std::ifstream entry_input(archive_path, std::ios::binary);
+				if (!entry_input) {
+					throw FileOpenException(archive_path.string());
+				}
+				ExtractEntry(entry_input, entry, output_paths[i], entry_settings);
+				report(entry.original_size);
+			}));
+		}
+
+		std::exception_ptr failure;
+		for (auto& task : pending) {
+			try {
+				pool.Wait(task);
+				task.get();
+			}
+			catch (...) {
+				if (!failure) {
+					failure = std::current_exception();
+				}
+			}
+		}
+		if (failure) {
+			std::rethrow_exception(failure);
+		}
+	}
+
+	// Large entries have enough blocks to keep every core busy on their own.
+	for (size_t i : large_entries) {
+		const auto& entry = directory.entries()[i];
+		std::filesystem::create_directories(output_paths[i].parent_path());
+		ExtractEntry(input, entry, output_paths[i], settings);
+		report(entry.original_size);
+	}
+
+	return directory;
+}
+
+std::filesystem::path Archive::EntryPath(const std::filesystem::path& output_dir, const std::string& name) {
+	std::filesystem::path relative = FromEntryName(name);
+
+	bool safe = !name.empty() && !relative.has_root_path();
+	for (const auto& part : relative) {
+		if (part == ".." || part == ".") {
+			safe = false;
+		}
+	}
+	if (!safe) {
+		throw CompressionException("Unsafe entry name in archive: " + name);
+	}
+	return output_dir / relative;
+}
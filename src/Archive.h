@@ -0,0 +1,223 @@
+// Archive.h
+//
+// Archive packs a directory tree into a single container so that thousands of
+// small files can be compressed, stored and restored as one job instead of one
+// job per file.
+//
+// Every entry is a complete compressed stream as written by CompressionEngine,
+// so entries are independent of each other. Small entries are compressed
+// concurrently on a thread pool and appended in completion order; a central
+// directory at the end of the archive records where each one ended up. Reading
+// the fixed-size footer locates the directory with a single seek, after which
+// any entry can be listed or extracted without touching the others.
+//
+// In solid mode, small files are concatenated (grouped by extension, so similar
+// data ends up together) and compressed as one shared stream, so their blocks and
+// Huffman tables are shared instead of paid for per file. The directory records
+// where each file starts inside the decompressed group, and the group's block
+// index lets a single file be extracted by decoding only the blocks it spans.
+//
+// Archive layout (little-endian):
+//   header     "CTA" magic, u8 version
+//   entries    complete compressed streams, in completion order
+//   directory  per entry: u16 name length, UTF-8 name ('/' separated),
+//              u8 codec, u8 flags, u64 offset, u64 compressed size,
+//              u64 original size, u64 offset within the solid group
+//   footer     u64 directory offset, u64 entry count, u32 CRC32C of the
+//              directory, "CDIR" magic
+
+
+#pragma once
+
+#include "CodecSettings.h"
+#include "EncodingAlgorithms.h"
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+/**
+* @struct ArchiveSource
+* @brief A file on disk to be stored in an archive.
+*/
+struct ArchiveSource {
+	std::filesystem::path path;					///< Location of the file on disk.
+	std::string name;							///< Name inside the archive, relative and '/' separated.
+	std::uint64_t size = 0;						///< Size of the file when it was listed.
+};
+
+
+/**
+* @struct ArchiveEntry
+* @brief A central directory record describing one stored file.
+*/
+struct ArchiveEntry {
+	std::string name;							///< Relative, '/' separated path of the file.
+	EncodingAlgorithms::CodecId codec{};		///< Algorithm the entry was compressed with.
+	std::uint64_t offset = 0;					///< Absolute offset of the entry's compressed stream.
+	std::uint64_t compressed_size = 0;			///< Size of the compressed stream.
+	std::uint64_t original_size = 0;			///< Size of the file after extraction.
+	bool solid = false;							///< Whether the stream is a solid group shared with other entries.
+	std::uint64_t solid_offset = 0;				///< Offset of the file within the decompressed solid group.
+};
+
+
+/**
+* @struct ArchiveOptions
+* @brief Controls how files are laid out in a new archive.
+*/
+struct ArchiveOptions {
+	bool solid = false;										///< Compress small files together in shared streams.
+	bool group_by_extension = true;							///< Only put files with the same extension in a solid group.
+	bool auto_codec = false;								///< Pick each entry's codec with CodecSelector instead of using the given one.
+	std::uint64_t solid_file_limit = 256 * 1024;			///< Files up to this size are stored in solid groups.
+	std::uint64_t solid_group_size = 16 * 1024 * 1024;		///< Maximum uncompressed size of a solid group.
+};
+
+
+/**
+* @class ArchiveDirectory
+* @brief The central directory of an archive, with constant-time lookup by name.
+*/
+class ArchiveDirectory {
+public:
+
+	/**
+	* @brief Appends an entry.
+	*
+	* @throws: CompressionException if an entry with the same name already exists.
+	*/
+	void Add(ArchiveEntry entry);
+
+	/**
+	* @brief Looks up an entry by name.
+	*
+	* @param name: The '/' separated name of the entry.
+	* @return: The entry, or nullptr if the archive has no such entry.
+	*/
+	const ArchiveEntry* Find(const std::string& name) const;
+
+	const std::vector<ArchiveEntry>& entries() const { return entries_; }
+	size_t size() const { return entries_.size(); }
+
+private:
+	std::vector<ArchiveEntry> entries_;
+	std::unordered_map<std::string, size_t> by_name_;
+};
+
+
+/**
+* @class Archive
+* @brief Creates, lists and extracts multi-file archives.
+*/
+class Archive {
+public:
+
+	/**
+	* @brief Lists the regular files below a directory, in a stable order.
+	*
+	* @param source_dir: The directory to archive.
+	* @return: One source per file, named relative to source_dir.
+	* @throws: CompressionException if the directory cannot be read.
+	*/
+	static std::vector<ArchiveSource> ListSources(const std::filesystem::path& source_dir);
+
+	/**
+	* @brief Writes an archive containing the given files.
+	*
+	* Files up to LARGE_ENTRY_SIZE are compressed concurrently into memory on
+	* settings.threads threads and appended as soon as each finishes. Larger files
+	* are then streamed into the archive one at a time, so memory stays bounded by
+	* a few small entries per thread.
+	*
+	* With options.solid, files up to options.solid_file_limit are instead read
+	* into groups of up to options.solid_group_size and each group is compressed
+	* as one block-format stream. Groups are compressed concurrently as well.
+	*
+	* @param sources: The files to store, usually from ListSources.
+	* @param output: The stream receiving the archive. Must report its position through tellp.
+	* @param codec: The algorithm every entry is compressed with, unless options.auto_codec is set.
+	* @param settings: Codec settings, resolved per entry.
+	* @param options: Layout of the archive.
+	* @param progress_callback: Optional callback receiving the number of input bytes compressed.
+	* @return: The central directory that was written.
+	* @throws: FileOpenException if a source cannot be opened, CompressionException on write errors.
+	*/
+	static ArchiveDirectory Create(const std::vector<ArchiveSource>& sources, std::ostream& output,
+		EncodingAlgorithms::CodecId codec, const EncodingAlgorithms::CodecSettings& settings,
+		const ArchiveOptions& options = {},
+		std::optional<EncodingAlgorithms::ProgressCallback> progress_callback = std::nullopt);
+
+	/**
+	* @brief Reads the central directory of an archive.
+	*
+	* @param input: A seekable stream containing the whole archive.
+	* @return: The directory of the archive.
+	* @throws: InvalidHeaderException if the stream is not an archive, CompressionException if the directory is corrupt.
+	*/
+	static ArchiveDirectory ReadDirectory(std::istream& input);
+
+	/**
+	* @brief Extracts a single entry to a file.
+	*
+	* Entries in a solid group are extracted through the group's block index,
+	* decoding only the blocks that contain the file.
+	*
+	* @param input: A seekable stream containing the whole archive.
+	* @param entry: The entry to extract, from ReadDirectory.
+	* @param output_path: The file to create.
+	* @param settings: Codec settings. settings.threads decodes the entry's blocks in parallel.
+	* @throws: CompressionException if the entry is corrupt.
+	*/
+	static void ExtractEntry(std::istream& input, const ArchiveEntry& entry, const std::filesystem::path& output_path,
+		const EncodingAlgorithms::CodecSettings& settings);
+
+	/**
+	* @brief Extracts every entry of an archive below a directory.
+	*
+	* Small entries are extracted concurrently, each with its own view of the
+	* archive. Each solid group is decoded once and split into its files. Large
+	* entries are extracted afterwards with their blocks decoded in parallel instead.
+	*
+	* @param archive_path: The archive to extract.
+	* @param output_dir: The directory to recreate the tree in. Created if missing.
+	* @param settings: Codec settings.
+	* @param progress_callback: Optional callback receiving the number of bytes extracted.
+	* @return: The directory of the archive.
+	* @throws: CompressionException if an entry is corrupt or its name would escape output_dir.
+	*/
+	static ArchiveDirectory ExtractAll(const std::filesystem::path& archive_path, const std::filesystem::path& output_dir,
+		const EncodingAlgorithms::CodecSettings& settings,
+		std::optional<EncodingAlgorithms::ProgressCallback> progress_callback = std::nullopt);
+
+	/**
+	* @brief Maps an entry name to a path below a directory.
+	*
+	* @param output_dir: The extraction directory.
+	* @param name: The entry name.
+	* @return: The path to extract the entry to.
+	* @throws: CompressionException if the name is absolute or contains "..", which could overwrite files elsewhere.
+	*/
+	static std::filesystem::path EntryPath(const std::filesystem::path& output_dir, const std::string& name);
+
+	static constexpr std::array<char, 3> MAGIC_NUMBER = { 'C', 'T', 'A' };			///< Identifies an archive.
+	static constexpr std::uint8_t VERSION_NUMBER = 1;								///< Current archive version.
+	static constexpr size_t HEADER_SIZE = 4;										///< Magic number and version.
+	static constexpr std::array<char, 4> FOOTER_MAGIC = { 'C', 'D', 'I', 'R' };		///< Ends every archive.
+	static constexpr size_t FOOTER_SIZE = 24;										///< Directory offset, count, checksum and magic.
+	static constexpr std::uint8_t ENTRY_FLAG_SOLID = 0x01;							///< Entry is part of a solid group.
+	static constexpr std::uint64_t LARGE_ENTRY_SIZE = 64 * 1024 * 1024;			///< Entries above this are streamed, not buffered.
+
+private:
+
+	/**
+	* @brief Serializes the directory and footer.
+	*/
+	static void WriteDirectory(std::ostream& output, const ArchiveDirectory& directory, std::uint64_t directory_offset);
+};
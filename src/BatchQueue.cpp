@@ -0,0 +1,326 @@
+#include "BatchQueue.h"
+#include "BlockCoding.h"
+#include "CodecSelector.h"
+#include "CompressionEngine.h"
+#include "CompressionExceptions.h"
+#include "DirectFileBuffer.h"
+#include "PartialOutputGuard.h"
+
+#include <algorithm>
+#include <system_error>
+
+
+int BatchJobStatus::percentage() const {
+	return state == BatchJobState::Completed ? 100 : progress.percentage();
+}
+
+int BatchProgress::percentage() const {
+	if (progress.total == 0) {
+		return finished() ? 100 : 0;
+	}
+	return progress.percentage();
+}
+
+
+BatchQueue::BatchQueue(const EncodingAlgorithms::CodecSettings& settings, StatusCallback callback, size_t threads)
+	: settings_(settings), callback_(std::move(callback)),
+	control_(std::make_shared<JobControl>(settings.control)),
+	memory_(std::make_shared<MemoryBudget>(MemoryBudget::UNLIMITED, settings.memory ? settings.memory : MemoryBudget::Process())),
+	pool_(ThreadCount(settings, memory_->EffectiveLimit(), threads)) {
+}
+
+BatchQueue::~BatchQueue() {
+	// Paused jobs would never finish.
+	Resume();
+	Wait();
+}
+
+size_t BatchQueue::Add(BatchJob job) {
+	// Empty and unreadable files still count as jobs, they just don't move the byte totals.
+	std::error_code error;
+	auto input_size = std::filesystem::file_size(job.input, error);
+
+	size_t index;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		index = entries_.size();
+		if (index == 0) {
+			start_ = std::chrono::steady_clock::now();
+		}
+
+		Entry entry;
+		entry.status.input = job.input;
+		entry.control = std::make_shared<JobControl>(control_);
+		entry.input_size = error ? 0 : input_size;
+		entry.job = std::move(job);
+		entries_.push_back(std::move(entry));
+
+		++progress_.jobs;
+		progress_.progress.total += entries_.back().input_size;
+	}
+
+	// The future isn't needed, RunJob records failures itself and Wait tracks completion.
+	pool_.Submit([this, index]() { RunJob(index); });
+	return index;
+}
+
+void BatchQueue::Wait() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	finished_condition_.wait(lock, [this] { return progress_.finished(); });
+}
+
+BatchJobStatus BatchQueue::Status(size_t job) const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return entries_.at(job).status;
+}
+
+BatchProgress BatchQueue::Progress() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return progress_;
+}
+
+void BatchQueue::Cancel(size_t job) {
+	std::shared_ptr<JobControl> control;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		control = entries_.at(job).control;
+	}
+	control->Cancel();
+}
+
+void BatchQueue::Cancel() {
+	control_->Cancel();
+}
+
+void BatchQueue::Pause() {
+	control_->Pause();
+}
+
+void BatchQueue::Resume() {
+	control_->Resume();
+}
+
+std::vector<std::filesystem::path> BatchQueue::ExpandPaths(const std::vector<std::filesystem::path>& paths) {
+	std::vector<std::filesystem::path> files;
+	for (const auto& path : paths) {
+		if (!std::filesystem::is_directory(path)) {
+			files.push_back(path);
+			continue;
+		}
+
+		std::vector<std::filesystem::path> folder_files;
+		for (const auto& item : std::filesystem::recursive_directory_iterator(path)) {
+			if (item.is_regular_file()) {
+				folder_files.push_back(item.path());
+			}
+		}
+		std::sort(folder_files.begin(), folder_files.end());
+		files.insert(files.end(), folder_files.begin(), folder_files.end());
+	}
+	return files;
+}
+
+size_t BatchQueue::ThreadCount(const EncodingAlgorithms::CodecSettings& settings, size_t memory_limit, size_t threads) {
+	threads = ThreadPool::ResolveThreadCount(threads);
+	if (memory_limit == MemoryBudget::UNLIMITED) {
+		return threads;
+	}
+
+	// Jobs shrink their blocks and buffers to the budget, which is as small as they get.
+	auto job_settings = settings;
+	job_settings.block_size = std::min(settings.block_size,
+		std::max(memory_limit / EncodingAlgorithms::CodecSettings::BLOCK_BUDGET_SHARE, EncodingAlgorithms::MIN_BLOCK_SIZE));
+	job_settings.buffer_size = std::min(settings.buffer_size,
+		std::max(memory_limit / EncodingAlgorithms::CodecSettings::BUFFER_BUDGET_SHARE, EncodingAlgorithms::MIN_BUFFER_SIZE));
+	size_t job_memory = EncodingAlgorithms::BlockCoding::EncodeMemory(EncodingAlgorithms::CodecId::Huffman, job_settings);
+	return std::clamp<size_t>(memory_limit / job_memory, 1, threads);
+}
+
+void BatchQueue::RunJob(size_t index) {
+	BatchJob job;
+	auto settings = settings_;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		job = entries_[index].job;
+		settings.control = entries_[index].control;
+	}
+	if (job.level) {
+		settings.SetLevel(*job.level);
+	}
+	auto memory = std::make_shared<MemoryBudget>(job.memory_limit.value_or(MemoryBudget::UNLIMITED), memory_);
+	settings.memory = memory;
+
+	try {
+		// Jobs cancelled while queued stop here, before touching any file.
+		settings.CheckPoint();
+		Update(index, [](BatchJobStatus& status) { status.state = BatchJobState::Running; });
+
+		auto output = job.operation == BatchOperation::Compress ? Compress(index, job, settings) : Decompress(index, job, settings);
+		Update(index, [&output, &memory](BatchJobStatus& status) {
+			status.state = BatchJobState::Completed;
+			status.output = output;
+			status.peak_memory = memory->peak();
+		});
+	}
+	catch (const OperationCancelledException& e) {
+		std::string message = e.what();
+		Update(index, [&message, &memory](BatchJobStatus& status) {
+			status.state = BatchJobState::Cancelled;
+			status.error = message;
+			status.peak_memory = memory->peak();
+		});
+	}
+	catch (const std::exception& e) {
+		std::string message = e.what();
+		Update(index, [&message, &memory](BatchJobStatus& status) {
+			status.state = BatchJobState::Failed;
+			status.error = message;
+			status.peak_memory = memory->peak();
+		});
+	}
+}
+
+std::filesystem::path BatchQueue::Compress(size_t index, const BatchJob& job, const EncodingAlgorithms::CodecSettings& job_settings) {
+	auto settings = job_settings.ResolvedFor(job.input);
+
+	auto input_stream = DirectFileBuffer::OpenInput(job.input, settings);
+	std::istream& input = *input_stream;
+	if (!input) {
+		throw FileOpenException(job.input.string());
+	}
+
+	// The codec decides the extension, so it is chosen before the output is named.
+	auto codec = job.codec ? *job.codec : EncodingAlgorithms::CodecSelector::Select(input, settings);
+	auto output_path = job.output.empty()
+		? job.input.parent_path() / (job.input.stem().string() + CompressionEngine::GetFileExtension(codec))
+		: job.output;
+	ClaimOutput(output_path, job);
+
+	// Declared before the stream, so the file is closed by the time it is removed.
+	PartialOutputGuard partial_output;
+	auto output_stream = DirectFileBuffer::OpenOutput(output_path, settings);
+	std::ostream& output = *output_stream;
+	if (!output) {
+		throw FileOpenException(output_path.string());
+	}
+	partial_output.Guard(output_path);
+
+	auto total = std::filesystem::file_size(job.input);
+	Update(index, [&output_path, total](BatchJobStatus& status) {
+		status.output = output_path;
+		status.progress.total = total;
+	});
+
+	ProgressReporter reporter(total, [this, index](const ProgressReport& report) {
+		Update(index, [&report](BatchJobStatus& status) { status.progress = report; });
+	});
+	CompressionEngine::Compress(input, output, codec, job.input.extension().string(), settings,
+		[&reporter, &output](std::int64_t processed) {
+			auto bytes_in = static_cast<std::uint64_t>(processed);
+			reporter.Update(bytes_in, [&]() { return std::make_pair(bytes_in, ProgressReporter::Position(output)); });
+		});
+	reporter.Finish(total, total, ProgressReporter::Position(output));
+	DirectFileBuffer::CloseOutput(output);
+	partial_output.Commit();
+	return output_path;
+}
+
+std::filesystem::path BatchQueue::Decompress(size_t index, const BatchJob& job, const EncodingAlgorithms::CodecSettings& job_settings) {
+	auto settings = job_settings.ResolvedFor(job.input);
+
+	auto input_stream = DirectFileBuffer::OpenInput(job.input, settings);
+	std::istream& input = *input_stream;
+	if (!input) {
+		throw FileOpenException(job.input.string());
+	}
+
+	FileHeader header = CompressionEngine::ReadHeader(input, job.codec);
+	auto output_path = job.output.empty()
+		? job.input.parent_path() / (job.input.stem().string() + header.original_extension_)
+		: job.output;
+	ClaimOutput(output_path, job);
+
+	// Files compressed from a pipe don't record their size, they only report completion.
+	std::uint64_t total = header.has_original_size() ? header.original_size_ : 0;
+	Update(index, [&output_path, total](BatchJobStatus& status) {
+		status.output = output_path;
+		status.progress.total = total;
+	});
+
+	// Block-format files decode their blocks on this queue's pool. The engine arms the guard once it
+	// has created the output, an existing file is kept if the job fails before that.
+	PartialOutputGuard partial_output;
+	ProgressReporter reporter(total, [this, index](const ProgressReport& report) {
+		Update(index, [&report](BatchJobStatus& status) { status.progress = report; });
+	});
+	CompressionEngine::DecompressToFile(input, header, output_path, settings,
+		[&reporter, &header, &input](std::int64_t processed) {
+			// Legacy files report compressed bytes, which aren't comparable to the original size.
+			if (header.is_block_format()) {
+				auto bytes_out = static_cast<std::uint64_t>(processed);
+				reporter.Update(bytes_out, [&]() { return std::make_pair(ProgressReporter::Position(input), bytes_out); });
+			}
+		}, &partial_output);
+
+	std::error_code error;
+	auto decompressed = std::filesystem::file_size(output_path, error);
+	auto compressed = std::filesystem::file_size(job.input, error);
+	reporter.Finish(decompressed, compressed, decompressed);
+	partial_output.Commit();
+	return output_path;
+}
+
+void BatchQueue::ClaimOutput(const std::filesystem::path& output, const BatchJob& job) {
+	if (!job.overwrite && std::filesystem::exists(output)) {
+		throw CompressionException("Output file already exists: " + output.string());
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (!outputs_.insert(output.lexically_normal()).second) {
+		throw CompressionException("Another file of the batch is written to " + output.string());
+	}
+}
+
+void BatchQueue::Update(size_t index, const std::function<void(BatchJobStatus&)>& change) {
+	BatchJobStatus status;
+	BatchProgress progress;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		Entry& entry = entries_[index];
+		change(entry.status);
+
+		// Keep the batch totals in step with the job's share of its input.
+		std::uint64_t counted = entry.status.finished()
+			? entry.input_size
+			: entry.input_size * static_cast<std::uint64_t>(entry.status.percentage()) / 100;
+		progress_.progress.processed += counted - entry.counted_bytes;
+		entry.counted_bytes = counted;
+
+		progress_.progress.bytes_in += entry.status.progress.bytes_in - entry.counted_in;
+		progress_.progress.bytes_out += entry.status.progress.bytes_out - entry.counted_out;
+		entry.counted_in = entry.status.progress.bytes_in;
+		entry.counted_out = entry.status.progress.bytes_out;
+		progress_.progress.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+		progress_.peak_memory = memory_->peak();
+
+		if (entry.status.state == BatchJobState::Completed) {
+			++progress_.completed;
+		}
+		else if (entry.status.state == BatchJobState::Failed) {
+			++progress_.failed;
+		}
+		else if (entry.status.state == BatchJobState::Cancelled) {
+			++progress_.cancelled;
+		}
+
+		status = entry.status;
+		progress = progress_;
+	}
+
+	if (callback_) {
+		callback_(index, status, progress);
+	}
+	if (progress.finished()) {
+		finished_condition_.notify_all();
+	}
+}
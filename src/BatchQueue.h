@@ -0,0 +1,291 @@
+// BatchQueue.h
+//
+// BatchQueue runs many compress and decompress jobs at once, such as a list of
+// dropped files or every file of a folder. Jobs start as soon as they are added
+// and run on a work-stealing ThreadPool sized to the hardware. Jobs that decode
+// blocks in parallel submit those blocks to the same pool, so a few large files
+// and thousands of small ones share the cores without oversubscribing them.
+//
+// Every job reports its own progress, and the queue keeps running totals across
+// all jobs weighted by input size, so both can be shown without polling every job.
+// Job progress goes through a ProgressReporter, so the callback sees a few dozen
+// updates per job rather than one per I/O buffer.
+// A failing job is recorded with its error and doesn't stop the others.
+//
+// Every job has its own JobControl, a child of the queue's. Cancelling one job
+// only stops that job, which makes it cheap to start speculative jobs and drop
+// the ones that turn out not to be needed. Pausing or cancelling the queue
+// affects every job. Cancelled and failed jobs remove their partial output.
+//
+// Memory is budgeted the same way: every job reserves its blocks and buffers from
+// a budget of its own (BatchJob::memory_limit), a child of the queue's, which is a
+// child of CodecSettings::memory or else of MemoryBudget::Process(). The pool only
+// starts as many threads as the budget can keep busy, jobs wait for memory before
+// they start, and the peaks of the jobs and the queue are reported with their status.
+//
+// It has no Qt dependency; CompressionWorker forwards its callbacks as signals.
+
+
+#pragma once
+
+#include "CodecSettings.h"
+#include "EncodingAlgorithms.h"
+#include "JobControl.h"
+#include "ProgressReporter.h"
+#include "ThreadPool.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+
+/**
+* @enum BatchOperation
+* @brief What a batch job does with its input file.
+*/
+enum class BatchOperation : std::uint8_t {
+	Compress,
+	Decompress
+};
+
+
+/**
+* @struct BatchJob
+* @brief A file to compress or decompress.
+*/
+struct BatchJob {
+	BatchOperation operation = BatchOperation::Compress;
+	std::filesystem::path input;										///< The file to read.
+	std::filesystem::path output;										///< The file to write. Empty to name it after the input, like the GUI does.
+	std::optional<EncodingAlgorithms::CodecId> codec;					///< Compress: nullopt picks one per file. Decompress: if set, the file must use it.
+	bool overwrite = true;												///< false fails the job instead of replacing an existing output.
+	std::optional<int> level = std::nullopt;							///< Compress: overrides the queue's compression level for this file.
+	std::optional<size_t> memory_limit = std::nullopt;					///< Most memory the job may hold, within the queue's budget. nullopt only limits it by the queue's.
+};
+
+
+/**
+* @enum BatchJobState
+* @brief Lifecycle of a batch job.
+*/
+enum class BatchJobState : std::uint8_t {
+	Queued,
+	Running,
+	Completed,
+	Failed,
+	Cancelled
+};
+
+
+/**
+* @struct BatchJobStatus
+* @brief Snapshot of one job, passed to the status callback.
+*/
+struct BatchJobStatus {
+	BatchJobState state = BatchJobState::Queued;
+	std::filesystem::path input;					///< The job's input file.
+	std::filesystem::path output;					///< The resolved output file, known once the job runs.
+	ProgressReport progress;						///< Input bytes for compression, decompressed bytes for decompression.
+	std::string error;								///< Why the job failed or that it was cancelled.
+	size_t peak_memory = 0;							///< Most memory the job held at once, known once it has finished.
+
+	/**
+	* @brief Progress of the job as a percentage, 0 while the total is unknown.
+	*/
+	int percentage() const;
+
+	/**
+	* @brief Checks whether the job has completed, failed or been cancelled.
+	*/
+	bool finished() const { return state != BatchJobState::Queued && state != BatchJobState::Running; }
+};
+
+
+/**
+* @struct BatchProgress
+* @brief Totals across all jobs of a queue.
+*/
+struct BatchProgress {
+	size_t jobs = 0;								///< Jobs added.
+	size_t completed = 0;							///< Jobs that finished successfully.
+	size_t failed = 0;								///< Jobs that failed.
+	size_t cancelled = 0;							///< Jobs that were cancelled.
+	ProgressReport progress;						///< Input bytes accounted for by the jobs' progress out of their combined size,
+													///< the bytes all jobs read and wrote, and the time since the first job was added.
+	size_t peak_memory = 0;							///< Most memory the jobs held at once, see MemoryBudget.
+
+	/**
+	* @brief Progress of the batch as a percentage of the input bytes.
+	*/
+	int percentage() const;
+
+	/**
+	* @brief Checks whether every job has finished.
+	*/
+	bool finished() const { return completed + failed + cancelled == jobs; }
+};
+
+
+/**
+* @class BatchQueue
+* @brief Runs compress and decompress jobs concurrently on a shared work-stealing pool.
+*/
+class BatchQueue {
+public:
+
+	/**
+	* @brief Receives a job's status and the batch totals whenever a job changes. Called from pool threads.
+	*/
+	using StatusCallback = std::function<void(size_t job, const BatchJobStatus& status, const BatchProgress& progress)>;
+
+	/**
+	* @brief Starts the pool.
+	*
+	* @param settings: Codec options applied to every job, resolved per file. Its control, if any,
+	*	becomes the parent of the queue's, so cancelling it cancels the whole queue. Its memory
+	*	budget, if any, becomes the parent of the queue's.
+	* @param callback: Optional callback receiving status updates. It must not add jobs or wait for the queue.
+	* @param threads: Number of pool threads. 0 uses every core. Fewer are started if the memory budget
+	*	can't keep them busy.
+	*/
+	explicit BatchQueue(const EncodingAlgorithms::CodecSettings& settings, StatusCallback callback = nullptr, size_t threads = 0);
+
+	/**
+	* @brief Resumes the queue if it is paused and waits for the queued jobs to finish.
+	*/
+	~BatchQueue();
+
+	BatchQueue(const BatchQueue&) = delete;
+	BatchQueue& operator=(const BatchQueue&) = delete;
+
+	/**
+	* @brief Queues a job. It starts as soon as a pool thread is free.
+	*
+	* @param job: The job to run.
+	* @return: The job's index, which status updates refer to it by.
+	*/
+	size_t Add(BatchJob job);
+
+	/**
+	* @brief Blocks until every job added so far has finished. Must not be called from a job.
+	*/
+	void Wait();
+
+	/**
+	* @brief Returns a snapshot of a job.
+	*
+	* @param job: The index returned by Add.
+	*/
+	BatchJobStatus Status(size_t job) const;
+
+	/**
+	* @brief Returns the totals across all jobs.
+	*/
+	BatchProgress Progress() const;
+
+	/**
+	* @brief Cancels one job. A queued job is cancelled before it opens any file.
+	*
+	* @param job: The index returned by Add.
+	*/
+	void Cancel(size_t job);
+
+	/**
+	* @brief Cancels every job, including jobs added afterwards.
+	*/
+	void Cancel();
+
+	/**
+	* @brief Pauses every job at its next block. Jobs added meanwhile wait before they start.
+	*/
+	void Pause();
+
+	/**
+	* @brief Lets paused jobs continue.
+	*/
+	void Resume();
+
+	/**
+	* @brief Expands folders into the regular files below them.
+	*
+	* @param paths: Files and folders, such as a list of dropped items.
+	* @return: The files, in the given order with each folder's files sorted by path.
+	*/
+	static std::vector<std::filesystem::path> ExpandPaths(const std::vector<std::filesystem::path>& paths);
+
+private:
+
+	/**
+	* @struct Entry
+	* @brief A job and its bookkeeping.
+	*/
+	struct Entry {
+		BatchJob job;
+		BatchJobStatus status;
+		std::shared_ptr<JobControl> control;		///< Child of the queue's control.
+		std::uint64_t input_size = 0;				///< Weight of the job in the batch totals.
+		std::uint64_t counted_bytes = 0;			///< Share of input_size currently included in the batch's processed bytes.
+		std::uint64_t counted_in = 0;				///< Bytes read currently included in the batch's totals.
+		std::uint64_t counted_out = 0;				///< Bytes written currently included in the batch's totals.
+	};
+
+	/**
+	* @brief Number of pool threads the memory budget can keep busy.
+	*
+	* @param settings: Codec options of the jobs.
+	* @param memory_limit: Limit of the queue's budget.
+	* @param threads: Requested number of threads, 0 for every core.
+	* @return: Up to the requested number of threads, but no more than jobs with the smallest
+	* blocks the budget leads to can run at once, and at least 1.
+	*/
+	static size_t ThreadCount(const EncodingAlgorithms::CodecSettings& settings, size_t memory_limit, size_t threads);
+
+	/**
+	* @brief Runs a job on a pool thread, recording its outcome instead of throwing.
+	*/
+	void RunJob(size_t index);
+
+	/**
+	* @brief Compresses a job's input and returns the output path it resolved.
+	*/
+	std::filesystem::path Compress(size_t index, const BatchJob& job, const EncodingAlgorithms::CodecSettings& settings);
+
+	/**
+	* @brief Decompresses a job's input and returns the output path it resolved.
+	*/
+	std::filesystem::path Decompress(size_t index, const BatchJob& job, const EncodingAlgorithms::CodecSettings& settings);
+
+	/**
+	* @brief Reserves an output path so that two jobs never write the same file.
+	*
+	* @throws: CompressionException if another job of the queue already writes it, or if it
+	* exists and the job doesn't allow overwriting it.
+	*/
+	void ClaimOutput(const std::filesystem::path& output, const BatchJob& job);
+
+	/**
+	* @brief Applies a change to a job's status, updates the totals and reports it.
+	*/
+	void Update(size_t index, const std::function<void(BatchJobStatus&)>& change);
+
+	EncodingAlgorithms::CodecSettings settings_;
+	StatusCallback callback_;
+	std::shared_ptr<JobControl> control_;			///< Parent of every job's control.
+	std::shared_ptr<MemoryBudget> memory_;			///< Parent of every job's memory budget.
+
+	mutable std::mutex mutex_;
+	std::condition_variable finished_condition_;
+	std::deque<Entry> entries_;						///< A deque, so entries stay in place as jobs are added.
+	std::set<std::filesystem::path> outputs_;		///< Output files claimed by jobs.
+	BatchProgress progress_;
+	std::chrono::steady_clock::time_point start_;	///< When the first job was added.
+
+	ThreadPool pool_;								///< Declared last, so its threads are joined before the members above go away.
+};
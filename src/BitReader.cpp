@@ -2,17 +2,17 @@
 
 #include <fstream>
 
-BitReader::BitReader(std::ifstream* input)
-	: input_(input), buffer_pos_(0), buffer_size_(0), bits_remaining_(0), eof_(false) {
+BitReader::BitReader(std::istream* input, size_t buffer_size)
+	: input_(input), buffer_capacity_(buffer_size), buffer_pos_(0), buffer_size_(0), bits_remaining_(0), eof_(false) {
 
-	buffer_.resize(BUFFER_SIZE);
+	buffer_.resize(buffer_capacity_);
 	FillBuffer();
 }
 
 bool BitReader::FillBuffer() {
 	if (eof_) return false;
 
-	input_->read(reinterpret_cast<char*>(buffer_.data()), BUFFER_SIZE);
+	input_->read(reinterpret_cast<char*>(buffer_.data()), buffer_capacity_);
 	buffer_size_ = input_->gcount();
 	buffer_pos_ = 0;
 
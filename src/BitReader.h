@@ -33,9 +33,10 @@ public:
 	* Initializes the BitReader with an input stream for binary data. This constructor
 	* also fills the internal buffer from the stream to prepare for bit reading.
 	* 
-	* @param input: Pointer to an open std::ifstream object for reading binary data.
+	* @param input: Pointer to an open std::istream object for reading binary data.
+	* @param buffer_size: Size of the internal read buffer in bytes.
 	*/
-	explicit BitReader(std::ifstream* input);
+	explicit BitReader(std::istream* input, size_t buffer_size = DEFAULT_BUFFER_SIZE);
 
 	/**
 	* @brief Reads the next bit from the input stream.
@@ -54,7 +55,7 @@ private:
 	/**
 	* @brief Fills the internal buffer with data from the input stream.
 	*
-	* Attempts to read up to BUFFER_SIZE bytes from the input stream into the
+	* Attempts to read up to buffer_capacity_ bytes from the input stream into the
 	* buffer. Updates buffer_size_ with the number of bytes read. Resets the
 	* buffer position and bit counters. Sets the eof_ flag if no more data is
 	* available from the input stream.
@@ -64,13 +65,15 @@ private:
 	*/
 	bool FillBuffer();
 
-	std::ifstream* input_;
+	std::istream* input_;
 	std::vector<std::uint8_t> buffer_;				  ///< Internal buffer for storing read bytes.
+	size_t buffer_capacity_;						  ///< Number of bytes requested per buffer fill.
 	size_t buffer_pos_;
 	size_t buffer_size_;
 	std::uint8_t current_byte_;
 	int bits_remaining_;							  ///< Number of bits left in current_byte_.
 	bool eof_;										  ///< Flag indicating if end of file has been reached.
 
-	static constexpr size_t BUFFER_SIZE = 16 * 1024;  ///< Size of the internal buffer (16 kB).
+public:
+	static constexpr size_t DEFAULT_BUFFER_SIZE = 16 * 1024;  ///< Default size of the internal buffer (16 kB).
 };
\ No newline at end of file
@@ -1,10 +1,10 @@
 #include "BitWriter.h"
 #include <fstream>
 
-BitWriter::BitWriter(std::ofstream* output)
-	: output_(output), current_byte_(0), bits_filled_(0) {
+BitWriter::BitWriter(std::ostream* output, size_t buffer_size)
+	: output_(output), buffer_capacity_(buffer_size), current_byte_(0), bits_filled_(0) {
 
-	buffer_.reserve(BUFFER_SIZE);
+	buffer_.reserve(buffer_capacity_);
 }
 
 void BitWriter::WriteBit(bool bit) {
@@ -19,7 +19,7 @@ void BitWriter::WriteBit(bool bit) {
 		bits_filled_ = 0;
 
 		// If the buffer is full, write it to the file.
-		if (buffer_.size() >= BUFFER_SIZE) {
+		if (buffer_.size() >= buffer_capacity_) {
 			FlushBuffer();
 		}
 	}
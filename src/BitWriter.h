@@ -33,10 +33,11 @@ public:
 	* The constructor prepares the internal buffer for writing and sets the
 	* internal state to handle bit-level operations.
 	*
-	* @param output: Pointer to an open std::ofstream object for writing binary data.
+	* @param output: Pointer to an open std::ostream object for writing binary data.
 	*               The BitWriter does not take ownership of the stream.
+	* @param buffer_size: Number of bytes buffered before they are written to the stream.
 	*/
-	explicit BitWriter(std::ofstream* output);
+	explicit BitWriter(std::ostream* output, size_t buffer_size = DEFAULT_BUFFER_SIZE);
 
 	/**
 	* @brief Writes a single bit to the output stream.
@@ -79,10 +80,12 @@ private:
 	*/
 	void FlushBuffer();
 
-	std::ofstream* output_;
+	std::ostream* output_;
 	std::vector<std::uint8_t> buffer_;				  ///< Internal buffer for storing bytes before writing.
+	size_t buffer_capacity_;						  ///< Number of bytes buffered before a write.
 	std::uint8_t current_byte_;
 	int bits_filled_;								  ///< Number of bits filled in current_byte_.
 
-	static constexpr size_t BUFFER_SIZE = 16 * 1024;  ///< Size of the internal buffer (16 kB).
+public:
+	static constexpr size_t DEFAULT_BUFFER_SIZE = 16 * 1024;  ///< Default size of the internal buffer (16 kB).
 };
\ No newline at end of file
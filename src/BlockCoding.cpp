@@ -0,0 +1,537 @@
+#include "BlockCoding.h"
+#include "BlockSplitter.h"
+#include "ByteIO.h"
+#include "Checksum.h"
+#include "CodecSelector.h"
+#include "CompressionExceptions.h"
+#include "ContextHuffmanCoding.h"
+#include "StaticHuffmanTable.h"
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <memory>
+
+namespace EncodingAlgorithms {
+
+	std::uint64_t BlockCoding::encode(std::istream& input_file, std::ostream& output_file, CodecId codec,
+		std::optional<ProgressCallback> progress_callback, const CodecSettings& settings, CompressContext* context,
+		ThreadPool* pool) {
+
+		// Only one block and its encoding are ever held in memory, in buffers the context keeps for the next call.
+		auto memory = settings.ReserveMemory(EncodeMemory(codec, settings));
+		CompressContext local;
+		CompressContext& work = context ? *context : local;
+		auto& block = work.block_;
+		auto& encoded = work.coded_;
+		auto& segments = work.segments_;
+		auto& index = work.index_;
+		work.Reserve(block, settings.block_size);
+		work.Reserve(encoded, settings.block_size);
+		if (block.size() < settings.block_size) {
+			block.resize(settings.block_size);
+		}
+		index.Clear();
+
+		std::int64_t total_processed = 0;
+		std::uint64_t compressed_offset = 0;
+		std::uint32_t file_checksum = 0;
+
+		while (true) {
+			// Cancellation and pause are checked once per block, outside the codecs' byte loops.
+			settings.CheckPoint();
+			size_t bytes_read = ReadFully(input_file, block.data(), settings.block_size);
+			if (bytes_read == 0) {
+				break;
+			}
+
+			// Blocks whose content changes get tables per segment, every segment is a frame of its own.
+			if (codec == CodecId::Huffman && settings.split_blocks && !settings.static_table) {
+				BlockSplitter::Split(block.data(), bytes_read, segments, settings.split_window, settings.split_passes);
+			}
+			else if (codec == CodecId::ContextHuffman && settings.split_blocks) {
+				SplitContextBlock(block.data(), bytes_read, settings, work);
+			}
+			else {
+				segments.assign(1, bytes_read);
+			}
+
+			const std::uint8_t* segment = block.data();
+			for (size_t segment_size : segments) {
+				// Checksum the segment while it is still hot in the cache, the file checksum is derived from it.
+				std::uint32_t checksum = 0;
+				if (settings.checksums) {
+					checksum = Checksum::Crc32c(segment, segment_size);
+					file_checksum = Checksum::Crc32cCombine(file_checksum, checksum, segment_size);
+				}
+
+				encoded.clear();
+				BlockType type = EncodeBlock(codec, segment, segment_size, encoded, settings, &work, pool);
+				const std::uint8_t* payload = type == BlockType::Stored ? segment : encoded.data();
+				size_t payload_size = type == BlockType::Stored ? segment_size : encoded.size();
+				WriteFrame(output_file, type, static_cast<std::uint32_t>(segment_size), payload, payload_size, checksum, settings);
+
+				index.Add(compressed_offset, static_cast<std::uint32_t>(payload_size), static_cast<std::uint32_t>(segment_size));
+				compressed_offset += FrameHeaderSize(settings) + payload_size;
+				segment += segment_size;
+			}
+
+			total_processed += bytes_read;
+			if (progress_callback) {
+				(*progress_callback)(total_processed);
+			}
+
+			// A short read means the input is exhausted.
+			if (bytes_read < settings.block_size) {
+				break;
+			}
+		}
+
+		WriteFrame(output_file, BlockType::End, 0, nullptr, 0, file_checksum, settings);
+		index.Write(output_file);
+
+		if (!output_file) {
+			throw CompressionException("Failed to write compressed block");
+		}
+		return static_cast<std::uint64_t>(total_processed);
+	}
+
+	std::uint64_t BlockCoding::decode(std::istream& input_file, std::ostream& output_file, CodecId codec,
+		std::optional<ProgressCallback> progress_callback, const CodecSettings& settings, DecompressContext* context) {
+
+		auto memory = settings.ReserveMemory(DecodeMemory(codec, settings));
+		DecompressContext local;
+		DecompressContext& work = context ? *context : local;
+		auto& encoded = work.block_;
+		auto& decoded = work.coded_;
+		work.Reserve(encoded, settings.block_size);
+		work.Reserve(decoded, settings.block_size);
+
+		std::int64_t total_processed = 0;
+		std::uint32_t file_checksum = 0;
+
+		std::uint32_t raw_size = 0;
+		std::uint32_t encoded_size = 0;
+		std::uint32_t checksum = 0;
+		BlockType type{};
+		while (ReadFrameHeader(input_file, type, raw_size, encoded_size, checksum, settings)) {
+			settings.CheckPoint();
+			encoded.resize(encoded_size);
+			if (ReadFully(input_file, encoded.data(), encoded_size) != encoded_size) {
+				throw CompressionException("Unexpected end of file while reading block");
+			}
+
+			// Stored blocks go straight from the read buffer to the output.
+			const std::vector<std::uint8_t>* block = &encoded;
+			if (type == BlockType::Encoded) {
+				decoded.clear();
+				DecodeBlock(codec, encoded.data(), encoded_size, decoded, raw_size, settings, &work);
+				block = &decoded;
+			}
+			VerifyBlock(block->data(), block->size(), checksum, settings);
+			file_checksum = Checksum::Crc32cCombine(file_checksum, checksum, raw_size);
+			output_file.write(reinterpret_cast<const char*>(block->data()), block->size());
+
+			total_processed += raw_size;
+			if (progress_callback) {
+				(*progress_callback)(total_processed);
+			}
+		}
+
+		// Catches blocks that are individually intact but missing, duplicated or reordered.
+		VerifyFile(checksum, file_checksum, settings);
+
+		if (!output_file) {
+			throw CompressionException("Failed to write decompressed block");
+		}
+		return static_cast<std::uint64_t>(total_processed);
+	}
+
+	std::uint64_t BlockCoding::DecodeParallel(std::istream& input_file, PositionalFile* output_file, CodecId codec,
+		ThreadPool& pool, std::optional<ProgressCallback> progress_callback, const CodecSettings& settings) {
+
+		struct PendingBlock {
+			std::future<void> done;
+			std::uint32_t raw_size;
+			std::optional<MemoryBudget::Reservation> memory;	///< nullopt for the block decoded in the stream's reservation.
+		};
+
+		// Frames are read in order on this thread and decoded on the pool. Limiting the
+		// number of blocks in flight bounds memory to a couple of blocks per worker. One
+		// block is covered by the stream's reservation, every other one reserves its own
+		// memory and is only started while the budget has room for it.
+		auto memory = settings.ReserveMemory(DecodeMemory(codec, settings));
+		bool reserved_block_in_flight = false;
+		const size_t max_in_flight = pool.size() * 2;
+		std::deque<PendingBlock> pending;
+
+		std::int64_t total_processed = 0;
+		std::uint64_t output_offset = 0;
+		std::uint32_t file_checksum = 0;
+
+		auto finish_oldest = [&]() {
+			PendingBlock block = std::move(pending.front());
+			pending.pop_front();
+			pool.Wait(block.done);
+			if (!block.memory) {
+				reserved_block_in_flight = false;
+			}
+			block.done.get();
+
+			total_processed += block.raw_size;
+			if (progress_callback) {
+				(*progress_callback)(total_processed);
+			}
+		};
+
+		try {
+			std::uint32_t raw_size = 0;
+			std::uint32_t encoded_size = 0;
+			std::uint32_t checksum = 0;
+			BlockType type{};
+			while (ReadFrameHeader(input_file, type, raw_size, encoded_size, checksum, settings)) {
+				// A paused job stops reading here, the blocks already submitted still finish.
+				settings.CheckPoint();
+
+				// Memory for the block is found before its payload is read. Waiting for the oldest
+				// block always frees some, since the stream's reservation is then in use by one.
+				std::optional<MemoryBudget::Reservation> block_memory;
+				while (true) {
+					if (pending.size() < max_in_flight) {
+						if (!reserved_block_in_flight) {
+							reserved_block_in_flight = true;
+							break;
+						}
+						block_memory = settings.TryReserveMemory(BlockMemory(codec, raw_size, encoded_size));
+						if (block_memory) {
+							break;
+						}
+					}
+					finish_oldest();
+				}
+
+				// Shared so the task stays copyable for std::function.
+				auto encoded = std::make_shared<std::vector<std::uint8_t>>(encoded_size);
+				if (ReadFully(input_file, encoded->data(), encoded_size) != encoded_size) {
+					throw CompressionException("Unexpected end of file while reading block");
+				}
+
+				// Every block's position in the output is the sum of the raw sizes before it.
+				std::uint64_t block_offset = output_offset;
+				output_offset += raw_size;
+
+				// Each task verifies its own block, so the recorded checksums can be combined here in order.
+				file_checksum = Checksum::Crc32cCombine(file_checksum, checksum, raw_size);
+
+				auto task = [encoded, type, raw_size, checksum, block_offset, codec, output_file, &settings]() {
+					std::vector<std::uint8_t> decoded;
+					const std::vector<std::uint8_t>* block = encoded.get();
+					if (type == BlockType::Encoded) {
+						decoded.reserve(raw_size);
+						DecodeBlock(codec, encoded->data(), encoded->size(), decoded, raw_size, settings);
+						block = &decoded;
+					}
+					VerifyBlock(block->data(), block->size(), checksum, settings);
+					if (output_file) {
+						output_file->WriteAt(block->data(), block->size(), block_offset);
+					}
+				};
+				pending.push_back({ pool.Submit(task), raw_size, std::move(block_memory) });
+			}
+
+			while (!pending.empty()) {
+				finish_oldest();
+			}
+			VerifyFile(checksum, file_checksum, settings);
+		}
+		catch (...) {
+			// The tasks reference output_file and settings, so they must finish before unwinding.
+			for (auto& block : pending) {
+				pool.Wait(block.done);
+			}
+			throw;
+		}
+
+		return output_offset;
+	}
+
+	std::uint64_t BlockCoding::DecodeRange(std::istream& input_file, std::uint64_t body_offset, const BlockIndex& index,
+		CodecId codec, std::uint64_t offset, std::uint64_t length, std::ostream& output_file, const CodecSettings& settings) {
+
+		if (offset >= index.raw_size()) {
+			return 0;
+		}
+		std::uint64_t end = offset + std::min(length, index.raw_size() - offset);
+
+		auto memory = settings.ReserveMemory(DecodeMemory(codec, settings));
+		std::vector<std::uint8_t> encoded;
+		std::vector<std::uint8_t> decoded;
+		std::uint64_t written = 0;
+
+		for (size_t i = index.FindBlock(offset); i < index.size() && index.entries()[i].raw_offset < end; ++i) {
+			settings.CheckPoint();
+			const auto& entry = index.entries()[i];
+			ReadIndexedBlock(input_file, body_offset, entry, codec, encoded, decoded, settings);
+
+			// Only copy the part of the block that overlaps the requested range.
+			std::uint64_t slice_begin = std::max(offset, entry.raw_offset) - entry.raw_offset;
+			std::uint64_t slice_end = std::min(end, entry.raw_offset + entry.raw_size) - entry.raw_offset;
+			output_file.write(reinterpret_cast<const char*>(decoded.data() + slice_begin),
+				static_cast<std::streamsize>(slice_end - slice_begin));
+			written += slice_end - slice_begin;
+		}
+
+		if (!output_file) {
+			throw CompressionException("Failed to write decompressed block");
+		}
+		return written;
+	}
+
+	void BlockCoding::ReadIndexedBlock(std::istream& input_file, std::uint64_t body_offset, const BlockIndexEntry& entry,
+		CodecId codec, std::vector<std::uint8_t>& encoded, std::vector<std::uint8_t>& decoded, const CodecSettings& settings) {
+
+		input_file.clear();
+		input_file.seekg(static_cast<std::streamoff>(body_offset + entry.compressed_offset));
+
+		// The frame header is read as well so that a mismatch with the index is caught.
+		size_t header_size = FrameHeaderSize(settings);
+		encoded.resize(header_size + entry.encoded_size);
+		bool complete = ReadFully(input_file, encoded.data(), encoded.size()) == encoded.size();
+		auto type = static_cast<BlockType>(encoded[0]);
+		if (!complete ||
+			(type != BlockType::Encoded && type != BlockType::Stored) ||
+			ByteIO::LoadLE<std::uint32_t>(encoded.data() + 1) != entry.raw_size ||
+			ByteIO::LoadLE<std::uint32_t>(encoded.data() + 5) != entry.encoded_size) {
+			throw CompressionException("Block does not match the block index");
+		}
+
+		decoded.clear();
+		if (type == BlockType::Stored) {
+			decoded.assign(encoded.begin() + header_size, encoded.end());
+		}
+		else {
+			DecodeBlock(codec, encoded.data() + header_size, entry.encoded_size, decoded, entry.raw_size, settings);
+		}
+		if (settings.checksums) {
+			VerifyBlock(decoded.data(), decoded.size(), ByteIO::LoadLE<std::uint32_t>(encoded.data() + FRAME_HEADER_SIZE), settings);
+		}
+	}
+
+	BlockCoding::BlockType BlockCoding::EncodeBlock(CodecId codec, const std::uint8_t* data, size_t size,
+		std::vector<std::uint8_t>& output, const CodecSettings& settings, CodecContext* context, ThreadPool* pool) {
+
+		if (!IsWorthEncoding(codec, data, size)) {
+			return BlockType::Stored;
+		}
+
+		// Blocks are in memory, so the codecs' in-memory variants are used. They write the same
+		// format as the stream variants without any I/O buffers of their own.
+		size_t initial_size = output.size();
+		switch (codec) {
+		case CodecId::RLE:
+			if (pool) {
+				RLECoding::encode(data, size, output, *pool);
+			}
+			else {
+				RLECoding::encode(data, size, output);
+			}
+			break;
+		case CodecId::Huffman:
+			if (settings.static_table) {
+				HuffmanCoding::encode(data, size, output, *settings.static_table);
+			}
+			else {
+				HuffmanCoding::encode(data, size, output);
+			}
+			break;
+		case CodecId::ContextHuffman:
+			ContextHuffmanCoding::encode(data, size, output, context ? &context->scratch_ : nullptr, settings.cluster_iterations);
+			break;
+		default:
+			throw CompressionException("Unknown algorithm type");
+		}
+
+		// The statistics only rule out hopeless blocks, the trial decides the rest.
+		if (output.size() - initial_size >= size) {
+			output.resize(initial_size);
+			return BlockType::Stored;
+		}
+		return BlockType::Encoded;
+	}
+
+	void BlockCoding::SplitContextBlock(const std::uint8_t* data, size_t size, const CodecSettings& settings,
+		CompressContext& context) {
+
+		if (settings.context_split_depth <= 0) {
+			BlockSplitter::Split(data, size, context.segments_, settings.context_split_window);
+			return;
+		}
+
+		auto& candidates = context.candidates_;
+		auto& encoded = context.coded_;
+		BlockSplitter::Split(data, size, candidates, settings.context_split_window);
+		context.segments_.clear();
+		for (size_t candidate_size : candidates) {
+			encoded.clear();
+			ContextHuffmanCoding::encode(data, candidate_size, encoded, &context.scratch_, settings.cluster_iterations);
+			SearchContextSegment(data, candidate_size, encoded.size() + FrameHeaderSize(settings), settings.context_split_depth,
+				settings, context);
+			data += candidate_size;
+		}
+	}
+
+	size_t BlockCoding::SearchContextSegment(const std::uint8_t* data, size_t size, size_t frame_size, int depth,
+		const CodecSettings& settings, CompressContext& context) {
+
+		auto& segments = context.segments_;
+		auto& encoded = context.coded_;
+		if (depth <= 0 || size < 2 * MIN_BLOCK_SIZE) {
+			segments.push_back(size);
+			return frame_size;
+		}
+
+		// The trial encodings are discarded, the chosen segments are encoded again when they are written.
+		size_t half = size / 2;
+		encoded.clear();
+		ContextHuffmanCoding::encode(data, half, encoded, &context.scratch_, settings.cluster_iterations);
+		size_t left_size = encoded.size() + FrameHeaderSize(settings);
+		encoded.clear();
+		ContextHuffmanCoding::encode(data + half, size - half, encoded, &context.scratch_, settings.cluster_iterations);
+		size_t right_size = encoded.size() + FrameHeaderSize(settings);
+
+		size_t first = segments.size();
+		size_t halves_size = SearchContextSegment(data, half, left_size, depth - 1, settings, context)
+			+ SearchContextSegment(data + half, size - half, right_size, depth - 1, settings, context);
+		if (halves_size < frame_size) {
+			return halves_size;
+		}
+		segments.resize(first);
+		segments.push_back(size);
+		return frame_size;
+	}
+
+	bool BlockCoding::IsWorthEncoding(CodecId codec, const std::uint8_t* data, size_t size) {
+		switch (codec) {
+		case CodecId::RLE:
+			// Every run costs two bytes.
+			return CodecSelector::CountRuns(data, size) * 2 < size;
+		case CodecId::Huffman:
+		case CodecId::ContextHuffman:
+			return CodecSelector::Entropy(data, size) < INCOMPRESSIBLE_ENTROPY;
+		default:
+			return true;
+		}
+	}
+
+	void BlockCoding::DecodeBlock(CodecId codec, const std::uint8_t* data, size_t size,
+		std::vector<std::uint8_t>& output, size_t expected_size, const CodecSettings& settings, CodecContext* context) {
+
+		size_t initial_size = output.size();
+		switch (codec) {
+		case CodecId::RLE:
+			RLECoding::decode(data, size, output, expected_size);
+			break;
+		case CodecId::Huffman:
+			// Static-table blocks carry no bit count, the frame's raw size says when to stop.
+			if (settings.static_table) {
+				HuffmanCoding::decode(data, size, output, *settings.static_table, expected_size);
+			}
+			else {
+				HuffmanCoding::decode(data, size, output, expected_size);
+			}
+			break;
+		case CodecId::ContextHuffman:
+			ContextHuffmanCoding::decode(data, size, output, expected_size, context ? &context->scratch_ : nullptr);
+			break;
+		default:
+			throw CompressionException("Unknown algorithm type");
+		}
+
+		if (output.size() - initial_size != expected_size) {
+			throw CompressionException("Decoded block size does not match the block header");
+		}
+	}
+
+	size_t BlockCoding::MaxEncodedSize(size_t raw_size) {
+		// RLE at worst doubles the data (plus an escape pair per run), Huffman never exceeds
+		// 8 bits per symbol plus its table, which is far below the slack added here.
+		return raw_size * 2 + raw_size / 128 + 64 * 1024;
+	}
+
+	size_t BlockCoding::EncodeMemory(CodecId codec, const CodecSettings& settings) {
+		// RLE may double a block before the encoding is found not to pay off and the block is stored.
+		size_t encoded = codec == CodecId::RLE ? 2 * settings.block_size : settings.block_size;
+		size_t tables = codec == CodecId::ContextHuffman ? ContextHuffmanCoding::SCRATCH_SIZE : 0;
+		return 2 * settings.buffer_size + settings.block_size + encoded + tables;
+	}
+
+	size_t BlockCoding::DecodeMemory(CodecId codec, const CodecSettings& settings) {
+		// Encoded payloads are smaller than their block, otherwise the block is stored.
+		return 2 * settings.buffer_size + BlockMemory(codec, settings.block_size, settings.block_size);
+	}
+
+	size_t BlockCoding::BlockMemory(CodecId codec, size_t raw_size, size_t encoded_size) {
+		return raw_size + encoded_size + (codec == CodecId::ContextHuffman ? ContextHuffmanCoding::SCRATCH_SIZE : 0);
+	}
+
+	bool BlockCoding::ReadFrameHeader(std::istream& input_file, BlockType& type, std::uint32_t& raw_size,
+		std::uint32_t& encoded_size, std::uint32_t& checksum, const CodecSettings& settings) {
+
+		std::uint8_t frame[FRAME_HEADER_SIZE + CHECKSUM_SIZE];
+		size_t header_size = FrameHeaderSize(settings);
+		if (ReadFully(input_file, frame, header_size) != header_size) {
+			throw CompressionException("Unexpected end of file while reading block header");
+		}
+
+		type = static_cast<BlockType>(frame[0]);
+		raw_size = ByteIO::LoadLE<std::uint32_t>(frame + 1);
+		encoded_size = ByteIO::LoadLE<std::uint32_t>(frame + 5);
+		checksum = settings.checksums ? ByteIO::LoadLE<std::uint32_t>(frame + FRAME_HEADER_SIZE) : 0;
+
+		if (type == BlockType::End) {
+			return false;
+		}
+
+		// Validate sizes before allocating anything, so a corrupt frame can't exhaust memory.
+		bool valid_size = type == BlockType::Stored ? encoded_size == raw_size : encoded_size <= MaxEncodedSize(raw_size);
+		if ((type != BlockType::Encoded && type != BlockType::Stored) || raw_size == 0 || raw_size > settings.block_size ||
+			!valid_size) {
+			throw CompressionException("Corrupt block header");
+		}
+		return true;
+	}
+
+	void BlockCoding::VerifyBlock(const std::uint8_t* decoded, size_t size, std::uint32_t checksum, const CodecSettings& settings) {
+		if (settings.checksums && Checksum::Crc32c(decoded, size) != checksum) {
+			throw CompressionException("Block checksum mismatch, the file is corrupted");
+		}
+	}
+
+	void BlockCoding::VerifyFile(std::uint32_t expected, std::uint32_t actual, const CodecSettings& settings) {
+		if (settings.checksums && expected != actual) {
+			throw CompressionException("File checksum mismatch, the file is corrupted");
+		}
+	}
+
+	size_t BlockCoding::ReadFully(std::istream& input_file, std::uint8_t* data, size_t size) {
+		size_t total = 0;
+		while (total < size && input_file) {
+			input_file.read(reinterpret_cast<char*>(data + total), static_cast<std::streamsize>(size - total));
+			total += static_cast<size_t>(input_file.gcount());
+		}
+		return total;
+	}
+
+	void BlockCoding::WriteFrame(std::ostream& output_file, BlockType type, std::uint32_t raw_size,
+		const std::uint8_t* payload, size_t payload_size, std::uint32_t checksum, const CodecSettings& settings) {
+
+		std::uint8_t frame[FRAME_HEADER_SIZE + CHECKSUM_SIZE];
+		frame[0] = static_cast<std::uint8_t>(type);
+		ByteIO::StoreLE(frame + 1, raw_size);
+		ByteIO::StoreLE(frame + 5, static_cast<std::uint32_t>(payload_size));
+		ByteIO::StoreLE(frame + FRAME_HEADER_SIZE, checksum);
+
+		output_file.write(reinterpret_cast<const char*>(frame), FrameHeaderSize(settings));
+		output_file.write(reinterpret_cast<const char*>(payload), static_cast<std::streamsize>(payload_size));
+	}
+
+}
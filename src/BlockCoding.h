@@ -0,0 +1,330 @@
+// BlockCoding.h
+//
+// BlockCoding implements the body of the version 2 container: the input is split
+// into blocks of CodecSettings::block_size bytes, and each block is encoded on its
+// own with one of the codecs in EncodingAlgorithms and written as a frame.
+// Huffman and context Huffman blocks may be written as several frames, split by
+// BlockSplitter where the content changes, so frames can be smaller than the
+// block size.
+//
+// Every frame records its type, uncompressed size and encoded size, and the body
+// ends with an end-of-stream frame followed by the BlockIndex. Neither the encoder
+// nor the sequential decoder ever seeks, and both only hold one block in memory
+// (plus 16 bytes of index per block while encoding), so the format can be produced
+// and consumed through pipes regardless of the stream length. Seekable inputs can
+// additionally use the index to decode any byte range by touching only the blocks
+// that overlap it. Since blocks are independent and every frame records its raw
+// size, the output offset of each block is known before it is decoded, which lets
+// DecodeParallel decode blocks on a thread pool and write them out of order.
+//
+// Frame layout (little-endian):
+//   u8  block type   (BlockType)
+//   u32 raw size     (bytes after decoding)
+//   u32 encoded size (bytes of payload that follow)
+//   u32 checksum     (only with FileHeader::FLAG_CHECKSUMS)
+//   payload
+//
+// Blocks that don't get smaller when encoded, such as already compressed media,
+// are written as stored frames holding the raw data, so no block ever expands and
+// decoding them is a plain copy. Blocks that are obviously incompressible (near
+// 8 bits of entropy for Huffman, almost no runs for RLE) skip the trial encode.
+//
+// With checksums, a data frame stores the CRC32C of its uncompressed data and
+// the end-of-stream frame stores the CRC32C of the whole uncompressed file. The
+// file checksum is combined from the block checksums, so the data is hashed once.
+//
+// Blocks are coded with the in-memory variants of the codecs. encode and decode
+// take an optional CompressContext or DecompressContext holding their buffers, so
+// callers coding many files in a row allocate them once.
+//
+// With a memory budget (CodecSettings::memory), every stream first reserves the
+// memory of one block, waiting for other jobs if the budget is exhausted.
+// DecodeParallel only keeps more blocks in flight while the budget has room for
+// them, so a tight budget degrades it to decoding one block at a time.
+
+
+#pragma once
+
+#include "BlockIndex.h"
+#include "CodecContext.h"
+#include "EncodingAlgorithms.h"
+#include "PositionalFile.h"
+#include "ThreadPool.h"
+#include <cstdint>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <vector>
+
+namespace EncodingAlgorithms {
+
+	/**
+	* @class BlockCoding
+	* @brief Encodes and decodes streams as a sequence of independently coded blocks.
+	*/
+	class BlockCoding {
+	public:
+
+		/**
+		* @enum BlockType
+		* @brief The kind of frame in a block-format body.
+		*/
+		enum class BlockType : std::uint8_t {
+			End = 0,			///< End of the stream, no payload.
+			Encoded = 1,		///< Payload encoded with the file's codec.
+			Stored = 2			///< Payload is the raw data, because encoding would not have made it smaller.
+		};
+
+		static constexpr size_t FRAME_HEADER_SIZE = 9;		///< Bytes of the type and size fields of a frame.
+		static constexpr size_t CHECKSUM_SIZE = 4;			///< Bytes of the optional checksum field of a frame.
+
+		/**
+		* @brief Size of every frame header of a file.
+		*
+		* @param settings: Runtime options. settings.checksums must match the file header.
+		* @return: FRAME_HEADER_SIZE, plus CHECKSUM_SIZE if the frames carry checksums.
+		*/
+		static size_t FrameHeaderSize(const CodecSettings& settings) {
+			return FRAME_HEADER_SIZE + (settings.checksums ? CHECKSUM_SIZE : 0);
+		}
+
+		/**
+		* @brief Compresses a stream as a sequence of framed blocks.
+		*
+		* Reads the input sequentially in blocks of settings.block_size bytes and
+		* never seeks, so it can be used with pipes. The block index is written
+		* after the end-of-stream frame. With settings.split_blocks, Huffman blocks
+		* and context Huffman blocks are written as one frame per segment
+		* BlockSplitter finds.
+		*
+		* @param input_file: The stream containing data to compress.
+		* @param output_file: The stream to write the framed blocks to.
+		* @param codec: The codec used for every block.
+		* @param progress_callback: Optional callback receiving the number of input bytes consumed.
+		* @param settings: Runtime options, including the block size.
+		* @param context: Buffers to reuse from earlier calls, or nullptr to allocate them for this call.
+		* @param pool: Optional threads to encode each RLE block on, see RLECoding. Blocks are still written in order.
+		* @return: The number of input bytes compressed.
+		*/
+		static std::uint64_t encode(std::istream& input_file, std::ostream& output_file, CodecId codec,
+			std::optional<ProgressCallback> progress_callback = std::nullopt, const CodecSettings& settings = {},
+			CompressContext* context = nullptr, ThreadPool* pool = nullptr);
+
+		/**
+		* @brief Decompresses a sequence of framed blocks.
+		*
+		* Stops at the end-of-stream frame without reading the index, so it never seeks.
+		*
+		* @param input_file: The stream positioned at the first frame.
+		* @param output_file: The stream to write the decompressed data to.
+		* @param codec: The codec the blocks were encoded with.
+		* @param progress_callback: Optional callback receiving the number of decompressed bytes written.
+		* @param settings: Runtime options. settings.block_size and settings.checksums must match the file header.
+		* @param context: Buffers to reuse from earlier calls, or nullptr to allocate them for this call.
+		* @return: The total decompressed size.
+		* @throws: CompressionException if a frame is truncated or corrupted, or a checksum does not match.
+		*/
+		static std::uint64_t decode(std::istream& input_file, std::ostream& output_file, CodecId codec,
+			std::optional<ProgressCallback> progress_callback = std::nullopt, const CodecSettings& settings = {},
+			DecompressContext* context = nullptr);
+
+		/**
+		* @brief Decompresses a sequence of framed blocks on a thread pool.
+		*
+		* Frames are read sequentially, so the input may be a pipe, while the blocks are
+		* decoded concurrently and written to their offsets in the output file. At most
+		* two blocks per pool thread are held in memory.
+		*
+		* @param input_file: The stream positioned at the first frame.
+		* @param output_file: The file receiving the decompressed data from offset 0, or nullptr to only decode and verify.
+		* @param codec: The codec the blocks were encoded with.
+		* @param pool: The threads decoding the blocks.
+		* @param progress_callback: Optional callback receiving the number of decompressed bytes written, in order.
+		* @param settings: Runtime options. settings.block_size and settings.checksums must match the file header.
+		* @return: The total decompressed size.
+		* @throws: CompressionException if a frame is truncated, corrupted or fails its checksum, or the output can't be written.
+		*/
+		static std::uint64_t DecodeParallel(std::istream& input_file, PositionalFile* output_file, CodecId codec,
+			ThreadPool& pool, std::optional<ProgressCallback> progress_callback = std::nullopt, const CodecSettings& settings = {});
+
+		/**
+		* @brief Decompresses a byte range using the block index.
+		*
+		* Only the blocks overlapping the range are read and decoded.
+		*
+		* @param input_file: A seekable stream containing the compressed file.
+		* @param body_offset: Absolute offset of the first frame (the size of the file header).
+		* @param index: The file's block index.
+		* @param codec: The codec the blocks were encoded with.
+		* @param offset: Start of the range in the decompressed data.
+		* @param length: Number of bytes to decompress. Clamped to the end of the data.
+		* @param output_file: The stream receiving the decompressed range.
+		* @param settings: Runtime options passed to the codec. settings.checksums must match the file header.
+		* @return: The number of bytes written.
+		* @throws: CompressionException if a block is corrupted or doesn't match the index.
+		*/
+		static std::uint64_t DecodeRange(std::istream& input_file, std::uint64_t body_offset, const BlockIndex& index,
+			CodecId codec, std::uint64_t offset, std::uint64_t length, std::ostream& output_file, const CodecSettings& settings);
+
+		/**
+		* @brief Encodes a single block held in memory, unless storing it is smaller.
+		*
+		* @param codec: The codec to use.
+		* @param data: The uncompressed block.
+		* @param size: Number of bytes in the block.
+		* @param output: Vector the encoded block is appended to. Left unchanged for stored blocks.
+		* @param settings: Runtime options passed to the codec.
+		* @param context: Working memory of the codecs to reuse, or nullptr.
+		* @param pool: Optional threads to encode an RLE block on.
+		* @return: BlockType::Encoded, or BlockType::Stored if the block should be written as it is.
+		*/
+		static BlockType EncodeBlock(CodecId codec, const std::uint8_t* data, size_t size,
+			std::vector<std::uint8_t>& output, const CodecSettings& settings, CodecContext* context = nullptr,
+			ThreadPool* pool = nullptr);
+
+		/**
+		* @brief Decodes a single block held in memory.
+		*
+		* @param codec: The codec the block was encoded with.
+		* @param data: The encoded block.
+		* @param size: Number of encoded bytes.
+		* @param output: Vector the decoded block is appended to.
+		* @param expected_size: The uncompressed size recorded for the block.
+		* @param settings: Runtime options passed to the codec.
+		* @param context: Working memory of the codecs to reuse, or nullptr.
+		* @throws: CompressionException if the block does not decode to expected_size bytes.
+		*/
+		static void DecodeBlock(CodecId codec, const std::uint8_t* data, size_t size,
+			std::vector<std::uint8_t>& output, size_t expected_size, const CodecSettings& settings,
+			CodecContext* context = nullptr);
+
+		/**
+		* @brief Upper bound on the encoded size of a block, used to reject corrupt frames.
+		*
+		* @param raw_size: The uncompressed size of the block.
+		* @return: The largest encoded size any codec can produce for it.
+		*/
+		static size_t MaxEncodedSize(size_t raw_size);
+
+		/**
+		* @brief Memory encode reserves for a stream.
+		*
+		* @param codec: The codec used for every block.
+		* @param settings: Runtime options, of which the block and buffer sizes count.
+		* @return: Bytes of the block, its encoding and the codec's tables, plus an input and an output buffer.
+		*/
+		static size_t EncodeMemory(CodecId codec, const CodecSettings& settings);
+
+		/**
+		* @brief Memory decode, DecodeParallel and DecodeRange reserve for a stream.
+		*
+		* @param codec: The codec the blocks were encoded with.
+		* @param settings: Runtime options. settings.block_size must match the file header.
+		* @return: Bytes of one block in flight at its largest, plus an input and an output buffer.
+		*/
+		static size_t DecodeMemory(CodecId codec, const CodecSettings& settings);
+
+	private:
+
+		/**
+		* @brief Reads until the buffer is full or the stream ends.
+		*
+		* Pipes may deliver fewer bytes per read than requested, so a single read is not enough.
+		*
+		* @return: The number of bytes read.
+		*/
+		static size_t ReadFully(std::istream& input_file, std::uint8_t* data, size_t size);
+
+		/**
+		* @brief Reads and validates the type and size fields of the next frame.
+		*
+		* @param type: Receives the type of the frame.
+		* @param raw_size: Receives the uncompressed size of the block.
+		* @param encoded_size: Receives the size of the payload that follows.
+		* @param checksum: Receives the checksum field, or 0 if the frames have none.
+		* @param settings: Runtime options. Blocks larger than settings.block_size are rejected.
+		* @return: false for the end-of-stream frame, true for an encoded or stored block.
+		* @throws: CompressionException if the header is truncated or corrupted.
+		*/
+		static bool ReadFrameHeader(std::istream& input_file, BlockType& type, std::uint32_t& raw_size,
+			std::uint32_t& encoded_size, std::uint32_t& checksum, const CodecSettings& settings);
+
+		/**
+		* @brief Splits a context Huffman block into the segments written as frames.
+		*
+		* BlockSplitter finds the segments in windows of settings.context_split_window bytes.
+		* With settings.context_split_depth, each is then halved, up to that many times,
+		* wherever trial encodings show the halves code smaller.
+		*
+		* @param data: The block.
+		* @param size: Number of bytes in the block.
+		* @param settings: Runtime options of the codec.
+		* @param context: Working memory, receives the sizes of the segments.
+		*/
+		static void SplitContextBlock(const std::uint8_t* data, size_t size, const CodecSettings& settings,
+			CompressContext& context);
+
+		/**
+		* @brief Appends the cheapest way to cut one segment into halves, quarters, ... to the context's segments.
+		*
+		* @param frame_size: Size of the segment's frame if it is not cut.
+		* @param depth: How many more times the segment may be halved.
+		* @return: Size of the frames of the appended segments.
+		*/
+		static size_t SearchContextSegment(const std::uint8_t* data, size_t size, size_t frame_size, int depth,
+			const CodecSettings& settings, CompressContext& context);
+
+		/**
+		* @brief Cheaply checks whether a block is worth a trial encode.
+		*
+		* @return: false if the block's statistics show the codec cannot make it smaller.
+		*/
+		static bool IsWorthEncoding(CodecId codec, const std::uint8_t* data, size_t size);
+
+		/**
+		* @brief Checks a decoded block against the checksum recorded in its frame.
+		*
+		* @throws: CompressionException if checksums are enabled and the block does not match.
+		*/
+		static void VerifyBlock(const std::uint8_t* decoded, size_t size, std::uint32_t checksum, const CodecSettings& settings);
+
+		/**
+		* @brief Checks the whole-file checksum from the end-of-stream frame.
+		*
+		* @param expected: The checksum recorded in the end-of-stream frame.
+		* @param actual: The checksum combined from the decoded blocks.
+		* @throws: CompressionException if checksums are enabled and they differ.
+		*/
+		static void VerifyFile(std::uint32_t expected, std::uint32_t actual, const CodecSettings& settings);
+
+		/**
+		* @brief Reads the frame of an indexed block and decodes (or, if stored, copies) it.
+		*
+		* @param input_file: A seekable stream containing the compressed file.
+		* @param body_offset: Absolute offset of the first frame.
+		* @param entry: The index entry of the block.
+		* @param codec: The codec the block was encoded with.
+		* @param encoded: Scratch buffer for the encoded payload.
+		* @param decoded: Receives the decoded block.
+		* @param settings: Runtime options passed to the codec.
+		*/
+		static void ReadIndexedBlock(std::istream& input_file, std::uint64_t body_offset, const BlockIndexEntry& entry,
+			CodecId codec, std::vector<std::uint8_t>& encoded, std::vector<std::uint8_t>& decoded, const CodecSettings& settings);
+
+		/**
+		* @brief Writes a frame header followed by its payload.
+		*
+		* The checksum is only written if settings.checksums is set.
+		*/
+		static void WriteFrame(std::ostream& output_file, BlockType type, std::uint32_t raw_size,
+			const std::uint8_t* payload, size_t payload_size, std::uint32_t checksum, const CodecSettings& settings);
+
+		/**
+		* @brief Memory of one block being decoded: its payload, the decoded bytes and the codec's tables.
+		*/
+		static size_t BlockMemory(CodecId codec, size_t raw_size, size_t encoded_size);
+
+		static constexpr double INCOMPRESSIBLE_ENTROPY = 7.9;	///< Bits per byte above which Huffman is not tried.
+	};
+
+}
@@ -0,0 +1,122 @@
+#include "BlockIndex.h"
+#include "ByteIO.h"
+#include "CompressionExceptions.h"
+#include <algorithm>
+
+namespace EncodingAlgorithms {
+
+	void BlockIndex::Add(std::uint64_t compressed_offset, std::uint32_t encoded_size, std::uint32_t raw_size) {
+		BlockIndexEntry entry;
+		entry.compressed_offset = compressed_offset;
+		entry.encoded_size = encoded_size;
+		entry.raw_size = raw_size;
+		entry.raw_offset = raw_size_;
+
+		entries_.push_back(entry);
+		raw_size_ += raw_size;
+	}
+
+	void BlockIndex::Clear() {
+		entries_.clear();
+		raw_size_ = 0;
+	}
+
+	void BlockIndex::Write(std::ostream& output_file) const {
+		// Entries are staged in a fixed chunk, so writing the index never allocates.
+		constexpr size_t CHUNK_ENTRIES = 256;
+		std::uint8_t buffer[CHUNK_ENTRIES * ENTRY_SIZE];
+
+		for (size_t first = 0; first < entries_.size(); first += CHUNK_ENTRIES) {
+			size_t count = std::min(CHUNK_ENTRIES, entries_.size() - first);
+			std::uint8_t* pos = buffer;
+			for (size_t i = first; i < first + count; ++i) {
+				const auto& entry = entries_[i];
+				ByteIO::StoreLE(pos, entry.compressed_offset);
+				ByteIO::StoreLE(pos + 8, entry.encoded_size);
+				ByteIO::StoreLE(pos + 12, entry.raw_size);
+				pos += ENTRY_SIZE;
+			}
+			output_file.write(reinterpret_cast<const char*>(buffer), static_cast<std::streamsize>(count * ENTRY_SIZE));
+		}
+
+		std::uint8_t footer[FOOTER_SIZE];
+		ByteIO::StoreLE(footer, static_cast<std::uint64_t>(entries_.size()));
+		std::copy(FOOTER_MAGIC.begin(), FOOTER_MAGIC.end(), footer + 8);
+		output_file.write(reinterpret_cast<const char*>(footer), FOOTER_SIZE);
+	}
+
+	BlockIndex BlockIndex::Read(std::istream& input_file, std::uint64_t body_offset, size_t frame_header_size,
+		std::uint32_t max_block_size) {
+
+		input_file.clear();
+		input_file.seekg(0, std::ios::end);
+		std::streamoff file_size = input_file.tellg();
+		if (file_size < 0) {
+			throw CompressionException("Random access requires a seekable input");
+		}
+
+		// The smallest valid body is the end-of-stream frame followed by an empty index.
+		auto size = static_cast<std::uint64_t>(file_size);
+		if (size < body_offset + frame_header_size + FOOTER_SIZE) {
+			throw CompressionException("Block index is missing or truncated");
+		}
+
+		std::uint8_t footer[FOOTER_SIZE];
+		input_file.seekg(static_cast<std::streamoff>(size - FOOTER_SIZE));
+		input_file.read(reinterpret_cast<char*>(footer), FOOTER_SIZE);
+		if (input_file.gcount() != static_cast<std::streamsize>(FOOTER_SIZE) ||
+			!std::equal(FOOTER_MAGIC.begin(), FOOTER_MAGIC.end(), footer + 8)) {
+			throw CompressionException("Block index is missing or truncated");
+		}
+
+		auto count = ByteIO::LoadLE<std::uint64_t>(footer);
+		std::uint64_t available = size - body_offset - frame_header_size - FOOTER_SIZE;
+		if (count > available / ENTRY_SIZE) {
+			throw CompressionException("Corrupt block index");
+		}
+
+		std::vector<std::uint8_t> buffer(static_cast<size_t>(count) * ENTRY_SIZE);
+		std::uint64_t index_offset = size - FOOTER_SIZE - buffer.size();
+		input_file.seekg(static_cast<std::streamoff>(index_offset));
+		input_file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+		if (input_file.gcount() != static_cast<std::streamsize>(buffer.size())) {
+			throw CompressionException("Block index is missing or truncated");
+		}
+
+		// Every frame must directly follow the previous one, and the end-of-stream frame
+		// must sit right before the index, otherwise the entries can't be trusted.
+		BlockIndex index;
+		std::uint64_t expected_offset = 0;
+		for (size_t i = 0; i < count; ++i) {
+			const std::uint8_t* pos = buffer.data() + i * ENTRY_SIZE;
+			auto compressed_offset = ByteIO::LoadLE<std::uint64_t>(pos);
+			auto encoded_size = ByteIO::LoadLE<std::uint32_t>(pos + 8);
+			auto raw_size = ByteIO::LoadLE<std::uint32_t>(pos + 12);
+
+			if (compressed_offset != expected_offset || raw_size == 0 || raw_size > max_block_size) {
+				throw CompressionException("Corrupt block index");
+			}
+			index.Add(compressed_offset, encoded_size, raw_size);
+			expected_offset += frame_header_size + encoded_size;
+		}
+
+		if (body_offset + expected_offset + frame_header_size != index_offset) {
+			throw CompressionException("Corrupt block index");
+		}
+
+		input_file.clear();
+		return index;
+	}
+
+	size_t BlockIndex::FindBlock(std::uint64_t raw_offset) const {
+		// First block starting after the offset, the one before it contains the offset.
+		auto it = std::upper_bound(entries_.begin(), entries_.end(), raw_offset,
+			[](std::uint64_t offset, const BlockIndexEntry& entry) { return offset < entry.raw_offset; });
+
+		if (it == entries_.begin() || raw_offset >= raw_size_) {
+			return entries_.size();
+		}
+		return static_cast<size_t>(std::distance(entries_.begin(), it) - 1);
+	}
+
+}
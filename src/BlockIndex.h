@@ -0,0 +1,108 @@
+// BlockIndex.h
+//
+// BlockIndex records where every block of a version 2 file lives, so that a
+// reader can jump straight to the blocks covering a byte range instead of
+// decoding the file from the start.
+//
+// The index is written after the end-of-stream frame, followed by a fixed-size
+// footer, so a seekable reader can find it from the end of the file while the
+// writer never has to seek back:
+//
+//   entries  (ENTRY_SIZE bytes each, little-endian)
+//     u64 compressed offset  (of the block's frame, relative to the first frame)
+//     u32 encoded size       (payload bytes after the frame header)
+//     u32 raw size           (bytes after decoding)
+//   footer   (FOOTER_SIZE bytes)
+//     u64 entry count
+//     4 byte magic "BIDX"
+
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+namespace EncodingAlgorithms {
+
+	/**
+	* @struct BlockIndexEntry
+	* @brief Location and sizes of a single block.
+	*/
+	struct BlockIndexEntry {
+		std::uint64_t compressed_offset = 0;		///< Offset of the block's frame relative to the first frame.
+		std::uint32_t encoded_size = 0;				///< Size of the encoded payload.
+		std::uint32_t raw_size = 0;					///< Size of the block after decoding.
+		std::uint64_t raw_offset = 0;				///< Offset of the block in the decompressed data (not stored).
+	};
+
+	/**
+	* @class BlockIndex
+	* @brief The trailing block index of a version 2 file.
+	*/
+	class BlockIndex {
+	public:
+
+		/**
+		* @brief Appends the next block to the index.
+		*
+		* @param compressed_offset: Offset of the block's frame relative to the first frame.
+		* @param encoded_size: Size of the encoded payload.
+		* @param raw_size: Size of the block after decoding.
+		*/
+		void Add(std::uint64_t compressed_offset, std::uint32_t encoded_size, std::uint32_t raw_size);
+
+		/**
+		* @brief Removes every entry, keeping the allocated capacity for the next file.
+		*/
+		void Clear();
+
+		/**
+		* @brief Writes the index entries and footer.
+		*
+		* @param output_file: The stream positioned right after the end-of-stream frame.
+		*/
+		void Write(std::ostream& output_file) const;
+
+		/**
+		* @brief Reads the index from the end of a seekable stream.
+		*
+		* @param input_file: A seekable stream containing a complete version 2 file.
+		* @param body_offset: Absolute offset of the first frame (the size of the file header).
+		* @param frame_header_size: Size of each frame header in the file (see BlockCoding::FrameHeaderSize).
+		* @param max_block_size: The file's block size, used to validate the entries.
+		* @return: The index read from the file.
+		* @throws: CompressionException if the stream is not seekable or the index is corrupted.
+		*/
+		static BlockIndex Read(std::istream& input_file, std::uint64_t body_offset, size_t frame_header_size,
+			std::uint32_t max_block_size);
+
+		/**
+		* @brief Finds the block containing a byte of the decompressed data.
+		*
+		* @param raw_offset: Offset in the decompressed data.
+		* @return: The index of the block, or size() if the offset is past the end.
+		*/
+		size_t FindBlock(std::uint64_t raw_offset) const;
+
+		const std::vector<BlockIndexEntry>& entries() const { return entries_; }
+		size_t size() const { return entries_.size(); }
+
+		/**
+		* @brief Total size of the decompressed data.
+		*/
+		std::uint64_t raw_size() const { return raw_size_; }
+
+		static constexpr size_t ENTRY_SIZE = 16;									///< Bytes per stored entry.
+		static constexpr size_t FOOTER_SIZE = 12;									///< Bytes of the footer.
+		static constexpr std::array<char, 4> FOOTER_MAGIC = { 'B', 'I', 'D', 'X' };	///< Marks the end of the index.
+
+	private:
+		std::vector<BlockIndexEntry> entries_;
+		std::uint64_t raw_size_ = 0;
+	};
+
+}
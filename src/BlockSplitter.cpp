@@ -0,0 +1,185 @@
+#include "BlockSplitter.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace EncodingAlgorithms {
+
+	namespace {
+
+		using Histogram = std::array<std::uint32_t, 256>;
+
+		Histogram Count(const std::uint8_t* data, size_t size) {
+			Histogram counts{};
+			for (size_t i = 0; i < size; ++i) {
+				++counts[data[i]];
+			}
+			return counts;
+		}
+
+		void Move(const std::uint8_t* data, size_t size, Histogram& from, Histogram& to) {
+			for (size_t i = 0; i < size; ++i) {
+				--from[data[i]];
+				++to[data[i]];
+			}
+		}
+
+		// Merges every pair of neighbouring segments that is estimated to code smaller as one, and moves
+		// the boundary of the others to the cheapest position up to range bytes either side, in steps.
+		void Refine(const std::uint8_t* data, std::vector<size_t>& segments, size_t range, size_t step) {
+			size_t start = 0;
+			for (size_t i = 0; i + 1 < segments.size(); ) {
+				size_t boundary = start + segments[i];
+				size_t end = boundary + segments[i + 1];
+				Histogram left = Count(data + start, boundary - start);
+				Histogram right = Count(data + boundary, end - boundary);
+
+				Histogram merged = left;
+				for (size_t byte = 0; byte < merged.size(); ++byte) {
+					merged[byte] += right[byte];
+				}
+				double best_bits = BlockSplitter::CodedBits(left) + BlockSplitter::CodedBits(right);
+				if (BlockSplitter::CodedBits(merged) <= best_bits) {
+					segments[i] += segments[i + 1];
+					segments.erase(segments.begin() + static_cast<std::ptrdiff_t>(i) + 1);
+					continue;
+				}
+
+				// Both segments keep at least a step.
+				size_t best = boundary;
+				Histogram shrunk = left, grown = right;
+				for (size_t position = boundary - step; position >= start + step && boundary - position <= range; position -= step) {
+					Move(data + position, step, shrunk, grown);
+					double bits = BlockSplitter::CodedBits(shrunk) + BlockSplitter::CodedBits(grown);
+					if (bits < best_bits) {
+						best_bits = bits;
+						best = position;
+					}
+				}
+				grown = left;
+				shrunk = right;
+				for (size_t position = boundary + step; position + step <= end && position - boundary <= range; position += step) {
+					Move(data + position - step, step, shrunk, grown);
+					double bits = BlockSplitter::CodedBits(grown) + BlockSplitter::CodedBits(shrunk);
+					if (bits < best_bits) {
+						best_bits = bits;
+						best = position;
+					}
+				}
+
+				segments[i] = best - start;
+				segments[i + 1] = end - best;
+				start = best;
+				++i;
+			}
+		}
+
+	}
+
+	std::vector<size_t> BlockSplitter::Split(const std::uint8_t* data, size_t size, size_t window_size, int refine_passes) {
+		std::vector<size_t> segments;
+		Split(data, size, segments, window_size, refine_passes);
+		return segments;
+	}
+
+	void BlockSplitter::Split(const std::uint8_t* data, size_t size, std::vector<size_t>& segments, size_t window_size,
+		int refine_passes) {
+
+		window_size = std::max(window_size, MIN_WINDOW_SIZE);
+		segments.clear();
+		if (size < 2 * window_size) {
+			segments.push_back(size);
+			return;
+		}
+
+		size_t segment_start = 0;
+		Histogram segment = Count(data, window_size);
+		double segment_bits = EstimatedBits(segment, window_size);
+
+		for (size_t position = window_size; position < size; position += window_size) {
+			// A short final window is merged into the one before rather than judged on its own.
+			size_t length = size - position < 2 * window_size ? size - position : window_size;
+			Histogram window = Count(data + position, length);
+			double window_bits = EstimatedBits(window, length);
+
+			Histogram merged = segment;
+			for (size_t byte = 0; byte < merged.size(); ++byte) {
+				merged[byte] += window[byte];
+			}
+			std::uint64_t merged_size = position + length - segment_start;
+			double merged_bits = EstimatedBits(merged, merged_size);
+
+			if (segment_bits + window_bits < merged_bits) {
+				segments.push_back(position - segment_start);
+				segment_start = position;
+				segment = window;
+				segment_bits = window_bits;
+			}
+			else {
+				segment = merged;
+				segment_bits = merged_bits;
+			}
+
+			if (length != window_size) {
+				break;
+			}
+		}
+
+		segments.push_back(size - segment_start);
+
+		// The first pass searches a window either side of each boundary in eighths of a window, every
+		// further pass two steps either side of the last in steps half as large.
+		for (int pass = 0; pass < refine_passes; ++pass) {
+			size_t step = std::max(window_size >> (3 + pass), MIN_REFINE_STEP);
+			Refine(data, segments, pass == 0 ? window_size : 2 * step, step);
+		}
+	}
+
+	double BlockSplitter::EstimatedBits(const std::array<std::uint32_t, 256>& counts, std::uint64_t total) {
+		double bits = SEGMENT_OVERHEAD_BITS;
+		auto n = static_cast<double>(total);
+		for (auto count : counts) {
+			if (count != 0) {
+				// Every byte needs at least a one-bit code.
+				double c = static_cast<double>(count);
+				bits += TABLE_ENTRY_BITS + c * std::max(std::log2(n / c), 1.0);
+			}
+		}
+		return bits;
+	}
+
+	double BlockSplitter::CodedBits(const std::array<std::uint32_t, 256>& counts) {
+		std::array<std::uint64_t, 256> leaves;
+		size_t leaf_count = 0;
+		for (auto count : counts) {
+			if (count != 0) {
+				leaves[leaf_count++] = count;
+			}
+		}
+		double bits = SEGMENT_OVERHEAD_BITS + TABLE_ENTRY_BITS * static_cast<double>(leaf_count);
+		if (leaf_count == 1) {
+			return bits + static_cast<double>(leaves[0]);
+		}
+
+		// Every byte's code has a bit for each inner node above it, so the code bits are the sum of
+		// the inner nodes' weights. Merged weights only grow, so the smallest two nodes are always at
+		// the front of the sorted leaves or of the inner nodes.
+		std::sort(leaves.begin(), leaves.begin() + leaf_count);
+		std::array<std::uint64_t, 256> inner;
+		size_t next_leaf = 0, next_inner = 0, inner_count = 0;
+		auto take_smallest = [&]() {
+			if (next_leaf < leaf_count && (next_inner == inner_count || leaves[next_leaf] <= inner[next_inner])) {
+				return leaves[next_leaf++];
+			}
+			return inner[next_inner++];
+		};
+		for (size_t merges = 1; merges < leaf_count; ++merges) {
+			std::uint64_t weight = take_smallest();
+			weight += take_smallest();
+			inner[inner_count++] = weight;
+			bits += static_cast<double>(weight);
+		}
+		return bits;
+	}
+
+}
@@ -0,0 +1,83 @@
+// BlockSplitter.h
+//
+// BlockSplitter picks the boundaries of the Huffman blocks within each block of
+// the block format, and the context Huffman coder's in coarser windows. Content that changes partway through, like a tar archive
+// mixing text and binary files, codes poorly with one table fitted to the mix.
+//
+// A block is scanned in windows of WINDOW_SIZE bytes (CodecSettings::split_window). Each window is compared
+// with the segment so far: if coding the two with separate tables, including the
+// cost of storing the second table, is estimated to be cheaper than one table for
+// both, a new segment starts at the window. Estimates use the order-0 entropy of
+// the byte histograms, which is what a Huffman code approaches. Sampling noise of
+// a window is well below the cost of a table, so data whose distribution doesn't
+// change is left in one segment.
+//
+// Boundaries found this way are only as precise as the window, and the scan can't
+// undo a split that later data makes pointless. Refinement passes move every
+// boundary to the cheapest position near it, in ever finer steps, and merge
+// neighbouring segments that are cheaper as one. They compare the sizes of the
+// actual Huffman codes, as the entropy misjudges a few bytes of another
+// distribution moving into a segment of few distinct bytes.
+
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace EncodingAlgorithms {
+
+	/**
+	* @class BlockSplitter
+	* @brief Splits a block where its byte distribution changes.
+	*/
+	class BlockSplitter {
+	public:
+
+		/**
+		* @brief Chooses segments of a block that are worth their own Huffman table.
+		*
+		* @param data: The block to split.
+		* @param size: Number of bytes in data.
+		* @param window_size: Granularity of the boundaries. Smaller windows follow changes more closely but cost more time.
+		* @param refine_passes: Number of refinement passes over the boundaries. Each makes the segments a little smaller to code.
+		* @return: The sizes of the consecutive segments, which add up to size. A single entry if the block is not split.
+		*/
+		static std::vector<size_t> Split(const std::uint8_t* data, size_t size, size_t window_size = WINDOW_SIZE,
+			int refine_passes = 0);
+
+		/**
+		* @brief Same as Split, but fills a caller-owned vector so its capacity is reused across blocks.
+		*
+		* @param segments: Receives the segment sizes. Existing contents are replaced.
+		*/
+		static void Split(const std::uint8_t* data, size_t size, std::vector<size_t>& segments,
+			size_t window_size = WINDOW_SIZE, int refine_passes = 0);
+
+		/**
+		* @brief Estimates the size of a histogram's bytes Huffman coded with a table of their own.
+		*
+		* @param counts: Number of occurrences of every byte value.
+		* @param total: Sum of counts.
+		* @return: The estimated size in bits, including the table.
+		*/
+		static double EstimatedBits(const std::array<std::uint32_t, 256>& counts, std::uint64_t total);
+
+		/**
+		* @brief Computes the size of a histogram's bytes coded with a Huffman code of their own.
+		*
+		* @param counts: Number of occurrences of every byte value.
+		* @return: The size in bits, including the estimated size of the table.
+		*/
+		static double CodedBits(const std::array<std::uint32_t, 256>& counts);
+
+		static constexpr size_t WINDOW_SIZE = 16 * 1024;		///< Default granularity of the segment boundaries.
+		static constexpr size_t MIN_WINDOW_SIZE = 1024;			///< Smaller windows are dominated by sampling noise.
+		static constexpr size_t MIN_REFINE_STEP = 64;			///< Finest step of the refinement passes.
+		static constexpr double TABLE_ENTRY_BITS = 24;			///< Stored table size per distinct byte (byte, length and code).
+		static constexpr double SEGMENT_OVERHEAD_BITS = 8 * 23;	///< Frame header, checksum, table size and bit count of a segment.
+	};
+
+}
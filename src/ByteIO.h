@@ -0,0 +1,80 @@
+// ByteIO.h
+//
+// Helpers for reading and writing fixed-width integers in little-endian byte
+// order, either to streams or to memory. Used for the container metadata so that
+// compressed files are portable between machines regardless of their native
+// byte order.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <type_traits>
+
+namespace ByteIO {
+
+	/**
+	* @brief Stores an unsigned integer in little-endian order at the given address.
+	*
+	* @param dest: Destination with room for sizeof(T) bytes.
+	* @param value: The value to store.
+	*/
+	template <typename T>
+	inline void StoreLE(std::uint8_t* dest, T value) {
+		static_assert(std::is_unsigned_v<T>, "StoreLE requires an unsigned type");
+		for (size_t i = 0; i < sizeof(T); ++i) {
+			dest[i] = static_cast<std::uint8_t>(value >> (8 * i));
+		}
+	}
+
+	/**
+	* @brief Loads an unsigned little-endian integer from the given address.
+	*
+	* @param src: Source holding at least sizeof(T) bytes.
+	* @return: The decoded value.
+	*/
+	template <typename T>
+	inline T LoadLE(const std::uint8_t* src) {
+		static_assert(std::is_unsigned_v<T>, "LoadLE requires an unsigned type");
+		T value = 0;
+		for (size_t i = 0; i < sizeof(T); ++i) {
+			value |= static_cast<T>(src[i]) << (8 * i);
+		}
+		return value;
+	}
+
+	/**
+	* @brief Writes an unsigned integer to a stream in little-endian order.
+	*
+	* @param output: The stream to write to.
+	* @param value: The value to write.
+	*/
+	template <typename T>
+	inline void WriteLE(std::ostream& output, T value) {
+		std::uint8_t bytes[sizeof(T)];
+		StoreLE(bytes, value);
+		output.write(reinterpret_cast<const char*>(bytes), sizeof(T));
+	}
+
+	/**
+	* @brief Reads an unsigned little-endian integer from a stream.
+	*
+	* @param input: The stream to read from.
+	* @param value: Receives the decoded value.
+	* @return: true if all sizeof(T) bytes were read.
+	*/
+	template <typename T>
+	inline bool ReadLE(std::istream& input, T& value) {
+		std::uint8_t bytes[sizeof(T)];
+		input.read(reinterpret_cast<char*>(bytes), sizeof(T));
+		if (input.gcount() != static_cast<std::streamsize>(sizeof(T))) {
+			return false;
+		}
+		value = LoadLE<T>(bytes);
+		return true;
+	}
+
+}
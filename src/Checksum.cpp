@@ -0,0 +1,193 @@
+#include "Checksum.h"
+
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CHECKSUM_HAS_SSE42 1
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace {
+
+	// Reflected CRC32C polynomial.
+	constexpr std::uint32_t CRC32C_POLYNOMIAL = 0x82F63B78;
+
+	using SlicingTable = std::array<std::array<std::uint32_t, 256>, 8>;
+
+	SlicingTable BuildSlicingTable() {
+		SlicingTable table{};
+		for (std::uint32_t i = 0; i < 256; ++i) {
+			std::uint32_t crc = i;
+			for (int bit = 0; bit < 8; ++bit) {
+				crc = (crc >> 1) ^ (CRC32C_POLYNOMIAL & (0u - (crc & 1)));
+			}
+			table[0][i] = crc;
+		}
+
+		// table[k][i] is the CRC of byte i followed by k zero bytes.
+		for (size_t k = 1; k < table.size(); ++k) {
+			for (std::uint32_t i = 0; i < 256; ++i) {
+				std::uint32_t previous = table[k - 1][i];
+				table[k][i] = (previous >> 8) ^ table[0][previous & 0xFF];
+			}
+		}
+		return table;
+	}
+
+	const SlicingTable& GetSlicingTable() {
+		static const SlicingTable table = BuildSlicingTable();
+		return table;
+	}
+
+#ifdef CHECKSUM_HAS_SSE42
+
+	bool DetectSse42() {
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 1);
+		return (info[2] & (1 << 20)) != 0;
+#else
+		return __builtin_cpu_supports("sse4.2");
+#endif
+	}
+
+#ifndef _MSC_VER
+	__attribute__((target("sse4.2")))
+#endif
+	std::uint32_t Crc32cHardware(const std::uint8_t* data, size_t size, std::uint32_t crc) {
+		// Align to 8 bytes, then consume a whole word per instruction.
+		while (size > 0 && (reinterpret_cast<std::uintptr_t>(data) & 7) != 0) {
+			crc = _mm_crc32_u8(crc, *data++);
+			--size;
+		}
+
+		std::uint64_t crc64 = crc;
+		while (size >= 8) {
+			std::uint64_t word;
+			std::memcpy(&word, data, sizeof(word));
+			crc64 = _mm_crc32_u64(crc64, word);
+			data += 8;
+			size -= 8;
+		}
+
+		crc = static_cast<std::uint32_t>(crc64);
+		while (size > 0) {
+			crc = _mm_crc32_u8(crc, *data++);
+			--size;
+		}
+		return crc;
+	}
+
+#endif
+
+	std::uint32_t Crc32cSlicing(const std::uint8_t* data, size_t size, std::uint32_t crc) {
+		const auto& table = GetSlicingTable();
+
+		// Eight bytes per iteration, folded through eight table lookups that are independent of each other.
+		while (size >= 8) {
+			std::uint32_t low = crc ^ (static_cast<std::uint32_t>(data[0]) | static_cast<std::uint32_t>(data[1]) << 8 |
+				static_cast<std::uint32_t>(data[2]) << 16 | static_cast<std::uint32_t>(data[3]) << 24);
+			crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^
+				table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24] ^
+				table[3][data[4]] ^ table[2][data[5]] ^ table[1][data[6]] ^ table[0][data[7]];
+			data += 8;
+			size -= 8;
+		}
+
+		while (size > 0) {
+			crc = (crc >> 8) ^ table[0][(crc ^ *data++) & 0xFF];
+			--size;
+		}
+		return crc;
+	}
+
+	// GF(2) matrix helpers for Crc32cCombine, as in zlib's crc32_combine.
+
+	std::uint32_t MatrixTimes(const std::uint32_t* matrix, std::uint32_t vector) {
+		std::uint32_t sum = 0;
+		for (; vector != 0; vector >>= 1, ++matrix) {
+			if (vector & 1) {
+				sum ^= *matrix;
+			}
+		}
+		return sum;
+	}
+
+	void MatrixSquare(std::uint32_t* square, const std::uint32_t* matrix) {
+		for (int n = 0; n < 32; ++n) {
+			square[n] = MatrixTimes(matrix, matrix[n]);
+		}
+	}
+
+}
+
+namespace Checksum {
+
+	std::uint32_t Crc32c(const void* data, size_t size, std::uint32_t crc) {
+#ifdef CHECKSUM_HAS_SSE42
+		static const bool hardware = DetectSse42();
+		if (hardware) {
+			return ~Crc32cHardware(static_cast<const std::uint8_t*>(data), size, ~crc);
+		}
+#endif
+		return Crc32cSoftware(data, size, crc);
+	}
+
+	std::uint32_t Crc32cSoftware(const void* data, size_t size, std::uint32_t crc) {
+		return ~Crc32cSlicing(static_cast<const std::uint8_t*>(data), size, ~crc);
+	}
+
+	std::uint32_t Crc32cCombine(std::uint32_t crc1, std::uint32_t crc2, std::uint64_t length2) {
+		if (length2 == 0) {
+			return crc1;
+		}
+
+		std::uint32_t even[32];		// Operator for an even power of two zero bytes.
+		std::uint32_t odd[32];		// Operator for an odd power of two zero bits.
+
+		// Operator for one zero bit.
+		odd[0] = CRC32C_POLYNOMIAL;
+		std::uint32_t row = 1;
+		for (int n = 1; n < 32; ++n) {
+			odd[n] = row;
+			row <<= 1;
+		}
+
+		MatrixSquare(even, odd);	// Two zero bits.
+		MatrixSquare(odd, even);	// Four zero bits.
+
+		// Apply length2 zero bytes to crc1, squaring the operator for each bit of the length.
+		do {
+			MatrixSquare(even, odd);
+			if (length2 & 1) {
+				crc1 = MatrixTimes(even, crc1);
+			}
+			length2 >>= 1;
+			if (length2 == 0) {
+				break;
+			}
+
+			MatrixSquare(odd, even);
+			if (length2 & 1) {
+				crc1 = MatrixTimes(odd, crc1);
+			}
+			length2 >>= 1;
+		} while (length2 != 0);
+
+		return crc1 ^ crc2;
+	}
+
+	bool HasHardwareCrc32c() {
+#ifdef CHECKSUM_HAS_SSE42
+		static const bool hardware = DetectSse42();
+		return hardware;
+#else
+		return false;
+#endif
+	}
+
+}
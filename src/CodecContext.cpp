@@ -0,0 +1,71 @@
+#include "CodecContext.h"
+#include "ThreadPool.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace EncodingAlgorithms {
+
+	size_t CodecContext::capacity() const {
+		return block_.capacity() + coded_.capacity() + scratch_.capacity();
+	}
+
+	void CodecContext::Release() {
+		// Assigning {} would keep the capacity, a swap with an empty vector frees it.
+		std::vector<std::uint8_t>().swap(block_);
+		std::vector<std::uint8_t>().swap(coded_);
+		scratch_ = ContextHuffmanCoding::Scratch();
+	}
+
+	void CodecContext::Reserve(std::vector<std::uint8_t>& buffer, size_t size) const {
+		if (buffer.capacity() >= size) {
+			return;
+		}
+		buffer.reserve(size);
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+		// madvise needs a page-aligned range, large allocations are mmapped and nearly aligned already.
+		if (huge_pages_ && size >= HUGE_PAGE_SIZE) {
+			auto page_size = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+			auto begin = reinterpret_cast<std::uintptr_t>(buffer.data());
+			auto end = begin + buffer.capacity();
+			auto aligned_begin = (begin + page_size - 1) & ~(page_size - 1);
+			auto aligned_end = end & ~(page_size - 1);
+			if (aligned_end > aligned_begin) {
+				// Only a hint, kernels without transparent huge pages reject it and nothing changes.
+				madvise(reinterpret_cast<void*>(aligned_begin), aligned_end - aligned_begin, MADV_HUGEPAGE);
+			}
+		}
+#endif
+	}
+
+	CompressContext::CompressContext() = default;
+
+	// ThreadPool is only complete here.
+	CompressContext::~CompressContext() = default;
+
+	size_t CompressContext::capacity() const {
+		return CodecContext::capacity() + (segments_.capacity() + candidates_.capacity()) * sizeof(size_t) +
+			index_.entries().capacity() * sizeof(BlockIndexEntry);
+	}
+
+	void CompressContext::Release() {
+		CodecContext::Release();
+		std::vector<size_t>().swap(segments_);
+		std::vector<size_t>().swap(candidates_);
+		pool_.reset();
+		index_ = BlockIndex();
+	}
+
+	ThreadPool& CompressContext::EncodePool(size_t thread_count) {
+		if (!pool_ || pool_->size() != thread_count) {
+			// The old threads are joined before the new ones start.
+			pool_.reset();
+			pool_ = std::make_unique<ThreadPool>(thread_count);
+		}
+		return *pool_;
+	}
+
+}
@@ -0,0 +1,131 @@
+// CodecContext.h
+//
+// CompressContext and DecompressContext hold the working memory of the block
+// codecs so that it can be kept from one call to the next. Services compressing
+// many small messages through CompressBuffer or the C API otherwise pay for a
+// block buffer, an encode buffer, the segment list, the block index and the
+// context coder's tables on every message, which dominates their cost.
+//
+// A context is lazy: it owns nothing until its first use, then grows its buffers
+// to the largest block it has seen and keeps them. Once a context has processed a
+// message of a given size and codec, later messages up to that size are encoded
+// and decoded without a single heap allocation. Release() returns the memory.
+//
+// On Linux, buffers of at least HUGE_PAGE_SIZE can be backed by transparent huge
+// pages (madvise MADV_HUGEPAGE), which saves TLB misses when large blocks are
+// scanned repeatedly. It is only a hint, so it is off by default and ignored where
+// the kernel doesn't support it.
+//
+// Parallel RLE encoding (CodecSettings::threads other than 1) runs on threads the
+// context starts on first use and keeps like its buffers, so only the tasks handed
+// to them are allocated per call.
+//
+// A context is used by one thread at a time. Pass one per worker thread.
+
+
+#pragma once
+
+#include "BlockIndex.h"
+#include "ContextHuffmanCoding.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class ThreadPool;
+
+namespace EncodingAlgorithms {
+
+	/**
+	* @class CodecContext
+	* @brief Buffers shared by CompressContext and DecompressContext.
+	*/
+	class CodecContext {
+	public:
+		CodecContext() = default;
+		virtual ~CodecContext() = default;
+		CodecContext(const CodecContext&) = delete;
+		CodecContext& operator=(const CodecContext&) = delete;
+
+		/**
+		* @brief Asks for huge pages on buffers allocated from now on.
+		*
+		* @param enabled: true to advise the kernel to back large buffers with huge pages.
+		*/
+		void UseHugePages(bool enabled) { huge_pages_ = enabled; }
+
+		bool huge_pages() const { return huge_pages_; }
+
+		/**
+		* @brief Number of bytes currently held by the context's buffers.
+		*/
+		virtual size_t capacity() const;
+
+		/**
+		* @brief Frees every buffer. The context stays usable and allocates again on its next use.
+		*/
+		virtual void Release();
+
+		static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;	///< Buffers at least this large may use huge pages.
+
+	protected:
+		friend class BlockCoding;
+
+		/**
+		* @brief Grows a buffer to hold at least size bytes, keeping it if it already does.
+		*
+		* New allocations of at least HUGE_PAGE_SIZE are advised to use huge pages when enabled.
+		*
+		* @param buffer: The buffer to grow.
+		* @param size: Number of bytes it must be able to hold without reallocating.
+		*/
+		void Reserve(std::vector<std::uint8_t>& buffer, size_t size) const;
+
+		std::vector<std::uint8_t> block_;				///< Uncompressed block (compress) or encoded payload (decompress).
+		std::vector<std::uint8_t> coded_;				///< Encoded block (compress) or decoded block (decompress).
+		ContextHuffmanCoding::Scratch scratch_;			///< Tables of the context Huffman coder.
+		bool huge_pages_ = false;
+	};
+
+	/**
+	* @class CompressContext
+	* @brief Working memory of BlockCoding::encode, reused across calls.
+	*/
+	class CompressContext : public CodecContext {
+	public:
+		CompressContext();
+		~CompressContext() override;
+
+		size_t capacity() const override;
+
+		/**
+		* @brief Frees every buffer and stops the encoding threads.
+		*/
+		void Release() override;
+
+		/**
+		* @brief Returns the threads encoding RLE blocks in parallel, started on first use and kept for later calls.
+		*
+		* @param thread_count: Number of threads. A pool with a different number is replaced.
+		* @return: The pool.
+		*/
+		ThreadPool& EncodePool(size_t thread_count);
+
+	private:
+		friend class BlockCoding;
+
+		std::unique_ptr<ThreadPool> pool_;				///< Threads of parallel RLE encoding, nullptr until first needed.
+
+		std::vector<size_t> segments_;					///< Sizes of the segments of the current block.
+		std::vector<size_t> candidates_;				///< Segments the context Huffman coder's search starts from.
+		BlockIndex index_;								///< Index of the file being written.
+	};
+
+	/**
+	* @class DecompressContext
+	* @brief Working memory of BlockCoding::decode, reused across calls.
+	*/
+	class DecompressContext : public CodecContext {
+	};
+
+}
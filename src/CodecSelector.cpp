@@ -0,0 +1,208 @@
+#include "CodecSelector.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace EncodingAlgorithms {
+
+	namespace {
+
+		constexpr size_t MATCH_LENGTH = 4;
+		constexpr int MATCH_HASH_BITS = 12;
+
+		std::uint32_t HashSequence(const std::uint8_t* data) {
+			std::uint32_t value;
+			std::memcpy(&value, data, sizeof(value));
+			return (value * 2654435761u) >> (32 - MATCH_HASH_BITS);
+		}
+
+		double EntropyOf(const std::array<std::uint64_t, 256>& counts, size_t size) {
+			double entropy = 0;
+			for (auto count : counts) {
+				if (count != 0) {
+					double p = static_cast<double>(count) / static_cast<double>(size);
+					entropy -= p * std::log2(p);
+				}
+			}
+			return entropy;
+		}
+
+	}
+
+	double SampleStatistics::EstimatedSize(CodecId codec, std::uint64_t size, std::uint64_t block_size) const {
+		auto bytes = static_cast<double>(size);
+
+		if (codec == CodecId::RLE) {
+			// One (byte, count) pair per run, and runs of 255 or more need an escape pair per 255 bytes.
+			double pairs = bytes / average_run_length;
+			double escapes = average_run_length >= 255 ? bytes / 255 : 0;
+			return 2 * pairs + 2 * escapes;
+		}
+
+		// Huffman needs at least one bit per byte, and every block stores its own table
+		// (about three bytes per symbol) and bit count.
+		double blocks = std::max(std::ceil(bytes / static_cast<double>(std::max<std::uint64_t>(block_size, 1))), 1.0);
+		if (codec == CodecId::ContextHuffman) {
+			// Clustered tables only get part of the way from order-0 to the sample's order-1 entropy,
+			// which also underestimates the true order-1 entropy of sparse contexts. Blocks store up
+			// to 32 tables of at most 160 bytes plus the context map.
+			double bits = std::max(context_entropy + (entropy - context_entropy) / 3, 1.0);
+			return bytes * bits / 8 + blocks * (257 + 32 * 160.0);
+		}
+		return bytes * std::max(entropy, 1.0) / 8 + blocks * (10 + 3.0 * static_cast<double>(distinct_bytes));
+	}
+
+	SampleStatistics CodecSelector::Analyze(const std::uint8_t* data, size_t size) {
+		SampleStatistics statistics;
+		statistics.sampled_bytes = size;
+		statistics.total_size = size;
+		if (size == 0) {
+			return statistics;
+		}
+
+		std::array<std::uint64_t, 256> counts{};
+		std::vector<std::uint32_t> pair_counts(256 * 256, 0);
+		std::vector<std::uint32_t> last_seen(size_t{ 1 } << MATCH_HASH_BITS, 0);
+		std::uint64_t runs = 1;
+		std::uint64_t matches = 0;
+
+		for (size_t i = 0; i < size; ++i) {
+			++counts[data[i]];
+			++pair_counts[(i > 0 ? data[i - 1] : 0) * 256 + data[i]];
+			if (i > 0 && data[i] != data[i - 1]) {
+				++runs;
+			}
+
+			// Remember the last position of each hashed sequence, a hit is counted only if the bytes really match.
+			if (i + MATCH_LENGTH <= size) {
+				auto& slot = last_seen[HashSequence(data + i)];
+				if (slot != 0 && std::memcmp(data + slot - 1, data + i, MATCH_LENGTH) == 0) {
+					++matches;
+				}
+				slot = static_cast<std::uint32_t>(i + 1);
+			}
+		}
+
+		statistics.entropy = EntropyOf(counts, size);
+
+		// The order-1 entropy is the entropy of each context's bytes, weighted by how often the context occurs.
+		double context_bits = 0;
+		for (size_t context = 0; context < 256; ++context) {
+			const std::uint32_t* row = pair_counts.data() + context * 256;
+			std::uint64_t total = 0;
+			for (size_t byte = 0; byte < 256; ++byte) {
+				total += row[byte];
+			}
+			for (size_t byte = 0; byte < 256 && total != 0; ++byte) {
+				if (row[byte] != 0) {
+					context_bits -= row[byte] * std::log2(static_cast<double>(row[byte]) / static_cast<double>(total));
+				}
+			}
+		}
+		statistics.context_entropy = context_bits / static_cast<double>(size);
+		statistics.distinct_bytes = static_cast<size_t>(std::count_if(counts.begin(), counts.end(),
+			[](std::uint64_t count) { return count != 0; }));
+		statistics.average_run_length = static_cast<double>(size) / static_cast<double>(runs);
+		statistics.match_density = static_cast<double>(matches) / static_cast<double>(size);
+		return statistics;
+	}
+
+	double CodecSelector::Entropy(const std::uint8_t* data, size_t size) {
+		if (size == 0) {
+			return 0;
+		}
+
+		std::array<std::uint64_t, 256> counts{};
+		for (size_t i = 0; i < size; ++i) {
+			++counts[data[i]];
+		}
+		return EntropyOf(counts, size);
+	}
+
+	std::uint64_t CodecSelector::CountRuns(const std::uint8_t* data, size_t size) {
+		if (size == 0) {
+			return 0;
+		}
+
+		std::uint64_t runs = 1;
+		for (size_t i = 1; i < size; ++i) {
+			runs += data[i] != data[i - 1];
+		}
+		return runs;
+	}
+
+	SampleStatistics CodecSelector::Sample(std::istream& input) {
+		std::streamoff start = input.tellg();
+		if (start < 0) {
+			input.clear();
+			return {};
+		}
+
+		input.seekg(0, std::ios::end);
+		std::streamoff end = input.tellg();
+		if (!input || end < start) {
+			input.clear();
+			input.seekg(start);
+			return {};
+		}
+		auto size = static_cast<std::uint64_t>(end - start);
+
+		// Small inputs are read whole, larger ones in evenly spaced windows from start to end.
+		std::vector<std::uint8_t> buffer;
+		if (size <= SAMPLE_COUNT * SAMPLE_SIZE) {
+			buffer.resize(static_cast<size_t>(size));
+			input.seekg(start);
+			input.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+			buffer.resize(static_cast<size_t>(std::max<std::streamsize>(input.gcount(), 0)));
+		}
+		else {
+			buffer.resize(SAMPLE_COUNT * SAMPLE_SIZE);
+			size_t filled = 0;
+			for (size_t i = 0; i < SAMPLE_COUNT; ++i) {
+				std::uint64_t offset = (size - SAMPLE_SIZE) * i / (SAMPLE_COUNT - 1);
+				input.seekg(start + static_cast<std::streamoff>(offset));
+				input.read(reinterpret_cast<char*>(buffer.data() + filled), SAMPLE_SIZE);
+				filled += static_cast<size_t>(std::max<std::streamsize>(input.gcount(), 0));
+			}
+			buffer.resize(filled);
+		}
+
+		input.clear();
+		input.seekg(start);
+
+		SampleStatistics statistics = Analyze(buffer.data(), buffer.size());
+		statistics.total_size = size;
+		return statistics;
+	}
+
+	CodecId CodecSelector::Choose(const SampleStatistics& statistics, const CodecSettings& settings) {
+		if (statistics.sampled_bytes == 0) {
+			return CodecId::Huffman;
+		}
+
+		// Without the block format there is one table for the whole stream.
+		std::uint64_t block_size = settings.block_format ? settings.block_size : statistics.total_size;
+		double rle = statistics.EstimatedSize(CodecId::RLE, statistics.total_size, block_size);
+		double huffman = statistics.EstimatedSize(CodecId::Huffman, statistics.total_size, block_size);
+		if (rle <= huffman) {
+			return CodecId::RLE;
+		}
+
+		// The context coder needs whole blocks in memory, and costs more time than plain Huffman.
+		if (settings.context_modeling && settings.block_format && !settings.static_table) {
+			double context = statistics.EstimatedSize(CodecId::ContextHuffman, statistics.total_size, block_size);
+			if (context < huffman * CONTEXT_MIN_GAIN) {
+				return CodecId::ContextHuffman;
+			}
+		}
+		return CodecId::Huffman;
+	}
+
+	CodecId CodecSelector::Select(std::istream& input, const CodecSettings& settings) {
+		return Choose(Sample(input), settings);
+	}
+
+}
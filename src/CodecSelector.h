@@ -0,0 +1,119 @@
+// CodecSelector.h
+//
+// CodecSelector picks a codec for data the user has not chosen one for. A few
+// evenly spaced windows of the input are sampled and summarized by their order-0
+// entropy (which bounds what Huffman coding can achieve), their average run
+// length (which determines what RLE achieves) and their match density (how much
+// of the data repeats earlier 4-byte sequences). The codec with the smallest
+// estimated output is chosen, with ties going to RLE as the cheaper one to run.
+// ContextHuffman is only considered when CodecSettings::context_modeling is set
+// (compression level 6 and up), judged by the order-1 entropy of the samples.
+//
+// Reading the samples costs a small fraction of compressing the file, and the
+// choice is recorded in the file header like any other, through its magic number.
+
+
+#pragma once
+
+#include "CodecSettings.h"
+#include "EncodingAlgorithms.h"
+#include <cstdint>
+#include <istream>
+
+namespace EncodingAlgorithms {
+
+	/**
+	* @struct SampleStatistics
+	* @brief Summary of sampled data used to estimate how well each codec compresses it.
+	*/
+	struct SampleStatistics {
+		std::uint64_t sampled_bytes = 0;		///< Number of bytes the statistics were computed from.
+		std::uint64_t total_size = 0;			///< Size of the data the samples were taken from.
+		double entropy = 8;						///< Order-0 entropy in bits per byte.
+		double context_entropy = 8;				///< Order-1 entropy, of each byte given the one before, in bits per byte.
+		double average_run_length = 1;			///< Average length of runs of the same byte.
+		double match_density = 0;				///< Fraction of positions starting a 4-byte sequence seen earlier in the sample.
+												///< Neither codec exploits matches, so it informs callers but not Choose.
+		size_t distinct_bytes = 256;			///< Number of different byte values in the sample.
+
+		/**
+		* @brief Estimates the compressed size of data with these statistics.
+		*
+		* @param codec: The codec to estimate for.
+		* @param size: Size of the data to compress.
+		* @param block_size: Block size of the block format, which determines how often Huffman writes a table.
+		* @return: The estimated compressed size in bytes.
+		*/
+		double EstimatedSize(CodecId codec, std::uint64_t size, std::uint64_t block_size) const;
+	};
+
+
+	/**
+	* @class CodecSelector
+	* @brief Chooses a codec from sampled statistics of the input.
+	*/
+	class CodecSelector {
+	public:
+
+		/**
+		* @brief Computes the statistics of a buffer.
+		*
+		* @param data: The data to analyze.
+		* @param size: Number of bytes in data.
+		* @return: The statistics. An empty buffer gives statistics of incompressible data.
+		*/
+		static SampleStatistics Analyze(const std::uint8_t* data, size_t size);
+
+		/**
+		* @brief Computes the order-0 entropy of a buffer, without the rest of Analyze's statistics.
+		*
+		* @param data: The data to measure.
+		* @param size: Number of bytes in data.
+		* @return: The entropy in bits per byte, 0 for an empty buffer.
+		*/
+		static double Entropy(const std::uint8_t* data, size_t size);
+
+		/**
+		* @brief Counts the runs of identical bytes in a buffer.
+		*
+		* @param data: The data to measure.
+		* @param size: Number of bytes in data.
+		* @return: The number of runs, 0 for an empty buffer.
+		*/
+		static std::uint64_t CountRuns(const std::uint8_t* data, size_t size);
+
+		/**
+		* @brief Samples SAMPLE_COUNT evenly spaced windows of a seekable stream.
+		*
+		* The stream is left at the position it had before sampling.
+		*
+		* @param input: The stream to sample, positioned at the start of the data.
+		* @return: The statistics of the samples, or of no data if the stream cannot seek.
+		*/
+		static SampleStatistics Sample(std::istream& input);
+
+		/**
+		* @brief Picks the codec with the smallest estimated output.
+		*
+		* @param statistics: Statistics of the data, from Analyze or Sample.
+		* @param settings: Settings the data will be compressed with.
+		* @return: The codec to compress with. Huffman if nothing was sampled, since it never expands data much.
+		*/
+		static CodecId Choose(const SampleStatistics& statistics, const CodecSettings& settings);
+
+		static constexpr double CONTEXT_MIN_GAIN = 0.9;			///< ContextHuffman must be estimated below this fraction of Huffman to pay for its slower encoding.
+
+		/**
+		* @brief Samples a stream and picks a codec for it.
+		*
+		* @param input: The stream to compress, positioned at the start of the data. Its position is kept.
+		* @param settings: Settings the data will be compressed with.
+		* @return: The codec to compress with.
+		*/
+		static CodecId Select(std::istream& input, const CodecSettings& settings);
+
+		static constexpr size_t SAMPLE_COUNT = 16;					///< Windows sampled from the input.
+		static constexpr size_t SAMPLE_SIZE = 16 * 1024;			///< Bytes per window.
+	};
+
+}
@@ -0,0 +1,122 @@
+#include "CodecSettings.h"
+
+#include <algorithm>
+#include <system_error>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace EncodingAlgorithms {
+
+	namespace {
+
+		struct LevelParameters {
+			bool split_blocks;
+			size_t split_window;
+			int split_passes;
+			size_t context_split_window;
+			int context_split_depth;
+			int cluster_iterations;
+			bool context_modeling;
+		};
+
+		// Measured on text and binaries. The block size stays at the default for every level: both coders
+		// lose more to smaller blocks than they gain, and are tuned with their segments instead. Huffman
+		// spends the levels on ever finer segments, then on refining their boundaries. The context coder's
+		// tables cost more, so its segments stop at 128 KB, below which text gets larger. Its levels search
+		// the tables deeper instead, and from level 7 trial encode ever smaller parts of the segments.
+		// Levels 6-9 also let automatic selection pick it.
+		constexpr LevelParameters LEVELS[MAX_LEVEL] = {
+			{ false, 64 * 1024,  0, 512 * 1024, 0, 1, false },	// 1
+			{ true,  128 * 1024, 0, 512 * 1024, 0, 1, false },	// 2
+			{ true,  64 * 1024,  0, 256 * 1024, 0, 1, false },	// 3
+			{ true,  32 * 1024,  0, 128 * 1024, 0, 1, false },	// 4
+			{ true,  16 * 1024,  0, 128 * 1024, 0, 2, false },	// 5
+			{ true,  16 * 1024,  1, 128 * 1024, 0, 4, true },	// 6
+			{ true,  16 * 1024,  2, 128 * 1024, 1, 4, true },	// 7
+			{ true,  16 * 1024,  3, 128 * 1024, 2, 4, true },	// 8
+			{ true,  16 * 1024,  4, 128 * 1024, 3, 4, true },	// 9
+		};
+
+	}
+
+	void CodecSettings::SetLevel(int new_level) {
+		level = std::clamp(new_level, MIN_LEVEL, MAX_LEVEL);
+		const LevelParameters& parameters = LEVELS[level - MIN_LEVEL];
+		block_size = DEFAULT_BLOCK_SIZE;
+		split_blocks = parameters.split_blocks;
+		split_window = parameters.split_window;
+		split_passes = parameters.split_passes;
+		context_split_window = parameters.context_split_window;
+		context_split_depth = parameters.context_split_depth;
+		cluster_iterations = parameters.cluster_iterations;
+		context_modeling = parameters.context_modeling;
+	}
+
+	CodecSettings CodecSettings::ResolvedFor(const std::filesystem::path& path) const {
+		CodecSettings resolved = *this;
+
+		if (auto_tune_buffer) {
+			std::error_code ec;
+			auto file_size = std::filesystem::file_size(path, ec);
+			if (ec) {
+				file_size = 0;
+			}
+			resolved.buffer_size = AutoTuneBufferSize(file_size, QueryIoBlockSize(path));
+		}
+		else {
+			resolved.buffer_size = std::clamp(buffer_size, MIN_BUFFER_SIZE, MAX_BUFFER_SIZE);
+		}
+
+		// Buffers shrink to fit the memory budget, the engine does the same for the blocks it writes.
+		size_t memory_limit = MemoryLimit();
+		if (memory_limit != MemoryBudget::UNLIMITED) {
+			resolved.buffer_size = std::min(resolved.buffer_size, std::max(memory_limit / BUFFER_BUDGET_SHARE, MIN_BUFFER_SIZE));
+		}
+
+		resolved.block_size = std::clamp(block_size, MIN_BLOCK_SIZE, MAX_BLOCK_SIZE);
+
+		return resolved;
+	}
+
+	size_t CodecSettings::AutoTuneBufferSize(std::uint64_t file_size, size_t io_block_size) {
+		if (io_block_size == 0) {
+			io_block_size = DEFAULT_IO_BLOCK_SIZE;
+		}
+
+		// Aim for a fixed number of buffer fills per file, bounded so that small files
+		// don't allocate more than they need and huge files don't hog memory.
+		std::uint64_t target = file_size / AUTO_TUNE_TARGET_CHUNKS;
+		target = std::clamp<std::uint64_t>(target, AUTO_TUNE_MIN_SIZE, AUTO_TUNE_MAX_SIZE);
+
+		// A buffer larger than the whole file is wasted memory.
+		target = std::min<std::uint64_t>(target, std::max<std::uint64_t>(file_size, MIN_BUFFER_SIZE));
+
+		// Round up to a whole number of filesystem blocks so every read is block aligned.
+		target = ((target + io_block_size - 1) / io_block_size) * io_block_size;
+
+		return std::clamp(static_cast<size_t>(target), MIN_BUFFER_SIZE, MAX_BUFFER_SIZE);
+	}
+
+	size_t CodecSettings::QueryIoBlockSize(const std::filesystem::path& path) {
+#ifdef _WIN32
+		// The cluster size is the closest equivalent to st_blksize on Windows.
+		std::error_code ec;
+		auto root = std::filesystem::absolute(path, ec).root_path();
+		DWORD sectors_per_cluster = 0, bytes_per_sector = 0, free_clusters = 0, total_clusters = 0;
+		if (!ec && GetDiskFreeSpaceW(root.c_str(), &sectors_per_cluster, &bytes_per_sector, &free_clusters, &total_clusters)) {
+			return static_cast<size_t>(sectors_per_cluster) * bytes_per_sector;
+		}
+#else
+		struct stat file_stat {};
+		if (stat(path.c_str(), &file_stat) == 0 && file_stat.st_blksize > 0) {
+			return static_cast<size_t>(file_stat.st_blksize);
+		}
+#endif
+		return DEFAULT_IO_BLOCK_SIZE;
+	}
+
+}
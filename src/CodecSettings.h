@@ -0,0 +1,181 @@
+// CodecSettings.h
+//
+// CodecSettings bundles the runtime options that control how the encoding
+// algorithms perform I/O. It is created by the CompressionWorker and passed down
+// to every codec, BitReader and BitWriter so that buffer sizes are no longer
+// fixed at compile time.
+//
+// The auto-tune helpers pick a buffer size from the size of the file being
+// processed and the optimal I/O block size reported by its filesystem. The I/O
+// mode selects how files are opened (see DirectFileBuffer). An optional
+// JobControl lets another thread cancel or pause the codecs between blocks, and
+// an optional MemoryBudget bounds the memory their blocks and buffers hold.
+//
+// The compression level is the one knob front ends expose for trading speed for
+// ratio. SetLevel maps it to the concrete parameters below (block size, how
+// finely blocks are cut into segments with their own tables, the context coder's
+// search depth and whether automatic selection may pick context modeling), so
+// every codec follows the same scale. Decoding doesn't depend on the level.
+
+
+#pragma once
+
+#include "JobControl.h"
+#include "MemoryBudget.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+
+namespace EncodingAlgorithms {
+
+	class StaticHuffmanTable;
+
+	// Default buffer size for all compression algorithms.
+	constexpr size_t DEFAULT_BUFFER_SIZE = 16 * 1024;			///< 16 kB buffer
+
+	// Limits applied to any configured or auto-tuned buffer size.
+	constexpr size_t MIN_BUFFER_SIZE = 4 * 1024;				///< 4 kB, a single page on most systems.
+	constexpr size_t MAX_BUFFER_SIZE = 16 * 1024 * 1024;		///< 16 MB
+
+	// Uncompressed size of the independently encoded blocks of the block format.
+	constexpr size_t DEFAULT_BLOCK_SIZE = 1024 * 1024;			///< 1 MB
+	constexpr size_t MIN_BLOCK_SIZE = 4 * 1024;					///< 4 kB
+	constexpr size_t MAX_BLOCK_SIZE = 64 * 1024 * 1024;			///< 64 MB, also the decoder's allocation limit.
+
+	// Compression levels, from fastest to smallest output.
+	constexpr int MIN_LEVEL = 1;
+	constexpr int MAX_LEVEL = 9;
+	constexpr int DEFAULT_LEVEL = 5;							///< The parameters every field below defaults to.
+
+	/**
+	* @enum IoMode
+	* @brief How the worker's input and output files interact with the OS page cache.
+	*/
+	enum class IoMode : std::uint8_t {
+		Buffered,		///< Regular buffered streams.
+		DropBehind,		///< Buffered, but pages behind the read and write cursors are dropped from the cache.
+		Direct			///< O_DIRECT with aligned buffers, falling back to DropBehind where unsupported.
+	};
+
+	/**
+	* @struct CodecSettings
+	* @brief Runtime options shared by the codecs and the bit-level readers and writers.
+	*/
+	struct CodecSettings {
+		size_t buffer_size = DEFAULT_BUFFER_SIZE;		///< Size of every I/O buffer used by a codec.
+		bool auto_tune_buffer = false;					///< Pick buffer_size from the file being processed.
+		IoMode io_mode = IoMode::Buffered;				///< Page cache behaviour of the worker's files.
+		bool block_format = true;						///< Write independent blocks (version 2) instead of one stream.
+		size_t block_size = DEFAULT_BLOCK_SIZE;			///< Uncompressed size of each block in the block format.
+		bool split_blocks = true;						///< Split Huffman and context Huffman blocks where their byte distribution changes (see BlockSplitter).
+		size_t split_window = 16 * 1024;				///< Granularity of the splits of Huffman blocks, BlockSplitter::WINDOW_SIZE by default.
+		int split_passes = 0;							///< Passes refining the boundaries of those splits, each in finer steps.
+		size_t context_split_window = 128 * 1024;		///< Granularity of the splits of context Huffman blocks, whose tables cost more.
+		int context_split_depth = 0;					///< How many times a context Huffman segment may be halved where trial encodings show the halves code smaller.
+		int cluster_iterations = 2;						///< Search depth of the context Huffman coder's table fitting (see ContextHuffmanCoding).
+		bool context_modeling = false;					///< Let automatic codec selection pick ContextHuffman, slower but smaller on text.
+		int level = DEFAULT_LEVEL;						///< Level the fields above were last set from by SetLevel.
+		bool checksums = true;							///< Store and verify a CRC32C of every block and of the whole file (block format only).
+		size_t threads = 0;								///< Threads decoding blocks and encoding RLE or single-stream Huffman. 0 uses every core, 1 works serially.
+		std::shared_ptr<const StaticHuffmanTable> static_table;	///< Pre-trained table for Huffman blocks instead of one table per block.
+		std::shared_ptr<const JobControl> control;		///< Cancels or pauses the codecs between blocks. nullptr never stops them.
+		std::shared_ptr<MemoryBudget> memory;			///< Budget the job's blocks and I/O buffers are reserved from. nullptr doesn't limit them.
+
+		/**
+		* @brief Stops here if the job was cancelled or paused, see JobControl::CheckPoint.
+		*
+		* @throws: OperationCancelledException if the job was cancelled.
+		*/
+		void CheckPoint() const {
+			if (control) {
+				control->CheckPoint();
+			}
+		}
+
+		/**
+		* @brief Reserves memory from the job's budget, waiting until other jobs have returned enough.
+		*
+		* @param bytes: Number of bytes the job is about to hold.
+		* @return: The reservation, empty if the job has no budget.
+		* @throws: CompressionException if the budget can never hold the bytes.
+		* @throws: OperationCancelledException if the job is cancelled while waiting.
+		*/
+		MemoryBudget::Reservation ReserveMemory(size_t bytes) const {
+			return memory ? memory->Reserve(bytes, control.get()) : MemoryBudget::Reservation();
+		}
+
+		/**
+		* @brief Reserves memory from the job's budget if it is available right now.
+		*
+		* @param bytes: Number of bytes the job would like to hold.
+		* @return: The reservation, or nullopt if the budget is exhausted. Always succeeds without a budget.
+		*/
+		std::optional<MemoryBudget::Reservation> TryReserveMemory(size_t bytes) const {
+			return memory ? memory->TryReserve(bytes) : std::make_optional<MemoryBudget::Reservation>();
+		}
+
+		/**
+		* @brief Most memory the job may hold, MemoryBudget::UNLIMITED without a budget.
+		*/
+		size_t MemoryLimit() const {
+			return memory ? memory->EffectiveLimit() : MemoryBudget::UNLIMITED;
+		}
+
+		/**
+		* @brief Sets the compression level and the parameters it maps to.
+		*
+		* Overwrites block_size, split_blocks, split_window, split_passes,
+		* context_split_window, context_split_depth, cluster_iterations and
+		* context_modeling, so options set explicitly must be applied afterwards.
+		* See the README for the throughput and ratio of each level.
+		*
+		* @param new_level: MIN_LEVEL (fastest) to MAX_LEVEL (smallest). Values outside are clamped.
+		*/
+		void SetLevel(int new_level);
+
+		/**
+		* @brief Returns a copy of these settings tuned for the given file.
+		*
+		* If auto_tune_buffer is set, the buffer size is replaced by the value of
+		* AutoTuneBufferSize for the path. Otherwise the configured buffer size is
+		* clamped to the supported range. The block size is always clamped. With a
+		* memory budget, each I/O buffer gets at most 1/BUFFER_BUDGET_SHARE of it.
+		*
+		* @param path: The file that will be read (or written) with these settings.
+		* @return: The settings to hand to the codecs.
+		*/
+		CodecSettings ResolvedFor(const std::filesystem::path& path) const;
+
+		/**
+		* @brief Picks an I/O buffer size for a file.
+		*
+		* Small files get a buffer no larger than themselves, while large files get
+		* progressively larger buffers (up to 4 MB) so that fast storage can reach its
+		* peak bandwidth. The result is always a multiple of the filesystem's
+		* optimal I/O block size.
+		*
+		* @param file_size: The size of the file in bytes.
+		* @param io_block_size: The optimal I/O block size reported by the filesystem.
+		* @return: The buffer size in bytes.
+		*/
+		static size_t AutoTuneBufferSize(std::uint64_t file_size, size_t io_block_size);
+
+		/**
+		* @brief Queries the optimal I/O block size of the filesystem holding a path.
+		*
+		* @param path: A file or directory on the filesystem to query.
+		* @return: The reported block size, or DEFAULT_IO_BLOCK_SIZE if it cannot be determined.
+		*/
+		static size_t QueryIoBlockSize(const std::filesystem::path& path);
+
+		static constexpr size_t DEFAULT_IO_BLOCK_SIZE = 4 * 1024;			///< Fallback when the filesystem cannot be queried.
+		static constexpr size_t AUTO_TUNE_MIN_SIZE = 64 * 1024;				///< Smallest auto-tuned buffer for files larger than it.
+		static constexpr size_t AUTO_TUNE_MAX_SIZE = 4 * 1024 * 1024;		///< Largest auto-tuned buffer.
+		static constexpr std::uint64_t AUTO_TUNE_TARGET_CHUNKS = 256;		///< Aim for about this many buffer fills per file.
+		static constexpr size_t BUFFER_BUDGET_SHARE = 16;					///< Each I/O buffer gets at most this fraction of a memory budget.
+		static constexpr size_t BLOCK_BUDGET_SHARE = 4;						///< Blocks written are at most this fraction of a memory budget.
+	};
+
+}
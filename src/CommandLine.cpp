@@ -0,0 +1,495 @@
+#include "CommandLine.h"
+#include "BatchQueue.h"
+#include "CodecSelector.h"
+#include "CompressionEngine.h"
+#include "CompressionExceptions.h"
+#include "DirectFileBuffer.h"
+#include "MemoryStream.h"
+#include "StaticHuffmanTable.h"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+
+	// Algorithms the benchmark compares when none is given.
+	constexpr EncodingAlgorithms::CodecId BENCHMARK_CODECS[] = {
+		EncodingAlgorithms::CodecId::RLE,
+		EncodingAlgorithms::CodecId::Huffman,
+		EncodingAlgorithms::CodecId::ContextHuffman
+	};
+
+	const char* CodecName(EncodingAlgorithms::CodecId codec) {
+		switch (codec) {
+		case EncodingAlgorithms::CodecId::RLE:
+			return "rle";
+		case EncodingAlgorithms::CodecId::Huffman:
+			return "huffman";
+		case EncodingAlgorithms::CodecId::ContextHuffman:
+			return "context";
+		}
+		return "unknown";
+	}
+
+	double SecondsSince(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	double MegabytesPerSecond(std::uint64_t bytes, double seconds) {
+		return seconds > 0 ? bytes / seconds / 1e6 : 0;
+	}
+
+	double Mebibytes(std::uint64_t bytes) {
+		return bytes / (1024.0 * 1024.0);
+	}
+
+	// Smallest memory limit accepted, below it not even the smallest blocks leave room for the codecs.
+	constexpr std::uint64_t MIN_MEMORY_LIMIT = 1024 * 1024;
+
+	// Budget of a file processed on its own, which is bound by both the overall and the per-file limit.
+	std::shared_ptr<MemoryBudget> SingleFileBudget(std::uint64_t memory_limit, std::uint64_t job_memory_limit) {
+		std::uint64_t limit = memory_limit == 0 ? job_memory_limit
+			: job_memory_limit == 0 ? memory_limit : std::min(memory_limit, job_memory_limit);
+		return limit == 0 ? nullptr : std::make_shared<MemoryBudget>(static_cast<size_t>(limit), MemoryBudget::Process());
+	}
+
+	// Reads the value of an option, e.g. the "4" of "--threads 4".
+	const std::string& OptionValue(const std::vector<std::string>& args, size_t& i) {
+		if (i + 1 >= args.size()) {
+			throw std::invalid_argument("Option " + args[i] + " needs a value");
+		}
+		return args[++i];
+	}
+
+}
+
+
+int CommandLine::Run(const std::vector<std::string>& args, std::istream& in, std::ostream& out, std::ostream& err) {
+	if (args.empty()) {
+		PrintUsage(err);
+		return EXIT_USAGE;
+	}
+
+	Options options;
+	try {
+		options = Parse(args);
+	}
+	catch (const std::exception& e) {
+		err << "Error: " << e.what() << "\n\n";
+		PrintUsage(err);
+		return EXIT_USAGE;
+	}
+
+	if (options.command == "help") {
+		PrintUsage(out);
+		return EXIT_OK;
+	}
+
+	try {
+		if (options.command == "compress" || options.command == "decompress") {
+			bool from_stdin = options.files.empty() || (options.files.size() == 1 && options.files[0] == "-");
+			if (from_stdin || options.to_stdout) {
+				std::ifstream file;
+				if (!from_stdin) {
+					file.open(options.files[0], std::ios::binary);
+					if (!file) {
+						throw FileOpenException(options.files[0]);
+					}
+				}
+				RunStream(options, from_stdin ? in : file, out);
+				out.flush();
+				return out ? EXIT_OK : EXIT_FAILED;
+			}
+			return RunFiles(options, err);
+		}
+		if (options.command == "verify") {
+			return Verify(options, out, err);
+		}
+		if (options.command == "benchmark") {
+			return Benchmark(options, out, err);
+		}
+		return TrainTable(options, out);
+	}
+	catch (const std::exception& e) {
+		err << "Error: " << e.what() << '\n';
+		return EXIT_FAILED;
+	}
+}
+
+void CommandLine::PrintUsage(std::ostream& stream) {
+	stream <<
+		"Usage: CompressionToolCli <command> [options] [files...]\n"
+		"\n"
+		"Commands:\n"
+		"  compress [files...]       Compress files next to themselves, or stdin to stdout\n"
+		"  decompress [files...]     Restore files next to themselves, or stdin to stdout\n"
+		"  verify <files...>         Check compressed files without writing them\n"
+		"  benchmark <files...>      Measure ratio and speed of each algorithm in memory\n"
+		"  train-table <table> <samples...>\n"
+		"                            Build a static Huffman table from sample files\n"
+		"\n"
+		"Options:\n"
+		"  -a, --algorithm NAME      rle, huffman, context or auto (default: auto)\n"
+		"  -t, --threads N           Threads for files and blocks (default: every core)\n"
+		"  -l, --level N, -N         Compression level, 1 (fastest) to 9 (smallest) (default: 5)\n"
+		"  -b, --block-size SIZE     Block size, e.g. 256K or 4M (default: set by the level)\n"
+		"  -m, --memory SIZE         Most memory for all files together, e.g. 512M (default: no limit)\n"
+		"      --job-memory SIZE     Most memory for each file (default: no limit)\n"
+		"  -o, --output FILE         Output file of a single input\n"
+		"  -c, --stdout              Write the output of a single input to stdout\n"
+		"  -f, --force               Replace existing output files\n"
+		"      --table FILE          Use a table written by train-table\n"
+		"  -p, --progress            Show overall progress\n"
+		"  -q, --quiet               Only print errors\n"
+		"  -h, --help                Show this help\n"
+		"\n"
+		"Use - or no files to read stdin. Exit status: 0 success, 1 a file failed, 2 invalid arguments.\n";
+}
+
+std::uint64_t CommandLine::ParseSize(const std::string& text) {
+	size_t digits = 0;
+	std::uint64_t value = 0;
+	try {
+		value = std::stoull(text, &digits);
+	}
+	catch (const std::exception&) {
+		throw std::invalid_argument("Invalid size '" + text + "'");
+	}
+
+	std::string suffix = text.substr(digits);
+	if (text[0] == '-' || suffix.size() > 1) {
+		throw std::invalid_argument("Invalid size '" + text + "'");
+	}
+
+	int shift = 0;
+	if (!suffix.empty()) {
+		switch (suffix[0]) {
+		case 'k': case 'K': shift = 10; break;
+		case 'm': case 'M': shift = 20; break;
+		case 'g': case 'G': shift = 30; break;
+		default: throw std::invalid_argument("Invalid size '" + text + "'");
+		}
+	}
+	if (value > (UINT64_MAX >> shift)) {
+		throw std::invalid_argument("Size '" + text + "' is too large");
+	}
+	return value << shift;
+}
+
+CommandLine::Options CommandLine::Parse(const std::vector<std::string>& args) {
+	Options options;
+	options.command = args[0];
+	if (options.command == "-h" || options.command == "--help") {
+		options.command = "help";
+		return options;
+	}
+	if (options.command != "compress" && options.command != "decompress" && options.command != "verify"
+		&& options.command != "benchmark" && options.command != "train-table") {
+		throw std::invalid_argument("Unknown command '" + options.command + "'");
+	}
+
+	// The level sets the block size too, an explicit block size wins regardless of the order.
+	std::optional<int> level;
+	std::optional<size_t> block_size;
+
+	bool only_files = false;
+	for (size_t i = 1; i < args.size(); ++i) {
+		const std::string& arg = args[i];
+		if (only_files || arg == "-" || arg.empty() || arg[0] != '-') {
+			options.files.push_back(arg);
+		}
+		else if (arg == "--") {
+			only_files = true;
+		}
+		else if (arg == "-a" || arg == "--algorithm") {
+			options.codec = ParseCodec(OptionValue(args, i));
+		}
+		else if (arg == "-t" || arg == "--threads") {
+			const std::string& value = OptionValue(args, i);
+			if (value.find_first_not_of("0123456789") != std::string::npos || value.size() > 4) {
+				throw std::invalid_argument("Invalid thread count '" + value + "'");
+			}
+			options.settings.threads = std::stoul(value);
+		}
+		else if (arg == "-b" || arg == "--block-size") {
+			auto size = ParseSize(OptionValue(args, i));
+			if (size < EncodingAlgorithms::MIN_BLOCK_SIZE || size > EncodingAlgorithms::MAX_BLOCK_SIZE) {
+				throw std::invalid_argument("The block size must be between 4K and 64M");
+			}
+			block_size = static_cast<size_t>(size);
+		}
+		else if (arg == "-l" || arg == "--level") {
+			const std::string& value = OptionValue(args, i);
+			if (value.size() != 1 || value[0] < '0' + EncodingAlgorithms::MIN_LEVEL || value[0] > '0' + EncodingAlgorithms::MAX_LEVEL) {
+				throw std::invalid_argument("The level must be between 1 and 9");
+			}
+			level = value[0] - '0';
+		}
+		else if (arg.size() == 2 && arg[1] >= '0' + EncodingAlgorithms::MIN_LEVEL && arg[1] <= '0' + EncodingAlgorithms::MAX_LEVEL) {
+			level = arg[1] - '0';
+		}
+		else if (arg == "-m" || arg == "--memory" || arg == "--job-memory") {
+			auto size = ParseSize(OptionValue(args, i));
+			if (size < MIN_MEMORY_LIMIT) {
+				throw std::invalid_argument("The memory limit must be at least 1M");
+			}
+			(arg == "--job-memory" ? options.job_memory_limit : options.memory_limit) = size;
+		}
+		else if (arg == "-o" || arg == "--output") {
+			options.output = OptionValue(args, i);
+		}
+		else if (arg == "--table") {
+			options.settings.static_table = EncodingAlgorithms::StaticHuffmanTable::Load(OptionValue(args, i));
+		}
+		else if (arg == "-c" || arg == "--stdout") {
+			options.to_stdout = true;
+		}
+		else if (arg == "-f" || arg == "--force") {
+			options.force = true;
+		}
+		else if (arg == "-p" || arg == "--progress") {
+			options.progress = true;
+		}
+		else if (arg == "-q" || arg == "--quiet") {
+			options.quiet = true;
+		}
+		else if (arg == "-h" || arg == "--help") {
+			options.command = "help";
+			return options;
+		}
+		else {
+			throw std::invalid_argument("Unknown option '" + arg + "'");
+		}
+	}
+
+	if (level) {
+		options.settings.SetLevel(*level);
+	}
+	if (block_size) {
+		options.settings.block_size = *block_size;
+	}
+
+	bool transforms = options.command == "compress" || options.command == "decompress";
+	if ((!options.output.empty() || options.to_stdout) && (!transforms || options.files.size() > 1)) {
+		throw std::invalid_argument("--output and --stdout need compress or decompress with a single input");
+	}
+	if (!transforms && options.files.empty()) {
+		throw std::invalid_argument(options.command + " needs at least one file");
+	}
+	if (options.command == "train-table" && options.files.size() < 2) {
+		throw std::invalid_argument("train-table needs a table file and at least one sample");
+	}
+	return options;
+}
+
+std::optional<EncodingAlgorithms::CodecId> CommandLine::ParseCodec(const std::string& name) {
+	if (name == "rle") {
+		return EncodingAlgorithms::CodecId::RLE;
+	}
+	if (name == "huffman") {
+		return EncodingAlgorithms::CodecId::Huffman;
+	}
+	if (name == "context") {
+		return EncodingAlgorithms::CodecId::ContextHuffman;
+	}
+	if (name == "auto") {
+		return std::nullopt;
+	}
+	throw std::invalid_argument("Unknown algorithm '" + name + "', expected rle, huffman, context or auto");
+}
+
+void CommandLine::RunStream(const Options& options, std::istream& in, std::ostream& out) {
+	auto settings = options.settings;
+	settings.memory = SingleFileBudget(options.memory_limit, options.job_memory_limit);
+
+	if (options.command == "decompress") {
+		CompressionEngine::Decompress(in, out, options.codec, settings);
+		return;
+	}
+
+	// Only seekable input can be sampled, pipes fall back to Huffman.
+	auto codec = options.codec ? *options.codec : EncodingAlgorithms::CodecSelector::Select(in, settings);
+	std::string extension = options.files.empty() || options.files[0] == "-"
+		? std::string()
+		: std::filesystem::path(options.files[0]).extension().string();
+	CompressionEngine::Compress(in, out, codec, extension, settings);
+}
+
+int CommandLine::RunFiles(const Options& options, std::ostream& err) {
+	std::vector<std::filesystem::path> paths(options.files.begin(), options.files.end());
+	auto files = BatchQueue::ExpandPaths(paths);
+
+	// Progress goes to one line that is rewritten in place.
+	std::mutex err_mutex;
+	BatchQueue::StatusCallback callback;
+	if (options.progress) {
+		callback = [&err, &err_mutex](size_t, const BatchJobStatus&, const BatchProgress& progress) {
+			std::lock_guard<std::mutex> lock(err_mutex);
+			err << '\r' << progress.completed + progress.failed + progress.cancelled << '/' << progress.jobs << " files  "
+				<< std::setw(3) << progress.percentage() << "%  "
+				<< std::fixed << std::setprecision(1) << progress.progress.megabytes_per_second() << " MB/s   " << std::flush;
+		};
+	}
+
+	auto settings = options.settings;
+	if (options.memory_limit != 0) {
+		settings.memory = std::make_shared<MemoryBudget>(static_cast<size_t>(options.memory_limit), MemoryBudget::Process());
+	}
+
+	std::vector<BatchJobStatus> results;
+	BatchProgress totals;
+	{
+		BatchQueue queue(settings, callback, settings.threads);
+		for (const auto& file : files) {
+			BatchJob job;
+			job.operation = options.command == "compress" ? BatchOperation::Compress : BatchOperation::Decompress;
+			job.input = file;
+			job.output = options.output;
+			job.codec = options.codec;
+			job.overwrite = options.force;
+			if (options.job_memory_limit != 0) {
+				job.memory_limit = static_cast<size_t>(options.job_memory_limit);
+			}
+			queue.Add(std::move(job));
+		}
+		queue.Wait();
+
+		for (size_t i = 0; i < files.size(); ++i) {
+			results.push_back(queue.Status(i));
+		}
+		totals = queue.Progress();
+	}
+	if (options.progress) {
+		err << '\n';
+	}
+
+	int exit_code = EXIT_OK;
+	for (const auto& status : results) {
+		if (status.state == BatchJobState::Completed) {
+			if (!options.quiet) {
+				err << status.input.string() << " -> " << status.output.string() << '\n';
+			}
+		}
+		else {
+			err << status.input.string() << ": " << status.error << '\n';
+			exit_code = EXIT_FAILED;
+		}
+	}
+
+	// With a limit, show how much of it was needed, so it can be tuned.
+	if (!options.quiet && (options.memory_limit != 0 || options.job_memory_limit != 0)) {
+		err << "Peak memory " << std::fixed << std::setprecision(1) << Mebibytes(totals.peak_memory) << " MiB";
+		if (options.memory_limit != 0) {
+			err << " of " << Mebibytes(options.memory_limit) << " MiB";
+		}
+		err << '\n';
+	}
+	return exit_code;
+}
+
+int CommandLine::Verify(const Options& options, std::ostream& out, std::ostream& err) {
+	std::vector<std::filesystem::path> paths(options.files.begin(), options.files.end());
+
+	int exit_code = EXIT_OK;
+	for (const auto& file : BatchQueue::ExpandPaths(paths)) {
+		try {
+			auto settings = options.settings;
+			settings.memory = SingleFileBudget(options.memory_limit, options.job_memory_limit);
+			settings = settings.ResolvedFor(file);
+			auto input_stream = DirectFileBuffer::OpenInput(file, settings);
+			std::istream& input = *input_stream;
+			if (!input) {
+				throw FileOpenException(file.string());
+			}
+
+			auto result = CompressionEngine::Verify(input, options.codec, settings);
+			if (!options.quiet) {
+				out << file.string() << ": OK, " << result.decompressed_size << " bytes, "
+					<< std::fixed << std::setprecision(1) << result.megabytes_per_second() << " MB/s"
+					<< (result.checksums_verified() ? "" : " (no checksums, decoded only)") << '\n';
+			}
+		}
+		catch (const std::exception& e) {
+			err << file.string() << ": FAILED, " << e.what() << '\n';
+			exit_code = EXIT_FAILED;
+		}
+	}
+	return exit_code;
+}
+
+int CommandLine::Benchmark(const Options& options, std::ostream& out, std::ostream& err) {
+	std::vector<EncodingAlgorithms::CodecId> codecs;
+	if (options.codec) {
+		codecs.push_back(*options.codec);
+	}
+	else {
+		codecs.assign(std::begin(BENCHMARK_CODECS), std::end(BENCHMARK_CODECS));
+	}
+
+	std::vector<std::filesystem::path> paths(options.files.begin(), options.files.end());
+
+	int exit_code = EXIT_OK;
+	for (const auto& file : BatchQueue::ExpandPaths(paths)) {
+		try {
+			std::ifstream input(file, std::ios::binary);
+			if (!input) {
+				throw FileOpenException(file.string());
+			}
+			std::vector<std::uint8_t> data((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+
+			out << file.string() << " (" << data.size() << " bytes, level " << options.settings.level << ")\n";
+			for (auto codec : codecs) {
+				std::vector<std::uint8_t> compressed;
+				MemoryInputBuffer source(data.data(), data.size());
+				MemoryOutputBuffer sink(compressed);
+				std::istream source_stream(&source);
+				std::ostream sink_stream(&sink);
+
+				auto start = std::chrono::steady_clock::now();
+				CompressionEngine::Compress(source_stream, sink_stream, codec, file.extension().string(), options.settings);
+				double compress_seconds = SecondsSince(start);
+
+				MemoryInputBuffer encoded(compressed.data(), compressed.size());
+				NullOutputBuffer discard;
+				std::istream encoded_stream(&encoded);
+				std::ostream discard_stream(&discard);
+
+				start = std::chrono::steady_clock::now();
+				CompressionEngine::Decompress(encoded_stream, discard_stream, codec, options.settings);
+				double decompress_seconds = SecondsSince(start);
+
+				if (discard.size() != data.size()) {
+					throw CompressionException(std::string(CodecName(codec)) + " did not restore the original size");
+				}
+
+				double ratio = data.empty() ? 0 : 100.0 * compressed.size() / data.size();
+				out << "  " << std::left << std::setw(8) << CodecName(codec) << std::right
+					// Neighbouring levels often differ by less than a tenth of a percent.
+					<< std::fixed << std::setprecision(2)
+					<< std::setw(7) << ratio << "%  " << std::setprecision(1)
+					<< std::setw(9) << MegabytesPerSecond(data.size(), compress_seconds) << " MB/s compress  "
+					<< std::setw(9) << MegabytesPerSecond(data.size(), decompress_seconds) << " MB/s decompress\n";
+			}
+		}
+		catch (const std::exception& e) {
+			err << file.string() << ": " << e.what() << '\n';
+			exit_code = EXIT_FAILED;
+		}
+	}
+	return exit_code;
+}
+
+int CommandLine::TrainTable(const Options& options, std::ostream& out) {
+	std::vector<std::filesystem::path> samples(options.files.begin() + 1, options.files.end());
+	auto table = EncodingAlgorithms::StaticHuffmanTable::Train(samples);
+	table->Save(options.files[0]);
+	if (!options.quiet) {
+		out << "Wrote table " << EncodingAlgorithms::StaticHuffmanTable::FormatId(table->id())
+			<< " to " << options.files[0] << '\n';
+	}
+	return EXIT_OK;
+}
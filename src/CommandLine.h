@@ -0,0 +1,129 @@
+// CommandLine.h
+//
+// CommandLine implements the headless front end, CompressionToolCli, which runs
+// without Qt for scripts, cron jobs and containers. It parses a subcommand and
+// its options and runs it on the same engine, batch queue and thread pool as the
+// GUI:
+//
+//   compress     Compresses files next to themselves, or stdin to stdout.
+//   decompress   Restores files next to themselves, or stdin to stdout.
+//   verify       Decodes files and checks their checksums without writing anything.
+//   benchmark    Compresses and decompresses files in memory with each algorithm.
+//   train-table  Builds a static Huffman table from sample files.
+//
+// Several files are processed concurrently on one work-stealing pool. Errors are
+// reported per file on the error stream, and the exit code is 0 on success, 1 if
+// any file failed and 2 for invalid arguments. The streams are passed in, so the
+// same code serves the CLI, the GUI executable's pipe mode and the tests.
+
+
+#pragma once
+
+#include "CodecSettings.h"
+#include "EncodingAlgorithms.h"
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+/**
+* @class CommandLine
+* @brief Parses and runs the command-line subcommands.
+*/
+class CommandLine {
+public:
+
+	static constexpr int EXIT_OK = 0;				///< Every file was processed.
+	static constexpr int EXIT_FAILED = 1;			///< At least one file failed.
+	static constexpr int EXIT_USAGE = 2;			///< The arguments were invalid.
+
+	/**
+	* @brief Runs a subcommand.
+	*
+	* @param args: The arguments after the program name, starting with the subcommand.
+	* @param in: Read by compress and decompress when no file (or "-") is given.
+	* @param out: Receives data written to stdout and the results of verify and benchmark.
+	* @param err: Receives errors, per-file messages and progress.
+	* @return: The process exit code.
+	*/
+	static int Run(const std::vector<std::string>& args, std::istream& in, std::ostream& out, std::ostream& err);
+
+	/**
+	* @brief Writes the usage text.
+	*
+	* @param stream: The stream to write to.
+	*/
+	static void PrintUsage(std::ostream& stream);
+
+	/**
+	* @brief Parses a size such as "65536", "256K" or "4M" (binary multiples).
+	*
+	* @param text: The size to parse.
+	* @return: The size in bytes.
+	* @throws: std::invalid_argument if the text is not a valid size.
+	*/
+	static std::uint64_t ParseSize(const std::string& text);
+
+private:
+
+	/**
+	* @struct Options
+	* @brief The parsed options of a subcommand.
+	*/
+	struct Options {
+		std::string command;
+		std::vector<std::string> files;									///< Inputs, "-" is stdin.
+		std::optional<EncodingAlgorithms::CodecId> codec;				///< nullopt selects automatically (compress) or accepts any (decompress).
+		std::filesystem::path output;									///< Output of a single input.
+		EncodingAlgorithms::CodecSettings settings;
+		std::uint64_t memory_limit = 0;									///< Most memory of all files together, 0 for no limit.
+		std::uint64_t job_memory_limit = 0;								///< Most memory of each file, 0 for no limit.
+		bool to_stdout = false;											///< Write every output to stdout instead of a file.
+		bool force = false;												///< Replace existing outputs.
+		bool progress = false;											///< Print overall progress to the error stream.
+		bool quiet = false;												///< Only print errors.
+	};
+
+	/**
+	* @brief Parses the arguments after the subcommand.
+	*
+	* @throws: std::invalid_argument with a message for the user if an option is invalid.
+	*/
+	static Options Parse(const std::vector<std::string>& args);
+
+	/**
+	* @brief Maps an algorithm name (rle, huffman, context or auto) to its codec, nullopt for auto.
+	*
+	* @throws: std::invalid_argument if the name is unknown.
+	*/
+	static std::optional<EncodingAlgorithms::CodecId> ParseCodec(const std::string& name);
+
+	/**
+	* @brief Compresses or decompresses between the given streams, as in a pipe.
+	*/
+	static void RunStream(const Options& options, std::istream& in, std::ostream& out);
+
+	/**
+	* @brief Compresses or decompresses files concurrently on a BatchQueue.
+	*/
+	static int RunFiles(const Options& options, std::ostream& err);
+
+	/**
+	* @brief Runs the verify subcommand.
+	*/
+	static int Verify(const Options& options, std::ostream& out, std::ostream& err);
+
+	/**
+	* @brief Runs the benchmark subcommand.
+	*/
+	static int Benchmark(const Options& options, std::ostream& out, std::ostream& err);
+
+	/**
+	* @brief Runs the train-table subcommand.
+	*/
+	static int TrainTable(const Options& options, std::ostream& out);
+};
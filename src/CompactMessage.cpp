@@ -0,0 +1,98 @@
+#include "CompactMessage.h"
+#include "ByteIO.h"
+#include "Checksum.h"
+#include "CompressionExceptions.h"
+#include <algorithm>
+#include <string>
+
+namespace {
+
+	// Magic, flags, table ID, a 64-bit varint and the checksum.
+	constexpr size_t MAX_HEADER_SIZE = 2 + 1 + 4 + 10 + 4;
+
+}
+
+
+void CompactMessage::Compress(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& output,
+	const EncodingAlgorithms::StaticHuffmanTable& table, bool checksum) {
+
+	if (size > MAX_SIZE) {
+		throw CompressionException("Compact messages are limited to 64 MiB");
+	}
+
+	std::uint8_t header[MAX_HEADER_SIZE];
+	std::uint8_t* pos = std::copy(MAGIC_NUMBER.begin(), MAGIC_NUMBER.end(), header);
+	*pos++ = checksum ? FLAG_CHECKSUM : 0;
+	ByteIO::StoreLE(pos, table.id());
+	pos += 4;
+	for (std::uint64_t remaining = size; ; remaining >>= 7) {
+		std::uint8_t byte = static_cast<std::uint8_t>(remaining & 0x7F);
+		if (remaining < 0x80) {
+			*pos++ = byte;
+			break;
+		}
+		*pos++ = byte | 0x80;
+	}
+	if (checksum) {
+		ByteIO::StoreLE(pos, Checksum::Crc32c(data, size));
+		pos += 4;
+	}
+
+	output.assign(header, pos);
+	EncodingAlgorithms::HuffmanCoding::encode(data, size, output, table);
+}
+
+void CompactMessage::Decompress(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& output) {
+	if (!IsCompactMessage(data, size) || size < MAGIC_NUMBER.size() + 1 + 4 + 1) {
+		throw InvalidHeaderException("Not a compact message");
+	}
+	const std::uint8_t* end = data + size;
+	const std::uint8_t* pos = data + MAGIC_NUMBER.size();
+
+	std::uint8_t flags = *pos++;
+	if (flags & ~KNOWN_FLAGS) {
+		throw InvalidHeaderException("Unknown compact message flags");
+	}
+	auto table_id = ByteIO::LoadLE<std::uint32_t>(pos);
+	pos += 4;
+
+	std::uint64_t original_size = 0;
+	for (int shift = 0; ; shift += 7) {
+		if (pos == end || shift > 63) {
+			throw InvalidHeaderException("Invalid compact message size");
+		}
+		std::uint8_t byte = *pos++;
+		original_size |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) {
+			break;
+		}
+	}
+	if (original_size > MAX_SIZE) {
+		throw InvalidHeaderException("Invalid compact message size");
+	}
+
+	std::uint32_t checksum = 0;
+	if (flags & FLAG_CHECKSUM) {
+		if (end - pos < 4) {
+			throw InvalidHeaderException("Truncated compact message");
+		}
+		checksum = ByteIO::LoadLE<std::uint32_t>(pos);
+		pos += 4;
+	}
+
+	auto table = EncodingAlgorithms::StaticHuffmanTable::Find(table_id);
+	if (!table) {
+		throw CompressionException("Message was compressed with Huffman table " + EncodingAlgorithms::StaticHuffmanTable::FormatId(table_id) +
+			", which has not been loaded");
+	}
+
+	output.clear();
+	EncodingAlgorithms::HuffmanCoding::decode(pos, static_cast<size_t>(end - pos), output, *table, static_cast<size_t>(original_size));
+	if ((flags & FLAG_CHECKSUM) && Checksum::Crc32c(output.data(), output.size()) != checksum) {
+		throw CompressionException("Message checksum mismatch, the message is corrupted");
+	}
+}
+
+bool CompactMessage::IsCompactMessage(const std::uint8_t* data, size_t size) {
+	return size >= MAGIC_NUMBER.size() && std::equal(MAGIC_NUMBER.begin(), MAGIC_NUMBER.end(), data);
+}
@@ -0,0 +1,69 @@
+// CompactMessage.h
+//
+// CompactMessage is a minimal framing for single records coded with a
+// StaticHuffmanTable, for services compressing one small message at a time.
+// The block format spends a header, a block frame, an End frame and a block
+// index on every stream, around 75 bytes, which is more than a record of a few
+// hundred bytes gains from being compressed at all. A compact message only
+// carries what decoding it needs:
+//
+//   2 byte magic "HM"
+//   u8  flags               (FLAG_CHECKSUM, other bits must be 0)
+//   u32 table ID            (little-endian, see StaticHuffmanTable)
+//   varint original size    (LEB128, 7 bits per byte, low bits first)
+//   u32 CRC32C              (of the original data, FLAG_CHECKSUM only)
+//   codes                   (HuffmanCoding's static-table encoding)
+//
+// The magic differs from every FileHeader magic, so decoders can accept both.
+
+
+#pragma once
+
+#include "StaticHuffmanTable.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+/**
+* @class CompactMessage
+* @brief Writes and reads single static-table Huffman messages with the smallest possible framing.
+*/
+class CompactMessage {
+public:
+
+	/**
+	* @brief Compresses a message with a pre-trained table.
+	*
+	* @param data: The message.
+	* @param size: Number of bytes at data.
+	* @param output: Replaced with the compact message. Its capacity is reused.
+	* @param table: The table to code the message with.
+	* @param checksum: Whether to store a CRC32C of the message, verified when it is decompressed.
+	* @throws: CompressionException if the message contains a byte the table has no code for.
+	*/
+	static void Compress(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& output,
+		const EncodingAlgorithms::StaticHuffmanTable& table, bool checksum);
+
+	/**
+	* @brief Decompresses a message written by Compress. The table must have been registered.
+	*
+	* @param data: The compact message.
+	* @param size: Number of bytes at data.
+	* @param output: Replaced with the message. Its capacity is reused.
+	* @throws: InvalidHeaderException if the framing is invalid or the message exceeds MAX_SIZE.
+	* @throws: CompressionException if the table has not been loaded, or the codes or checksum are corrupt.
+	*/
+	static void Decompress(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& output);
+
+	/**
+	* @brief Checks whether a buffer starts like a compact message rather than a file.
+	*/
+	static bool IsCompactMessage(const std::uint8_t* data, size_t size);
+
+	static constexpr std::array<char, 2> MAGIC_NUMBER = { 'H', 'M' };	///< Identifies a compact message.
+	static constexpr std::uint8_t FLAG_CHECKSUM = 0x01;					///< A CRC32C of the message follows its size.
+	static constexpr std::uint8_t KNOWN_FLAGS = FLAG_CHECKSUM;			///< Mask of the flag bits this version understands.
+	static constexpr size_t MAX_SIZE = EncodingAlgorithms::MAX_BLOCK_SIZE;	///< Largest message, bounding what a corrupt size can allocate.
+};
@@ -0,0 +1,233 @@
+#include "CompressionApi.h"
+#include "CodecContext.h"
+#include "CodecSettings.h"
+#include "CompactMessage.h"
+#include "CompressionEngine.h"
+#include "CompressionExceptions.h"
+#include "StaticHuffmanTable.h"
+
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+struct ct_context {
+	EncodingAlgorithms::CodecSettings settings;
+	EncodingAlgorithms::CodecId codec = EncodingAlgorithms::CodecId::Huffman;
+	std::vector<std::uint8_t> output;		///< Result of the last call, handed out to the caller.
+	std::string error;						///< Message of the last failure.
+	EncodingAlgorithms::CompressContext compress_buffers;		///< Block buffers kept between ct_compress calls.
+	EncodingAlgorithms::DecompressContext decompress_buffers;	///< Block buffers kept between ct_decompress calls.
+	std::shared_ptr<MemoryBudget> memory;					///< Budget of the calls, below the process budget.
+	std::shared_ptr<const EncodingAlgorithms::StaticHuffmanTable> table;	///< Table of compact messages, nullptr to write files.
+};
+
+namespace {
+
+	// Sets the context's error from the exception being handled and maps it to a status.
+	// Must be called from a catch block.
+	ct_status HandleException(ct_context* context) {
+		try {
+			throw;
+		}
+		catch (const std::bad_alloc&) {
+			context->error = "Out of memory";
+			return CT_ERROR_OUT_OF_MEMORY;
+		}
+		catch (const InvalidHeaderException& e) {
+			context->error = e.what();
+			return CT_ERROR_INVALID_DATA;
+		}
+		catch (const std::exception& e) {
+			context->error = e.what();
+			// Decoding errors of corrupt files are plain CompressionExceptions.
+			return dynamic_cast<const CompressionException*>(&e) ? CT_ERROR_INVALID_DATA : CT_ERROR_INTERNAL;
+		}
+		catch (...) {
+			context->error = "Unknown error";
+			return CT_ERROR_INTERNAL;
+		}
+	}
+
+	ct_status InvalidArgument(ct_context* context, const char* message) {
+		context->error = message;
+		return CT_ERROR_INVALID_ARGUMENT;
+	}
+
+	// Shared by ct_compress and ct_decompress, which only differ in the engine call.
+	template <typename Operation>
+	ct_status Transform(ct_context* context, const void* data, size_t size, const void** output, size_t* output_size,
+		Operation operation) {
+
+		if (!context) {
+			return CT_ERROR_INVALID_ARGUMENT;
+		}
+		if ((!data && size > 0) || !output || !output_size) {
+			return InvalidArgument(context, "Invalid buffer");
+		}
+
+		context->error.clear();
+		try {
+			static const std::uint8_t empty = 0;
+			operation(data ? static_cast<const std::uint8_t*>(data) : &empty, size);
+			*output = context->output.data();
+			*output_size = context->output.size();
+			return CT_OK;
+		}
+		catch (...) {
+			context->output.clear();
+			return HandleException(context);
+		}
+	}
+
+}
+
+
+ct_context* ct_context_create(void) {
+	try {
+		auto context = new ct_context;
+		// Callers are services with their own concurrency, so decoding stays on the calling thread by default.
+		context->settings.threads = 1;
+		context->memory = std::make_shared<MemoryBudget>(MemoryBudget::UNLIMITED, MemoryBudget::Process());
+		context->settings.memory = context->memory;
+		return context;
+	}
+	catch (const std::bad_alloc&) {
+		return nullptr;
+	}
+}
+
+void ct_context_free(ct_context* context) {
+	delete context;
+}
+
+ct_status ct_context_set_option(ct_context* context, ct_option option, long long value) {
+	if (!context) {
+		return CT_ERROR_INVALID_ARGUMENT;
+	}
+	context->error.clear();
+
+	switch (option) {
+	case CT_OPTION_ALGORITHM:
+		if (value < CT_ALGORITHM_RLE || value > CT_ALGORITHM_CONTEXT_HUFFMAN) {
+			return InvalidArgument(context, "Unknown algorithm");
+		}
+		context->codec = static_cast<EncodingAlgorithms::CodecId>(value);
+		return CT_OK;
+	case CT_OPTION_THREADS:
+		if (value < 0 || value > 4096) {
+			return InvalidArgument(context, "Invalid thread count");
+		}
+		context->settings.threads = static_cast<size_t>(value);
+		return CT_OK;
+	case CT_OPTION_BLOCK_SIZE:
+		if (value < static_cast<long long>(EncodingAlgorithms::MIN_BLOCK_SIZE)
+			|| value > static_cast<long long>(EncodingAlgorithms::MAX_BLOCK_SIZE)) {
+			return InvalidArgument(context, "The block size must be between 4 KiB and 64 MiB");
+		}
+		context->settings.block_size = static_cast<size_t>(value);
+		return CT_OK;
+	case CT_OPTION_CHECKSUMS:
+		if (value != 0 && value != 1) {
+			return InvalidArgument(context, "Checksums must be 0 or 1");
+		}
+		context->settings.checksums = value == 1;
+		return CT_OK;
+	case CT_OPTION_LEVEL:
+		if (value < EncodingAlgorithms::MIN_LEVEL || value > EncodingAlgorithms::MAX_LEVEL) {
+			return InvalidArgument(context, "The level must be between 1 and 9");
+		}
+		context->settings.SetLevel(static_cast<int>(value));
+		return CT_OK;
+	case CT_OPTION_MEMORY_LIMIT:
+		if (value < 0) {
+			return InvalidArgument(context, "The memory limit must not be negative");
+		}
+		context->memory->SetLimit(value == 0 ? MemoryBudget::UNLIMITED : static_cast<size_t>(value));
+		return CT_OK;
+	case CT_OPTION_HUGE_PAGES:
+		if (value != 0 && value != 1) {
+			return InvalidArgument(context, "Huge pages must be 0 or 1");
+		}
+		context->compress_buffers.UseHugePages(value == 1);
+		context->decompress_buffers.UseHugePages(value == 1);
+		return CT_OK;
+	case CT_OPTION_TABLE_ID:
+		if (value < 0 || value > 0xFFFFFFFFLL) {
+			return InvalidArgument(context, "Invalid table ID");
+		}
+		if (value == 0) {
+			context->table = nullptr;
+			return CT_OK;
+		}
+		if (auto table = EncodingAlgorithms::StaticHuffmanTable::Find(static_cast<std::uint32_t>(value))) {
+			context->table = std::move(table);
+			return CT_OK;
+		}
+		return InvalidArgument(context, "No table with this ID has been loaded");
+	}
+	return InvalidArgument(context, "Unknown option");
+}
+
+ct_status ct_context_load_table(ct_context* context, const char* path, unsigned int* table_id) {
+	if (!context) {
+		return CT_ERROR_INVALID_ARGUMENT;
+	}
+	if (!path) {
+		return InvalidArgument(context, "Invalid path");
+	}
+
+	context->error.clear();
+	try {
+		context->table = EncodingAlgorithms::StaticHuffmanTable::Load(path);
+		if (table_id) {
+			*table_id = context->table->id();
+		}
+		return CT_OK;
+	}
+	catch (const FileOpenException& e) {
+		return InvalidArgument(context, e.what());
+	}
+	catch (...) {
+		return HandleException(context);
+	}
+}
+
+ct_status ct_compress(ct_context* context, const void* data, size_t size, const void** output, size_t* output_size) {
+	return Transform(context, data, size, output, output_size, [context](const std::uint8_t* input, size_t input_size) {
+		if (context->table) {
+			CompactMessage::Compress(input, input_size, context->output, *context->table, context->settings.checksums);
+			return;
+		}
+		CompressionEngine::CompressBuffer(input, input_size, context->output, context->codec, context->settings,
+			&context->compress_buffers);
+	});
+}
+
+ct_status ct_decompress(ct_context* context, const void* data, size_t size, const void** output, size_t* output_size) {
+	return Transform(context, data, size, output, output_size, [context](const std::uint8_t* input, size_t input_size) {
+		if (CompactMessage::IsCompactMessage(input, input_size)) {
+			CompactMessage::Decompress(input, input_size, context->output);
+			return;
+		}
+		CompressionEngine::DecompressBuffer(input, input_size, context->output, std::nullopt, context->settings,
+			&context->decompress_buffers);
+	});
+}
+
+const char* ct_context_error(const ct_context* context) {
+	return context ? context->error.c_str() : "Invalid context";
+}
+
+size_t ct_context_peak_memory(const ct_context* context) {
+	return context ? context->memory->peak() : 0;
+}
+
+void ct_set_process_memory_limit(size_t limit) {
+	MemoryBudget::Process()->SetLimit(limit == 0 ? MemoryBudget::UNLIMITED : limit);
+}
+
+int ct_api_version(void) {
+	return CT_API_VERSION;
+}
@@ -0,0 +1,187 @@
+/* CompressionApi.h
+ *
+ * The C interface of the compression library, for C programs and for languages
+ * that load it through an FFI (Python ctypes or cffi, Go cgo, ...). It covers
+ * in-memory compression and decompression of the same file format the GUI and
+ * CompressionToolCli write, so services can call the codecs in-process instead
+ * of shelling out.
+ *
+ * A ct_context holds the options and the output buffer of its calls. The output
+ * of ct_compress and ct_decompress stays owned by the context and is valid until
+ * the next call on it or ct_context_free. The context also keeps the working
+ * buffers of the codecs, so once it has handled a message, further messages of
+ * up to the same size and algorithm are processed without allocating memory.
+ * A context must not be used by two threads at once; separate contexts are
+ * independent. Every function that can fail returns a ct_status, and
+ * ct_context_error describes the last failure.
+ *
+ * Small records compress best with a table trained on similar data (see the
+ * tool's train-table command). With CT_OPTION_TABLE_ID set, ct_compress writes
+ * compact messages instead of files: the table's ID, the size and an optional
+ * checksum, around 10 bytes in front of the codes where a file spends 75.
+ * ct_decompress accepts both.
+ *
+ * CT_OPTION_MEMORY_LIMIT bounds the blocks and buffers a context's calls hold,
+ * and ct_set_process_memory_limit those of all contexts together. A call that
+ * finds the process limit exhausted waits for other threads' calls to finish.
+ *
+ * The interface is plain C with opaque handles and fixed-width enums, so its
+ * ABI stays stable while the C++ classes behind it change.
+ */
+
+
+#ifndef COMPRESSION_API_H
+#define COMPRESSION_API_H
+
+#include <stddef.h>
+
+#if defined(_WIN32) && defined(CT_SHARED)
+#ifdef CT_BUILDING_LIBRARY
+#define CT_API __declspec(dllexport)
+#else
+#define CT_API __declspec(dllimport)
+#endif
+#elif defined(__GNUC__)
+#define CT_API __attribute__((visibility("default")))
+#else
+#define CT_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Version of the interface, increased when functions or options are added. */
+#define CT_API_VERSION 5
+
+/**
+* @brief Result of the functions of the interface.
+*/
+typedef enum ct_status {
+	CT_OK = 0,						/**< The call succeeded. */
+	CT_ERROR_INVALID_ARGUMENT = 1,	/**< A null pointer, unknown option or out-of-range value was passed. */
+	CT_ERROR_INVALID_DATA = 2,		/**< The input is not a valid compressed file, or it is corrupt. */
+	CT_ERROR_OUT_OF_MEMORY = 3,		/**< An allocation failed. */
+	CT_ERROR_INTERNAL = 4			/**< Any other failure, see ct_context_error. */
+} ct_status;
+
+/**
+* @brief Algorithms for CT_OPTION_ALGORITHM, with the values stored in the file format.
+*/
+typedef enum ct_algorithm {
+	CT_ALGORITHM_RLE = 1,
+	CT_ALGORITHM_HUFFMAN = 2,
+	CT_ALGORITHM_CONTEXT_HUFFMAN = 3
+} ct_algorithm;
+
+/**
+* @brief Options of a context, set with ct_context_set_option.
+*/
+typedef enum ct_option {
+	CT_OPTION_ALGORITHM = 1,		/**< A ct_algorithm used by ct_compress. Default CT_ALGORITHM_HUFFMAN. */
+	CT_OPTION_THREADS = 2,			/**< Threads decoding blocks, and encoding RLE, in parallel, 0 for every core. Default 1. */
+	CT_OPTION_BLOCK_SIZE = 3,		/**< Uncompressed bytes per block, 4 KiB to 64 MiB. Default 1 MiB. */
+	CT_OPTION_CHECKSUMS = 4,		/**< 1 to store and verify CRC32C checksums, 0 to skip them. Default 1. */
+	CT_OPTION_HUGE_PAGES = 5,		/**< 1 to back buffers of 2 MiB or more with huge pages where the OS supports it. Default 0. Since version 2. */
+	CT_OPTION_LEVEL = 6,			/**< Compression level, 1 (fastest) to 9 (smallest). Resets the block size to 1 MiB. Default 5. Since version 3. */
+	CT_OPTION_MEMORY_LIMIT = 7,		/**< Most bytes the calls may hold for blocks, 0 for no limit. Smaller blocks and fewer threads are used to fit. Default 0. Since version 4. */
+	CT_OPTION_TABLE_ID = 8			/**< ID of a loaded Huffman table ct_compress codes compact messages with, whatever the algorithm, 0 to write files. Default 0. Since version 5. */
+} ct_option;
+
+/** Opaque compression context. */
+typedef struct ct_context ct_context;
+
+/**
+* @brief Creates a context with the default options.
+*
+* @return: The context, or NULL if it could not be allocated.
+*/
+CT_API ct_context* ct_context_create(void);
+
+/**
+* @brief Frees a context and its output buffer. NULL is ignored.
+*/
+CT_API void ct_context_free(ct_context* context);
+
+/**
+* @brief Sets an option of a context.
+*
+* @param context: The context.
+* @param option: The option to set.
+* @param value: The new value.
+* @return: CT_OK, or CT_ERROR_INVALID_ARGUMENT if the option or value is invalid.
+*/
+CT_API ct_status ct_context_set_option(ct_context* context, ct_option option, long long value);
+
+/**
+* @brief Loads a table file written by the tool's train-table command and selects it as CT_OPTION_TABLE_ID.
+*
+* The table stays loaded for every context of the process, so ct_decompress can decode messages coded with it.
+* Since version 5.
+*
+* @param context: The context.
+* @param path: The table file.
+* @param table_id: Receives the table's ID, for other contexts' CT_OPTION_TABLE_ID. May be NULL.
+* @return: CT_OK, CT_ERROR_INVALID_ARGUMENT if the file cannot be opened, CT_ERROR_INVALID_DATA if it is not a table.
+*/
+CT_API ct_status ct_context_load_table(ct_context* context, const char* path, unsigned int* table_id);
+
+/**
+* @brief Compresses a buffer.
+*
+* @param context: The context, whose options select the algorithm.
+* @param data: The data to compress. May be NULL if size is 0.
+* @param size: Number of bytes at data.
+* @param output: Receives a pointer to the compressed data, owned by the context.
+* @param output_size: Receives the size of the compressed data.
+* @return: CT_OK or the reason of the failure.
+*/
+CT_API ct_status ct_compress(ct_context* context, const void* data, size_t size,
+	const void** output, size_t* output_size);
+
+/**
+* @brief Decompresses a buffer written by ct_compress or any other front end of the tool.
+*
+* Compact messages need their table to have been loaded in the process.
+*
+* @param context: The context.
+* @param data: The compressed data.
+* @param size: Number of bytes at data.
+* @param output: Receives a pointer to the decompressed data, owned by the context.
+* @param output_size: Receives the size of the decompressed data.
+* @return: CT_OK or the reason of the failure.
+*/
+CT_API ct_status ct_decompress(ct_context* context, const void* data, size_t size,
+	const void** output, size_t* output_size);
+
+/**
+* @brief Describes the last failure of a context.
+*
+* @return: The message, empty if the last call succeeded. Valid until the next call on the context.
+*/
+CT_API const char* ct_context_error(const ct_context* context);
+
+/**
+* @brief Returns the most bytes a context's calls held at once, see CT_OPTION_MEMORY_LIMIT.
+*
+* @return: The peak since the context was created, 0 for NULL.
+*/
+CT_API size_t ct_context_peak_memory(const ct_context* context);
+
+/**
+* @brief Limits the memory the calls of all contexts of the process hold together.
+*
+* @param limit: Most bytes, 0 for no limit. Calls already running keep what they hold.
+*/
+CT_API void ct_set_process_memory_limit(size_t limit);
+
+/**
+* @brief Returns CT_API_VERSION of the loaded library, to check it against the header.
+*/
+CT_API int ct_api_version(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMPRESSION_API_H */
@@ -0,0 +1,439 @@
+#include "CompressionEngine.h"
+#include "BlockCoding.h"
+#include "CompressionExceptions.h"
+#include "DirectFileBuffer.h"
+#include "MemoryStream.h"
+#include "PartialOutputGuard.h"
+#include "PositionalFile.h"
+#include "StaticHuffmanTable.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+using EncodingAlgorithms::CodecId;
+
+void CompressionEngine::Compress(std::istream& input, std::ostream& output, CodecId codec,
+	const std::string& original_extension, const EncodingAlgorithms::CodecSettings& settings,
+	std::optional<EncodingAlgorithms::ProgressCallback> progress_callback, EncodingAlgorithms::CompressContext* context) {
+
+	// The context coder works on whole blocks in memory, there is no streaming variant of it.
+	if (codec == CodecId::ContextHuffman && !settings.block_format) {
+		throw CompressionException("Context Huffman coding requires the block format");
+	}
+
+	// Write metadata into file when encoding to determine original extension and algorithim used.
+	FileHeader header(GetMagicNumber(codec), original_extension);
+	auto block_settings = settings;
+	auto input_size = RemainingSize(input);
+	if (settings.block_format) {
+		// Decoders reject block sizes outside the supported range, settings that weren't resolved included.
+		block_settings.block_size = std::clamp(settings.block_size, EncodingAlgorithms::MIN_BLOCK_SIZE, EncodingAlgorithms::MAX_BLOCK_SIZE);
+		header.flags_ |= FileHeader::FLAG_BLOCK_INDEX;
+		if (settings.checksums) {
+			header.flags_ |= FileHeader::FLAG_CHECKSUMS;
+		}
+
+		// Pipes have no size, everything else records it for the decompressor.
+		if (input_size) {
+			header.flags_ |= FileHeader::FLAG_ORIGINAL_SIZE;
+			header.original_size_ = *input_size;
+
+			// Small files don't need a full-size block buffer on either side.
+			block_settings.block_size = std::min<std::uint64_t>(block_settings.block_size,
+				std::max<std::uint64_t>(*input_size, EncodingAlgorithms::MIN_BLOCK_SIZE));
+		}
+
+		// A block and its encoding must fit the memory budget with room to spare for the buffers.
+		size_t memory_limit = settings.MemoryLimit();
+		if (memory_limit != MemoryBudget::UNLIMITED) {
+			block_settings.block_size = std::min(block_settings.block_size,
+				std::max(memory_limit / EncodingAlgorithms::CodecSettings::BLOCK_BUDGET_SHARE, EncodingAlgorithms::MIN_BLOCK_SIZE));
+		}
+		header.block_size_ = static_cast<std::uint32_t>(block_settings.block_size);
+
+		// Register the table too, so this process can decode what it wrote without loading it.
+		if (settings.static_table && codec == CodecId::Huffman) {
+			header.flags_ |= FileHeader::FLAG_STATIC_TABLE;
+			header.table_id_ = settings.static_table->id();
+			EncodingAlgorithms::StaticHuffmanTable::Register(settings.static_table);
+		}
+		else {
+			block_settings.static_table = nullptr;
+		}
+	}
+	else {
+		header.version_ = FileHeader::LEGACY_VERSION;
+	}
+	header.write(output);
+
+	// Blocks are still encoded one after another, but RLE splits each of them across the threads,
+	// and the legacy format's single stream is split the same way. A context keeps its threads
+	// for the next call like its buffers.
+	std::optional<ThreadPool> own_pool;
+	ThreadPool* pool = nullptr;
+	if (size_t threads = EncodeThreadCount(codec, input_size, block_settings); threads > 1) {
+		if (ThreadPool::Current()) {
+			pool = ThreadPool::Current();
+		}
+		else if (context) {
+			pool = &context->EncodePool(threads);
+		}
+		else {
+			pool = &own_pool.emplace(threads);
+		}
+	}
+
+	if (header.is_block_format()) {
+		auto compressed = EncodingAlgorithms::BlockCoding::encode(input, output, codec, progress_callback, block_settings,
+			context, pool);
+		CheckInput(input);
+		if (header.has_original_size() && compressed != header.original_size_) {
+			throw CompressionException("Input file changed size during compression");
+		}
+		return;
+	}
+
+	switch (codec) {
+	case CodecId::RLE:
+		EncodingAlgorithms::RLECoding::encode(input, output, progress_callback, settings, pool);
+		break;
+	case CodecId::Huffman:
+		EncodingAlgorithms::HuffmanCoding::encode(input, output, progress_callback, settings, pool);
+		break;
+	default:
+		throw CompressionException("Unknown algorithm type");
+	}
+	CheckInput(input);
+}
+
+FileHeader CompressionEngine::Decompress(std::istream& input, std::ostream& output,
+	std::optional<CodecId> expected_codec, const EncodingAlgorithms::CodecSettings& settings,
+	std::optional<EncodingAlgorithms::ProgressCallback> progress_callback, EncodingAlgorithms::DecompressContext* context) {
+
+	FileHeader header = ReadHeader(input, expected_codec);
+	DecodeBody(input, output, header, settings, progress_callback, context);
+	return header;
+}
+
+void CompressionEngine::CompressBuffer(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& output,
+	CodecId codec, const EncodingAlgorithms::CodecSettings& settings, EncodingAlgorithms::CompressContext* context) {
+
+	output.clear();
+	MemoryInputBuffer input_buffer(data, size);
+	MemoryOutputBuffer output_buffer(output);
+	std::istream input(&input_buffer);
+	std::ostream output_stream(&output_buffer);
+	Compress(input, output_stream, codec, std::string(), settings, std::nullopt, context);
+}
+
+FileHeader CompressionEngine::DecompressBuffer(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& output,
+	std::optional<CodecId> expected_codec, const EncodingAlgorithms::CodecSettings& settings,
+	EncodingAlgorithms::DecompressContext* context) {
+
+	output.clear();
+	MemoryInputBuffer input_buffer(data, size);
+	MemoryOutputBuffer output_buffer(output);
+	std::istream input(&input_buffer);
+	std::ostream output_stream(&output_buffer);
+
+	FileHeader header = ReadHeader(input, expected_codec);
+	// The recorded size is only trusted up to the block decoder's limit, the output grows past it if needed.
+	if (header.has_original_size()) {
+		output.reserve(static_cast<size_t>(std::min<std::uint64_t>(header.original_size_, EncodingAlgorithms::MAX_BLOCK_SIZE)));
+	}
+	DecodeBody(input, output_stream, header, settings, std::nullopt, context);
+	return header;
+}
+
+FileHeader CompressionEngine::DecompressToFile(std::istream& input, const std::filesystem::path& output_path,
+	std::optional<CodecId> expected_codec, const EncodingAlgorithms::CodecSettings& settings,
+	std::optional<EncodingAlgorithms::ProgressCallback> progress_callback) {
+
+	FileHeader header = ReadHeader(input, expected_codec);
+	DecompressToFile(input, header, output_path, settings, progress_callback);
+	return header;
+}
+
+void CompressionEngine::DecompressToFile(std::istream& input, const FileHeader& header, const std::filesystem::path& output_path,
+	const EncodingAlgorithms::CodecSettings& settings, std::optional<EncodingAlgorithms::ProgressCallback> progress_callback,
+	PartialOutputGuard* partial_output) {
+
+	if (header.is_block_format() && settings.io_mode != EncodingAlgorithms::IoMode::Direct) {
+		auto block_settings = BlockSettings(header, settings);
+
+		PositionalFile output(output_path, settings.io_mode);
+		if (partial_output) {
+			partial_output->Guard(output_path);
+		}
+		// The recorded size isn't checked until the end, a crafted header must not make the
+		// preallocation fill the disk. Pipes have no size to bound it by.
+		auto compressed_size = RemainingSize(input);
+		if (header.has_original_size() && compressed_size
+			&& header.original_size_ / MAX_PREALLOCATION_RATIO <= *compressed_size) {
+			output.Preallocate(header.original_size_);
+		}
+
+		// Jobs already running on a pool decode their blocks on it too.
+		std::optional<ThreadPool> own_pool;
+		ThreadPool& pool = ThreadPool::Current() ? *ThreadPool::Current() : own_pool.emplace(DecodeThreadCount(header, settings));
+		auto decompressed = EncodingAlgorithms::BlockCoding::DecodeParallel(input, &output, GetCodec(header), pool,
+			progress_callback, block_settings);
+		CheckOriginalSize(header, decompressed);
+		output.Close();
+		return;
+	}
+
+	auto output_stream = DirectFileBuffer::OpenOutput(output_path, settings);
+	if (!*output_stream) {
+		throw FileOpenException(output_path.string());
+	}
+	if (partial_output) {
+		partial_output->Guard(output_path);
+	}
+	DecodeBody(input, *output_stream, header, settings, progress_callback);
+	DirectFileBuffer::CloseOutput(*output_stream);
+}
+
+VerificationResult CompressionEngine::Verify(std::istream& input, std::optional<CodecId> expected_codec,
+	const EncodingAlgorithms::CodecSettings& settings, std::optional<EncodingAlgorithms::ProgressCallback> progress_callback) {
+
+	FileHeader header = ReadHeader(input, expected_codec);
+	return Verify(input, header, settings, progress_callback);
+}
+
+VerificationResult CompressionEngine::Verify(std::istream& input, const FileHeader& header,
+	const EncodingAlgorithms::CodecSettings& settings, std::optional<EncodingAlgorithms::ProgressCallback> progress_callback) {
+
+	VerificationResult result;
+	result.header = header;
+	auto start = std::chrono::steady_clock::now();
+
+	if (result.header.is_block_format()) {
+		// Blocks are decoded and checked in parallel, but never written anywhere.
+		auto block_settings = BlockSettings(result.header, settings);
+		std::optional<ThreadPool> own_pool;
+		ThreadPool& pool = ThreadPool::Current() ? *ThreadPool::Current()
+			: own_pool.emplace(DecodeThreadCount(result.header, settings));
+		result.decompressed_size = EncodingAlgorithms::BlockCoding::DecodeParallel(input, nullptr, GetCodec(result.header),
+			pool, progress_callback, block_settings);
+		CheckOriginalSize(result.header, result.decompressed_size);
+	}
+	else {
+		// Legacy files have no checksums, decoding them without errors is all that can be checked.
+		NullOutputBuffer sink;
+		std::ostream output(&sink);
+		DecodeBody(input, output, result.header, settings, progress_callback);
+		result.decompressed_size = sink.size();
+	}
+
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+std::uint64_t CompressionEngine::DecompressRange(std::istream& input, std::ostream& output,
+	std::uint64_t offset, std::uint64_t length, const EncodingAlgorithms::CodecSettings& settings) {
+
+	FileHeader header = FileHeader::read(input);
+	CodecId codec = GetCodec(header);
+
+	if (!header.has_block_index()) {
+		throw InvalidHeaderException("Random access requires a block-format file with a block index");
+	}
+
+	// Block offsets in the index are relative to the end of the header.
+	std::streamoff body_offset = input.tellg();
+	if (body_offset < 0) {
+		throw CompressionException("Random access requires a seekable input");
+	}
+
+	auto block_settings = BlockSettings(header, settings);
+
+	auto index = EncodingAlgorithms::BlockIndex::Read(input, static_cast<std::uint64_t>(body_offset),
+		EncodingAlgorithms::BlockCoding::FrameHeaderSize(block_settings), header.block_size_);
+	return EncodingAlgorithms::BlockCoding::DecodeRange(input, static_cast<std::uint64_t>(body_offset), index, codec,
+		offset, length, output, block_settings);
+}
+
+FileHeader CompressionEngine::ReadHeader(std::istream& input, std::optional<CodecId> expected_codec) {
+	// Read file header and validate magic number
+	FileHeader header = FileHeader::read(input);
+	CodecId codec = GetCodec(header);
+
+	// Check if selected algorithm matches the file's algorithm
+	if (expected_codec && *expected_codec != codec) {
+		throw InvalidHeaderException("Selected algorithm does not match the file's compression method");
+	}
+	return header;
+}
+
+void CompressionEngine::DecodeBody(std::istream& input, std::ostream& output, const FileHeader& header,
+	const EncodingAlgorithms::CodecSettings& settings, std::optional<EncodingAlgorithms::ProgressCallback> progress_callback,
+	EncodingAlgorithms::DecompressContext* context) {
+
+	CodecId codec = GetCodec(header);
+
+	if (header.is_block_format()) {
+		auto block_settings = BlockSettings(header, settings);
+		auto decompressed = EncodingAlgorithms::BlockCoding::decode(input, output, codec, progress_callback, block_settings,
+			context);
+		CheckOriginalSize(header, decompressed);
+		return;
+	}
+
+	switch (codec) {
+	case CodecId::RLE:
+		EncodingAlgorithms::RLECoding::decode(input, output, progress_callback, settings);
+		break;
+	case CodecId::Huffman:
+		EncodingAlgorithms::HuffmanCoding::decode(input, output, progress_callback, settings);
+		break;
+	default:
+		throw InvalidHeaderException("Context Huffman files must use the block format");
+	}
+}
+
+EncodingAlgorithms::CodecSettings CompressionEngine::BlockSettings(const FileHeader& header,
+	const EncodingAlgorithms::CodecSettings& settings) {
+
+	// Blocks can never be larger than what the header declares, and the frame layout
+	// depends on the file's flags rather than on how this build would write it.
+	auto block_settings = settings;
+	block_settings.block_size = header.block_size_;
+	block_settings.checksums = header.has_checksums();
+
+	block_settings.static_table = nullptr;
+	if (header.has_static_table()) {
+		if (GetCodec(header) != CodecId::Huffman) {
+			throw InvalidHeaderException("Static tables are only supported for Huffman files");
+		}
+		block_settings.static_table = EncodingAlgorithms::StaticHuffmanTable::Find(header.table_id_);
+		if (!block_settings.static_table) {
+			throw CompressionException("File was compressed with Huffman table " + EncodingAlgorithms::StaticHuffmanTable::FormatId(header.table_id_) +
+				", which has not been loaded");
+		}
+	}
+	return block_settings;
+}
+
+std::optional<std::uint64_t> CompressionEngine::RemainingSize(std::istream& input) {
+	std::streamoff position = input.tellg();
+	if (position < 0) {
+		input.clear();
+		return std::nullopt;
+	}
+
+	input.seekg(0, std::ios::end);
+	std::streamoff end = input.tellg();
+	input.clear();
+	input.seekg(position);
+	if (end < position || !input) {
+		input.clear();
+		return std::nullopt;
+	}
+	return static_cast<std::uint64_t>(end - position);
+}
+
+size_t CompressionEngine::DecodeThreadCount(const FileHeader& header, const EncodingAlgorithms::CodecSettings& settings) {
+	size_t threads = ThreadPool::ResolveThreadCount(settings.threads);
+
+	// No point starting more threads than there are blocks.
+	if (header.has_original_size()) {
+		auto blocks = (header.original_size_ + header.block_size_ - 1) / header.block_size_;
+		threads = static_cast<size_t>(std::clamp<std::uint64_t>(blocks, 1, threads));
+	}
+
+	// Every thread needs a block in memory to work on.
+	size_t memory_limit = settings.MemoryLimit();
+	if (memory_limit != MemoryBudget::UNLIMITED) {
+		auto block_settings = settings;
+		block_settings.block_size = header.block_size_;
+		size_t block_memory = EncodingAlgorithms::BlockCoding::DecodeMemory(GetCodec(header), block_settings);
+		threads = std::clamp<size_t>(memory_limit / block_memory, 1, threads);
+	}
+	return threads;
+}
+
+size_t CompressionEngine::EncodeThreadCount(CodecId codec, std::optional<std::uint64_t> input_size,
+	const EncodingAlgorithms::CodecSettings& settings) {
+
+	// RLE splits every block or window, Huffman only the single stream of the legacy format, which
+	// it reads twice and therefore only from seekable inputs.
+	size_t chunk_size = 0;
+	if (codec == CodecId::RLE) {
+		chunk_size = EncodingAlgorithms::RLECoding::PARALLEL_CHUNK_SIZE;
+	}
+	else if (codec == CodecId::Huffman && !settings.block_format && input_size) {
+		chunk_size = EncodingAlgorithms::HuffmanCoding::PARALLEL_CHUNK_SIZE;
+	}
+	else {
+		return 1;
+	}
+	size_t threads = ThreadPool::ResolveThreadCount(settings.threads);
+
+	// Every thread needs a chunk of its own, of a block or of what the input holds.
+	std::uint64_t encoded_at_once = settings.block_format ? settings.block_size : std::numeric_limits<std::uint64_t>::max();
+	if (input_size) {
+		encoded_at_once = std::min(encoded_at_once, *input_size);
+	}
+	auto chunks = encoded_at_once / chunk_size;
+	return static_cast<size_t>(std::clamp<std::uint64_t>(chunks, 1, threads));
+}
+
+void CompressionEngine::CheckInput(const std::istream& input) {
+	// The codecs stop at the first failed read like at the end of the input, only badbit tells them apart.
+	if (input.bad()) {
+		throw CompressionException("Failed to read the input file");
+	}
+}
+
+void CompressionEngine::CheckOriginalSize(const FileHeader& header, std::uint64_t decompressed) {
+	if (header.has_original_size() && decompressed != header.original_size_) {
+		throw CompressionException("Decompressed size does not match the file header");
+	}
+}
+
+std::array<char, FileHeader::MAGIC_NUMBER_SIZE> CompressionEngine::GetMagicNumber(CodecId codec) {
+	switch (codec) {
+	case CodecId::RLE:
+		return RLE_MAGIC_NUMBER;
+
+	case CodecId::Huffman:
+		return HUFFMAN_MAGIC_NUMBER;
+
+	case CodecId::ContextHuffman:
+		return CONTEXT_HUFFMAN_MAGIC_NUMBER;
+
+	default:
+		throw CompressionException("Unknown algorithm type");
+	}
+}
+
+std::string CompressionEngine::GetFileExtension(CodecId codec) {
+	switch (codec) {
+	case CodecId::RLE:
+		return ".rle";
+
+	case CodecId::Huffman:
+		return ".huff";
+
+	case CodecId::ContextHuffman:
+		return ".hctx";
+
+	default:
+		throw CompressionException("Unknown algorithm type");
+	}
+}
+
+CodecId CompressionEngine::GetCodec(const FileHeader& header) {
+	if (header.is_valid_magic_number(RLE_MAGIC_NUMBER)) {
+		return CodecId::RLE;
+	}
+	if (header.is_valid_magic_number(HUFFMAN_MAGIC_NUMBER)) {
+		return CodecId::Huffman;
+	}
+	if (header.is_valid_magic_number(CONTEXT_HUFFMAN_MAGIC_NUMBER)) {
+		return CodecId::ContextHuffman;
+	}
+	throw InvalidHeaderException("Unknown compression file format");
+}
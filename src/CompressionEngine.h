@@ -0,0 +1,315 @@
+// CompressionEngine.h
+//
+// CompressionEngine ties the file header and the codecs together into complete
+// compress and decompress operations on streams. It has no Qt dependency, so it
+// is shared by the GUI's CompressionWorker, the command-line tool and the C API.
+//
+// Compression writes the FileHeader followed by either the block-framed body
+// (version 2) or a single codec stream (version 1). Decompression reads the
+// header, identifies the codec from its magic number and dispatches accordingly.
+// Version 2 files can also be partially decompressed through their block index,
+// or decompressed to a file with their blocks decoded in parallel. Verify decodes
+// a file without writing it, to check its integrity before deleting the source.
+// Files referring to a StaticHuffmanTable decode only once that table is loaded.
+
+
+#pragma once
+
+#include "CodecContext.h"
+#include "EncodingAlgorithms.h"
+#include "FileHeader.h"
+#include <array>
+#include <filesystem>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class PartialOutputGuard;
+
+
+/**
+* @struct VerificationResult
+* @brief Outcome of CompressionEngine::Verify for a file that passed verification.
+*/
+struct VerificationResult {
+	FileHeader header;								///< The header read from the file.
+	std::uint64_t decompressed_size = 0;			///< Number of bytes the file decodes to.
+	double seconds = 0;								///< Wall-clock time spent decoding.
+
+	/**
+	* @brief Checks whether the data was protected by checksums, rather than only decoded successfully.
+	*/
+	bool checksums_verified() const { return header.has_checksums(); }
+
+	/**
+	* @brief Decoding throughput in megabytes (10^6 bytes) of decompressed data per second.
+	*/
+	double megabytes_per_second() const { return seconds > 0 ? decompressed_size / seconds / 1e6 : 0; }
+};
+
+
+/**
+* @class CompressionEngine
+* @brief Performs whole-stream compression and decompression, including the file header.
+*/
+class CompressionEngine {
+public:
+
+	/**
+	* @brief Compresses a stream, writing the file header and the encoded data.
+	*
+	* @param input: The stream with the data to compress. Only read sequentially in the block format.
+	* @param output: The stream receiving the compressed file.
+	* @param codec: The algorithm to compress with.
+	* @param original_extension: Extension stored in the header to restore the file name (may be empty for streams).
+	* @param settings: Resolved codec settings. settings.block_format selects the container version, and
+	* settings.static_table (Huffman, block format only) is recorded in the header and registered.
+	* With settings.memory, blocks are made small enough for the budget. RLE input, and Huffman
+	* input in the legacy format, is encoded on settings.threads threads, on the caller's ThreadPool
+	* if it runs on one, else on the context's.
+	* @param progress_callback: Optional callback receiving the number of input bytes consumed.
+	* @param context: Block buffers and encoding threads to reuse across calls, or nullptr to allocate them for this call.
+	* @throws: CompressionException if the input can't be read, if a seekable input changes size while it is compressed, if
+	* CodecId::ContextHuffman is used without the block format, or if the memory budget is too small.
+	*/
+	static void Compress(std::istream& input, std::ostream& output, EncodingAlgorithms::CodecId codec,
+		const std::string& original_extension, const EncodingAlgorithms::CodecSettings& settings,
+		std::optional<EncodingAlgorithms::ProgressCallback> progress_callback = std::nullopt,
+		EncodingAlgorithms::CompressContext* context = nullptr);
+
+	/**
+	* @brief Compresses a buffer in memory, for callers that hold the whole payload such as services
+	* compressing messages. The output is the same file Compress writes.
+	*
+	* @param data: The data to compress.
+	* @param size: Number of bytes at data.
+	* @param output: Receives the compressed file. It is cleared first, its capacity is reused.
+	* @param codec: The algorithm to compress with.
+	* @param settings: Codec settings, see Compress.
+	* @param context: Block buffers to reuse across calls. With a warmed-up context and output, calls
+	* on messages no larger than earlier ones don't allocate, except for the tasks of parallel RLE.
+	*/
+	static void CompressBuffer(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& output,
+		EncodingAlgorithms::CodecId codec, const EncodingAlgorithms::CodecSettings& settings,
+		EncodingAlgorithms::CompressContext* context = nullptr);
+
+	/**
+	* @brief Decompresses a stream produced by Compress.
+	*
+	* @param input: The stream positioned at the start of the compressed file.
+	* @param output: The stream receiving the decompressed data.
+	* @param expected_codec: If set, the file must have been compressed with this codec.
+	* @param settings: Resolved codec settings.
+	* @param progress_callback: Optional callback receiving the number of decompressed bytes written for
+	* block-format files, or of compressed bytes consumed for legacy files.
+	* @param context: Block buffers to reuse across calls, or nullptr to allocate them for this call.
+	* @return: The header read from the file.
+	* @throws: InvalidHeaderException if the header is invalid or the codec does not match.
+	* @throws: CompressionException if the file needs a StaticHuffmanTable that has not been loaded.
+	*/
+	static FileHeader Decompress(std::istream& input, std::ostream& output,
+		std::optional<EncodingAlgorithms::CodecId> expected_codec, const EncodingAlgorithms::CodecSettings& settings,
+		std::optional<EncodingAlgorithms::ProgressCallback> progress_callback = std::nullopt,
+		EncodingAlgorithms::DecompressContext* context = nullptr);
+
+	/**
+	* @brief Decompresses a file held in memory.
+	*
+	* @param data: The compressed file.
+	* @param size: Number of bytes at data.
+	* @param output: Receives the decompressed data. It is cleared first, its capacity is reused.
+	* @param expected_codec: If set, the file must have been compressed with this codec.
+	* @param settings: Codec settings.
+	* @param context: Block buffers to reuse across calls, see CompressBuffer.
+	* @return: The header read from the file.
+	* @throws: See Decompress.
+	*/
+	static FileHeader DecompressBuffer(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& output,
+		std::optional<EncodingAlgorithms::CodecId> expected_codec, const EncodingAlgorithms::CodecSettings& settings,
+		EncodingAlgorithms::DecompressContext* context = nullptr);
+
+	/**
+	* @brief Decompresses a stream produced by Compress into a file.
+	*
+	* Block-format input is decoded on settings.threads threads, each block written
+	* directly to its offset in the output file. If the header records the original
+	* size, the output is preallocated in one piece and no more threads are started
+	* than there are blocks. Legacy files and Direct I/O (which requires aligned
+	* writes) use the serial decoder instead.
+	*
+	* @param input: The stream positioned at the start of the compressed file.
+	* @param output_path: The file to create with the decompressed data.
+	* @param expected_codec: If set, the file must have been compressed with this codec.
+	* @param settings: Resolved codec settings.
+	* @param progress_callback: Optional callback, see Decompress.
+	* @return: The header read from the file.
+	* @throws: InvalidHeaderException if the header is invalid or the codec does not match.
+	* @throws: FileOpenException if the output file cannot be created.
+	*/
+	static FileHeader DecompressToFile(std::istream& input, const std::filesystem::path& output_path,
+		std::optional<EncodingAlgorithms::CodecId> expected_codec, const EncodingAlgorithms::CodecSettings& settings,
+		std::optional<EncodingAlgorithms::ProgressCallback> progress_callback = std::nullopt);
+
+	/**
+	* @brief Decompresses the body of a file whose header has already been read with ReadHeader.
+	*
+	* Lets callers size their progress reporting from the header before decoding starts.
+	*
+	* @param input: The stream positioned right after the header.
+	* @param header: The header returned by ReadHeader.
+	* @param output_path: The file to create with the decompressed data.
+	* @param settings: Resolved codec settings.
+	* @param progress_callback: Optional callback, see Decompress.
+	* @param partial_output: Optional guard, set to the output once it has been created. A file that
+	*	already existed is left alone if decoding fails before it is truncated.
+	*/
+	static void DecompressToFile(std::istream& input, const FileHeader& header, const std::filesystem::path& output_path,
+		const EncodingAlgorithms::CodecSettings& settings,
+		std::optional<EncodingAlgorithms::ProgressCallback> progress_callback = std::nullopt,
+		PartialOutputGuard* partial_output = nullptr);
+
+	/**
+	* @brief Reads and validates the header of a compressed stream.
+	*
+	* @param input: The stream positioned at the start of the compressed file.
+	* @param expected_codec: If set, the file must have been compressed with this codec.
+	* @return: The header read from the file.
+	* @throws: InvalidHeaderException if the header is invalid or the codec does not match.
+	*/
+	static FileHeader ReadHeader(std::istream& input, std::optional<EncodingAlgorithms::CodecId> expected_codec);
+
+	/**
+	* @brief Checks the integrity of a compressed file without writing its contents.
+	*
+	* Every block is decoded into a discarding sink on settings.threads threads, its
+	* checksum verified, and the total compared with the original size in the header.
+	* Legacy files are decoded serially and can only be checked for decoding errors.
+	*
+	* @param input: The stream positioned at the start of the compressed file.
+	* @param expected_codec: If set, the file must have been compressed with this codec.
+	* @param settings: Resolved codec settings.
+	* @param progress_callback: Optional callback, see Decompress.
+	* @return: The size and decoding throughput of the verified file.
+	* @throws: CompressionException (or InvalidHeaderException) describing the first problem found.
+	*/
+	static VerificationResult Verify(std::istream& input, std::optional<EncodingAlgorithms::CodecId> expected_codec,
+		const EncodingAlgorithms::CodecSettings& settings,
+		std::optional<EncodingAlgorithms::ProgressCallback> progress_callback = std::nullopt);
+
+	/**
+	* @brief Verifies the body of a file whose header has already been read with ReadHeader.
+	*/
+	static VerificationResult Verify(std::istream& input, const FileHeader& header,
+		const EncodingAlgorithms::CodecSettings& settings,
+		std::optional<EncodingAlgorithms::ProgressCallback> progress_callback = std::nullopt);
+
+	/**
+	* @brief Decompresses a byte range of a block-format file.
+	*
+	* Uses the trailing block index to read and decode only the blocks that overlap
+	* the range, so reading a small slice of a large file is cheap.
+	*
+	* @param input: A seekable stream positioned at the start of the compressed file.
+	* @param output: The stream receiving the decompressed range.
+	* @param offset: Start of the range in the decompressed data.
+	* @param length: Number of bytes to decompress. Clamped to the end of the data.
+	* @param settings: Resolved codec settings.
+	* @return: The number of bytes written.
+	* @throws: InvalidHeaderException if the file has no block index.
+	*/
+	static std::uint64_t DecompressRange(std::istream& input, std::ostream& output,
+		std::uint64_t offset, std::uint64_t length, const EncodingAlgorithms::CodecSettings& settings);
+
+	/**
+	* @brief Retrieves the magic number associated with a codec.
+	*
+	* @param codec: The compression algorithm.
+	* @return: A 3-character array written to the file header.
+	*/
+	static std::array<char, FileHeader::MAGIC_NUMBER_SIZE> GetMagicNumber(EncodingAlgorithms::CodecId codec);
+
+	/**
+	* @brief Retrieves the file extension compressed files of a codec are given.
+	*
+	* @param codec: The compression algorithm.
+	* @return: The extension including the dot, e.g. ".huff".
+	*/
+	static std::string GetFileExtension(EncodingAlgorithms::CodecId codec);
+
+	/**
+	* @brief Identifies the codec of a compressed file from its header.
+	*
+	* @param header: The header read from the file.
+	* @return: The codec the file was compressed with.
+	* @throws: InvalidHeaderException if the magic number is unknown.
+	*/
+	static EncodingAlgorithms::CodecId GetCodec(const FileHeader& header);
+
+private:
+
+	/**
+	* @brief Determines how many bytes are left in a stream without consuming them.
+	*
+	* @return: The remaining size, or std::nullopt if the stream is not seekable.
+	*/
+	static std::optional<std::uint64_t> RemainingSize(std::istream& input);
+
+	/**
+	* @brief Number of threads to decode a block-format file with.
+	*
+	* @return: settings.threads (0 meaning every core), but no more than the file has blocks
+	* or the memory budget can hold at once.
+	*/
+	static size_t DecodeThreadCount(const FileHeader& header, const EncodingAlgorithms::CodecSettings& settings);
+
+	/**
+	* @brief Number of threads to encode a stream with.
+	*
+	* @param codec: The algorithm to compress with. RLE, and Huffman in the legacy format, encode on several threads.
+	* @param input_size: Bytes to compress, or std::nullopt for pipes.
+	* @param settings: Settings of the blocks to write.
+	* @return: settings.threads (0 meaning every core), but no more than a block or the input
+	* has chunks of the codec's PARALLEL_CHUNK_SIZE.
+	*/
+	static size_t EncodeThreadCount(EncodingAlgorithms::CodecId codec, std::optional<std::uint64_t> input_size,
+		const EncodingAlgorithms::CodecSettings& settings);
+
+	/**
+	* @brief Checks that the input of a compression was read without errors.
+	*
+	* @throws: CompressionException if a read failed, which would otherwise look like the end of the input.
+	*/
+	static void CheckInput(const std::istream& input);
+
+	/**
+	* @brief Checks the decompressed size against the size recorded in the header, if any.
+	*
+	* @throws: CompressionException if they differ.
+	*/
+	static void CheckOriginalSize(const FileHeader& header, std::uint64_t decompressed);
+
+	/**
+	* @brief Adapts the caller's settings to the block size, frame layout and table declared by a header.
+	*
+	* @throws: CompressionException if the header refers to a StaticHuffmanTable that has not been loaded.
+	*/
+	static EncodingAlgorithms::CodecSettings BlockSettings(const FileHeader& header, const EncodingAlgorithms::CodecSettings& settings);
+
+	/**
+	* @brief Serially decodes the body that follows a header.
+	*/
+	static void DecodeBody(std::istream& input, std::ostream& output, const FileHeader& header,
+		const EncodingAlgorithms::CodecSettings& settings, std::optional<EncodingAlgorithms::ProgressCallback> progress_callback,
+		EncodingAlgorithms::DecompressContext* context = nullptr);
+
+	// Decompressed bytes per compressed byte beyond any codec's real ratio: RLE, the best
+	// of them, stores a full run of 255 bytes in 4. Outputs are only preallocated up to it.
+	static constexpr std::uint64_t MAX_PREALLOCATION_RATIO = 256;
+
+	// Magic numbers identifying the compression algorithm in the file header.
+	static constexpr std::array<char, FileHeader::MAGIC_NUMBER_SIZE> RLE_MAGIC_NUMBER = { 'R', 'L', 'E' };
+	static constexpr std::array<char, FileHeader::MAGIC_NUMBER_SIZE> HUFFMAN_MAGIC_NUMBER = { 'H', 'U', 'F' };
+	static constexpr std::array<char, FileHeader::MAGIC_NUMBER_SIZE> CONTEXT_HUFFMAN_MAGIC_NUMBER = { 'H', 'C', 'X' };
+};
@@ -73,3 +73,19 @@ public:
 		: CompressionException("Invalid header: " + message) {}
 };
 
+/**
+* @class OperationCancelledException
+* @brief Exception for jobs stopped through their JobControl.
+*
+* This class is thrown from a job's next check point after it was cancelled,
+* so callers can tell a cancellation apart from a failure.
+*/
+class OperationCancelledException : public CompressionException {
+public:
+
+	/**
+	* @brief Constructs an OperationCancelledException.
+	*/
+	OperationCancelledException()
+		: CompressionException("Operation cancelled") {}
+};
@@ -27,10 +27,14 @@ CompressionTool::CompressionTool(QWidget *parent)
     compress_button_(nullptr),
     decompress_button_(nullptr),
     algorithm_selector_(nullptr),
+    level_selector_(nullptr),
     status_bar_(nullptr),
     status_reset_timer_(new QTimer(this)),
     info_button_(nullptr),
     progress_bar_(nullptr),
+    pause_button_(nullptr),
+    cancel_button_(nullptr),
+    job_list_(nullptr),
     worker_(nullptr)
 
 {
@@ -39,6 +43,7 @@ CompressionTool::CompressionTool(QWidget *parent)
     SetupLayout();
     // Disable resizing
     setFixedSize(QSize(WINDOW_WIDTH, WINDOW_HEIGHT));
+    setAcceptDrops(true);
 
     // Setup worker/worker thread
     SetupWorkerThread();
@@ -49,13 +54,19 @@ CompressionTool::CompressionTool(QWidget *parent)
 }
 
 CompressionTool::~CompressionTool() {
+    // A running or paused job would keep the worker thread from ever quitting.
+    worker_->Cancel();
     worker_thread_.quit();
     worker_thread_.wait();
 }
 
 void CompressionTool::SetupWorkerThread() {
 
-    worker_ = new CompressionWorker();
+    // Let the worker size its I/O buffers from each file and its filesystem.
+    EncodingAlgorithms::CodecSettings settings;
+    settings.auto_tune_buffer = true;
+
+    worker_ = new CompressionWorker(nullptr, settings);
     worker_->moveToThread(&worker_thread_);
 
 
@@ -63,7 +74,13 @@ void CompressionTool::SetupWorkerThread() {
     connect(&worker_thread_, &QThread::finished, worker_, &QObject::deleteLater);
     connect(worker_, &CompressionWorker::ProgressUpdated, this, &CompressionTool::UpdateProgress);
     connect(worker_, &CompressionWorker::completed, this, &CompressionTool::OnCompressionCompleted);
+    connect(worker_, &CompressionWorker::verified, this, &CompressionTool::OnVerificationCompleted);
     connect(worker_, &CompressionWorker::error, this, &CompressionTool::OnCompressionError);
+    connect(worker_, &CompressionWorker::JobProgressUpdated, this, &CompressionTool::OnJobProgressUpdated);
+    connect(worker_, &CompressionWorker::JobFinished, this, &CompressionTool::OnJobFinished);
+    connect(worker_, &CompressionWorker::BatchCompleted, this, &CompressionTool::OnBatchCompleted);
+    connect(worker_, &CompressionWorker::cancelled, this, &CompressionTool::OnOperationCancelled);
+    connect(worker_, &CompressionWorker::JobCancelled, this, &CompressionTool::OnJobCancelled);
 
 
     worker_thread_.start();
@@ -78,19 +95,39 @@ void CompressionTool::SetupLayout() {
 
     // Setup file input selector
     file_input_ = new QLineEdit(this);
-    file_input_->setPlaceholderText(tr("Select a file..."));
+    file_input_->setPlaceholderText(tr("Select or drop files..."));
     main_layout->addWidget(file_input_);
 
     // Select file
-    select_file_button_ = new QPushButton(tr("Select File"), this);
+    select_file_button_ = new QPushButton(tr("Select Files"), this);
     main_layout->addWidget(select_file_button_);
 
     // Algorithim selector
     algorithm_selector_ = new QComboBox(this);
     algorithm_selector_->addItem(tr("Run-Length Encoding"));
     algorithm_selector_->addItem(tr("Huffman Coding"));
+    algorithm_selector_->addItem(tr("Context Huffman Coding"));
+    algorithm_selector_->addItem(tr("Automatic"));
     main_layout->addWidget(algorithm_selector_);
 
+    // Compression level, the same scale as the command line's -1 to -9
+    level_selector_ = new QComboBox(this);
+    for (int level = EncodingAlgorithms::MIN_LEVEL; level <= EncodingAlgorithms::MAX_LEVEL; ++level) {
+        QString label = tr("Level %1").arg(level);
+        if (level == EncodingAlgorithms::MIN_LEVEL) {
+            label += tr(" (fastest)");
+        }
+        else if (level == EncodingAlgorithms::DEFAULT_LEVEL) {
+            label += tr(" (default)");
+        }
+        else if (level == EncodingAlgorithms::MAX_LEVEL) {
+            label += tr(" (smallest)");
+        }
+        level_selector_->addItem(label);
+    }
+    level_selector_->setCurrentIndex(EncodingAlgorithms::DEFAULT_LEVEL - EncodingAlgorithms::MIN_LEVEL);
+    main_layout->addWidget(level_selector_);
+
     // Buttons
     compress_button_ = new QPushButton(tr("Compress"), this);
     main_layout->addWidget(compress_button_);
@@ -98,6 +135,12 @@ void CompressionTool::SetupLayout() {
     decompress_button_ = new QPushButton(tr("Decompress"), this);
     main_layout->addWidget(decompress_button_);
 
+    verify_button_ = new QPushButton(tr("Verify"), this);
+    main_layout->addWidget(verify_button_);
+
+    archive_button_ = new QPushButton(tr("Archive Folder"), this);
+    main_layout->addWidget(archive_button_);
+
     // Progress bar
     progress_bar_ = new QProgressBar(this);
 
@@ -119,6 +162,21 @@ void CompressionTool::SetupLayout() {
     progress_bar_->setVisible(false);
     main_layout->addWidget(progress_bar_);
 
+    // Pause and cancel, only shown while an operation runs
+    auto* control_layout = new QHBoxLayout();
+    pause_button_ = new QPushButton(tr("Pause"), this);
+    pause_button_->setVisible(false);
+    control_layout->addWidget(pause_button_);
+    cancel_button_ = new QPushButton(tr("Cancel"), this);
+    cancel_button_->setVisible(false);
+    control_layout->addWidget(cancel_button_);
+    main_layout->addLayout(control_layout);
+
+    // One row per file of the current batch
+    job_list_ = new QListWidget(this);
+    job_list_->setSelectionMode(QAbstractItemView::NoSelection);
+    main_layout->addWidget(job_list_);
+
     // Status bar
     status_bar_ = new QStatusBar(this);
     status_bar_->setSizeGripEnabled(false);
@@ -156,7 +214,12 @@ void CompressionTool::SetupLayout() {
     connect(select_file_button_, &QPushButton::clicked, this, &CompressionTool::SelectFile);
     connect(compress_button_, &QPushButton::clicked, this, &CompressionTool::CompressFile);
     connect(decompress_button_, &QPushButton::clicked, this, &CompressionTool::DecompressFile);
+    connect(verify_button_, &QPushButton::clicked, this, &CompressionTool::VerifyFile);
+    connect(archive_button_, &QPushButton::clicked, this, &CompressionTool::ArchiveFolder);
+    connect(pause_button_, &QPushButton::clicked, this, &CompressionTool::TogglePause);
+    connect(cancel_button_, &QPushButton::clicked, this, &CompressionTool::CancelOperation);
     connect(algorithm_selector_, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &CompressionTool::OnAlgorithmChanged);
+    connect(level_selector_, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &CompressionTool::OnLevelChanged);
     connect(info_button_, &QPushButton::clicked, this, &CompressionTool::ShowInfoWindow);
 }
 
@@ -177,6 +240,8 @@ void CompressionTool::ShowInfoWindow() {
         <ul>
             <li><b>Run-Length Encoding (RLE):</b> A simple lossless compression algorithm that works well for files with many repeated data sequences.</li>
             <li><b>Huffman Coding:</b> An efficient lossless compression technique that assigns variable-length codes to characters based on their frequency.</li>
+            <li><b>Context Huffman Coding:</b> Huffman coding with a separate code table for each group of similar preceding bytes, which compresses text and CSV files considerably better at nearly the same speed.</li>
+            <li><b>Automatic:</b> Samples the file and picks whichever of RLE and Huffman Coding is expected to compress it best.</li>
         </ul>
         <p>To use the tool:</p>
         <ol>
@@ -184,7 +249,7 @@ void CompressionTool::ShowInfoWindow() {
             <li>Choose the compression algorithm</li>
             <li>Click 'Compress' or 'Decompress' as needed</li>
         </ol>
-        <p>Note: Compressed files (.rle or .huff) cannot be opened directly and must be decompressed using this tool before viewing.</p>
+        <p>Note: Compressed files (.rle, .huff or .hctx) cannot be opened directly and must be decompressed using this tool before viewing.</p>
     )");
 
     layout->addWidget(info_text);
@@ -204,165 +269,306 @@ void CompressionTool::OnAlgorithmChanged(int index) {
         selected_algorithm_ = CompressionWorker::AlgorithmType::Huffman;
         break;
 
+    case 2:
+        selected_algorithm_ = CompressionWorker::AlgorithmType::ContextHuffman;
+        break;
+
+    case 3:
+        selected_algorithm_ = CompressionWorker::AlgorithmType::Auto;
+        break;
+
     default:
         break;
     }
 }
 
-void CompressionTool::SelectFile() {
-
-    QString file_path = QFileDialog::getOpenFileName(this, tr("Open File"), QString());
+void CompressionTool::OnLevelChanged(int index) {
+    // Queued, so it reaches the worker before any operation started after this.
+    QMetaObject::invokeMethod(worker_, "setLevel", Qt::QueuedConnection,
+        Q_ARG(int, EncodingAlgorithms::MIN_LEVEL + index));
+}
 
-    if (!file_path.isEmpty()) {
-        original_file_path_ = std::filesystem::path(file_path.toStdString());
-        file_input_->setText(file_path);
+bool CompressionTool::IsAlgorithmMatchingExtension(const QString& file_extension) const {
+    // Automatic accepts either, the header identifies the codec.
+    switch (selected_algorithm_) {
+    case CompressionWorker::AlgorithmType::RLE:
+        return file_extension == ".rle";
+    case CompressionWorker::AlgorithmType::Huffman:
+        return file_extension == ".huff";
+    case CompressionWorker::AlgorithmType::ContextHuffman:
+        return file_extension == ".hctx";
+    default:
+        return true;
     }
 }
 
-void CompressionTool::CompressFile() {
-    try {
-        if (original_file_path_.empty()) {
-            QMessageBox::warning(this, tr("Warning"), tr("Please select a file to compress."));
-            return;
-        }
+bool CompressionTool::IsCompressedExtension(const QString& file_extension) {
+    return file_extension == ".rle" || file_extension == ".huff" || file_extension == ".hctx";
+}
 
-        std::ifstream input_file(original_file_path_, std::ios::binary);
-        if (!input_file) {
-            throw FileOpenException(original_file_path_.string());
-        }
+void CompressionTool::SelectFile() {
 
-        // Check if the file is empty
-        input_file.seekg(0, std::ios::end);
-        if (input_file.tellg() == 0) {
-            QMessageBox::warning(this, tr("Warning"), tr("The selected file is empty. Compression aborted."));
-            return;
-        }
-        input_file.seekg(0, std::ios::beg);
+    QStringList file_paths = QFileDialog::getOpenFileNames(this, tr("Open Files"), QString());
 
-        QString original_extension = QString::fromStdString(original_file_path_.extension().string()).toLower();
-        if (original_extension == ".rle" || original_extension == ".huff") {
-            QMessageBox::warning(this, tr("Warning"),
-                tr("The selected file is already compressed. "
-                    "Compressing it again is not recommended."));
-            return;
+    if (!file_paths.isEmpty()) {
+        std::vector<std::filesystem::path> paths;
+        for (const auto& file_path : file_paths) {
+            paths.push_back(std::filesystem::path(file_path.toStdString()));
         }
+        SetSelectedPaths(paths);
+    }
+}
 
-        status_label_->setText(tr("Compressing..."));
-
-        std::string output_extension;
-
-        switch (selected_algorithm_) {
+void CompressionTool::SetSelectedPaths(const std::vector<std::filesystem::path>& paths) {
+    selected_paths_ = paths;
+    original_file_path_ = paths.empty() ? std::filesystem::path() : paths.front();
 
-        case CompressionWorker::AlgorithmType::RLE:
-            output_extension = ".rle";
-            break;
+    if (paths.size() == 1) {
+        file_input_->setText(QString::fromStdString(paths.front().string()));
+    }
+    else {
+        file_input_->setText(tr("%1 files selected").arg(static_cast<int>(paths.size())));
+    }
+}
 
-        case CompressionWorker::AlgorithmType::Huffman:
-            output_extension = ".huff";
-            break;
+void CompressionTool::dragEnterEvent(QDragEnterEvent* event) {
+    if (event->mimeData()->hasUrls()) {
+        event->acceptProposedAction();
+    }
+}
 
-        default:
-            QMessageBox::warning(this, tr("Warning"), tr("Something went wrong determing compression algorithim."));
-            return;
+void CompressionTool::dropEvent(QDropEvent* event) {
+    try {
+        std::vector<std::filesystem::path> paths;
+        for (const QUrl& url : event->mimeData()->urls()) {
+            if (url.isLocalFile()) {
+                paths.push_back(std::filesystem::path(url.toLocalFile().toStdString()));
+            }
         }
 
-        
-        // Determine output file based on the selected algorithm
-        auto output_path = original_file_path_.parent_path() / (original_file_path_.stem().string() +
-            output_extension);
+        // Dropped folders contribute every file below them.
+        SetSelectedPaths(BatchQueue::ExpandPaths(paths));
+        event->acceptProposedAction();
+    }
+    catch (const std::exception& e) {
+        QMessageBox::critical(this, tr("Error"), tr(e.what()));
+    }
+}
 
-        // Unhide progress bar and disable buttons
-        progress_bar_->setValue(0);
-        progress_bar_->setVisible(true);
-        compress_button_->setEnabled(false);
-        decompress_button_->setEnabled(false);
-        algorithm_selector_->setEnabled(false);
+void CompressionTool::CompressFile() {
+    if (selected_paths_.empty()) {
+        QMessageBox::warning(this, tr("Warning"), tr("Please select a file to compress."));
+        return;
+    }
 
-        QMetaObject::invokeMethod(worker_, "compress", Qt::QueuedConnection,
-            Q_ARG(QString, QString::fromStdString(original_file_path_.string())),
-            Q_ARG(QString, QString::fromStdString(output_path.string())),
-            Q_ARG(CompressionWorker::AlgorithmType, selected_algorithm_));
+    // Empty and already compressed files are left out, everything else is queued.
+    QStringList input_files;
+    int skipped = 0;
+    for (const auto& path : selected_paths_) {
+        QString extension = QString::fromStdString(path.extension().string()).toLower();
+        std::error_code error;
+        bool empty = std::filesystem::file_size(path, error) == 0 && !error;
+        if (empty || IsCompressedExtension(extension) || extension == ".cta") {
+            ++skipped;
+            continue;
+        }
+        input_files.append(QString::fromStdString(path.string()));
     }
-    catch (const std::exception& e) {
-        QMessageBox::critical(this, tr("Compression Error"), tr(e.what()));
-        status_label_->setText(tr("Failed"));
-        status_reset_timer_->start(TIMER_RESET_DURATION);
+
+    if (input_files.isEmpty()) {
+        QMessageBox::warning(this, tr("Warning"),
+            tr("The selected files are empty or already compressed. "
+                "Compressing them again is not recommended."));
         return;
     }
+    if (skipped > 0) {
+        QMessageBox::warning(this, tr("Warning"),
+            tr("%1 of the selected files are empty or already compressed and will be skipped.").arg(skipped));
+    }
+
+    StartBatch(input_files, BatchOperation::Compress);
 }
 
 
 void CompressionTool::DecompressFile() {
-    try {
-        if (original_file_path_.empty()) {
-            QMessageBox::warning(this, tr("Warning"), tr("Please select a file to decompress."));
-            return;
-        }
-
-        std::ifstream input_file(original_file_path_, std::ios::binary);
-        if (!input_file) {
-            throw FileOpenException(original_file_path_.string());
-        }
+    if (selected_paths_.empty()) {
+        QMessageBox::warning(this, tr("Warning"), tr("Please select a file to decompress."));
+        return;
+    }
 
-        // Check if the file is empty
-        input_file.seekg(0, std::ios::end);
-        if (input_file.tellg() == 0) {
-            QMessageBox::warning(this, tr("Warning"), tr("The selected file is empty. Decompression aborted."));
+    // Archives record the algorithm of every entry, so the selector doesn't apply.
+    QString first_extension = QString::fromStdString(original_file_path_.extension().string()).toLower();
+    if (selected_paths_.size() == 1 && first_extension == ".cta") {
+        if (batch_running_) {
+            QMessageBox::warning(this, tr("Warning"), tr("Please wait for the running files to finish before extracting."));
             return;
         }
-        input_file.seekg(0, std::ios::beg);
+        auto output_dir = original_file_path_.parent_path() / original_file_path_.stem();
 
-        QString file_extension = QString::fromStdString(original_file_path_.extension().string()).toLower();
+        BeginOperation(tr("Extracting..."));
 
-        if (file_extension != ".rle" && file_extension != ".huff") {
-            QMessageBox::warning(this, tr("Warning"),
-                tr("The selected file does not appear to be compressed by this tool. "
-                    "Please select a .rle or .huff file for decompression."));
-            return;
+        QMetaObject::invokeMethod(worker_, "extract", Qt::QueuedConnection,
+            Q_ARG(QString, QString::fromStdString(original_file_path_.string())),
+            Q_ARG(QString, QString::fromStdString(output_dir.string())));
+        return;
+    }
+
+    // The worker reads each header and names the output after the original extension.
+    QStringList input_files;
+    int unknown = 0;
+    int mismatched = 0;
+    for (const auto& path : selected_paths_) {
+        QString extension = QString::fromStdString(path.extension().string()).toLower();
+        if (!IsCompressedExtension(extension)) {
+            ++unknown;
+        }
+        else if (!IsAlgorithmMatchingExtension(extension)) {
+            ++mismatched;
         }
+        else {
+            input_files.append(QString::fromStdString(path.string()));
+        }
+    }
 
-        if ((file_extension == ".rle" && selected_algorithm_ != CompressionWorker::AlgorithmType::RLE) ||
-            (file_extension == ".huff" && selected_algorithm_ != CompressionWorker::AlgorithmType::Huffman)) {
+    if (input_files.isEmpty()) {
+        if (mismatched > 0) {
             QMessageBox::warning(this, tr("Warning"),
                 tr("The selected algorithm does not match the file extension. "
                     "Please select the correct algorithm for the file type."));
-            return;
         }
+        else {
+            QMessageBox::warning(this, tr("Warning"),
+                tr("The selected file does not appear to be compressed by this tool. "
+                    "Please select a .rle, .huff, .hctx or .cta file for decompression."));
+        }
+        return;
+    }
+    if (unknown + mismatched > 0) {
+        QMessageBox::warning(this, tr("Warning"),
+            tr("%1 of the selected files were not compressed by this tool or don't match the selected algorithm "
+                "and will be skipped.").arg(unknown + mismatched));
+    }
 
-        status_label_->setText(tr("Decompressing..."));
-  
-        FileHeader header = FileHeader::read(input_file);
-        
-        auto output_path = original_file_path_.parent_path() / (original_file_path_.stem().string() + header.original_extension_);
+    StartBatch(input_files, BatchOperation::Decompress);
+}
 
-        progress_bar_->setValue(0);
-        progress_bar_->setVisible(true);
-        compress_button_->setEnabled(false);
-        decompress_button_->setEnabled(false);
-        algorithm_selector_->setEnabled(false);
+void CompressionTool::StartBatch(const QStringList& input_files, BatchOperation operation) {
+    // A new batch starts with an empty list, files queued while one runs join it.
+    if (!batch_running_) {
+        job_list_->clear();
+        job_items_.clear();
+        batch_failures_.clear();
+        BeginOperation(operation == BatchOperation::Compress ? tr("Compressing...") : tr("Decompressing..."));
+    }
 
-        QMetaObject::invokeMethod(worker_, "decompress", Qt::QueuedConnection,
-            Q_ARG(QString, QString::fromStdString(original_file_path_.string())),
-            Q_ARG(QString, QString::fromStdString(output_path.string())),
-            Q_ARG(CompressionWorker::AlgorithmType, selected_algorithm_));
+    for (const auto& input_file : input_files) {
+        auto* item = new QListWidgetItem(tr("%1 - queued").arg(QFileInfo(input_file).fileName()), job_list_);
+        job_items_.insert(input_file, item);
+    }
+    batch_running_ = true;
+
+    // Compress and Decompress stay available to queue more files. Verify and Archive
+    // would share the progress bar, so they wait for the batch.
+    compress_button_->setEnabled(true);
+    decompress_button_->setEnabled(true);
+
+    QMetaObject::invokeMethod(worker_, "enqueue", Qt::QueuedConnection,
+        Q_ARG(QStringList, input_files),
+        Q_ARG(BatchOperation, operation),
+        Q_ARG(CompressionWorker::AlgorithmType, selected_algorithm_));
+}
 
+void CompressionTool::VerifyFile() {
+    if (original_file_path_.empty()) {
+        QMessageBox::warning(this, tr("Warning"), tr("Please select a file to verify."));
+        return;
     }
-    catch (const std::exception& e) {
-        QMessageBox::critical(this, tr("Decompression Error"), tr(e.what()));
-        status_label_->setText(tr("Failed"));
-        status_reset_timer_->start(TIMER_RESET_DURATION);
+    if (selected_paths_.size() > 1) {
+        QMessageBox::warning(this, tr("Warning"), tr("Please select a single file to verify."));
+        return;
+    }
+
+    QString file_extension = QString::fromStdString(original_file_path_.extension().string()).toLower();
+
+    if (!IsCompressedExtension(file_extension)) {
+        QMessageBox::warning(this, tr("Warning"),
+            tr("The selected file does not appear to be compressed by this tool. "
+                "Please select a .rle, .huff or .hctx file for verification."));
         return;
     }
+
+    if (!IsAlgorithmMatchingExtension(file_extension)) {
+        QMessageBox::warning(this, tr("Warning"),
+            tr("The selected algorithm does not match the file extension. "
+                "Please select the correct algorithm for the file type."));
+        return;
+    }
+
+    BeginOperation(tr("Verifying..."));
+
+    // The worker reports unreadable or corrupt files through its error signal.
+    QMetaObject::invokeMethod(worker_, "verify", Qt::QueuedConnection,
+        Q_ARG(QString, QString::fromStdString(original_file_path_.string())),
+        Q_ARG(CompressionWorker::AlgorithmType, selected_algorithm_));
+}
+
+void CompressionTool::ArchiveFolder() {
+    QString dir_path = QFileDialog::getExistingDirectory(this, tr("Select Folder to Archive"), QString());
+    if (dir_path.isEmpty()) {
+        return;
+    }
+
+    auto source_dir = std::filesystem::path(dir_path.toStdString());
+    if (!source_dir.has_filename()) {
+        source_dir = source_dir.parent_path();
+    }
+    auto output_path = source_dir.parent_path() / (source_dir.filename().string() + ".cta");
+
+    BeginOperation(tr("Archiving..."));
+
+    QMetaObject::invokeMethod(worker_, "archive", Qt::QueuedConnection,
+        Q_ARG(QString, QString::fromStdString(source_dir.string())),
+        Q_ARG(QString, QString::fromStdString(output_path.string())),
+        Q_ARG(CompressionWorker::AlgorithmType, selected_algorithm_));
 }
 
 void CompressionTool::ResetStatusLabel() {
     status_label_->setText(tr("Ready"));
 }
+
+void CompressionTool::BeginOperation(const QString& status) {
+    // Clear a cancel or pause left over from the previous operation before queuing the next.
+    worker_->ResetControl();
+    paused_ = false;
+    pause_button_->setText(tr("Pause"));
+
+    operation_status_ = status;
+    status_label_->setText(status);
+    progress_bar_->setValue(0);
+    progress_bar_->setFormat(tr("%p%"));
+    progress_bar_->setVisible(true);
+    pause_button_->setVisible(true);
+    cancel_button_->setVisible(true);
+    pause_button_->setEnabled(true);
+    cancel_button_->setEnabled(true);
+    compress_button_->setEnabled(false);
+    decompress_button_->setEnabled(false);
+    verify_button_->setEnabled(false);
+    archive_button_->setEnabled(false);
+    algorithm_selector_->setEnabled(false);
+    level_selector_->setEnabled(false);
+}
+
 void CompressionTool::ResetUIAfterOperation() {
     progress_bar_->setVisible(false);
+    pause_button_->setVisible(false);
+    cancel_button_->setVisible(false);
     compress_button_->setEnabled(true);
     decompress_button_->setEnabled(true);
+    verify_button_->setEnabled(true);
+    archive_button_->setEnabled(true);
     algorithm_selector_->setEnabled(true);
+    level_selector_->setEnabled(true);
 }
 
 void CompressionTool::OnCompressionCompleted() {
@@ -371,14 +577,110 @@ void CompressionTool::OnCompressionCompleted() {
     ResetUIAfterOperation();
 }
 
-void CompressionTool::UpdateProgress(int percentage) {
-    progress_bar_->setValue(percentage);
+void CompressionTool::OnVerificationCompleted(qint64 decompressed_size, double megabytes_per_second, bool checksums_verified) {
+    // Legacy files carry no checksums, so say what was actually checked.
+    QString status = checksums_verified ? tr("Verified") : tr("Decoded (no checksums)");
+    status_label_->setText(tr("%1: %2 MB at %3 MB/s")
+        .arg(status)
+        .arg(decompressed_size / 1e6, 0, 'f', 1)
+        .arg(megabytes_per_second, 0, 'f', 0));
+    status_reset_timer_->start(TIMER_RESET_DURATION);
+    ResetUIAfterOperation();
+}
+
+void CompressionTool::UpdateProgress(const ProgressReport& report) {
+    progress_bar_->setValue(report.percentage());
+
+    // "%p%" is filled in by the progress bar itself.
+    QString format = tr("%p%");
+    if (report.megabytes_per_second() > 0) {
+        format += tr("  -  %1 MB/s").arg(report.megabytes_per_second(), 0, 'f', 0);
+    }
+    if (auto eta = report.eta_seconds()) {
+        int seconds = static_cast<int>(*eta + 0.5);
+        format += tr("  -  %1:%2 left").arg(seconds / 60).arg(seconds % 60, 2, 10, QChar('0'));
+    }
+    progress_bar_->setFormat(format);
 }
 
 void CompressionTool::OnCompressionError(const QString& errorMessage) {
     QMessageBox::critical(this, tr("Operation Failed"), errorMessage);
     status_label_->setText(tr("Operation Failed"));
     status_reset_timer_->start(TIMER_RESET_DURATION);
+    batch_running_ = false;
+    ResetUIAfterOperation();
+}
+
+void CompressionTool::CancelOperation() {
+    // The worker's event loop is busy with the operation, so it is told directly.
+    worker_->Cancel();
+    status_label_->setText(tr("Cancelling..."));
+    pause_button_->setEnabled(false);
+    cancel_button_->setEnabled(false);
+
+    // Files queued now would only be cancelled too.
+    compress_button_->setEnabled(false);
+    decompress_button_->setEnabled(false);
+}
+
+void CompressionTool::TogglePause() {
+    paused_ = !paused_;
+    if (paused_) {
+        worker_->Pause();
+        pause_button_->setText(tr("Resume"));
+        status_label_->setText(tr("Paused"));
+    }
+    else {
+        worker_->Resume();
+        pause_button_->setText(tr("Pause"));
+        status_label_->setText(operation_status_);
+    }
+}
+
+void CompressionTool::OnOperationCancelled() {
+    status_label_->setText(tr("Cancelled"));
+    status_reset_timer_->start(TIMER_RESET_DURATION);
+    batch_running_ = false;
+    ResetUIAfterOperation();
+}
+
+void CompressionTool::OnJobCancelled(const QString& input_file) {
+    if (auto* item = job_items_.value(input_file)) {
+        item->setText(tr("%1 - cancelled").arg(QFileInfo(input_file).fileName()));
+    }
+}
+
+void CompressionTool::OnJobProgressUpdated(const QString& input_file, int percentage) {
+    if (auto* item = job_items_.value(input_file)) {
+        item->setText(tr("%1 - %2%").arg(QFileInfo(input_file).fileName()).arg(percentage));
+    }
+}
+
+void CompressionTool::OnJobFinished(const QString& input_file, const QString& error_message) {
+    QString file_name = QFileInfo(input_file).fileName();
+    if (!error_message.isEmpty()) {
+        batch_failures_.append(tr("%1: %2").arg(file_name, error_message));
+    }
+    if (auto* item = job_items_.value(input_file)) {
+        item->setText(error_message.isEmpty() ? tr("%1 - done").arg(file_name) : tr("%1 - failed").arg(file_name));
+        item->setToolTip(error_message);
+    }
+}
+
+void CompressionTool::OnBatchCompleted(int succeeded, int failed, int cancelled) {
+    batch_running_ = false;
+
+    if (failed > 0) {
+        QMessageBox::warning(this, tr("Some Files Failed"), batch_failures_.join("\n"));
+        status_label_->setText(tr("%1 done, %2 failed").arg(succeeded).arg(failed));
+    }
+    else if (cancelled > 0) {
+        status_label_->setText(tr("%1 done, %2 cancelled").arg(succeeded).arg(cancelled));
+    }
+    else {
+        status_label_->setText(succeeded == 1 ? tr("Success") : tr("%1 files done").arg(succeeded));
+    }
+    status_reset_timer_->start(TIMER_RESET_DURATION);
     ResetUIAfterOperation();
 }
 
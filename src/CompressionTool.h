@@ -21,9 +21,15 @@
 #include <QtWidgets/QComboBox>
 #include <QtWidgets/QProgressBar>
 #include <QtWidgets/QStatusBar>
+#include <QtWidgets/QListWidget>
+#include <QDragEnterEvent>
+#include <QDropEvent>
+#include <QMimeData>
+#include <QHash>
 #include <QThread>
 #include <QTimer>
 #include <filesystem>
+#include <vector>
 #include "CompressionWorker.h"
 
 /**
@@ -31,9 +37,10 @@
 * @brief Main window class for the compression tool.
 *
 * The CompressionTool class provides a GUI for compressing and decompressing files.
-* It allows the user to select a file, choose the compression algorithm, and view
-* the progress of the operation. Compression and decompression tasks are handled
-* by the CompressionWorker, which runs on a separate thread.
+* It allows the user to select or drop files and folders, choose the compression
+* algorithm, and view the progress of every file and of the whole batch. Compression
+* and decompression tasks are handled by the CompressionWorker, which runs on a
+* separate thread.
 */
 class CompressionTool : public QMainWindow
 {
@@ -60,31 +67,59 @@ public:
     */
     ~CompressionTool() override;
 
+protected:
+
+    /**
+    * @brief Accepts drags that carry files or folders.
+    */
+    void dragEnterEvent(QDragEnterEvent* event) override;
+
+    /**
+    * @brief Selects the dropped files, expanding folders into the files they contain.
+    */
+    void dropEvent(QDropEvent* event) override;
+
 private slots:
     /**
-    * @brief Opens a file selection dialog to choose a file for compression/decompression.
+    * @brief Opens a file selection dialog to choose files for compression/decompression.
     *
-    * The selected file path is displayed in the file input field, and stored for later use
+    * The selected files are displayed in the file input field, and stored for later use
     * during compression or decompression.
     */
     void SelectFile();
 
     /**
-    * @brief Compresses the selected file using the chosen algorithm.
+    * @brief Compresses the selected files using the chosen algorithm.
     *
-    * Handles the file compression process, checks for valid input, and invokes the
-    * compression task on the worker thread. Updates the UI with progress information.
+    * Skips empty and already compressed files and queues the rest as a batch on the
+    * worker. Can be used again while a batch runs to add more files to it.
     */
     void CompressFile();
 
     /**
-    * @brief Decompresses the selected file using the chosen algorithm.
+    * @brief Decompresses the selected files using the chosen algorithm.
     *
-    * Handles the file decompression process, checks for valid input, and invokes the
-    * decompression task on the worker thread. Also updates the UI with progress information.
+    * A single archive is extracted into a folder. Otherwise the compressed files that
+    * match the chosen algorithm are queued as a batch on the worker.
     */
     void DecompressFile();
 
+    /**
+    * @brief Verifies the selected compressed file without decompressing it to disk.
+    *
+    * Checks the file the same way as DecompressFile, then invokes the verification
+    * task on the worker thread.
+    */
+    void VerifyFile();
+
+    /**
+    * @brief Packs a directory chosen by the user into a single archive.
+    *
+    * Opens a directory selection dialog and invokes the archive task on the worker
+    * thread. The archive is written next to the directory with the .cta extension.
+    */
+    void ArchiveFolder();
+
     /**
     * @brief Changes the selected compression algorithm based on user selection.
     *
@@ -95,6 +130,13 @@ private slots:
     */
     void OnAlgorithmChanged(int index);
 
+    /**
+    * @brief Passes the selected compression level to the worker.
+    *
+    * @param index: The index of the selected level in the dropdown, 0 for the fastest level.
+    */
+    void OnLevelChanged(int index);
+
 
     /**
     * @brief Displays an informational dialog about the program.
@@ -107,9 +149,12 @@ private slots:
     /**
     * @brief Updates the progress bar as the compression or decompression operation proceeds.
     *
-    * @param percentage: The progress percentage (0-100) of the ongoing operation.
+    * Shows the percentage together with the throughput and, once it can be estimated,
+    * the remaining time.
+    *
+    * @param report: The progress of the ongoing operation.
     */
-    void UpdateProgress(int percentage);
+    void UpdateProgress(const ProgressReport& report);
 
     /**
     * @brief Slot triggered when the compression or decompression operation is completed.
@@ -118,6 +163,17 @@ private slots:
     */
     void OnCompressionCompleted();
 
+    /**
+    * @brief Slot triggered when a file passes verification.
+    *
+    * Resets the UI and shows the decompressed size and decoding throughput.
+    *
+    * @param decompressed_size: Number of bytes the file decodes to.
+    * @param megabytes_per_second: Decoding throughput.
+    * @param checksums_verified: Whether the file's checksums were checked.
+    */
+    void OnVerificationCompleted(qint64 decompressed_size, double megabytes_per_second, bool checksums_verified);
+
     /**
     * @brief Slot triggered when an error occurs during compression or decompression.
     *
@@ -127,6 +183,57 @@ private slots:
     */
     void OnCompressionError(const QString& errorMessage);
 
+    /**
+    * @brief Cancels the running operation and every queued file.
+    *
+    * The worker stops at the next block and removes the partial outputs.
+    */
+    void CancelOperation();
+
+    /**
+    * @brief Pauses the running operation, or resumes it if it is paused.
+    */
+    void TogglePause();
+
+    /**
+    * @brief Slot triggered when the worker has stopped a cancelled operation.
+    */
+    void OnOperationCancelled();
+
+    /**
+    * @brief Marks a file of the batch as cancelled in the job list.
+    *
+    * @param input_file: The file that was cancelled.
+    */
+    void OnJobCancelled(const QString& input_file);
+
+    /**
+    * @brief Shows the progress of one file of the batch in the job list.
+    *
+    * @param input_file: The file being processed.
+    * @param percentage: Its progress (0-100).
+    */
+    void OnJobProgressUpdated(const QString& input_file, int percentage);
+
+    /**
+    * @brief Marks a file of the batch as done or failed in the job list.
+    *
+    * @param input_file: The file that finished.
+    * @param error_message: Why it failed, empty on success.
+    */
+    void OnJobFinished(const QString& input_file, const QString& error_message);
+
+    /**
+    * @brief Slot triggered when every file of the batch has finished.
+    *
+    * Resets the UI and reports the files that failed, if any.
+    *
+    * @param succeeded: Number of files processed successfully.
+    * @param failed: Number of files that failed.
+    * @param cancelled: Number of files that were cancelled.
+    */
+    void OnBatchCompleted(int succeeded, int failed, int cancelled);
+
 
 private:
 
@@ -164,10 +271,54 @@ private:
     */
     void ResetStatusLabel();
 
+    /**
+    * @brief Disables the controls that start operations and shows the progress and operation controls.
+    *
+    * @param status: The status message describing the operation.
+    */
+    void BeginOperation(const QString& status);
+
+    /**
+    * @brief Checks that a compressed file's extension agrees with the selected algorithm.
+    *
+    * @param file_extension: The lowercase extension of the selected file.
+    * @return: true if they match, or if the algorithm is Automatic.
+    */
+    bool IsAlgorithmMatchingExtension(const QString& file_extension) const;
+
+    /**
+    * @brief Checks whether an extension is one this tool gives compressed files.
+    *
+    * @param file_extension: The lowercase extension of the file.
+    */
+    static bool IsCompressedExtension(const QString& file_extension);
+
+    /**
+    * @brief Stores the selected files and shows them in the file input field.
+    *
+    * @param paths: The selected files.
+    */
+    void SetSelectedPaths(const std::vector<std::filesystem::path>& paths);
+
+    /**
+    * @brief Adds files to the job list and queues them on the worker.
+    *
+    * @param input_files: The files to process.
+    * @param operation: Whether to compress or decompress them.
+    */
+    void StartBatch(const QStringList& input_files, BatchOperation operation);
+
     // Default to RLE (because its where the selector starts by default)
     CompressionWorker::AlgorithmType selected_algorithm_ = CompressionWorker::AlgorithmType::RLE;
    
-    std::filesystem::path original_file_path_;             ///< The path of the selected file for compression or decompression.
+    std::filesystem::path original_file_path_;             ///< The first selected file, the one Verify and Extract work on.
+    std::vector<std::filesystem::path> selected_paths_;    ///< All selected files.
+
+    QHash<QString, QListWidgetItem*> job_items_;           ///< Job list rows by input file.
+    QStringList batch_failures_;                           ///< Failed files of the running batch and why.
+    bool batch_running_ = false;                           ///< Whether files added now join a running batch.
+    bool paused_ = false;                                  ///< Whether the running operation is paused.
+    QString operation_status_;                             ///< Status shown again when a paused operation resumes.
 
 
     QLineEdit* file_input_;
@@ -175,10 +326,16 @@ private:
     QPushButton* select_file_button_;
     QPushButton* compress_button_;
     QPushButton* decompress_button_;
+    QPushButton* verify_button_;
+    QPushButton* archive_button_;
     QComboBox* algorithm_selector_;
+    QComboBox* level_selector_;                            ///< Compression level, from fastest to smallest output.
     QStatusBar* status_bar_;
     QPushButton* info_button_;
     QProgressBar* progress_bar_;
+    QPushButton* pause_button_;
+    QPushButton* cancel_button_;
+    QListWidget* job_list_;
     QTimer* status_reset_timer_;
 
     QThread worker_thread_;                                ///< Thread for running the CompressionWorker.
@@ -188,6 +345,6 @@ private:
 
     // Constants for window and timer configuration
     static constexpr int WINDOW_WIDTH = 300;              ///< Width of the main window.
-    static constexpr int WINDOW_HEIGHT = 250;             ///< Height of the main window.
+    static constexpr int WINDOW_HEIGHT = 510;             ///< Height of the main window.
     static constexpr int TIMER_RESET_DURATION = 3000;     ///< Duration (in ms) before resetting the status label.
 };
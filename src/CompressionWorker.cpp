@@ -1,54 +1,93 @@
 #include "CompressionWorker.h"
-#include "EncodingAlgorithms.h"
+#include "Archive.h"
+#include "CodecSelector.h"
+#include "CompressionEngine.h"
 #include "CompressionExceptions.h" 
+#include "DirectFileBuffer.h"
+#include "PartialOutputGuard.h"
+#include "ProgressReporter.h"
 #include "fstream"
 #include <qfileinfo.h>
 
 
-CompressionWorker::CompressionWorker(QObject* parent) 
-	: QObject(parent) 
-{}
+CompressionWorker::CompressionWorker(QObject* parent, const EncodingAlgorithms::CodecSettings& settings)
+	: QObject(parent), codec_settings_(settings), control_(std::make_shared<JobControl>())
+{
+	codec_settings_.control = control_;
+}
+
+CompressionWorker::~CompressionWorker() = default;
+
+void CompressionWorker::SetCodecSettings(const EncodingAlgorithms::CodecSettings& settings) {
+	codec_settings_ = settings;
+	codec_settings_.control = control_;
+}
+
+void CompressionWorker::setLevel(int level) {
+	codec_settings_.SetLevel(level);
+}
+
+void CompressionWorker::Cancel() {
+	control_->Cancel();
+}
+
+void CompressionWorker::Pause() {
+	control_->Pause();
+}
+
+void CompressionWorker::Resume() {
+	control_->Resume();
+}
+
+void CompressionWorker::ResetControl() {
+	control_->Reset();
+}
 
 void CompressionWorker::compress(const QString& input_file, const QString& output_file, AlgorithmType selected_algo) {
 	try {
 		input_path_ = std::filesystem::path(input_file.toStdString());
 		output_path_ = std::filesystem::path(output_file.toStdString());
 
-		std::ifstream input(input_path_, std::ios::binary);
-		std::ofstream output(output_path_, std::ios::binary);
+		auto settings = codec_settings_.ResolvedFor(input_path_);
+
+		// Depending on the I/O mode these may bypass or drop behind the page cache.
+		// The guard is declared first, so the output is closed before it is removed.
+		PartialOutputGuard partial_output;
+		auto input_stream = DirectFileBuffer::OpenInput(input_path_, settings);
+		auto output_stream = DirectFileBuffer::OpenOutput(output_path_, settings);
+		std::istream& input = *input_stream;
+		std::ostream& output = *output_stream;
 
 		if (!input || !output) {
 			throw FileOpenException((!input ? input_file : output_file).toStdString());
 		}
-		// Write metadata into file when encoding to determine original extension and algorithim used.
-		FileHeader header(CompressionWorker::GetMagicNumber(selected_algo), input_path_.extension().string());
-		WriteHeader(output, header);
-
-		qint64 total_size = QFileInfo(input_file).size();
-
-		switch (selected_algo) {
-		case AlgorithmType::RLE:
-			// Call RLE encode and update progress as it proceeds.
-			EncodingAlgorithms::RLECoding::encode(input, output, [this, total_size](std::int64_t processed_size) {
-				int progress = static_cast<int>((processed_size * 100) / total_size);
-				emit ProgressUpdated(progress);
-			});
+		partial_output.Guard(output_path_);
 
-			break;
-		case AlgorithmType::Huffman:
-			EncodingAlgorithms::HuffmanCoding::encode(input, output, [this, total_size](std::int64_t processed_size) {
-				int progress = static_cast<int>((processed_size * 100) / total_size);
-				emit ProgressUpdated(progress);
-			});
-			break;
-		default:
-			throw CompressionException("Unknown algorithm type");
+		auto total_size = static_cast<std::uint64_t>(QFileInfo(input_file).size());
+
+		// Sampling only reads a few windows of the input and leaves it where it was.
+		auto codec = GetCodecId(selected_algo);
+		if (!codec) {
+			codec = EncodingAlgorithms::CodecSelector::Select(input, settings);
 		}
 
+		// Call the encoder and report progress as it proceeds, a few times a second at most.
+		ProgressReporter reporter(total_size, [this](const ProgressReport& report) { emit ProgressUpdated(report); });
+		CompressionEngine::Compress(input, output, *codec, input_path_.extension().string(), settings,
+			[&reporter, &output](std::int64_t processed_size) {
+				auto bytes_in = static_cast<std::uint64_t>(processed_size);
+				reporter.Update(bytes_in, [&]() { return std::make_pair(bytes_in, ProgressReporter::Position(output)); });
+			});
+
 		// Ensure we always end at 100%
-		emit ProgressUpdated(100);
+		reporter.Finish(total_size, total_size, ProgressReporter::Position(output));
+		DirectFileBuffer::CloseOutput(output);
+		partial_output.Commit();
 		emit completed();
 	}
+	catch (const OperationCancelledException&) {
+		emit cancelled();
+	}
 	catch (const std::exception& e) {
 		emit error(QString::fromStdString(e.what()));
 	}
@@ -59,78 +98,249 @@ void CompressionWorker::decompress(const QString& input_file, const QString& out
 		input_path_ = std::filesystem::path(input_file.toStdString());
 		output_path_ = std::filesystem::path(output_file.toStdString());
 
-		std::ifstream input(input_path_, std::ios::binary);
-		std::ofstream output(output_path_, std::ios::binary);
+		auto settings = codec_settings_.ResolvedFor(input_path_);
 
-		// Early return if either file fails to open
-		if (!input || !output) {
-			throw FileOpenException((!input ? input_file : output_file).toStdString());
+		auto input_stream = DirectFileBuffer::OpenInput(input_path_, settings);
+		std::istream& input = *input_stream;
+
+		// Early return if the input fails to open, the engine creates the output itself.
+		if (!input) {
+			throw FileOpenException(input_file.toStdString());
 		}
 
-		// Read file header and validate magic number
-		FileHeader header = ReadHeader(input);
+		// The engine validates the header and checks the selected algorithm matches the file's.
+		FileHeader header = CompressionEngine::ReadHeader(input, GetCodecId(selected_algo));
 
+		// Blocks are decoded in parallel straight into the preallocated output file.
+		// The engine guards the output only once it has created it.
+		PartialOutputGuard partial_output;
+		ProgressReporter reporter(GetProgressTotal(header, input_file),
+			[this](const ProgressReport& report) { emit ProgressUpdated(report); });
+		CompressionEngine::DecompressToFile(input, header, output_path_, settings,
+			[&reporter, &header, &input](std::int64_t processed_size) {
+				auto processed = static_cast<std::uint64_t>(processed_size);
+				reporter.Update(processed, [&]() { return DecodedByteCounts(header, input, processed); });
+			}, &partial_output);
+		partial_output.Commit();
+
+		// Ensure we always end at 100%
+		auto compressed_size = static_cast<std::uint64_t>(QFileInfo(input_file).size());
+		auto decompressed_size = static_cast<std::uint64_t>(QFileInfo(output_file).size());
+		reporter.Finish(header.is_block_format() ? decompressed_size : compressed_size, compressed_size, decompressed_size);
+		emit completed();
+	}
+	catch (const OperationCancelledException&) {
+		emit cancelled();
+	}
+	catch (const std::exception& e) {
+		emit error(QString::fromStdString(e.what()));
+	}
+}
 
-		AlgorithmType file_algo;
+void CompressionWorker::enqueue(const QStringList& input_files, BatchOperation operation, AlgorithmType selected_algo) {
+	try {
+		// Totals start over with the first batch after the previous one has finished.
+		// Destroying the old queue joins its idle threads.
+		if (!batch_ || batch_->Progress().finished()) {
+			batch_.reset();
+			batch_ = std::make_unique<BatchQueue>(codec_settings_,
+				[this](size_t /*job*/, const BatchJobStatus& status, const BatchProgress& progress) {
+					// Called on the queue's threads, the connections to the UI are queued.
+					QString input_file = QString::fromStdString(status.input.string());
+					if (status.state == BatchJobState::Cancelled) {
+						emit JobCancelled(input_file);
+					}
+					else if (status.finished()) {
+						emit JobFinished(input_file, QString::fromStdString(status.error));
+					}
+					else {
+						emit JobProgressUpdated(input_file, status.percentage());
+					}
 
-		if (header.is_valid_magic_number(RLE_MAGIC_NUMBER)) {
-			file_algo = AlgorithmType::RLE;
+					emit ProgressUpdated(progress.progress);
+					if (progress.finished()) {
+						emit BatchCompleted(static_cast<int>(progress.completed), static_cast<int>(progress.failed),
+							static_cast<int>(progress.cancelled));
+					}
+				},
+				codec_settings_.threads);
 		}
-		else if (header.is_valid_magic_number(HUFFMAN_MAGIC_NUMBER)) {
-			file_algo = AlgorithmType::Huffman;
+
+		auto codec = GetCodecId(selected_algo);
+		for (const auto& input_file : input_files) {
+			BatchJob job;
+			job.operation = operation;
+			job.input = std::filesystem::path(input_file.toStdString());
+			job.codec = codec;
+			// The queue may have been created before the level last changed.
+			job.level = codec_settings_.level;
+			batch_->Add(std::move(job));
 		}
-		else {
-			throw InvalidHeaderException("Unknown compression file format");
+	}
+	catch (const std::exception& e) {
+		emit error(QString::fromStdString(e.what()));
+	}
+}
+
+void CompressionWorker::verify(const QString& input_file, AlgorithmType selected_algo) {
+	try {
+		input_path_ = std::filesystem::path(input_file.toStdString());
+
+		auto settings = codec_settings_.ResolvedFor(input_path_);
+
+		auto input_stream = DirectFileBuffer::OpenInput(input_path_, settings);
+		std::istream& input = *input_stream;
+		if (!input) {
+			throw FileOpenException(input_file.toStdString());
 		}
 
-		// Check if selected algorithm matches the file's algorithm
-		if (selected_algo != file_algo) {
-			throw InvalidHeaderException("Selected algorithm does not match the file's compression method");
+		FileHeader header = CompressionEngine::ReadHeader(input, GetCodecId(selected_algo));
+
+		ProgressReporter reporter(GetProgressTotal(header, input_file),
+			[this](const ProgressReport& report) { emit ProgressUpdated(report); });
+		auto result = CompressionEngine::Verify(input, header, settings,
+			[&reporter, &header, &input](std::int64_t processed_size) {
+				auto processed = static_cast<std::uint64_t>(processed_size);
+				reporter.Update(processed, [&]() { return DecodedByteCounts(header, input, processed); });
+			});
+
+		auto compressed_size = static_cast<std::uint64_t>(QFileInfo(input_file).size());
+		reporter.Finish(header.is_block_format() ? result.decompressed_size : compressed_size, compressed_size,
+			result.decompressed_size);
+		emit verified(static_cast<qint64>(result.decompressed_size), result.megabytes_per_second(), result.checksums_verified());
+	}
+	catch (const OperationCancelledException&) {
+		emit cancelled();
+	}
+	catch (const std::exception& e) {
+		emit error(QString::fromStdString(e.what()));
+	}
+}
+
+void CompressionWorker::archive(const QString& source_dir, const QString& output_file, AlgorithmType selected_algo) {
+	try {
+		input_path_ = std::filesystem::path(source_dir.toStdString());
+		output_path_ = std::filesystem::path(output_file.toStdString());
+
+		auto sources = Archive::ListSources(input_path_);
+		std::uint64_t total_size = 0;
+		for (const auto& source : sources) {
+			total_size += source.size;
 		}
 
-		qint64 total_size = QFileInfo(input_file).size();
-
-		switch (file_algo) {
-		case AlgorithmType::RLE:
-			EncodingAlgorithms::RLECoding::decode(input, output, [this, total_size](std::int64_t processed_size) {
-				int progress = static_cast<int>((processed_size * 100) / total_size);
-				emit ProgressUpdated(progress);
-				});
-			break;
-		case AlgorithmType::Huffman:
-			EncodingAlgorithms::HuffmanCoding::decode(input, output, [this, total_size](std::int64_t processed_size) {
-				int progress = static_cast<int>((processed_size * 100) / total_size);
-				emit ProgressUpdated(progress);
-				});
-			break;
+		// Archives are written through a regular stream, entries are appended from several threads.
+		PartialOutputGuard partial_output;
+		std::ofstream output(output_path_, std::ios::binary);
+		if (!output) {
+			throw FileOpenException(output_file.toStdString());
 		}
+		partial_output.Guard(output_path_);
 
-		// Ensure we always end at 100%
-		emit ProgressUpdated(100);
+		// Folders are mostly many small files, which compress far better together.
+		ArchiveOptions options;
+		options.solid = true;
+
+		// With Auto every entry (or solid group) gets the codec that suits its own data.
+		auto codec = GetCodecId(selected_algo);
+		options.auto_codec = !codec;
+
+		// Entries report while holding the archive's output lock, so its position can be read.
+		ProgressReporter reporter(total_size, [this](const ProgressReport& report) { emit ProgressUpdated(report); });
+		Archive::Create(sources, output, codec.value_or(EncodingAlgorithms::CodecId::Huffman), codec_settings_, options,
+			[&reporter, &output](std::int64_t processed_size) {
+				auto bytes_in = static_cast<std::uint64_t>(processed_size);
+				reporter.Update(bytes_in, [&]() { return std::make_pair(bytes_in, ProgressReporter::Position(output)); });
+			});
+
+		reporter.Finish(total_size, total_size, ProgressReporter::Position(output));
+		DirectFileBuffer::CloseOutput(output);
+		partial_output.Commit();
+		emit completed();
+	}
+	catch (const OperationCancelledException&) {
+		emit cancelled();
+	}
+	catch (const std::exception& e) {
+		emit error(QString::fromStdString(e.what()));
+	}
+}
+
+void CompressionWorker::extract(const QString& input_file, const QString& output_dir) {
+	try {
+		input_path_ = std::filesystem::path(input_file.toStdString());
+		output_path_ = std::filesystem::path(output_dir.toStdString());
+
+		// The directory is tiny and read again by ExtractAll, this only sizes the progress bar.
+		ArchiveDirectory directory;
+		{
+			std::ifstream input(input_path_, std::ios::binary);
+			if (!input) {
+				throw FileOpenException(input_file.toStdString());
+			}
+			directory = Archive::ReadDirectory(input);
+		}
+
+		std::uint64_t total_size = 0;
+		for (const auto& entry : directory.entries()) {
+			total_size += entry.original_size;
+		}
+
+		// A directory created for the archive is removed again if extraction stops, an existing one is left alone.
+		// Entries are read concurrently from several streams, so only the bytes written are counted.
+		PartialOutputGuard partial_output(std::filesystem::exists(output_path_) ? std::filesystem::path() : output_path_, true);
+		ProgressReporter reporter(total_size, [this](const ProgressReport& report) { emit ProgressUpdated(report); });
+		Archive::ExtractAll(input_path_, output_path_, codec_settings_,
+			[&reporter](std::int64_t processed_size) {
+				auto bytes_out = static_cast<std::uint64_t>(processed_size);
+				reporter.Update(bytes_out, [&]() { return std::make_pair(std::uint64_t{ 0 }, bytes_out); });
+			});
+		partial_output.Commit();
+
+		reporter.Finish(total_size, static_cast<std::uint64_t>(QFileInfo(input_file).size()), total_size);
 		emit completed();
 	}
+	catch (const OperationCancelledException&) {
+		emit cancelled();
+	}
 	catch (const std::exception& e) {
 		emit error(QString::fromStdString(e.what()));
 	}
 }
 
-FileHeader CompressionWorker::ReadHeader(std::ifstream& input_file) {
-	return FileHeader::read(input_file);
+std::uint64_t CompressionWorker::GetProgressTotal(const FileHeader& header, const QString& input_file) {
+	// Block-format files report decompressed bytes, so progress is measured against the
+	// original size. Legacy files report compressed bytes consumed instead. Files
+	// compressed from a pipe record no size, so they only report completion.
+	if (header.has_original_size()) {
+		return header.original_size_;
+	}
+	return header.is_block_format() ? 0 : static_cast<std::uint64_t>(QFileInfo(input_file).size());
 }
 
-void CompressionWorker::WriteHeader(std::ofstream& output_file, const FileHeader& header) {
-	header.write(output_file);
+std::pair<std::uint64_t, std::uint64_t> CompressionWorker::DecodedByteCounts(const FileHeader& header, std::istream& input,
+	std::uint64_t processed) {
+	// Legacy decoders report what they consumed and don't expose what they wrote.
+	if (header.is_block_format()) {
+		return { ProgressReporter::Position(input), processed };
+	}
+	return { processed, 0 };
 }
 
-std::array<char, FileHeader::MAGIC_NUMBER_SIZE> CompressionWorker::GetMagicNumber(AlgorithmType algo) {
+std::optional<EncodingAlgorithms::CodecId> CompressionWorker::GetCodecId(AlgorithmType algo) {
 	switch (algo) {
 	case AlgorithmType::RLE:
-		return RLE_MAGIC_NUMBER;
+		return EncodingAlgorithms::CodecId::RLE;
 
 	case AlgorithmType::Huffman:
-		return HUFFMAN_MAGIC_NUMBER;
+		return EncodingAlgorithms::CodecId::Huffman;
+
+	case AlgorithmType::ContextHuffman:
+		return EncodingAlgorithms::CodecId::ContextHuffman;
+
+	case AlgorithmType::Auto:
+		return std::nullopt;
 
 	default:
 		throw CompressionException("Unknown algorithm type");
 	}
-}
\ No newline at end of file
+}
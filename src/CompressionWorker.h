@@ -4,14 +4,28 @@
 // decompression tasks. It supports multiple algorithms, such as Run-Length Encoding (RLE)
 // and Huffman Coding. The worker runs in a separate thread to ensure that
 // the main GUI remains responsive during long-running compression or decompression operations.
+// Compress and decompress requests for many files are queued on a BatchQueue, which
+// runs them concurrently on its own pool and reports per-file and overall progress.
+//
+// The running operation blocks the worker's event loop, so Cancel, Pause and Resume
+// are plain thread-safe methods the GUI calls directly rather than queued slots.
 
 
 #pragma once
 
 #include <qobject.h>
 #include <qstring.h>
+#include <cstdint>
 #include <filesystem>
+#include <istream>
+#include <memory>
+#include <utility>
+#include "BatchQueue.h"
 #include "FileHeader.h"
+#include "CodecSettings.h"
+#include "EncodingAlgorithms.h"
+#include "JobControl.h"
+#include "ProgressReporter.h"
 
 
 /**
@@ -36,8 +50,47 @@ public:
 	* compression and decompression tasks.
 	*
 	* @param parent: Optional parent QObject
+	* @param settings: Runtime codec options applied to every job.
+	*/
+	CompressionWorker(QObject* parent = nullptr, const EncodingAlgorithms::CodecSettings& settings = {});
+
+	/**
+	* @brief Waits for queued batch jobs to finish.
+	*/
+	~CompressionWorker() override;
+
+	/**
+	* @brief Replaces the codec options used by subsequent jobs.
+	*
+	* Must be called before a job is queued, or from the worker's own thread.
+	*
+	* @param settings: Runtime codec options such as the buffer size or auto-tuning.
+	*/
+	void SetCodecSettings(const EncodingAlgorithms::CodecSettings& settings);
+
+	/**
+	* @brief Stops the running operation and every queued file at their next block.
+	*
+	* Thread-safe. Partial outputs are removed and cancelled() or JobCancelled() is emitted.
+	*/
+	void Cancel();
+
+	/**
+	* @brief Suspends the running operation and every queued file at their next block. Thread-safe.
+	*/
+	void Pause();
+
+	/**
+	* @brief Lets a paused operation continue. Thread-safe.
+	*/
+	void Resume();
+
+	/**
+	* @brief Clears a previous Cancel or Pause, called before starting a new operation.
+	*
+	* Must only be called while no operation is running.
 	*/
-	CompressionWorker(QObject* parent = nullptr);
+	void ResetControl();
 
 
 	/**
@@ -46,11 +99,22 @@ public:
 	*/
 	enum class AlgorithmType {
 		RLE,
-		Huffman
+		Huffman,
+		ContextHuffman,
+		Auto		///< Chosen per file from sampled statistics when compressing, read from the header otherwise.
 	};
 
 public slots:
 
+	/**
+	* @brief Sets the compression level of the operations queued after this call.
+	*
+	* Invoked through a queued connection, so it takes effect in order with the
+	* operations the GUI queues. Files already queued keep their level.
+	*
+	* @param level: EncodingAlgorithms::MIN_LEVEL (fastest) to MAX_LEVEL (smallest output).
+	*/
+	void setLevel(int level);
 
 	/**
 	* @brief Compresses a file using the selected algorithm.
@@ -78,14 +142,65 @@ public slots:
 	*/
 	void decompress(const QString& input_file, const QString& output_file, AlgorithmType selected_algo);
 
+	/**
+	* @brief Queues files to be compressed or decompressed concurrently.
+	*
+	* Jobs run on a pool sized to the hardware and can be queued while earlier ones
+	* are still running. Output files are named like those of compress and decompress
+	* and written next to their inputs. Each file reports JobProgressUpdated and
+	* JobFinished, the batch as a whole ProgressUpdated and finally BatchCompleted.
+	* A file that fails is reported through JobFinished and doesn't stop the others.
+	*
+	* @param input_files: Paths of the files to process.
+	* @param operation: Whether to compress or decompress them.
+	* @param selected_algo: The compression algorithm, or the one the files must use when decompressing.
+	*/
+	void enqueue(const QStringList& input_files, BatchOperation operation, AlgorithmType selected_algo);
+
+	/**
+	* @brief Verifies a compressed file without writing the decompressed data.
+	*
+	* Decodes every block in parallel, checks the stored checksums and original size,
+	* and emits verified() with the decoding throughput. Problems are reported through
+	* error() like any other failure.
+	*
+	* @param input_file: Path to the compressed file to verify.
+	* @param selected_algo: The algorithm the file is expected to be compressed with.
+	*/
+	void verify(const QString& input_file, AlgorithmType selected_algo);
+
+	/**
+	* @brief Packs a directory tree into a single archive.
+	*
+	* Files are compressed concurrently with the selected algorithm, small files
+	* together in solid groups, see Archive::Create.
+	* Progress is reported against the total size of the files.
+	*
+	* @param source_dir: Path to the directory to archive.
+	* @param output_file: Path to the archive to create.
+	* @param selected_algo: The compression algorithm used for every entry.
+	*/
+	void archive(const QString& source_dir, const QString& output_file, AlgorithmType selected_algo);
+
+	/**
+	* @brief Extracts every entry of an archive below a directory.
+	*
+	* @param input_file: Path to the archive.
+	* @param output_dir: Path to the directory to recreate the tree in.
+	*/
+	void extract(const QString& input_file, const QString& output_dir);
+
 signals:
 
 	/**
-	* @brief Signal emitted when the progress of compression or decompression is updated.
+	* @brief Signal emitted when the progress of an operation or batch is updated.
+	*
+	* Reports are coalesced by ProgressReporter to whole-percent steps at most every
+	* 50 ms, plus a final one at 100%.
 	*
-	* @param percentage: The current progress as a percentage (0-100).
+	* @param report: Percentage, bytes read and written, throughput and ETA.
 	*/
-	void ProgressUpdated(int percentage);
+	void ProgressUpdated(const ProgressReport& report);
 
 	/**
 	* @brief Signal emitted when the compression or decompression task is completed.
@@ -93,6 +208,15 @@ signals:
 	*/
 	void completed();
 
+	/**
+	* @brief Signal emitted instead of completed() when a file passes verification.
+	*
+	* @param decompressed_size: Number of bytes the file decodes to.
+	* @param megabytes_per_second: Decoding throughput.
+	* @param checksums_verified: false for files without checksums, which could only be decoded.
+	*/
+	void verified(qint64 decompressed_size, double megabytes_per_second, bool checksums_verified);
+
 	/**
 	* @brief Signal emitted when an error occurs during compression or decompression.
 	*
@@ -100,45 +224,77 @@ signals:
 	*/
 	void error(const QString& message);
 
-private:
+	/**
+	* @brief Signal emitted instead of completed() or error() when the operation was cancelled.
+	*/
+	void cancelled();
 
 	/**
-	* @brief Reads the header of a compressed file to retrieve metadata.
+	* @brief Signal emitted when the progress of a queued file changes.
 	*
-	* This function reads the header from the input file to extract the metadata
+	* @param input_file: The file as passed to enqueue.
+	* @param percentage: The file's progress (0-100).
+	*/
+	void JobProgressUpdated(const QString& input_file, int percentage);
+
+	/**
+	* @brief Signal emitted when a queued file has been processed.
 	*
-	* @param input_file: The input file stream from which to read the header.
-	* @return: A FileHeader object storing the metadata.
+	* @param input_file: The file as passed to enqueue.
+	* @param error_message: Why it failed, or an empty string if it succeeded.
 	*/
-	static FileHeader ReadHeader(std::ifstream& input_file);
+	void JobFinished(const QString& input_file, const QString& error_message);
 
 	/**
-	* @brief Writes the header to the output file during compression.
+	* @brief Signal emitted when a queued file was cancelled before it finished.
 	*
-	* This function writes metadata to the output file.
+	* @param input_file: The file as passed to enqueue.
+	*/
+	void JobCancelled(const QString& input_file);
+
+	/**
+	* @brief Signal emitted when every queued file has been processed.
 	*
-	* @param output_file: The output file stream to which the header is written.
-	* @param header: The FileHeader object containing metadata to be written.
+	* @param succeeded: Number of files processed successfully.
+	* @param failed: Number of files that failed.
+	* @param cancelled: Number of files that were cancelled.
 	*/
-	static void WriteHeader(std::ofstream& output_File, const FileHeader& header);
+	void BatchCompleted(int succeeded, int failed, int cancelled);
 
+private:
 
 	/**
-	* @brief Retrieves the magic number associated with the selected compression algorithm.
-	*
-	* This function returns a magic number that is written to
-	* the file header to indicate which compression algorithm was used.
+	* @brief Maps the GUI's algorithm selection to the codec identifier used by the engine.
 	*
 	* @param algo: The compression algorithm.
-	* @return: A 3-character array representing the magic number.
+	* @return: The matching codec identifier, or std::nullopt for AlgorithmType::Auto.
 	*/
-	static std::array<char, FileHeader::MAGIC_NUMBER_SIZE> GetMagicNumber(AlgorithmType algo);
+	static std::optional<EncodingAlgorithms::CodecId> GetCodecId(AlgorithmType algo);
+
+	/**
+	* @brief Determines what the engine's decompression progress values are measured against.
+	*
+	* @param header: The header of the file being decoded.
+	* @param input_file: Path to the compressed file.
+	* @return: The value that corresponds to 100%, or 0 if it is unknown.
+	*/
+	static std::uint64_t GetProgressTotal(const FileHeader& header, const QString& input_file);
+
+	/**
+	* @brief Returns the bytes read and written so far while decoding, for a ProgressReport.
+	*
+	* @param header: The header of the file being decoded.
+	* @param input: The compressed stream, read by the calling thread.
+	* @param processed: The value the engine reported.
+	* @return: The bytes read and the bytes written.
+	*/
+	static std::pair<std::uint64_t, std::uint64_t> DecodedByteCounts(const FileHeader& header, std::istream& input,
+		std::uint64_t processed);
 
 	std::filesystem::path input_path_;
 	std::filesystem::path output_path_;
-
-	// Magic numbers identifying the compression algorithm in the file header.
-	static constexpr std::array<char, FileHeader::MAGIC_NUMBER_SIZE> RLE_MAGIC_NUMBER = { 'R', 'L', 'E' };
-	static constexpr std::array<char, FileHeader::MAGIC_NUMBER_SIZE> HUFFMAN_MAGIC_NUMBER = { 'H', 'U', 'F' };
+	EncodingAlgorithms::CodecSettings codec_settings_;			///< Options handed to the codecs, resolved per job.
+	std::shared_ptr<JobControl> control_;						///< Shared by every operation through codec_settings_.
+	std::unique_ptr<BatchQueue> batch_;							///< Jobs queued through enqueue, replaced once all have finished.
 };
 
@@ -0,0 +1,451 @@
+#include "ContextHuffmanCoding.h"
+#include "BlockSplitter.h"
+#include "CompressionExceptions.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <utility>
+
+namespace EncodingAlgorithms {
+
+	namespace {
+
+		constexpr size_t BITMAP_SIZE = 256 / 8;
+
+		std::uint16_t ReverseBits(std::uint32_t code, int length) {
+			std::uint32_t reversed = 0;
+			for (int i = 0; i < length; ++i) {
+				reversed = (reversed << 1) | ((code >> i) & 1);
+			}
+			return static_cast<std::uint16_t>(reversed);
+		}
+
+		[[noreturn]] void ThrowCorrupt() {
+			throw CompressionException("Corrupt context Huffman block");
+		}
+
+	}
+
+	size_t ContextHuffmanCoding::Scratch::capacity() const {
+		return contexts_.capacity() * sizeof(Histogram) + clusters_.capacity() * sizeof(Histogram) +
+			kept_.capacity() * sizeof(Histogram) + costs_.capacity() * sizeof(costs_[0]) + occurring_.capacity() +
+			lengths_.capacity() * sizeof(CodeLengths) + codes_.capacity() * sizeof(codes_[0]) +
+			tables_.capacity() * sizeof(std::uint16_t);
+	}
+
+	void ContextHuffmanCoding::encode(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& output,
+		Scratch* scratch, int cluster_iterations) {
+
+		if (size == 0) {
+			return;
+		}
+		Scratch local;
+		Scratch& work = scratch ? *scratch : local;
+
+		// The first byte is coded in context 0, as if the block were preceded by a zero.
+		work.contexts_.assign(256, Histogram{});
+		std::uint8_t previous = 0;
+		for (size_t i = 0; i < size; ++i) {
+			++work.contexts_[previous][data[i]];
+			previous = data[i];
+		}
+
+		std::array<std::uint8_t, 256> context_map{};
+		ClusterContexts(work, size, context_map, cluster_iterations);
+		const auto& clusters = work.kept_;
+
+		auto& lengths = work.lengths_;
+		auto& codes = work.codes_;
+		lengths.resize(clusters.size());
+		codes.resize(clusters.size());
+		for (size_t i = 0; i < clusters.size(); ++i) {
+			lengths[i] = BuildCodeLengths(clusters[i]);
+			codes[i] = BuildCodes(lengths[i]);
+		}
+
+		output.push_back(static_cast<std::uint8_t>(clusters.size()));
+		if (clusters.size() > 1) {
+			output.insert(output.end(), context_map.begin(), context_map.end());
+		}
+
+		for (const auto& cluster_lengths : lengths) {
+			std::array<std::uint8_t, BITMAP_SIZE> bitmap{};
+			std::array<std::uint8_t, 256> present;
+			size_t present_count = 0;
+			for (size_t byte = 0; byte < cluster_lengths.size(); ++byte) {
+				if (cluster_lengths[byte] != 0) {
+					bitmap[byte / 8] |= static_cast<std::uint8_t>(1u << (byte % 8));
+					present[present_count++] = cluster_lengths[byte];
+				}
+			}
+			output.insert(output.end(), bitmap.begin(), bitmap.end());
+			for (size_t i = 0; i < present_count; i += 2) {
+				std::uint8_t high = i + 1 < present_count ? present[i + 1] : 0;
+				output.push_back(static_cast<std::uint8_t>(present[i] | (high << 4)));
+			}
+		}
+
+		// Codes are collected in a 64-bit accumulator and flushed 32 bits at a time.
+		std::uint64_t accumulator = 0;
+		int bit_count = 0;
+		previous = 0;
+		for (size_t i = 0; i < size; ++i) {
+			std::uint8_t cluster = context_map[previous];
+			std::uint8_t byte = data[i];
+			accumulator |= static_cast<std::uint64_t>(codes[cluster][byte]) << bit_count;
+			bit_count += lengths[cluster][byte];
+			if (bit_count >= 32) {
+				for (int b = 0; b < 4; ++b) {
+					output.push_back(static_cast<std::uint8_t>(accumulator >> (8 * b)));
+				}
+				accumulator >>= 32;
+				bit_count -= 32;
+			}
+			previous = byte;
+		}
+		for (; bit_count > 0; bit_count -= 8) {
+			output.push_back(static_cast<std::uint8_t>(accumulator));
+			accumulator >>= 8;
+		}
+	}
+
+	void ContextHuffmanCoding::decode(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& output,
+		size_t symbol_count, Scratch* scratch) {
+
+		if (symbol_count == 0) {
+			return;
+		}
+		Scratch local;
+		Scratch& work = scratch ? *scratch : local;
+
+		size_t position = 0;
+		auto require = [&](size_t count) {
+			if (size - position < count) {
+				ThrowCorrupt();
+			}
+		};
+
+		require(1);
+		size_t cluster_count = data[position++];
+		if (cluster_count == 0 || cluster_count > MAX_CLUSTERS) {
+			ThrowCorrupt();
+		}
+
+		std::array<std::uint8_t, 256> context_map{};
+		if (cluster_count > 1) {
+			require(context_map.size());
+			std::copy_n(data + position, context_map.size(), context_map.begin());
+			position += context_map.size();
+			for (auto cluster : context_map) {
+				if (cluster >= cluster_count) {
+					ThrowCorrupt();
+				}
+			}
+		}
+
+		// One lookup table per cluster, indexed by the next MAX_CODE_LENGTH bits. Each entry holds
+		// the byte and its code length, a length of 0 marks bit patterns no code starts with.
+		constexpr size_t TABLE_SIZE = size_t{ 1 } << MAX_CODE_LENGTH;
+		auto& tables = work.tables_;
+		tables.assign(cluster_count * TABLE_SIZE, 0);
+
+		for (size_t cluster = 0; cluster < cluster_count; ++cluster) {
+			require(BITMAP_SIZE);
+			const std::uint8_t* bitmap = data + position;
+			position += BITMAP_SIZE;
+
+			std::array<std::uint8_t, 256> present;
+			size_t present_count = 0;
+			for (size_t byte = 0; byte < 256; ++byte) {
+				if (bitmap[byte / 8] & (1u << (byte % 8))) {
+					present[present_count++] = static_cast<std::uint8_t>(byte);
+				}
+			}
+			if (present_count == 0) {
+				ThrowCorrupt();
+			}
+
+			require((present_count + 1) / 2);
+			CodeLengths lengths{};
+			std::uint32_t kraft_sum = 0;
+			for (size_t i = 0; i < present_count; ++i) {
+				std::uint8_t length = (data[position + i / 2] >> (4 * (i % 2))) & 0x0F;
+				if (length == 0 || length > MAX_CODE_LENGTH) {
+					ThrowCorrupt();
+				}
+				lengths[present[i]] = length;
+				kraft_sum += 1u << (MAX_CODE_LENGTH - length);
+			}
+			position += (present_count + 1) / 2;
+			if (kraft_sum > TABLE_SIZE) {
+				ThrowCorrupt();
+			}
+
+			auto codes = BuildCodes(lengths);
+			std::uint16_t* table = tables.data() + cluster * TABLE_SIZE;
+			for (size_t i = 0; i < present_count; ++i) {
+				std::uint8_t byte = present[i];
+				int length = lengths[byte];
+				auto entry = static_cast<std::uint16_t>(byte | (length << 8));
+				for (size_t fill = codes[byte]; fill < TABLE_SIZE; fill += size_t{ 1 } << length) {
+					table[fill] = entry;
+				}
+			}
+		}
+
+		size_t initial_size = output.size();
+		output.resize(initial_size + symbol_count);
+		std::uint8_t* out = output.data() + initial_size;
+
+		std::uint64_t accumulator = 0;
+		int bit_count = 0;
+		const std::uint16_t* table = tables.data() + context_map[0] * TABLE_SIZE;
+		for (size_t i = 0; i < symbol_count; ++i) {
+			if (bit_count < MAX_CODE_LENGTH) {
+				for (; bit_count <= 56 && position < size; bit_count += 8) {
+					accumulator |= static_cast<std::uint64_t>(data[position++]) << bit_count;
+				}
+			}
+
+			std::uint16_t entry = table[accumulator & (TABLE_SIZE - 1)];
+			int length = entry >> 8;
+			if (length == 0 || length > bit_count) {
+				ThrowCorrupt();
+			}
+			accumulator >>= length;
+			bit_count -= length;
+
+			auto byte = static_cast<std::uint8_t>(entry);
+			out[i] = byte;
+			table = tables.data() + context_map[byte] * TABLE_SIZE;
+		}
+	}
+
+	void ContextHuffmanCoding::ClusterContexts(Scratch& scratch, size_t size, std::array<std::uint8_t, 256>& context_map,
+		int iterations) {
+		const auto& contexts = scratch.contexts_;
+
+		// Seed the clusters with the most frequent contexts, there is one per BYTES_PER_CLUSTER bytes of block.
+		std::array<std::uint8_t, 256> used;
+		size_t used_count = 0;
+		std::array<std::uint64_t, 256> totals{};
+		for (size_t context = 0; context < contexts.size(); ++context) {
+			for (auto count : contexts[context]) {
+				totals[context] += count;
+			}
+			if (totals[context] != 0) {
+				used[used_count++] = static_cast<std::uint8_t>(context);
+			}
+		}
+		const auto used_end = used.begin() + used_count;
+		// Ties keep context order, like a stable sort, without the temporary buffer std::stable_sort allocates.
+		std::sort(used.begin(), used_end, [&totals](size_t a, size_t b) {
+			return totals[a] > totals[b] || (totals[a] == totals[b] && a < b);
+		});
+
+		size_t cluster_count = std::clamp<size_t>(size / BYTES_PER_CLUSTER, 1, MAX_CLUSTERS);
+		cluster_count = std::min(cluster_count, used_count);
+
+		auto& clusters = scratch.clusters_;
+		clusters.assign(cluster_count, Histogram{});
+		context_map.fill(0);
+		for (size_t i = 0; i < cluster_count; ++i) {
+			context_map[used[i]] = static_cast<std::uint8_t>(i);
+		}
+
+		// The bytes occurring in each context, so assignment only looks at those. They are stored
+		// one context after another, the bytes of context c are at [offsets[c], offsets[c + 1]).
+		auto& occurring = scratch.occurring_;
+		std::array<std::uint32_t, 257> offsets{};
+		occurring.clear();
+		for (size_t context = 0; context < contexts.size(); ++context) {
+			offsets[context] = static_cast<std::uint32_t>(occurring.size());
+			if (totals[context] != 0) {
+				for (size_t byte = 0; byte < 256; ++byte) {
+					if (contexts[context][byte] != 0) {
+						occurring.push_back(static_cast<std::uint8_t>(byte));
+					}
+				}
+			}
+		}
+		offsets[contexts.size()] = static_cast<std::uint32_t>(occurring.size());
+
+		auto accumulate = [&]() {
+			std::fill(clusters.begin(), clusters.end(), Histogram{});
+			for (auto it = used.begin(); it != used_end; ++it) {
+				size_t context = *it;
+				auto& cluster = clusters[context_map[context]];
+				for (size_t k = offsets[context]; k < offsets[context + 1]; ++k) {
+					cluster[occurring[k]] += contexts[context][occurring[k]];
+				}
+			}
+		};
+
+		if (cluster_count > 1) {
+			for (size_t i = 0; i < cluster_count; ++i) {
+				clusters[i] = contexts[used[i]];
+			}
+
+			// Move every context to the cluster that codes it in the fewest bits, then refit
+			// the clusters, until nothing moves. Unseen bytes get half a count so they aren't free.
+			// The entropy the moves minimize is not exactly what the Huffman codes cost, so a later
+			// round may code larger than an earlier one. The best round is kept, which makes sure
+			// more iterations never cost ratio.
+			auto& costs = scratch.costs_;
+			costs.resize(cluster_count);
+			std::array<std::uint8_t, 256> best_map = context_map;
+			double best_bits = std::numeric_limits<double>::infinity();
+			for (int iteration = 0; iteration < iterations; ++iteration) {
+				for (size_t i = 0; i < cluster_count; ++i) {
+					std::uint64_t total = 0;
+					for (auto count : clusters[i]) {
+						total += count;
+					}
+					for (size_t byte = 0; byte < 256; ++byte) {
+						costs[i][byte] = static_cast<float>(std::log2((static_cast<double>(total) + 128) /
+							(static_cast<double>(clusters[i][byte]) + 0.5)));
+					}
+				}
+
+				bool moved = false;
+				for (auto it = used.begin(); it != used_end; ++it) {
+					size_t context = *it;
+					size_t best = 0;
+					double best_cost = 0;
+					for (size_t i = 0; i < cluster_count; ++i) {
+						double cost = 0;
+						for (size_t k = offsets[context]; k < offsets[context + 1]; ++k) {
+							cost += contexts[context][occurring[k]] * costs[i][occurring[k]];
+						}
+						if (i == 0 || cost < best_cost) {
+							best = i;
+							best_cost = cost;
+						}
+					}
+					moved |= context_map[context] != best;
+					context_map[context] = static_cast<std::uint8_t>(best);
+				}
+
+				accumulate();
+				double bits = 0;
+				for (const auto& cluster : clusters) {
+					if (std::any_of(cluster.begin(), cluster.end(), [](std::uint32_t count) { return count != 0; })) {
+						bits += BlockSplitter::CodedBits(cluster);
+					}
+				}
+				if (bits < best_bits) {
+					best_bits = bits;
+					best_map = context_map;
+				}
+				if (!moved) {
+					break;
+				}
+			}
+			if (best_map != context_map) {
+				context_map = best_map;
+				accumulate();
+			}
+		}
+		else {
+			accumulate();
+		}
+
+		// Drop clusters no context ended up in, they would only cost table space.
+		std::array<std::uint8_t, MAX_CLUSTERS> renumbered{};
+		auto& kept = scratch.kept_;
+		kept.clear();
+		for (size_t i = 0; i < clusters.size(); ++i) {
+			bool empty = std::all_of(clusters[i].begin(), clusters[i].end(), [](std::uint32_t count) { return count == 0; });
+			if (!empty) {
+				renumbered[i] = static_cast<std::uint8_t>(kept.size());
+				kept.push_back(clusters[i]);
+			}
+		}
+		for (auto it = used.begin(); it != used_end; ++it) {
+			context_map[*it] = renumbered[context_map[*it]];
+		}
+	}
+
+	ContextHuffmanCoding::CodeLengths ContextHuffmanCoding::BuildCodeLengths(const Histogram& counts) {
+		CodeLengths lengths{};
+		std::array<std::uint64_t, 256> weights;
+		std::copy(counts.begin(), counts.end(), weights.begin());
+
+		std::array<std::uint8_t, 256> symbols;
+		size_t symbol_count = 0;
+		for (size_t byte = 0; byte < weights.size(); ++byte) {
+			if (weights[byte] != 0) {
+				symbols[symbol_count++] = static_cast<std::uint8_t>(byte);
+			}
+		}
+		if (symbol_count == 1) {
+			lengths[symbols[0]] = 1;
+			return lengths;
+		}
+
+		// Flattening the weights until the tree fits in MAX_CODE_LENGTH bits costs little ratio,
+		// and always ends because 256 equal weights give 8-bit codes. The queue is a heap in a
+		// fixed array, a tree of 256 leaves has at most 511 nodes.
+		using Item = std::pair<std::uint64_t, size_t>;
+		std::array<Item, 512> queue;
+		std::array<size_t, 512> parents;
+		const auto later = std::greater<Item>();
+		while (true) {
+			size_t queue_size = 0;
+			size_t node_count = symbol_count;
+			for (size_t i = 0; i < symbol_count; ++i) {
+				parents[i] = 0;
+				queue[queue_size++] = { weights[symbols[i]], i };
+				std::push_heap(queue.begin(), queue.begin() + queue_size, later);
+			}
+			while (queue_size > 1) {
+				std::pop_heap(queue.begin(), queue.begin() + queue_size--, later);
+				Item first = queue[queue_size];
+				std::pop_heap(queue.begin(), queue.begin() + queue_size--, later);
+				Item second = queue[queue_size];
+
+				size_t node = node_count++;
+				parents[node] = 0;
+				parents[first.second] = node;
+				parents[second.second] = node;
+				queue[queue_size++] = { first.first + second.first, node };
+				std::push_heap(queue.begin(), queue.begin() + queue_size, later);
+			}
+
+			size_t root = node_count - 1;
+			int max_length = 0;
+			for (size_t i = 0; i < symbol_count; ++i) {
+				int length = 0;
+				for (size_t node = i; node != root; node = parents[node]) {
+					++length;
+				}
+				lengths[symbols[i]] = static_cast<std::uint8_t>(length);
+				max_length = std::max(max_length, length);
+			}
+			if (max_length <= MAX_CODE_LENGTH) {
+				return lengths;
+			}
+
+			for (size_t i = 0; i < symbol_count; ++i) {
+				weights[symbols[i]] = (weights[symbols[i]] + 1) / 2;
+			}
+		}
+	}
+
+	std::array<std::uint16_t, 256> ContextHuffmanCoding::BuildCodes(const CodeLengths& lengths) {
+		std::array<std::uint16_t, 256> codes{};
+		std::uint32_t code = 0;
+		for (int length = 1; length <= MAX_CODE_LENGTH; ++length) {
+			for (size_t byte = 0; byte < lengths.size(); ++byte) {
+				if (lengths[byte] == length) {
+					codes[byte] = ReverseBits(code++, length);
+				}
+			}
+			code <<= 1;
+		}
+		return codes;
+	}
+
+}
@@ -0,0 +1,133 @@
+// ContextHuffmanCoding.h
+//
+// ContextHuffmanCoding is an order-1 variant of Huffman coding: every byte is
+// coded with a table chosen by the byte before it. Text and CSV data are far more
+// predictable from the previous byte (a letter after 'q', a digit after a digit)
+// than from overall frequencies, so this gets much closer to the ratio of
+// context-mixing and BWT compressors while still decoding one table lookup per byte.
+//
+// A table per context would cost up to 256 tables per block, so the contexts are
+// clustered: similar contexts share one table, and the number of clusters grows
+// with the block size. Tables are canonical and limited to MAX_CODE_LENGTH bits,
+// which keeps them compact to store (a presence bitmap plus a 4-bit length per
+// byte) and lets the decoder resolve every code with a single table lookup.
+//
+// The codec works on whole blocks in memory, so it is only available in the
+// block format. Block layout:
+//
+//   u8  cluster count
+//   u8  cluster of each of the 256 contexts   (only if there are several clusters)
+//   per cluster:
+//     32 bytes   bitmap of the bytes with a code
+//     4 bits     code length of each of those bytes, in byte order, padded to a byte
+//   bit stream of the codes, least significant bit first
+//
+// The number of bytes to decode is not stored, it comes from the block's frame.
+
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace EncodingAlgorithms {
+
+	/**
+	* @class ContextHuffmanCoding
+	* @brief Huffman coding with code tables selected by the previous byte.
+	*/
+	class ContextHuffmanCoding {
+	private:
+		using Histogram = std::array<std::uint32_t, 256>;
+		using CodeLengths = std::array<std::uint8_t, 256>;
+
+	public:
+
+		/**
+		* @class Scratch
+		* @brief Working memory of encode and decode. Kept across blocks, it is only allocated for the first one.
+		*/
+		class Scratch {
+		public:
+			/**
+			* @brief Number of bytes held by the working memory.
+			*/
+			size_t capacity() const;
+
+		private:
+			friend class ContextHuffmanCoding;
+
+			std::vector<Histogram> contexts_;						///< Byte histogram following each context.
+			std::vector<Histogram> clusters_;						///< Histograms of the clusters being fitted.
+			std::vector<Histogram> kept_;							///< Histograms of the clusters that are used.
+			std::vector<std::array<float, 256>> costs_;				///< Bits per byte of each cluster.
+			std::vector<std::uint8_t> occurring_;					///< Bytes occurring in each context, one context after another.
+			std::vector<CodeLengths> lengths_;						///< Code lengths of each cluster.
+			std::vector<std::array<std::uint16_t, 256>> codes_;	///< Codes of each cluster.
+			std::vector<std::uint16_t> tables_;						///< Decode tables of each cluster.
+		};
+
+		/**
+		* @brief Compresses a block.
+		*
+		* @param data: The block to compress.
+		* @param size: Number of bytes in data.
+		* @param output: Buffer the encoded block is appended to.
+		* @param scratch: Working memory to reuse, or nullptr to allocate it for this block.
+		* @param cluster_iterations: Rounds of refitting the tables to the contexts. More find better tables, slower.
+		*/
+		static void encode(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& output, Scratch* scratch = nullptr,
+			int cluster_iterations = CLUSTER_ITERATIONS);
+
+		/**
+		* @brief Decompresses a block written by encode.
+		*
+		* @param data: The encoded block.
+		* @param size: Number of bytes in data.
+		* @param output: Buffer the decoded bytes are appended to.
+		* @param symbol_count: Number of bytes the block decodes to.
+		* @param scratch: Working memory to reuse, or nullptr to allocate it for this block.
+		* @throws: CompressionException if the block is corrupt.
+		*/
+		static void decode(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& output, size_t symbol_count,
+			Scratch* scratch = nullptr);
+
+		static constexpr int MAX_CODE_LENGTH = 12;					///< Longest code, which sizes the decode tables.
+		static constexpr size_t MAX_CLUSTERS = 32;					///< Most tables stored in one block.
+		static constexpr size_t BYTES_PER_CLUSTER = 4 * 1024;		///< Block bytes needed to pay for each additional table.
+		static constexpr int CLUSTER_ITERATIONS = 4;				///< Default rounds of reassigning contexts to their closest cluster.
+		static constexpr size_t SCRATCH_SIZE = 1024 * 1024;			///< Upper bound of Scratch::capacity(), which depends on MAX_CLUSTERS, not the block size.
+
+	private:
+
+		/**
+		* @brief Groups contexts with similar byte distributions.
+		*
+		* @param scratch: Holds the byte histogram following each context, and receives the
+		* histogram of each cluster in kept_.
+		* @param size: Number of bytes in the block.
+		* @param context_map: Receives the cluster of each context.
+		* @param iterations: Most rounds of reassigning contexts and refitting the clusters.
+		*/
+		static void ClusterContexts(Scratch& scratch, size_t size, std::array<std::uint8_t, 256>& context_map, int iterations);
+
+		/**
+		* @brief Computes Huffman code lengths limited to MAX_CODE_LENGTH bits.
+		*
+		* @param counts: Frequency of every byte.
+		* @return: The code length of every byte, 0 for bytes that don't occur.
+		*/
+		static CodeLengths BuildCodeLengths(const Histogram& counts);
+
+		/**
+		* @brief Assigns canonical codes to code lengths, bit-reversed for the LSB-first bit stream.
+		*
+		* @param lengths: The code length of every byte.
+		* @return: The code of every byte.
+		*/
+		static std::array<std::uint16_t, 256> BuildCodes(const CodeLengths& lengths);
+	};
+
+}
@@ -0,0 +1,428 @@
+#include "DirectFileBuffer.h"
+#include "CompressionExceptions.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <new>
+#include <string>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+	// Offset passed to DropCacheBefore to drop everything up to the end of the file.
+	constexpr std::int64_t END_OF_FILE = std::numeric_limits<std::int64_t>::max();
+
+	// Thin wrappers so the buffer logic is shared between POSIX and the MSVC CRT.
+	// The CRT has no cache hints, so on Windows every mode behaves like DropBehind
+	// without the drop.
+
+	int OpenFile(const std::filesystem::path& path, bool writing, bool direct) {
+#ifdef _WIN32
+		(void)direct;
+		int flags = _O_BINARY | _O_SEQUENTIAL | (writing ? (_O_WRONLY | _O_CREAT | _O_TRUNC) : _O_RDONLY);
+		return _wopen(path.c_str(), flags, _S_IREAD | _S_IWRITE);
+#else
+		int flags = O_CLOEXEC | (writing ? (O_WRONLY | O_CREAT | O_TRUNC) : O_RDONLY);
+#ifdef O_DIRECT
+		if (direct) {
+			flags |= O_DIRECT;
+		}
+#else
+		(void)direct;
+#endif
+		return ::open(path.c_str(), flags, 0666);
+#endif
+	}
+
+	std::int64_t ReadFile(int fd, char* data, size_t size) {
+#ifdef _WIN32
+		return _read(fd, data, static_cast<unsigned int>(size));
+#else
+		ssize_t result;
+		do {
+			result = ::read(fd, data, size);
+		} while (result < 0 && errno == EINTR);
+		return result;
+#endif
+	}
+
+	bool WriteFile(int fd, const char* data, size_t size) {
+		while (size > 0) {
+#ifdef _WIN32
+			auto written = _write(fd, data, static_cast<unsigned int>(size));
+#else
+			auto written = ::write(fd, data, size);
+			if (written < 0 && errno == EINTR) {
+				continue;
+			}
+#endif
+			if (written <= 0) {
+				return false;
+			}
+			data += written;
+			size -= static_cast<size_t>(written);
+		}
+		return true;
+	}
+
+	std::int64_t SeekFile(int fd, std::int64_t offset, int whence) {
+#ifdef _WIN32
+		return _lseeki64(fd, offset, whence);
+#else
+		return ::lseek(fd, static_cast<off_t>(offset), whence);
+#endif
+	}
+
+	void CloseFile(int fd) {
+#ifdef _WIN32
+		_close(fd);
+#else
+		::close(fd);
+#endif
+	}
+
+	/**
+	* @brief A stream that owns the DirectFileBuffer it reads from or writes to.
+	*/
+	template <typename Stream>
+	class DirectFileStream : public Stream {
+	public:
+		DirectFileStream(const std::filesystem::path& path, std::ios::openmode mode,
+			EncodingAlgorithms::IoMode io_mode, size_t buffer_size)
+			: Stream(nullptr), buffer_(path, mode, io_mode, buffer_size) {
+
+			this->rdbuf(&buffer_);
+			if (!buffer_.is_open()) {
+				this->setstate(std::ios::failbit);
+			}
+		}
+
+	private:
+		DirectFileBuffer buffer_;
+	};
+
+}
+
+void DirectFileBuffer::AlignedDelete::operator()(char* ptr) const {
+	::operator delete[](ptr, std::align_val_t{ DIRECT_IO_ALIGNMENT });
+}
+
+DirectFileBuffer::DirectFileBuffer(const std::filesystem::path& path, std::ios::openmode mode,
+	EncodingAlgorithms::IoMode io_mode, size_t buffer_size)
+	: writing_((mode & std::ios::out) != 0), io_mode_(io_mode) {
+
+	// O_DIRECT requires the buffer address, file offsets and transfer sizes to be aligned.
+	capacity_ = std::max(buffer_size, DIRECT_IO_ALIGNMENT);
+	capacity_ = ((capacity_ + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT) * DIRECT_IO_ALIGNMENT;
+	buffer_.reset(static_cast<char*>(::operator new[](capacity_, std::align_val_t{ DIRECT_IO_ALIGNMENT })));
+
+	bool direct = io_mode_ == EncodingAlgorithms::IoMode::Direct;
+	fd_ = OpenFile(path, writing_, direct);
+
+	// Some filesystems (tmpfs, many network filesystems) reject O_DIRECT.
+	if (fd_ < 0 && direct) {
+		io_mode_ = EncodingAlgorithms::IoMode::DropBehind;
+		fd_ = OpenFile(path, writing_, false);
+	}
+	if (fd_ < 0) {
+		return;
+	}
+
+#if !defined(O_DIRECT) && defined(F_NOCACHE)
+	// macOS has no O_DIRECT, but F_NOCACHE gives the same cache bypass.
+	if (direct) {
+		fcntl(fd_, F_NOCACHE, 1);
+	}
+#endif
+
+#ifdef POSIX_FADV_SEQUENTIAL
+	if (!writing_) {
+		posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+	}
+#endif
+
+	if (writing_) {
+		setp(buffer_.get(), buffer_.get() + capacity_);
+	}
+	else {
+		setg(buffer_.get(), buffer_.get(), buffer_.get());
+	}
+}
+
+DirectFileBuffer::~DirectFileBuffer() {
+	close();
+}
+
+bool DirectFileBuffer::close() {
+	if (fd_ < 0) {
+		return true;
+	}
+
+	bool ok = true;
+	if (writing_) {
+		ok = FlushOutput(true);
+	}
+
+	// Whatever is left of the file in the cache is no longer needed.
+	DropCacheBefore(END_OF_FILE);
+
+	CloseFile(fd_);
+	fd_ = -1;
+	return ok;
+}
+
+DirectFileBuffer::int_type DirectFileBuffer::underflow() {
+	if (writing_ || fd_ < 0) {
+		return traits_type::eof();
+	}
+	if (gptr() < egptr()) {
+		return traits_type::to_int_type(*gptr());
+	}
+
+	// The next read starts right after the current buffer contents.
+	buffer_offset_ += egptr() - eback();
+
+	// Reading the full capacity keeps every O_DIRECT read aligned. A short read only
+	// happens at the end of the file.
+	size_t filled = 0;
+	while (filled < capacity_) {
+		auto result = ReadFile(fd_, buffer_.get() + filled, capacity_ - filled);
+		if (result == 0) {
+			break;
+		}
+		if (result < 0) {
+#ifdef O_DIRECT
+			// Some filesystems accept O_DIRECT at open but reject the reads, continue without it.
+			if (errno == EINVAL && io_mode_ == EncodingAlgorithms::IoMode::Direct) {
+				fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) & ~O_DIRECT);
+				io_mode_ = EncodingAlgorithms::IoMode::DropBehind;
+				continue;
+			}
+#endif
+			// Reported as the end of the file, a failed read would make the job compress a truncated
+			// copy. The stream catches this and sets badbit, which the callers check.
+			setg(buffer_.get(), buffer_.get(), buffer_.get());
+			throw std::ios_base::failure(std::string("Failed to read file: ") + std::strerror(errno));
+		}
+		filled += static_cast<size_t>(result);
+	}
+
+	setg(buffer_.get(), buffer_.get(), buffer_.get() + filled);
+
+	// Everything before this buffer has been consumed.
+	DropCacheBefore(buffer_offset_);
+
+	if (filled == 0) {
+		return traits_type::eof();
+	}
+	return traits_type::to_int_type(*gptr());
+}
+
+DirectFileBuffer::int_type DirectFileBuffer::overflow(int_type ch) {
+	if (!writing_ || fd_ < 0 || !FlushOutput(false)) {
+		return traits_type::eof();
+	}
+	if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+		*pptr() = traits_type::to_char_type(ch);
+		pbump(1);
+	}
+	return traits_type::not_eof(ch);
+}
+
+int DirectFileBuffer::sync() {
+	if (writing_ && fd_ >= 0) {
+		return FlushOutput(false) ? 0 : -1;
+	}
+	return 0;
+}
+
+DirectFileBuffer::pos_type DirectFileBuffer::seekoff(off_type off, std::ios::seekdir dir, std::ios::openmode which) {
+	if (fd_ < 0) {
+		return pos_type(off_type(-1));
+	}
+
+	if (writing_) {
+		// Output is strictly sequential, only report the current position.
+		if (off == 0 && dir == std::ios::cur) {
+			return pos_type(buffer_offset_ + (pptr() - pbase()));
+		}
+		return pos_type(off_type(-1));
+	}
+
+	std::int64_t target = off;
+	if (dir == std::ios::cur) {
+		target += buffer_offset_ + (gptr() - eback());
+	}
+	else if (dir == std::ios::end) {
+		auto size = SeekFile(fd_, 0, SEEK_END);
+		if (size < 0) {
+			return pos_type(off_type(-1));
+		}
+		target += size;
+		// Force the next read to reposition the file.
+		setg(buffer_.get(), buffer_.get(), buffer_.get());
+		buffer_offset_ = size;
+	}
+	return seekpos(pos_type(target), which);
+}
+
+DirectFileBuffer::pos_type DirectFileBuffer::seekpos(pos_type pos, std::ios::openmode /*which*/) {
+	std::int64_t target = pos;
+	if (writing_ || fd_ < 0 || target < 0) {
+		return pos_type(off_type(-1));
+	}
+
+	// Seeking within the current buffer needs no I/O.
+	std::int64_t buffered = egptr() - eback();
+	if (target >= buffer_offset_ && target <= buffer_offset_ + buffered) {
+		setg(eback(), eback() + (target - buffer_offset_), egptr());
+		return pos;
+	}
+
+	// Reposition to an aligned offset and skip forward within the first buffer.
+	std::int64_t aligned = target - target % static_cast<std::int64_t>(DIRECT_IO_ALIGNMENT);
+	if (SeekFile(fd_, aligned, SEEK_SET) != aligned) {
+		return pos_type(off_type(-1));
+	}
+	buffer_offset_ = aligned;
+	setg(buffer_.get(), buffer_.get(), buffer_.get());
+
+	// Rewinding means the pages will be read again, so they are eligible for dropping again.
+	dropped_until_ = std::min(dropped_until_, aligned);
+
+	if (target > aligned) {
+		if (traits_type::eq_int_type(underflow(), traits_type::eof()) || egptr() - eback() < target - aligned) {
+			return pos_type(off_type(-1));
+		}
+		gbump(static_cast<int>(target - aligned));
+	}
+	return pos;
+}
+
+bool DirectFileBuffer::FlushOutput(bool final) {
+	auto pending = static_cast<size_t>(pptr() - pbase());
+	size_t writable = pending;
+
+#ifdef O_DIRECT
+	if (io_mode_ == EncodingAlgorithms::IoMode::Direct) {
+		if (!final) {
+			// Keep the unaligned remainder buffered until more data arrives.
+			writable -= pending % DIRECT_IO_ALIGNMENT;
+		}
+		else if (pending % DIRECT_IO_ALIGNMENT != 0) {
+			// The tail of the file cannot be written with O_DIRECT, so turn it off for the last write.
+			fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) & ~O_DIRECT);
+		}
+	}
+#endif
+
+	if (writable > 0 && !WriteFile(fd_, pbase(), writable)) {
+#ifdef O_DIRECT
+		// Some filesystems accept O_DIRECT at open but reject the writes, continue without it
+		// from wherever the rejected write stopped.
+		bool rejected = errno == EINVAL && io_mode_ == EncodingAlgorithms::IoMode::Direct;
+		std::int64_t done = rejected ? SeekFile(fd_, 0, SEEK_CUR) - buffer_offset_ : -1;
+		if (done < 0 || static_cast<size_t>(done) > writable) {
+			return false;
+		}
+		fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) & ~O_DIRECT);
+		io_mode_ = EncodingAlgorithms::IoMode::DropBehind;
+		if (!WriteFile(fd_, pbase() + done, writable - static_cast<size_t>(done))) {
+			return false;
+		}
+#else
+		return false;
+#endif
+	}
+
+	// Move anything we couldn't write yet to the front of the buffer.
+	size_t remaining = pending - writable;
+	if (remaining > 0) {
+		std::memmove(buffer_.get(), pbase() + writable, remaining);
+	}
+	setp(buffer_.get(), buffer_.get() + capacity_);
+	pbump(static_cast<int>(remaining));
+
+	std::int64_t previous_offset = buffer_offset_;
+	buffer_offset_ += static_cast<std::int64_t>(writable);
+
+#ifdef SYNC_FILE_RANGE_WRITE
+	// Start writeback of what we just wrote now, so it is clean by the time it is dropped.
+	if (io_mode_ == EncodingAlgorithms::IoMode::DropBehind && writable > 0) {
+		sync_file_range(fd_, previous_offset, static_cast<off_t>(writable), SYNC_FILE_RANGE_WRITE);
+	}
+#endif
+
+	// Pages of the previous write have had a full buffer's worth of time to reach the disk.
+	DropCacheBefore(previous_offset);
+	return true;
+}
+
+void DirectFileBuffer::DropCacheBefore(std::int64_t offset) {
+	if (io_mode_ != EncodingAlgorithms::IoMode::DropBehind || fd_ < 0 || offset <= dropped_until_) {
+		return;
+	}
+
+	// A length of 0 means "to the end of the file".
+	std::int64_t length = offset == END_OF_FILE ? 0 : offset - dropped_until_;
+
+#ifdef SYNC_FILE_RANGE_WRITE
+	// Dirty pages can't be dropped, so wait for their writeback to finish first.
+	if (writing_) {
+		sync_file_range(fd_, dropped_until_, length,
+			SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+	}
+#endif
+
+#ifdef POSIX_FADV_DONTNEED
+	posix_fadvise(fd_, dropped_until_, length, POSIX_FADV_DONTNEED);
+#else
+	(void)length;
+#endif
+
+	dropped_until_ = offset;
+}
+
+std::unique_ptr<std::istream> DirectFileBuffer::OpenInput(const std::filesystem::path& path,
+	const EncodingAlgorithms::CodecSettings& settings) {
+
+	if (settings.io_mode == EncodingAlgorithms::IoMode::Buffered) {
+		return std::make_unique<std::ifstream>(path, std::ios::binary);
+	}
+	return std::make_unique<DirectFileStream<std::istream>>(path, std::ios::in, settings.io_mode, settings.buffer_size);
+}
+
+std::unique_ptr<std::ostream> DirectFileBuffer::OpenOutput(const std::filesystem::path& path,
+	const EncodingAlgorithms::CodecSettings& settings) {
+
+	if (settings.io_mode == EncodingAlgorithms::IoMode::Buffered) {
+		return std::make_unique<std::ofstream>(path, std::ios::binary);
+	}
+	return std::make_unique<DirectFileStream<std::ostream>>(path, std::ios::out, settings.io_mode, settings.buffer_size);
+}
+
+void DirectFileBuffer::CloseOutput(std::ostream& output) {
+	bool ok = static_cast<bool>(output.flush());
+	if (auto buffer = dynamic_cast<DirectFileBuffer*>(output.rdbuf())) {
+		ok = buffer->close() && ok;
+	}
+	else if (auto file = dynamic_cast<std::ofstream*>(&output)) {
+		file->close();
+		ok = !file->fail() && ok;
+	}
+	if (!ok) {
+		throw CompressionException("Failed to write output file");
+	}
+}
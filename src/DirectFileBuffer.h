@@ -0,0 +1,151 @@
+// DirectFileBuffer.h
+//
+// A std::streambuf over a raw file descriptor that keeps large compression jobs
+// from evicting other processes' data from the OS page cache.
+//
+// In DropBehind mode the buffer tells the kernel to discard pages once the read
+// cursor has moved past them, and starts writeback of written pages early so they
+// can be dropped as soon as they reach the disk (posix_fadvise + sync_file_range).
+// In Direct mode the file is opened with O_DIRECT (F_NOCACHE on macOS) and all I/O
+// goes through an aligned buffer, bypassing the cache entirely. Where a platform
+// or filesystem does not support a mode, the buffer falls back to the next
+// weaker one rather than failing.
+
+
+#pragma once
+
+#include "CodecSettings.h"
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+
+
+/**
+* @class DirectFileBuffer
+* @brief Stream buffer with page-cache-friendly sequential file I/O.
+*
+* The buffer is opened either for reading or for writing, never both. Reading
+* supports seeking (the Huffman encoder rewinds its input), writing is strictly
+* sequential.
+*/
+class DirectFileBuffer : public std::streambuf {
+public:
+
+	/**
+	* @brief Opens a file for page-cache-friendly I/O.
+	*
+	* @param path: The file to open. Output files are created or truncated.
+	* @param mode: std::ios::in to read the file or std::ios::out to write it.
+	* @param io_mode: The requested cache behaviour. Direct falls back to DropBehind if O_DIRECT is rejected.
+	* @param buffer_size: Size of the internal buffer, rounded up to DIRECT_IO_ALIGNMENT.
+	*/
+	DirectFileBuffer(const std::filesystem::path& path, std::ios::openmode mode,
+		EncodingAlgorithms::IoMode io_mode, size_t buffer_size);
+
+	/**
+	* @brief Flushes any pending output and closes the file.
+	*/
+	~DirectFileBuffer() override;
+
+	DirectFileBuffer(const DirectFileBuffer&) = delete;
+	DirectFileBuffer& operator=(const DirectFileBuffer&) = delete;
+
+	/**
+	* @brief Checks whether the file was opened successfully.
+	*
+	* @return: true if the underlying file descriptor is open.
+	*/
+	bool is_open() const { return fd_ >= 0; }
+
+	/**
+	* @brief Writes any pending output, drops the file from the cache and closes it.
+	*
+	* @return: true if all pending data was written and the file closed cleanly.
+	*/
+	bool close();
+
+	/**
+	* @brief The cache mode actually in effect after any fallback.
+	*/
+	EncodingAlgorithms::IoMode io_mode() const { return io_mode_; }
+
+	/**
+	* @brief Opens an input stream for a file according to the settings' I/O mode.
+	*
+	* Buffered mode returns a plain std::ifstream. The other modes return a stream
+	* backed by a DirectFileBuffer. Check the returned stream's state for open errors.
+	*
+	* @param path: The file to read.
+	* @param settings: Codec settings providing the I/O mode and buffer size.
+	* @return: An owning pointer to the opened stream.
+	*/
+	static std::unique_ptr<std::istream> OpenInput(const std::filesystem::path& path,
+		const EncodingAlgorithms::CodecSettings& settings);
+
+	/**
+	* @brief Opens an output stream for a file according to the settings' I/O mode.
+	*
+	* @param path: The file to create or truncate.
+	* @param settings: Codec settings providing the I/O mode and buffer size.
+	* @return: An owning pointer to the opened stream.
+	*/
+	static std::unique_ptr<std::ostream> OpenOutput(const std::filesystem::path& path,
+		const EncodingAlgorithms::CodecSettings& settings);
+
+	/**
+	* @brief Flushes and closes a stream returned by OpenOutput, or any std::ofstream.
+	*
+	* Direct mode writes the unaligned tail of the file only on close, and the destructors
+	* ignore errors, so jobs call this before they report their output as complete.
+	*
+	* @param output: The stream to close.
+	* @throws: CompressionException if the stream failed or its pending data could not be written.
+	*/
+	static void CloseOutput(std::ostream& output);
+
+	static constexpr size_t DIRECT_IO_ALIGNMENT = 4096;		///< Buffer, offset and length alignment for O_DIRECT.
+
+protected:
+	int_type underflow() override;
+	int_type overflow(int_type ch) override;
+	int sync() override;
+	pos_type seekoff(off_type off, std::ios::seekdir dir, std::ios::openmode which) override;
+	pos_type seekpos(pos_type pos, std::ios::openmode which) override;
+
+private:
+
+	/**
+	* @brief Writes the put area to the file.
+	*
+	* In Direct mode only whole aligned blocks are written unless this is the final
+	* flush, in which case O_DIRECT is switched off to write the unaligned tail.
+	*
+	* @param final: true when the file is being closed.
+	* @return: true if the write succeeded.
+	*/
+	bool FlushOutput(bool final);
+
+	/**
+	* @brief Drops cached pages of the file below the given offset.
+	*
+	* For output files the pages are first written back so that they can be dropped.
+	*
+	* @param offset: Pages before this file offset are no longer needed.
+	*/
+	void DropCacheBefore(std::int64_t offset);
+
+	struct AlignedDelete {
+		void operator()(char* ptr) const;
+	};
+
+	int fd_ = -1;
+	bool writing_ = false;
+	EncodingAlgorithms::IoMode io_mode_;
+	std::unique_ptr<char, AlignedDelete> buffer_;
+	size_t capacity_ = 0;
+	std::int64_t buffer_offset_ = 0;		///< File offset of the first byte in the buffer.
+	std::int64_t dropped_until_ = 0;		///< Cached pages below this offset have already been dropped.
+};
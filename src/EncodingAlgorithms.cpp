@@ -1,18 +1,358 @@
 #include "EncodingAlgorithms.h"
 #include "BitReader.h"
 #include "BitWriter.h"
+#include "StaticHuffmanTable.h"
+#include "CompressionExceptions.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <array>
 #include <queue>
 #include <iostream>
 #include <bitset>
 
 namespace EncodingAlgorithms {
 
+	namespace {
+
+		// Longest code the in-memory Huffman coder handles. Codes are built from at most
+		// MAX_BLOCK_SIZE bytes, which can't produce codes anywhere near this long.
+		constexpr int MAX_MEMORY_CODE_LENGTH = 56;
+
+		// Codes up to this length are decoded with one table lookup, longer ones finish bit by bit.
+		constexpr int LOOKUP_BITS = 11;
+
+		// A Huffman tree over 256 symbols has 255 internal nodes, tables needing more are corrupt.
+		constexpr size_t MAX_TREE_NODES = 256;
+
+		[[noreturn]] void ThrowCorruptHuffman() {
+			throw CompressionException("Corrupt Huffman block");
+		}
+
+		// Codes of every byte, most significant bit first. A length of 0 means the byte has no code.
+		struct CodeTable {
+			std::array<std::uint64_t, 256> codes{};
+			std::array<std::uint8_t, 256> lengths{};
+		};
+
+		// Writes codes most significant bit first into memory sized by the caller, like BitWriter.
+		class MemoryBitWriter {
+		public:
+			explicit MemoryBitWriter(std::uint8_t* output) : output_(output) {}
+
+			void Put(std::uint64_t value, int length) {
+				accumulator_ = (accumulator_ << length) | value;
+				bits_ += length;
+				while (bits_ >= 8) {
+					bits_ -= 8;
+					*output_++ = static_cast<std::uint8_t>(accumulator_ >> bits_);
+				}
+			}
+
+			// Pads the last byte with zero bits, like BitWriter::Flush.
+			void Flush() {
+				if (bits_ > 0) {
+					*output_++ = static_cast<std::uint8_t>(accumulator_ << (8 - bits_));
+					bits_ = 0;
+				}
+			}
+
+			// The bits of the last byte, padded like Flush pads them, for callers merging it with more bits.
+			std::uint8_t Pending() const {
+				return bits_ > 0 ? static_cast<std::uint8_t>(accumulator_ << (8 - bits_)) : 0;
+			}
+
+		private:
+			std::uint8_t* output_;
+			std::uint64_t accumulator_ = 0;
+			int bits_ = 0;
+		};
+
+		// Reads bits most significant bit first from memory, like BitReader.
+		class MemoryBitReader {
+		public:
+			MemoryBitReader(const std::uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+			// Returns the next length bits, zero-padded past the end. available receives how many are real.
+			std::uint64_t Peek(int length, int& available) {
+				if (bits_ < length) {
+					for (; bits_ <= 56 && position_ < size_; bits_ += 8) {
+						accumulator_ = (accumulator_ << 8) | data_[position_++];
+					}
+				}
+				available = std::min(bits_, length);
+				std::uint64_t mask = (std::uint64_t{ 1 } << length) - 1;
+				return (bits_ >= length ? accumulator_ >> (bits_ - length) : accumulator_ << (length - bits_)) & mask;
+			}
+
+			void Skip(int length) {
+				bits_ -= length;
+				consumed_ += static_cast<std::uint64_t>(length);
+			}
+
+			std::uint64_t Read(int length) {
+				int available = 0;
+				std::uint64_t value = Peek(length, available);
+				if (available < length) {
+					ThrowCorruptHuffman();
+				}
+				Skip(length);
+				return value;
+			}
+
+			std::uint64_t consumed() const { return consumed_; }
+			std::uint64_t remaining() const { return (size_ - position_) * 8 + static_cast<std::uint64_t>(bits_); }
+
+		private:
+			const std::uint8_t* data_;
+			size_t size_;
+			size_t position_ = 0;
+			std::uint64_t accumulator_ = 0;
+			int bits_ = 0;
+			std::uint64_t consumed_ = 0;
+		};
+
+		// Decodes a prefix code through a lookup table of the first LOOKUP_BITS bits and, for
+		// longer codes, the code tree below it. Everything lives in fixed-size arrays.
+		class HuffmanDecoder {
+		public:
+			explicit HuffmanDecoder(const CodeTable& table) {
+				int max_length = 0;
+				for (size_t byte = 0; byte < 256; ++byte) {
+					if (table.lengths[byte] != 0) {
+						Insert(static_cast<std::uint8_t>(byte), table.codes[byte], table.lengths[byte]);
+						max_length = std::max<int>(max_length, table.lengths[byte]);
+					}
+				}
+
+				// Small alphabets get a small table, which matters for short blocks.
+				lookup_bits_ = std::min(LOOKUP_BITS, std::max(max_length, 1));
+				for (std::uint32_t pattern = 0; pattern < (1u << lookup_bits_); ++pattern) {
+					std::uint32_t entry = INVALID;
+					std::int16_t node = 0;
+					for (int depth = 0; depth < lookup_bits_; ++depth) {
+						std::int16_t child = nodes_[node][(pattern >> (lookup_bits_ - 1 - depth)) & 1];
+						if (child < 0) {
+							entry = static_cast<std::uint32_t>(-child - 1) | static_cast<std::uint32_t>(depth + 1) << 8;
+							break;
+						}
+						if (child == 0) {
+							break;
+						}
+						node = child;
+						if (depth == lookup_bits_ - 1) {
+							entry = static_cast<std::uint32_t>(node) << 16;
+						}
+					}
+					lookup_[pattern] = entry;
+				}
+			}
+
+			std::uint8_t Decode(MemoryBitReader& reader) const {
+				int available = 0;
+				std::uint32_t entry = lookup_[reader.Peek(lookup_bits_, available)];
+				int length = (entry >> 8) & 0xFF;
+				if (length != 0) {
+					if (length > available) {
+						ThrowCorruptHuffman();
+					}
+					reader.Skip(length);
+					return static_cast<std::uint8_t>(entry);
+				}
+				if (entry == INVALID || available < lookup_bits_) {
+					ThrowCorruptHuffman();
+				}
+
+				reader.Skip(lookup_bits_);
+				auto node = static_cast<std::int16_t>(entry >> 16);
+				while (true) {
+					std::int16_t child = nodes_[node][reader.Read(1)];
+					if (child < 0) {
+						return static_cast<std::uint8_t>(-child - 1);
+					}
+					if (child == 0) {
+						ThrowCorruptHuffman();
+					}
+					node = child;
+				}
+			}
+
+		private:
+			// Children are 0 for none, a node index, or -(byte + 1) for a leaf. Node 0 is the root.
+			void Insert(std::uint8_t byte, std::uint64_t code, int length) {
+				std::int16_t node = 0;
+				for (int depth = 0; depth < length; ++depth) {
+					auto& child = nodes_[node][(code >> (length - 1 - depth)) & 1];
+					if (depth == length - 1) {
+						if (child != 0) {
+							ThrowCorruptHuffman();
+						}
+						child = static_cast<std::int16_t>(-static_cast<int>(byte) - 1);
+						return;
+					}
+					if (child < 0) {
+						ThrowCorruptHuffman();
+					}
+					if (child == 0) {
+						if (node_count_ == MAX_TREE_NODES) {
+							ThrowCorruptHuffman();
+						}
+						child = static_cast<std::int16_t>(node_count_++);
+					}
+					node = child;
+				}
+			}
+
+			static constexpr std::uint32_t INVALID = 0;		///< Lookup entry of patterns no code starts with.
+
+			std::array<std::array<std::int16_t, 2>, MAX_TREE_NODES> nodes_{};
+			size_t node_count_ = 1;
+			std::array<std::uint32_t, size_t{ 1 } << LOOKUP_BITS> lookup_{};
+			int lookup_bits_ = 1;
+		};
+
+		// Optimal code lengths for the counts, built with the two-queue method on sorted leaves, and
+		// canonical codes for them. Any prefix code decodes, so the codes needn't match the stream encoder's.
+		CodeTable BuildCodeTable(const std::array<std::uint64_t, 256>& counts) {
+			CodeTable table;
+
+			std::array<std::uint16_t, 256> symbols{};
+			size_t symbol_count = 0;
+			for (size_t byte = 0; byte < 256; ++byte) {
+				if (counts[byte] != 0) {
+					symbols[symbol_count++] = static_cast<std::uint16_t>(byte);
+				}
+			}
+			if (symbol_count == 0) {
+				return table;
+			}
+			if (symbol_count == 1) {
+				// Same as the stream encoder, a lone symbol still needs a one-bit code.
+				table.lengths[symbols[0]] = 1;
+				return table;
+			}
+
+			// Ties keep byte order, like a stable sort, without the temporary buffer std::stable_sort allocates.
+			std::sort(symbols.begin(), symbols.begin() + symbol_count, [&counts](std::uint16_t a, std::uint16_t b) {
+				return counts[a] < counts[b] || (counts[a] == counts[b] && a < b);
+			});
+
+			// Leaves are nodes 0..n-1 in ascending weight, merged nodes follow in creation order,
+			// which is also ascending, so the two lightest nodes are always at one of two queue heads.
+			std::array<std::uint64_t, 511> weights{};
+			std::array<std::uint16_t, 511> parents{};
+			for (size_t i = 0; i < symbol_count; ++i) {
+				weights[i] = counts[symbols[i]];
+			}
+			size_t next_leaf = 0;
+			size_t next_merged = symbol_count;
+			size_t node_count = symbol_count;
+			auto take = [&]() {
+				if (next_leaf < symbol_count && (next_merged == node_count || weights[next_leaf] <= weights[next_merged])) {
+					return next_leaf++;
+				}
+				return next_merged++;
+			};
+			while (node_count < 2 * symbol_count - 1) {
+				size_t first = take();
+				size_t second = take();
+				weights[node_count] = weights[first] + weights[second];
+				parents[first] = static_cast<std::uint16_t>(node_count);
+				parents[second] = static_cast<std::uint16_t>(node_count);
+				++node_count;
+			}
+
+			// Parents are created after their children, so depths resolve from the root down.
+			std::array<std::uint8_t, 511> depths{};
+			int max_length = 0;
+			for (size_t node = node_count - 1; node-- > 0;) {
+				depths[node] = static_cast<std::uint8_t>(depths[parents[node]] + 1);
+				if (node < symbol_count) {
+					table.lengths[symbols[node]] = depths[node];
+					max_length = std::max<int>(max_length, depths[node]);
+				}
+			}
+			if (max_length > MAX_MEMORY_CODE_LENGTH) {
+				throw CompressionException("Huffman code too long for the block coder");
+			}
+
+			std::uint64_t code = 0;
+			for (int length = 1; length <= max_length; ++length) {
+				for (size_t byte = 0; byte < 256; ++byte) {
+					if (table.lengths[byte] == length) {
+						table.codes[byte] = code++;
+					}
+				}
+				code <<= 1;
+			}
+			return table;
+		}
+
+		// Converts the string codes of a static table, which are at most a few dozen bits.
+		CodeTable StaticCodeTable(const StaticHuffmanTable& static_table) {
+			CodeTable table;
+			for (size_t byte = 0; byte < 256; ++byte) {
+				const std::string& code = static_table.code(static_cast<std::uint8_t>(byte));
+				if (code.size() > static_cast<size_t>(MAX_MEMORY_CODE_LENGTH)) {
+					throw CompressionException("Huffman code too long for the block coder");
+				}
+				for (char bit : code) {
+					table.codes[byte] = (table.codes[byte] << 1) | (bit == '1' ? 1 : 0);
+				}
+				table.lengths[byte] = static_cast<std::uint8_t>(code.size());
+			}
+			return table;
+		}
+
+		// Converts the string codes of the stream encoder's table, std::nullopt if one is too long.
+		std::optional<CodeTable> StringCodeTable(const std::unordered_map<std::uint8_t, std::string>& encoding_table) {
+			CodeTable table;
+			for (const auto& [byte, code] : encoding_table) {
+				if (code.size() > static_cast<size_t>(MAX_MEMORY_CODE_LENGTH)) {
+					return std::nullopt;
+				}
+				for (char bit : code) {
+					table.codes[byte] = (table.codes[byte] << 1) | (bit == '1' ? 1 : 0);
+				}
+				table.lengths[byte] = static_cast<std::uint8_t>(code.size());
+			}
+			return table;
+		}
+
+		// Reads until size bytes are read or the input ends, returning the number read.
+		size_t FillBuffer(std::istream& input_file, std::uint8_t* data, size_t size) {
+			size_t total = 0;
+			while (total < size && input_file) {
+				input_file.read(reinterpret_cast<char*>(data + total), static_cast<std::streamsize>(size - total));
+				total += static_cast<size_t>(input_file.gcount());
+			}
+			return total;
+		}
+
+		// Runs task(i) for every chunk i on the pool. Rethrows the first exception once all chunks
+		// are done, since the tasks reference the caller's buffers.
+		void RunChunks(ThreadPool& pool, size_t chunk_count, const std::function<void(size_t)>& task) {
+			std::vector<std::future<void>> done;
+			done.reserve(chunk_count);
+			for (size_t i = 0; i < chunk_count; ++i) {
+				done.push_back(pool.Submit([&task, i]() { task(i); }));
+			}
+			for (auto& future : done) {
+				pool.Wait(future);
+			}
+			for (auto& future : done) {
+				future.get();
+			}
+		}
+
+	}
+
+
     // HuffmanCoding implementation.
-	std::unordered_map<std::uint8_t, int> HuffmanCoding::BuildFrequencyTable(std::ifstream& input_file) {
-		std::unordered_map<std::uint8_t, int> freq_table;
-		std::vector<std::uint8_t> buffer(BUFFER_SIZE);
+	std::unordered_map<std::uint8_t, int> HuffmanCoding::BuildFrequencyTable(std::istream& input_file, size_t buffer_size) {
+		std::array<std::uint64_t, 256> counts{};
+		std::vector<std::uint8_t> buffer(buffer_size);
 
-		// Count the frequency of each byte and store it in our map.
+		// Count the frequency of each byte, then store the bytes that occur in our map.
 
 		while (input_file) {
 			input_file.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
@@ -20,10 +360,20 @@ namespace EncodingAlgorithms {
 			size_t bytes_read = input_file.gcount();
 
 			for (size_t i = 0; i < bytes_read; ++i) {
-				++freq_table[buffer[i]];
+				++counts[buffer[i]];
 			}
 		}
 
+		return FrequencyTable(counts);
+	}
+
+	std::unordered_map<std::uint8_t, int> HuffmanCoding::FrequencyTable(const std::array<std::uint64_t, 256>& counts) {
+		std::unordered_map<std::uint8_t, int> freq_table;
+		for (size_t byte = 0; byte < counts.size(); ++byte) {
+			if (counts[byte] != 0) {
+				freq_table[static_cast<std::uint8_t>(byte)] = static_cast<int>(counts[byte]);
+			}
+		}
 		return freq_table;
 	}
 
@@ -72,7 +422,9 @@ namespace EncodingAlgorithms {
 		// When we hit a leaf node, store the current code for that
 		// byte in the encoding table.
 		if (!root->left && !root->right) {
-			encoding_table[root->data] = std::string(code.begin(), code.end());
+			// A tree with a single symbol is just a leaf. Give it a one bit code,
+			// otherwise nothing would be written for it and decoding would produce no output.
+			encoding_table[root->data] = code.empty() ? std::string("0") : std::string(code.begin(), code.end());
 			return;
 		}
 
@@ -204,11 +556,19 @@ namespace EncodingAlgorithms {
 
 	}
 
-	void HuffmanCoding::encode(std::ifstream& input_file, std::ofstream& output_file,
-		std::optional<ProgressCallback> progress_callback) {
+	void HuffmanCoding::encode(std::istream& input_file, std::ostream& output_file,
+		std::optional<ProgressCallback> progress_callback, const CodecSettings& settings, ThreadPool* pool) {
+
+		// A window holds a chunk per thread and its encoding, which is usually smaller.
+		size_t threads = pool ? std::min(pool->size(), settings.MemoryLimit() / (2 * PARALLEL_CHUNK_SIZE)) : 1;
+		// Very large inputs can have codes too long for the parallel coder, the serial one
+		// encodes them after it has rewound the input.
+		if (threads > 1 && EncodeParallel(input_file, output_file, progress_callback, settings, *pool, threads)) {
+			return;
+		}
 
 		// Build frequency table from input file.
-		auto freq_table = BuildFrequencyTable(input_file);
+		auto freq_table = BuildFrequencyTable(input_file, settings.buffer_size);
 
 		// Construct Huffman tree.
 		auto root = BuildHuffmanTree(freq_table);
@@ -219,7 +579,7 @@ namespace EncodingAlgorithms {
 		BuildEncodingTable(root, code, encoding_table);
 
 		// Write encoding table to output file
-		BitWriter bit_writer(&output_file);
+		BitWriter bit_writer(&output_file, settings.buffer_size);
 		WriteEncodingTable(encoding_table, bit_writer);
 
 		// Calculate and write total encoded bits
@@ -242,7 +602,7 @@ namespace EncodingAlgorithms {
 			// 2. When the bit buffer has 8 or more bits, write the first 8 bits as a byte
 			// to output file and remove from buffer
 		// After processing all input, if there are any bits left in the buffer, pad to 8 bits and write the final byte.
-		std::vector<std::uint8_t> buffer(BUFFER_SIZE);
+		std::vector<std::uint8_t> buffer(settings.buffer_size);
 		std::int64_t total_processed = 0;
 
 		while (input_file) {
@@ -256,6 +616,7 @@ namespace EncodingAlgorithms {
 			}
 
 			total_processed += bytes_read;
+			settings.CheckPoint();
 			if (progress_callback) {
 				(*progress_callback)(total_processed);
 			}
@@ -266,13 +627,144 @@ namespace EncodingAlgorithms {
 
 	}
 
+	bool HuffmanCoding::EncodeParallel(std::istream& input_file, std::ostream& output_file,
+		std::optional<ProgressCallback> progress_callback, const CodecSettings& settings, ThreadPool& pool, size_t threads) {
+
+		const auto start = input_file.tellg();
+		const size_t window_size = threads * PARALLEL_CHUNK_SIZE;
+		auto memory = settings.ReserveMemory(2 * window_size);
+		std::vector<std::uint8_t> window(window_size);
+		std::vector<std::array<std::uint64_t, 256>> chunk_counts(threads);
+		size_t available = 0;
+		auto chunk_start = [&](size_t i) { return available / threads * i; };
+		auto chunk_end = [&](size_t i) { return i + 1 == threads ? available : chunk_start(i + 1); };
+		auto count_chunk = [&](size_t i) {
+			auto& counts = chunk_counts[i];
+			counts.fill(0);
+			for (size_t j = chunk_start(i); j < chunk_end(i); ++j) {
+				++counts[window[j]];
+			}
+		};
+
+		// The same table as the serial encoder's, from counts gathered in parallel.
+		std::array<std::uint64_t, 256> counts{};
+		while ((available = FillBuffer(input_file, window.data(), window_size)) > 0) {
+			RunChunks(pool, threads, count_chunk);
+			for (const auto& chunk : chunk_counts) {
+				for (size_t byte = 0; byte < 256; ++byte) {
+					counts[byte] += chunk[byte];
+				}
+			}
+			settings.CheckPoint();
+		}
+		auto freq_table = FrequencyTable(counts);
+		auto root = BuildHuffmanTree(freq_table);
+		std::unordered_map<std::uint8_t, std::string> encoding_table;
+		std::vector<char> code;
+		BuildEncodingTable(root, code, encoding_table);
+		auto code_table = StringCodeTable(encoding_table);
+		if (!code_table) {
+			input_file.clear();
+			input_file.seekg(start);
+			return false;
+		}
+		const CodeTable& table = *code_table;
+
+		// The table and bit count are laid out like WriteEncodingTable writes them. They don't end on
+		// a byte boundary, so their last bits are carried into the first byte of the codes.
+		std::uint64_t header_bits = 16 + 64;
+		std::uint64_t total_encoded_bits = 0;
+		for (const auto& [byte, byte_code] : encoding_table) {
+			header_bits += 16 + byte_code.size();
+			total_encoded_bits += byte_code.size() * counts[byte];
+		}
+		std::vector<std::uint8_t> output(static_cast<size_t>(header_bits / 8 + 1));
+		MemoryBitWriter header(output.data());
+		header.Put(encoding_table.size(), 16);
+		for (const auto& [byte, byte_code] : encoding_table) {
+			header.Put(byte, 8);
+			header.Put(byte_code.size(), 8);
+			header.Put(table.codes[byte], table.lengths[byte]);
+		}
+		header.Put(total_encoded_bits >> 32, 32);
+		header.Put(total_encoded_bits & 0xFFFFFFFF, 32);
+		output_file.write(reinterpret_cast<const char*>(output.data()), static_cast<std::streamsize>(header_bits / 8));
+		std::uint8_t carry = header.Pending();
+		size_t carry_bits = static_cast<size_t>(header_bits % 8);
+
+		input_file.clear();
+		input_file.seekg(start);
+
+		// Codes longer than a byte make the encoding larger than its input, up to seven times for
+		// 56-bit codes. The windows shrink so that their encoding still fits the reservation.
+		int max_length = *std::max_element(table.lengths.begin(), table.lengths.end());
+		const size_t coding_window_size = std::max(window_size * 8 / static_cast<size_t>(std::max(max_length, 8)), threads);
+
+		std::vector<std::uint64_t> offsets(threads + 1);
+		std::vector<std::uint8_t> partial(threads);
+		std::uint64_t encoded_bits = 0;
+		std::int64_t total_processed = 0;
+		while ((available = FillBuffer(input_file, window.data(), coding_window_size)) > 0) {
+			// Every chunk starts at the sum of the bit lengths before it, after the carried bits.
+			RunChunks(pool, threads, count_chunk);
+			offsets[0] = carry_bits;
+			for (size_t i = 0; i < threads; ++i) {
+				std::uint64_t chunk_bits = 0;
+				for (size_t byte = 0; byte < 256; ++byte) {
+					if (chunk_counts[i][byte] != 0 && table.lengths[byte] == 0) {
+						throw CompressionException("Input file changed during compression");
+					}
+					chunk_bits += chunk_counts[i][byte] * table.lengths[byte];
+				}
+				offsets[i + 1] = offsets[i] + chunk_bits;
+			}
+
+			// A chunk writes every byte its codes complete, including the first one, whose leading bits
+			// belong to the chunk before. Its last, incomplete byte is kept and merged below.
+			const size_t full_bytes = static_cast<size_t>(offsets[threads] / 8);
+			output.resize(full_bytes + 1);
+			RunChunks(pool, threads, [&](size_t i) {
+				MemoryBitWriter writer(output.data() + offsets[i] / 8);
+				writer.Put(0, static_cast<int>(offsets[i] % 8));
+				for (size_t j = chunk_start(i); j < chunk_end(i); ++j) {
+					writer.Put(table.codes[window[j]], table.lengths[window[j]]);
+				}
+				partial[i] = writer.Pending();
+			});
+
+			output[full_bytes] = 0;
+			output[0] |= carry;
+			for (size_t i = 0; i < threads; ++i) {
+				output[offsets[i + 1] / 8] |= partial[i];
+			}
+			output_file.write(reinterpret_cast<const char*>(output.data()), static_cast<std::streamsize>(full_bytes));
+			carry = output[full_bytes];
+			carry_bits = static_cast<size_t>(offsets[threads] % 8);
+			encoded_bits += offsets[threads] - offsets[0];
+
+			total_processed += static_cast<std::int64_t>(available);
+			settings.CheckPoint();
+			if (progress_callback) {
+				(*progress_callback)(total_processed);
+			}
+		}
+
+		if (encoded_bits != total_encoded_bits) {
+			throw CompressionException("Input file changed during compression");
+		}
+		if (carry_bits > 0) {
+			output_file.write(reinterpret_cast<const char*>(&carry), 1);
+		}
+		return true;
+	}
+
 	// 1. Read Encoding table
 	// 2. Build Decoding tree
 	// 3. Decode data.
-	void HuffmanCoding::decode(std::ifstream& input_file, std::ofstream& output_file,
-		std::optional<ProgressCallback> progress_callback) {
+	void HuffmanCoding::decode(std::istream& input_file, std::ostream& output_file,
+		std::optional<ProgressCallback> progress_callback, const CodecSettings& settings) {
 
-		BitReader bit_reader(&input_file);
+		BitReader bit_reader(&input_file, settings.buffer_size);
 
 		// Read the encoding table.
 		auto encoding_table = ReadEncodingTable(bit_reader);
@@ -291,7 +783,8 @@ namespace EncodingAlgorithms {
 		}
 
 
-		std::vector<std::uint8_t> output_buffer(BUFFER_SIZE);
+		const size_t buffer_size = settings.buffer_size;
+		std::vector<std::uint8_t> output_buffer(buffer_size);
 		size_t buffer_index = 0;
 
 		std::int64_t bits_processed = 0;
@@ -318,11 +811,12 @@ namespace EncodingAlgorithms {
 				++bytes_decoded;
 
 				// If buffer is full, write it to the output file
-				if (buffer_index == BUFFER_SIZE) {
-					output_file.write(reinterpret_cast<char*>(output_buffer.data()), BUFFER_SIZE);
+				if (buffer_index == buffer_size) {
+					output_file.write(reinterpret_cast<char*>(output_buffer.data()), buffer_size);
 					buffer_index = 0;
 
 					// Report progress
+					settings.CheckPoint();
 					if (progress_callback) {
 						(*progress_callback)(bytes_decoded);
 					}
@@ -349,18 +843,260 @@ namespace EncodingAlgorithms {
 	}
 
 
+	void HuffmanCoding::encode(std::istream& input_file, std::ostream& output_file, const StaticHuffmanTable& table,
+		std::optional<ProgressCallback> progress_callback, const CodecSettings& settings) {
+
+		// The table is known up front, so the input is encoded as it is read.
+		BitWriter bit_writer(&output_file, settings.buffer_size);
+		std::vector<std::uint8_t> buffer(settings.buffer_size);
+		std::int64_t total_processed = 0;
+
+		while (input_file) {
+			input_file.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+
+			size_t bytes_read = input_file.gcount();
+
+			for (size_t i = 0; i < bytes_read; ++i) {
+				const std::string& code = table.code(buffer[i]);
+				if (code.empty()) {
+					throw std::runtime_error("Input contains a byte the Huffman table has no code for");
+				}
+				bit_writer.WriteBits(code);
+			}
+
+			total_processed += bytes_read;
+			settings.CheckPoint();
+			if (progress_callback) {
+				(*progress_callback)(total_processed);
+			}
+		}
+
+		bit_writer.Flush();
+	}
+
+	void HuffmanCoding::decode(std::istream& input_file, std::ostream& output_file, const StaticHuffmanTable& table,
+		std::uint64_t symbol_count, std::optional<ProgressCallback> progress_callback, const CodecSettings& settings) {
+
+		BitReader bit_reader(&input_file, settings.buffer_size);
+
+		const size_t buffer_size = settings.buffer_size;
+		std::vector<std::uint8_t> output_buffer(buffer_size);
+		size_t buffer_index = 0;
+
+		// The tree was built when the table was loaded and is shared, it is only walked here.
+		const auto& root = table.decoding_tree_;
+		const Node* curr_node = root.get();
+		std::uint64_t bytes_decoded = 0;
+
+		while (bytes_decoded < symbol_count) {
+			bool bit;
+			if (!bit_reader.ReadBit(bit)) {
+				throw std::runtime_error("Unexpected end of file: decoded fewer bytes than expected");
+			}
+
+			curr_node = bit ? curr_node->right.get() : curr_node->left.get();
+
+			if (!curr_node) {
+				throw std::runtime_error("Invalid Huffman code encountered during decoding");
+			}
+
+			if (!curr_node->left && !curr_node->right) {
+				output_buffer[buffer_index++] = curr_node->data;
+				++bytes_decoded;
+
+				if (buffer_index == buffer_size) {
+					output_file.write(reinterpret_cast<char*>(output_buffer.data()), buffer_size);
+					buffer_index = 0;
+
+					settings.CheckPoint();
+					if (progress_callback) {
+						(*progress_callback)(static_cast<std::int64_t>(bytes_decoded));
+					}
+				}
+
+				curr_node = root.get();
+			}
+		}
+
+		if (buffer_index > 0) {
+			output_file.write(reinterpret_cast<char*>(output_buffer.data()), buffer_index);
+		}
+	}
+
+
+	void HuffmanCoding::encode(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& output) {
+		std::array<std::uint64_t, 256> counts{};
+		for (size_t i = 0; i < size; ++i) {
+			++counts[data[i]];
+		}
+		CodeTable table = BuildCodeTable(counts);
+
+		// The exact size is known from the counts, so the output is resized once and written in place.
+		std::uint64_t symbol_count = 0;
+		std::uint64_t header_bits = 16 + 64;
+		std::uint64_t encoded_bits = 0;
+		for (size_t byte = 0; byte < 256; ++byte) {
+			if (table.lengths[byte] != 0) {
+				++symbol_count;
+				header_bits += 16 + table.lengths[byte];
+				encoded_bits += counts[byte] * table.lengths[byte];
+			}
+		}
+
+		size_t initial_size = output.size();
+		output.resize(initial_size + static_cast<size_t>((header_bits + encoded_bits + 7) / 8));
+		MemoryBitWriter writer(output.data() + initial_size);
+
+		writer.Put(symbol_count, 16);
+		for (size_t byte = 0; byte < 256; ++byte) {
+			if (table.lengths[byte] != 0) {
+				writer.Put(byte, 8);
+				writer.Put(table.lengths[byte], 8);
+				writer.Put(table.codes[byte], table.lengths[byte]);
+			}
+		}
+		writer.Put(encoded_bits >> 32, 32);
+		writer.Put(encoded_bits & 0xFFFFFFFF, 32);
+
+		for (size_t i = 0; i < size; ++i) {
+			writer.Put(table.codes[data[i]], table.lengths[data[i]]);
+		}
+		writer.Flush();
+	}
+
+	void HuffmanCoding::decode(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& output, size_t symbol_count) {
+		MemoryBitReader reader(data, size);
+
+		CodeTable table;
+		auto table_size = reader.Read(16);
+		if (table_size > 256) {
+			ThrowCorruptHuffman();
+		}
+		for (std::uint64_t i = 0; i < table_size; ++i) {
+			auto byte = static_cast<std::uint8_t>(reader.Read(8));
+			auto length = static_cast<int>(reader.Read(8));
+			if (length == 0 || length > MAX_MEMORY_CODE_LENGTH || table.lengths[byte] != 0) {
+				ThrowCorruptHuffman();
+			}
+			table.codes[byte] = reader.Read(length);
+			table.lengths[byte] = static_cast<std::uint8_t>(length);
+		}
+
+		std::uint64_t encoded_bits = reader.Read(32) << 32;
+		encoded_bits |= reader.Read(32);
+		if (encoded_bits > reader.remaining()) {
+			ThrowCorruptHuffman();
+		}
+
+		HuffmanDecoder decoder(table);
+		std::uint64_t codes_start = reader.consumed();
+		size_t initial_size = output.size();
+		output.resize(initial_size + symbol_count);
+		std::uint8_t* out = output.data() + initial_size;
+		for (size_t i = 0; i < symbol_count; ++i) {
+			out[i] = decoder.Decode(reader);
+		}
+
+		// The stored bit count must account for exactly the decoded codes.
+		if (reader.consumed() - codes_start != encoded_bits) {
+			ThrowCorruptHuffman();
+		}
+	}
+
+	void HuffmanCoding::encode(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& output,
+		const StaticHuffmanTable& static_table) {
+
+		CodeTable table = StaticCodeTable(static_table);
+
+		std::uint64_t encoded_bits = 0;
+		for (size_t i = 0; i < size; ++i) {
+			if (table.lengths[data[i]] == 0) {
+				throw CompressionException("Input contains a byte the Huffman table has no code for");
+			}
+			encoded_bits += table.lengths[data[i]];
+		}
+
+		size_t initial_size = output.size();
+		output.resize(initial_size + static_cast<size_t>((encoded_bits + 7) / 8));
+		MemoryBitWriter writer(output.data() + initial_size);
+		for (size_t i = 0; i < size; ++i) {
+			writer.Put(table.codes[data[i]], table.lengths[data[i]]);
+		}
+		writer.Flush();
+	}
+
+	void HuffmanCoding::decode(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& output,
+		const StaticHuffmanTable& static_table, size_t symbol_count) {
+
+		HuffmanDecoder decoder(StaticCodeTable(static_table));
+		MemoryBitReader reader(data, size);
+
+		size_t initial_size = output.size();
+		output.resize(initial_size + symbol_count);
+		std::uint8_t* out = output.data() + initial_size;
+		for (size_t i = 0; i < symbol_count; ++i) {
+			out[i] = decoder.Decode(reader);
+		}
+	}
+
+
 	///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
     // RLECoding implementation.
-    void RLECoding::encode(std::ifstream& input_file, std::ofstream& output_file,
-        std::optional<ProgressCallback> progress_callback) {
+    void RLECoding::encode(std::istream& input_file, std::ostream& output_file,
+        std::optional<ProgressCallback> progress_callback, const CodecSettings& settings, ThreadPool* pool) {
+
+        // A window holds a chunk per thread, and its encoding up to twice over, in the chunks' buffers and
+        // in the output. Only as many threads are used as the memory budget has windows for.
+        const size_t window_memory = 5 * PARALLEL_CHUNK_SIZE;
+        size_t threads = pool ? std::min(pool->size(), settings.MemoryLimit() / window_memory) : 1;
+        if (threads > 1) {
+            const size_t window_size = threads * PARALLEL_CHUNK_SIZE;
+            auto memory = settings.ReserveMemory(threads * window_memory);
+            std::vector<std::uint8_t> window(window_size);
+            std::vector<std::uint8_t> encoded;
+
+            std::int64_t total_processed = 0;
+            size_t held = 0;        // Bytes of a run kept from the previous window, which may go on in this one.
+            bool end_of_input = false;
+            while (!end_of_input) {
+                size_t available = held + FillBuffer(input_file, window.data() + held, window_size - held);
+                end_of_input = available < window_size;
+
+                // Only the full runs of 255 of the window's last run are final before the input ends.
+                size_t end = available;
+                if (!end_of_input) {
+                    size_t run_start = available - 1;
+                    while (run_start > 0 && window[run_start - 1] == window[available - 1]) {
+                        --run_start;
+                    }
+                    const auto escape = std::to_integer<size_t>(ESCAPE);
+                    end = run_start + (available - run_start) / escape * escape;
+                }
+
+                encoded.clear();
+                encode(window.data(), end, encoded, *pool);
+                output_file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+
+                total_processed += available - held;
+                held = available - end;
+                std::copy(window.begin() + end, window.begin() + available, window.begin());
 
-        std::vector<std::byte> input_buffer(BUFFER_SIZE);
+                settings.CheckPoint();
+                if (progress_callback) {
+                    (*progress_callback)(total_processed);
+                }
+            }
+            return;
+        }
+
+        const size_t buffer_size = settings.buffer_size;
+        std::vector<std::byte> input_buffer(buffer_size);
         std::vector<std::byte> output_buffer;
-        output_buffer.reserve(BUFFER_SIZE);
+        output_buffer.reserve(buffer_size);
 
         std::byte run_char{};
         std::byte run_char_count{};
@@ -369,7 +1105,7 @@ namespace EncodingAlgorithms {
         std::int64_t total_processed = 0;
 
         while (input_file) {
-            // Try to read in up to 8kb of data.
+            // Try to read in up to buffer_size bytes of data.
             input_file.read(reinterpret_cast<char*>(input_buffer.data()), input_buffer.size());
 
             // Keep track of the actual amount of bytes we've read.
@@ -386,7 +1122,7 @@ namespace EncodingAlgorithms {
                 }
                 // Hit a new character so reset our values and write to output file.
                 else {
-                    writeRun(output_buffer, output_file, run_char, run_char_count);
+                    writeRun(output_buffer, output_file, run_char, run_char_count, buffer_size);
                     run_char = current_char;
                     run_char_count = std::byte{ 1 };
                 }
@@ -394,16 +1130,17 @@ namespace EncodingAlgorithms {
 
             total_processed += bytes_read;
 
+            settings.CheckPoint();
             if (progress_callback) {
                 (*progress_callback)(total_processed);
             }
         }
 
         // Flush again to handle remaining data.
-        writeRun(output_buffer, output_file, run_char, run_char_count);
+        writeRun(output_buffer, output_file, run_char, run_char_count, buffer_size);
 
         // Write any remaining data in the output buffer. (we may not fill 
-        // our byte quota using writeRun since it only writes in 8kb chunks).
+        // our byte quota using writeRun since it only writes in buffer_size chunks).
         if (!output_buffer.empty()) {
             flushBuffer(output_buffer, output_file);
             output_buffer.clear();
@@ -411,34 +1148,36 @@ namespace EncodingAlgorithms {
 
     }
 
-    void RLECoding::decode(std::ifstream& input_file, std::ofstream& output_file,
-        std::optional<ProgressCallback> progress_callback) {
+    void RLECoding::decode(std::istream& input_file, std::ostream& output_file,
+        std::optional<ProgressCallback> progress_callback, const CodecSettings& settings) {
 
-        std::vector<std::byte> input_buffer(BUFFER_SIZE);
+        const size_t buffer_size = settings.buffer_size;
+        std::vector<std::byte> input_buffer(buffer_size);
         std::vector<std::byte> output_buffer;
-        output_buffer.reserve(BUFFER_SIZE);
+        output_buffer.reserve(buffer_size);
 
 
         std::int64_t total_processed = 0;
+        size_t carry = 0;       // Bytes of an incomplete pair or escape sequence kept from the previous read.
 
         while (input_file) {
-            // Try reading up to BUFFER_SIZE of data.
-            input_file.read(reinterpret_cast<char*>(input_buffer.data()), input_buffer.size());
+            // Try reading up to buffer_size bytes of data after anything carried over.
+            input_file.read(reinterpret_cast<char*>(input_buffer.data() + carry), input_buffer.size() - carry);
 
             size_t bytes_read = input_file.gcount();
+            size_t available = carry + bytes_read;
 
-            for (size_t i = 0; i < bytes_read; i += 2) {
+            size_t i = 0;
+            for (; i + 1 < available; i += 2) {
                 // Read as a pair (char, count)
-                if (i + 1 >= bytes_read) break;
-
                 std::byte character = input_buffer[i];
                 std::byte character_count = input_buffer[i + 1];
 
                 // Handle our ESCAPE sequence
                 if (character == ESCAPE && character_count == std::byte{ 0 }) {
 
-                    // Ensure we have next complete pair.
-                    if (i + 3 >= bytes_read) break;
+                    // Ensure we have next complete pair, otherwise wait for the next read.
+                    if (i + 3 >= available) break;
 
                     character = input_buffer[i + 2];
                     character_count = ESCAPE;
@@ -449,13 +1188,18 @@ namespace EncodingAlgorithms {
                 auto repeat_count = std::to_integer<size_t>(character_count);
                 output_buffer.insert(output_buffer.end(), repeat_count, character);
 
-                if (output_buffer.size() >= BUFFER_SIZE) {
+                if (output_buffer.size() >= buffer_size) {
                     flushBuffer(output_buffer, output_file);
                     output_buffer.clear();
                 }
             }
 
+            // Move a pair or escape sequence split by the buffer boundary to the front.
+            carry = available - i;
+            std::copy(input_buffer.begin() + i, input_buffer.begin() + available, input_buffer.begin());
+
             total_processed += bytes_read;
+            settings.CheckPoint();
             if (progress_callback) {
                 (*progress_callback)(total_processed);
             }
@@ -468,7 +1212,122 @@ namespace EncodingAlgorithms {
         }
     }
 
-    void RLECoding::writeRun(std::vector<std::byte>& buffer, std::ofstream& output_file, std::byte character, std::byte count) {
+    void RLECoding::encode(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& output) {
+        const auto escape = std::to_integer<std::uint8_t>(ESCAPE);
+
+        // Runs are capped at 255 like in the stream encoder, and a full run is preceded by the escape pair.
+        size_t i = 0;
+        while (i < size) {
+            std::uint8_t character = data[i];
+            size_t run_end = i + 1;
+            while (run_end < size && data[run_end] == character && run_end - i < escape) {
+                ++run_end;
+            }
+
+            auto count = static_cast<std::uint8_t>(run_end - i);
+            if (count == escape) {
+                output.push_back(escape);
+                output.push_back(0);
+            }
+            output.push_back(character);
+            output.push_back(count);
+            i = run_end;
+        }
+    }
+
+    void RLECoding::encode(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& output, ThreadPool& pool) {
+        size_t chunk_count = std::min(pool.size(), size / PARALLEL_CHUNK_SIZE);
+        if (chunk_count < 2) {
+            encode(data, size, output);
+            return;
+        }
+
+        // Chunks start where the serial encoder starts a run anyway, so encoding them independently
+        // gives the same runs. A run crossing an even split stays in the chunk it starts in.
+        std::vector<size_t> starts{ 0 };
+        for (size_t i = 1; i < chunk_count; ++i) {
+            size_t start = RunBoundary(data, size, starts.back(), std::max(size / chunk_count * i, starts.back()));
+            if (start > starts.back() && start < size) {
+                starts.push_back(start);
+            }
+        }
+        starts.push_back(size);
+
+        std::vector<std::vector<std::uint8_t>> chunks(starts.size() - 1);
+        RunChunks(pool, chunks.size(), [&](size_t i) {
+            encode(data + starts[i], starts[i + 1] - starts[i], chunks[i]);
+        });
+
+        // Every chunk goes to the prefix sum of the encoded sizes before it.
+        size_t offset = output.size();
+        size_t total = offset;
+        for (const auto& chunk : chunks) {
+            total += chunk.size();
+        }
+        output.resize(total);
+        for (const auto& chunk : chunks) {
+            std::copy(chunk.begin(), chunk.end(), output.begin() + offset);
+            offset += chunk.size();
+        }
+    }
+
+    size_t RLECoding::RunBoundary(const std::uint8_t* data, size_t size, size_t chunk_start, size_t boundary) {
+        const auto escape = std::to_integer<size_t>(ESCAPE);
+        if (boundary >= size) {
+            return size;
+        }
+
+        // The runs in front of the boundary started at the start of its bytes or of the chunk, whichever is later.
+        std::uint8_t character = data[boundary];
+        size_t run_start = boundary;
+        while (run_start > chunk_start && data[run_start - 1] == character) {
+            --run_start;
+        }
+
+        // The next run starts after the current full run, or earlier where the bytes change.
+        size_t next_run = run_start + (boundary - run_start + escape - 1) / escape * escape;
+        size_t position = boundary;
+        while (position < next_run && position < size && data[position] == character) {
+            ++position;
+        }
+        return position;
+    }
+
+    void RLECoding::decode(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& output, size_t symbol_count) {
+        const auto escape = std::to_integer<std::uint8_t>(ESCAPE);
+
+        size_t initial_size = output.size();
+        output.resize(initial_size + symbol_count);
+        std::uint8_t* out = output.data() + initial_size;
+        size_t written = 0;
+
+        for (size_t i = 0; i + 1 < size; i += 2) {
+            std::uint8_t character = data[i];
+            size_t count = data[i + 1];
+
+            // An escape pair announces a full run, the pair after it holds the character.
+            if (character == escape && count == 0) {
+                if (i + 3 >= size) {
+                    break;
+                }
+                character = data[i + 2];
+                count = escape;
+                i += 2;
+            }
+
+            if (count > symbol_count - written) {
+                throw CompressionException("Corrupt RLE block");
+            }
+            std::fill_n(out + written, count, character);
+            written += count;
+        }
+
+        // A short block is reported by the caller, which knows the expected size.
+        output.resize(initial_size + written);
+    }
+
+    void RLECoding::writeRun(std::vector<std::byte>& buffer, std::ostream& output_file, std::byte character, std::byte count,
+        size_t buffer_size) {
         // Prevent a write for runs of 0 length.
         if (count > std::byte{ 0 }) {
             // If we hit out 255 byte limit. Mark it with our ESCAPE value.
@@ -479,15 +1338,15 @@ namespace EncodingAlgorithms {
             buffer.push_back(character);
             buffer.push_back(count);
 
-            // Dump our buffer when we hit our intended BUFFER_SIZE.
-            if (buffer.size() >= BUFFER_SIZE) {
+            // Dump our buffer when we hit our intended buffer_size.
+            if (buffer.size() >= buffer_size) {
                 flushBuffer(buffer, output_file);
                 buffer.clear();
             }
         }
     }
 
-    void RLECoding::flushBuffer(const std::vector<std::byte>& buffer, std::ofstream& output_file) {
+    void RLECoding::flushBuffer(const std::vector<std::byte>& buffer, std::ostream& output_file) {
         output_file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
 
     }
@@ -5,8 +5,16 @@
 // compress and decompress data in a lossless manner. Both classes are designed 
 // to work with file streams for input and output.
 //
-// The file also defines a common buffer size and a progress callback type used 
-// by both algorithms to report progress during compression or decompression.
+// The file also defines a progress callback type used by both algorithms to report
+// progress during compression or decompression. Buffer sizes are configured at
+// runtime through CodecSettings.
+//
+// Given a ThreadPool, RLE encodes large inputs in chunks on several threads. The
+// chunks start where the serial encoder starts a run, so runs never straddle two
+// chunks and the output is the same bytes the serial encoder writes. Huffman
+// does the same for its single-stream format: with one table for the whole file,
+// each chunk's length in bits follows from its histogram, so every thread knows
+// the bit its codes start at and writes them straight into the shared output.
 //
 
 
@@ -14,6 +22,10 @@
 
 #include "BitReader.h"
 #include "BitWriter.h"
+#include "CodecSettings.h"
+#include "FunctionRef.h"
+#include <array>
+#include <cstddef>
 #include <fstream>
 #include <memory>
 #include <functional>
@@ -23,13 +35,26 @@
 #include <string>
 #include <vector>
 
+class ThreadPool;
+
 namespace EncodingAlgorithms {
 
-    // Common buffer size for all compression algorithms.
-    constexpr size_t BUFFER_SIZE = 16 * 1024; // 16 kB buffer
+    // Callback type for reporting progress during compression and decompression. It only
+    // references the caller's callable, so it must not be kept after the call returns.
+    // Rate limiting happens in the callable (see ProgressReporter), not in the codecs.
+    using ProgressCallback = FunctionRef<void(std::int64_t)>;
+
+    /**
+    * @enum CodecId
+    * @brief Identifies the algorithm a block or file was encoded with.
+    */
+    enum class CodecId : std::uint8_t {
+        RLE = 1,
+        Huffman = 2,
+        ContextHuffman = 3      ///< Order-1 Huffman, see ContextHuffmanCoding. Block format only.
+    };
 
-    // Callback type for reporting progress during compression and decompression.
-    using ProgressCallback = std::function<void(std::int64_t)>;
+	class StaticHuffmanTable;
 
 
 	/**
@@ -48,9 +73,14 @@ namespace EncodingAlgorithms {
 		* @param input_file: The input file stream containing data to compress.
 		* @param output_file: The output file stream to write the compressed data.
 		* @param progress_callback: Optional callback to report progress during compression.
+		* @param settings: Runtime options such as the I/O buffer size.
+		* @param pool: Optional threads to count and encode the input on, in windows of PARALLEL_CHUNK_SIZE
+		* per thread. The output is the same as without them.
+		* @throws: CompressionException if the input changes between the counting and the encoding pass.
 		*/
-		static void encode(std::ifstream& input_file, std::ofstream& output_file,
-			std::optional<ProgressCallback> progress_callback = std::nullopt);
+		static void encode(std::istream& input_file, std::ostream& output_file,
+			std::optional<ProgressCallback> progress_callback = std::nullopt, const CodecSettings& settings = {},
+			ThreadPool* pool = nullptr);
 
 		/**
 		* @brief Decompresses the input file using Huffman Coding and writes to the output file.
@@ -58,12 +88,86 @@ namespace EncodingAlgorithms {
 		* @param input_file: The input file stream containing the compressed data.
 		* @param output_file: The output file stream to write the decompressed data.
 		* @param progress_callback: Optional callback to report progress during decompression.
+		* @param settings: Runtime options such as the I/O buffer size.
+		*/
+		static void decode(std::istream& input_file, std::ostream& output_file,
+			std::optional<ProgressCallback> progress_callback = std::nullopt, const CodecSettings& settings = {});
+
+		/**
+		* @brief Compresses the input with a pre-trained table, in a single pass.
+		*
+		* Only the codes are written: no table, no bit count and no frequency pass, so
+		* the decoder must be given the same table and the number of input bytes.
+		*
+		* @param input_file: The input stream containing data to compress. Read sequentially.
+		* @param output_file: The output stream to write the codes to, padded to a whole byte.
+		* @param table: The table to encode with.
+		* @param progress_callback: Optional callback to report progress during compression.
+		* @param settings: Runtime options such as the I/O buffer size.
+		* @throws: std::runtime_error if the input contains a byte the table has no code for.
+		*/
+		static void encode(std::istream& input_file, std::ostream& output_file, const StaticHuffmanTable& table,
+			std::optional<ProgressCallback> progress_callback = std::nullopt, const CodecSettings& settings = {});
+
+		/**
+		* @brief Decompresses data written by the static-table encode.
+		*
+		* @param input_file: The input stream containing the codes.
+		* @param output_file: The output stream to write the decompressed data.
+		* @param table: The table the data was encoded with.
+		* @param symbol_count: The number of bytes to decode.
+		* @param progress_callback: Optional callback to report progress during decompression.
+		* @param settings: Runtime options such as the I/O buffer size.
+		*/
+		static void decode(std::istream& input_file, std::ostream& output_file, const StaticHuffmanTable& table,
+			std::uint64_t symbol_count, std::optional<ProgressCallback> progress_callback = std::nullopt,
+			const CodecSettings& settings = {});
+
+		/**
+		* @brief Compresses a block held in memory, producing the same format as the stream encode.
+		*
+		* Used by the block format. The code table is built in fixed-size arrays and the
+		* output is sized up front, so nothing is allocated once output has the capacity.
+		*
+		* @param data: The data to compress.
+		* @param size: Number of bytes at data.
+		* @param output: Vector the encoded data is appended to.
+		*/
+		static void encode(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& output);
+
+		/**
+		* @brief Decompresses a block held in memory that was written by either encode.
+		*
+		* @param data: The encoded data.
+		* @param size: Number of bytes at data.
+		* @param output: Vector the decoded data is appended to.
+		* @param symbol_count: Number of bytes the block decodes to.
+		* @throws: CompressionException if the data is corrupt or doesn't hold symbol_count bytes.
+		*/
+		static void decode(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& output, size_t symbol_count);
+
+		/**
+		* @brief Compresses a block held in memory with a pre-trained table, see the static-table stream encode.
+		*
+		* @throws: CompressionException if the input contains a byte the table has no code for.
+		*/
+		static void encode(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& output,
+			const StaticHuffmanTable& table);
+
+		/**
+		* @brief Decompresses a block held in memory written with a pre-trained table.
+		*
+		* @throws: CompressionException if the data is corrupt or too short for symbol_count bytes.
 		*/
-		static void decode(std::ifstream& input_file, std::ofstream& output_file,
-			std::optional<ProgressCallback> progress_callback = std::nullopt);
+		static void decode(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& output,
+			const StaticHuffmanTable& table, size_t symbol_count);
+
+		static constexpr size_t PARALLEL_CHUNK_SIZE = 256 * 1024;	///< Input a thread counts and encodes at a time.
 
 
 	private:
+		friend class StaticHuffmanTable;
+
 		// Internal structure representing a node in the Huffman tree.
 		struct Node {
 			std::uint8_t data;					///< The byte value stored in the leaf node.
@@ -96,9 +200,40 @@ namespace EncodingAlgorithms {
 		 * the value is the frequency of that byte in the input data.
 		 *
 		 * @param input_file: The input file stream containing the data.
+		 * @param buffer_size: Number of bytes read from the stream at a time.
 		 * @return: An unordered map where each key is a byte, and each value is the frequency of that byte.
 		 */
-		static std::unordered_map<std::uint8_t, int> BuildFrequencyTable(std::ifstream& input_file);
+		static std::unordered_map<std::uint8_t, int> BuildFrequencyTable(std::istream& input_file, size_t buffer_size);
+
+		/**
+		 * @brief Converts byte counts to the frequency table the tree is built from.
+		 *
+		 * Bytes are inserted in ascending order, so equal counts always give the same tree
+		 * no matter how the counts were gathered.
+		 *
+		 * @param counts: Occurrences of every byte value.
+		 * @return: The frequencies of the bytes that occur.
+		 */
+		static std::unordered_map<std::uint8_t, int> FrequencyTable(const std::array<std::uint64_t, 256>& counts);
+
+		/**
+		 * @brief The stream encode on several threads, writing the same bytes as the serial one.
+		 *
+		 * Both passes read the input in windows of one chunk per thread. The first counts
+		 * the chunks' bytes in parallel. The second, in windows shrunk by codes longer than
+		 * a byte so that their encoding never outgrows the first's window, counts them
+		 * again to get every chunk's length in bits from the table, places the chunks at
+		 * the prefix sums of those lengths and encodes them into a shared buffer. Each
+		 * thread writes the bytes its codes complete, the partial bytes between chunks are
+		 * merged afterwards.
+		 *
+		 * @param threads: Number of chunks per window, at most pool.size().
+		 * @return: false if a code is longer than the parallel coder handles. Nothing is written
+		 *          then and the input is rewound to where it started, for the serial encoder.
+		 * @throws: CompressionException if the input changes between the passes.
+		 */
+		static bool EncodeParallel(std::istream& input_file, std::ostream& output_file,
+			std::optional<ProgressCallback> progress_callback, const CodecSettings& settings, ThreadPool& pool, size_t threads);
 
 		/**
 		 * @brief Builds a Huffman tree based on the frequency table.
@@ -184,8 +319,11 @@ namespace EncodingAlgorithms {
 		 * @param input_file: The input file stream containing data to compress.
 		 * @param output_file: The output file stream to write the compressed data.
 		 * @param progress_callback: Optional callback to report progress during compression.
+		 * @param settings: Runtime options such as the I/O buffer size.
+		 * @param pool: Optional threads to encode the input on, in windows of PARALLEL_CHUNK_SIZE per thread.
 		 */
-		static void encode(std::ifstream& input_file, std::ofstream& output_file, std::optional<ProgressCallback> progress_callback = std::nullopt);
+		static void encode(std::istream& input_file, std::ostream& output_file, std::optional<ProgressCallback> progress_callback = std::nullopt,
+			const CodecSettings& settings = {}, ThreadPool* pool = nullptr);
 
 		/**
 		 * @brief Decompresses the input file using Run-Length Encoding (RLE).
@@ -196,13 +334,65 @@ namespace EncodingAlgorithms {
 		 * @param input_file: The input file stream containing the compressed data.
 		 * @param output_file: The output file stream to write the decompressed data.
 		 * @param progress_callback: Optional callback to report progress during decompression.
+		 * @param settings: Runtime options such as the I/O buffer size.
+		 */
+		static void decode(std::istream& input_file, std::ostream& output_file, std::optional<ProgressCallback> progress_callback = std::nullopt,
+			const CodecSettings& settings = {});
+
+		/**
+		 * @brief Compresses a block held in memory, producing the same bytes as the stream encode.
+		 *
+		 * @param data: The data to compress.
+		 * @param size: Number of bytes at data.
+		 * @param output: Vector the encoded data is appended to.
 		 */
-		static void decode(std::ifstream& input_file, std::ofstream& output_file, std::optional<ProgressCallback> progress_callback = std::nullopt);
+		static void encode(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& output);
+
+		/**
+		 * @brief Compresses a block held in memory on several threads, producing the same bytes as the serial encode.
+		 *
+		 * The block is cut into one chunk per thread, each chunk is encoded into a buffer
+		 * of its own and the buffers are placed in the output at the prefix sums of their
+		 * sizes. Blocks smaller than two chunks of PARALLEL_CHUNK_SIZE are encoded serially.
+		 *
+		 * @param data: The data to compress.
+		 * @param size: Number of bytes at data.
+		 * @param output: Vector the encoded data is appended to.
+		 * @param pool: The threads encoding the chunks. The caller encodes the first one itself.
+		 */
+		static void encode(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& output, ThreadPool& pool);
+
+		/**
+		 * @brief Decompresses a block held in memory.
+		 *
+		 * @param data: The encoded data.
+		 * @param size: Number of bytes at data.
+		 * @param output: Vector the decoded data is appended to.
+		 * @param symbol_count: Number of bytes the block decodes to. Decoding stops with an error beyond it.
+		 * @throws: CompressionException if the block decodes to more than symbol_count bytes.
+		 */
+		static void decode(const std::uint8_t* data, size_t size, std::vector<std::uint8_t>& output, size_t symbol_count);
+
+		static constexpr size_t PARALLEL_CHUNK_SIZE = 256 * 1024;	///< Smallest input a thread encodes on its own.
 
 	private:
 
 		static constexpr std::byte ESCAPE{ 255 };			///< Escape character for 255 byte limit
 
+		/**
+		 * @brief Moves a chunk boundary to the next position at which the serial encoder starts a run.
+		 *
+		 * Those are the first byte of every run of equal bytes and, within a run, every
+		 * 255th byte after its start, where a full run ends and the next one begins.
+		 *
+		 * @param data: The data being encoded.
+		 * @param size: Number of bytes at data.
+		 * @param chunk_start: Start of the chunk before the boundary, itself such a position.
+		 * @param boundary: The boundary to move, chunk_start at the least.
+		 * @return: The first position at or after boundary the serial encoder starts a run at, or size.
+		 */
+		static size_t RunBoundary(const std::uint8_t* data, size_t size, size_t chunk_start, size_t boundary);
+
 
 		/**
 		 * @brief Writes a run of repeated bytes to the output file.
@@ -214,8 +404,10 @@ namespace EncodingAlgorithms {
 		 * @param output_file The output file stream to write the compressed data.
 		 * @param character The byte being repeated.
 		 * @param count The number of times the byte is repeated.
+		 * @param buffer_size The buffer size at which the buffer is flushed to the file.
 		 */
-		static void writeRun(std::vector<std::byte>& buffer, std::ofstream& output_file, std::byte character, std::byte count);
+		static void writeRun(std::vector<std::byte>& buffer, std::ostream& output_file, std::byte character, std::byte count,
+			size_t buffer_size);
 
 		/**
 		 * @brief Flushes the buffer to the output file.
@@ -225,7 +417,7 @@ namespace EncodingAlgorithms {
 		 * @param buffer: The buffer containing compressed data to flush.
 		 * @param output_file: The output file stream to write the data.
 		 */
-		static void flushBuffer(const std::vector<std::byte>& buffer, std::ofstream& output_file);
+		static void flushBuffer(const std::vector<std::byte>& buffer, std::ostream& output_file);
 	};
 
 }
\ No newline at end of file
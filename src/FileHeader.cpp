@@ -1,20 +1,35 @@
 #include "FileHeader.h"
+#include "ByteIO.h"
+#include "CodecSettings.h"
 #include "CompressionExceptions.h"
 
 
 FileHeader::FileHeader(const std::array<char, MAGIC_NUMBER_SIZE>& magic, const std::string& extension)
     : magic_number_(magic), original_extension_(extension) {}
 
-void FileHeader::write(std::ofstream& output_file) const {
+void FileHeader::write(std::ostream& output_file) const {
     output_file.write(magic_number_.data(), MAGIC_NUMBER_SIZE);
     output_file.write(reinterpret_cast<const char*>(&version_), VERSION_SIZE);
 
     auto extension_length = static_cast<uint8_t>(original_extension_.length());
     output_file.write(reinterpret_cast<const char*>(&extension_length), EXTENSION_LENGTH_SIZE);
     output_file.write(original_extension_.data(), extension_length);
+
+    if (is_block_format()) {
+        output_file.write(reinterpret_cast<const char*>(&flags_), FLAGS_SIZE);
+        ByteIO::WriteLE(output_file, block_size_);
+
+        if (has_original_size()) {
+            ByteIO::WriteLE(output_file, original_size_);
+        }
+
+        if (has_static_table()) {
+            ByteIO::WriteLE(output_file, table_id_);
+        }
+    }
 }
 
-FileHeader FileHeader::read(std::ifstream& input_file) {
+FileHeader FileHeader::read(std::istream& input_file) {
     FileHeader header;
 
     input_file.read(header.magic_number_.data(), MAGIC_NUMBER_SIZE);
@@ -23,13 +38,14 @@ FileHeader FileHeader::read(std::ifstream& input_file) {
     }
 
     input_file.read(reinterpret_cast<char*>(&header.version_), VERSION_SIZE);
-    if (input_file.gcount() != VERSION_SIZE || header.version_ != VERSION_NUMBER) {
+    if (input_file.gcount() != VERSION_SIZE || header.version_ < LEGACY_VERSION || header.version_ > VERSION_NUMBER) {
         throw InvalidHeaderException("Unsupported file version");
     }
 
+    // Streamed input has no extension, which only the block format can represent.
     uint8_t extension_length{};
     input_file.read(reinterpret_cast<char*>(&extension_length), EXTENSION_LENGTH_SIZE);
-    if (input_file.gcount() != EXTENSION_LENGTH_SIZE || extension_length == 0) {
+    if (input_file.gcount() != EXTENSION_LENGTH_SIZE || (extension_length == 0 && !header.is_block_format())) {
         throw InvalidHeaderException("Invalid extension length");
     }
 
@@ -39,6 +55,27 @@ FileHeader FileHeader::read(std::ifstream& input_file) {
         throw InvalidHeaderException("Failed to read original file extension");
     }
 
+    if (header.is_block_format()) {
+        input_file.read(reinterpret_cast<char*>(&header.flags_), FLAGS_SIZE);
+        if (input_file.gcount() != FLAGS_SIZE || (header.flags_ & ~KNOWN_FLAGS) != 0) {
+            throw InvalidHeaderException("Unsupported feature flags");
+        }
+
+        // Decoders allocate blocks of this size, so it is held to the sizes the encoder writes.
+        if (!ByteIO::ReadLE(input_file, header.block_size_) || header.block_size_ < EncodingAlgorithms::MIN_BLOCK_SIZE ||
+            header.block_size_ > EncodingAlgorithms::MAX_BLOCK_SIZE) {
+            throw InvalidHeaderException("Invalid block size");
+        }
+
+        if (header.has_original_size() && !ByteIO::ReadLE(input_file, header.original_size_)) {
+            throw InvalidHeaderException("Failed to read original file size");
+        }
+
+        if (header.has_static_table() && !ByteIO::ReadLE(input_file, header.table_id_)) {
+            throw InvalidHeaderException("Failed to read static table ID");
+        }
+    }
+
     return header;
 
 }
@@ -5,11 +5,20 @@
 // metadata to/from compressed files to ensure the correct algorithm and file format
 // are used for decompression. It also includes validation checks to detect
 // invalid or corrupted file headers.
+//
+// Version 1 files contain a single codec stream after the header. Version 2 files
+// add a flags byte and the block size, and are followed by independently encoded
+// blocks (see BlockCoding), which allows streaming without seeking. When the input
+// size is known up front it is recorded as well, so the decompressor can allocate
+// the output file in one piece and report progress against the real total.
+// Huffman files compressed with a pre-trained table record the table's ID
+// instead of storing a table in every block.
 
 
 #pragma once
 
 #include <array>
+#include <cstdint>
 #include <string>
 #include <fstream>
 
@@ -30,7 +39,20 @@ public:
     static constexpr size_t MAGIC_NUMBER_SIZE = 3;        ///< Size of the magic number field (3 bytes).
     static constexpr size_t VERSION_SIZE = 1;             ///< Size of the version field (1 byte).
     static constexpr size_t EXTENSION_LENGTH_SIZE = 1;    ///< Size of the extension length field (1 byte).
-    static constexpr size_t VERSION_NUMBER = 1;           ///< Current version number of the file format.
+    static constexpr size_t FLAGS_SIZE = 1;               ///< Size of the flags field (1 byte, version 2+).
+    static constexpr size_t BLOCK_SIZE_SIZE = 4;          ///< Size of the block size field (4 bytes, version 2+).
+    static constexpr size_t ORIGINAL_SIZE_SIZE = 8;       ///< Size of the original size field (8 bytes, FLAG_ORIGINAL_SIZE only).
+    static constexpr size_t TABLE_ID_SIZE = 4;            ///< Size of the static table ID field (4 bytes, FLAG_STATIC_TABLE only).
+
+    static constexpr uint8_t LEGACY_VERSION = 1;          ///< A single codec stream follows the header.
+    static constexpr uint8_t BLOCK_VERSION = 2;           ///< Independently encoded blocks follow the header.
+    static constexpr uint8_t VERSION_NUMBER = BLOCK_VERSION; ///< Current version number of the file format.
+
+    static constexpr uint8_t FLAG_BLOCK_INDEX = 0x01;      ///< A BlockIndex follows the end-of-stream frame.
+    static constexpr uint8_t FLAG_CHECKSUMS = 0x02;        ///< Frames carry CRC32C checksums of their data.
+    static constexpr uint8_t FLAG_ORIGINAL_SIZE = 0x04;    ///< The uncompressed size follows the block size.
+    static constexpr uint8_t FLAG_STATIC_TABLE = 0x08;     ///< Blocks are coded with the StaticHuffmanTable whose ID follows.
+    static constexpr uint8_t KNOWN_FLAGS = FLAG_BLOCK_INDEX | FLAG_CHECKSUMS | FLAG_ORIGINAL_SIZE | FLAG_STATIC_TABLE; ///< Mask of the flag bits this version understands.
 
     /**
     * @brief Default constructor for FileHeader.
@@ -51,24 +73,25 @@ public:
     * @brief Writes the file header to the output stream.
     *
     * This method writes the magic number, version, and original file extension
-    * to the output file. It is used during compression to store the file's metadata.
+    * to the output file, followed by the flags and block size for version 2.
+    * It is used during compression to store the file's metadata.
     *
     * @param output_file: The output stream where the header will be written.
     */
-    void write(std::ofstream& output_file) const;
+    void write(std::ostream& output_file) const;
 
     /**
     * @brief Reads the file header from the input stream.
     *
     * This method reads the magic number, version, and original file extension
-    * from the input file. It validates the correctness of the file header and
+    * (and for version 2, the flags and block size) from the input file. It validates the correctness of the file header and
     * throws exceptions if any part of the header is invalid or corrupted.
     *
     * @param input_file: The input stream from which the header will be read.
     * @return: A FileHeader object containing the read metadata.
     * @throws: InvalidHeaderException if the header is invalid or corrupted.
     */
-    static FileHeader read(std::ifstream& input_file);
+    static FileHeader read(std::istream& input_file);
 
     /**
     * @brief Validates the magic number against an expected value.
@@ -81,9 +104,40 @@ public:
     */
     bool is_valid_magic_number(const std::array<char, MAGIC_NUMBER_SIZE>& expected) const;
 
+    /**
+    * @brief Checks whether the body of the file is a sequence of framed blocks.
+    *
+    * @return: true for version 2 files, false for legacy single-stream files.
+    */
+    bool is_block_format() const { return version_ >= BLOCK_VERSION; }
+
+    /**
+    * @brief Checks whether the file ends with a block index that allows random access.
+    */
+    bool has_block_index() const { return is_block_format() && (flags_ & FLAG_BLOCK_INDEX) != 0; }
+
+    /**
+    * @brief Checks whether every block and the whole file are protected by CRC32C checksums.
+    */
+    bool has_checksums() const { return is_block_format() && (flags_ & FLAG_CHECKSUMS) != 0; }
+
+    /**
+    * @brief Checks whether the uncompressed size of the file is recorded in original_size_.
+    */
+    bool has_original_size() const { return is_block_format() && (flags_ & FLAG_ORIGINAL_SIZE) != 0; }
+
+    /**
+    * @brief Checks whether the blocks were coded with the pre-trained table identified by table_id_.
+    */
+    bool has_static_table() const { return is_block_format() && (flags_ & FLAG_STATIC_TABLE) != 0; }
+
     // Public member variables containing the file metadata.
     std::array<char, MAGIC_NUMBER_SIZE> magic_number_;      ///< Magic number identifying the compression algorithm.
     uint8_t version_ = VERSION_NUMBER;                      ///< File format version.
     std::string original_extension_;                        ///< The original file extension before compression.
+    uint8_t flags_ = 0;                                     ///< Optional feature flags (version 2+).
+    uint32_t block_size_ = 0;                               ///< Uncompressed size of every block but the last (version 2+).
+    uint64_t original_size_ = 0;                            ///< Uncompressed size of the file (FLAG_ORIGINAL_SIZE only).
+    uint32_t table_id_ = 0;                                 ///< ID of the StaticHuffmanTable (FLAG_STATIC_TABLE only).
 
 };
\ No newline at end of file
@@ -0,0 +1,56 @@
+// FunctionRef.h
+//
+// A non-owning reference to a callable, used for callbacks that are only
+// invoked during the call they are passed to, such as progress callbacks.
+// Unlike std::function it never allocates or copies the callable: it is two
+// pointers, and calling it is one indirect call.
+//
+// The referenced callable must outlive the FunctionRef. Passing a lambda
+// directly as an argument is fine, since the temporary lives until the call
+// returns, but a FunctionRef must not be stored beyond that.
+
+
+#pragma once
+
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+
+template <class Signature>
+class FunctionRef;
+
+/**
+* @class FunctionRef
+* @brief Non-owning, non-allocating reference to any callable with the given signature.
+*/
+template <class Result, class... Args>
+class FunctionRef<Result(Args...)> {
+public:
+
+	/**
+	* @brief References a callable. The callable is not copied and must outlive this reference.
+	*
+	* @param callable: A function, lambda or other object callable with Args.
+	*/
+	template <class Callable, class = std::enable_if_t<
+		!std::is_same_v<std::decay_t<Callable>, FunctionRef> &&
+		std::is_invocable_r_v<Result, Callable&, Args...>>>
+	FunctionRef(Callable&& callable) noexcept
+		: object_(const_cast<void*>(static_cast<const void*>(std::addressof(callable)))),
+		thunk_([](void* object, Args... args) -> Result {
+			return (*static_cast<std::add_pointer_t<Callable>>(object))(std::forward<Args>(args)...);
+		}) {
+	}
+
+	/**
+	* @brief Calls the referenced callable.
+	*/
+	Result operator()(Args... args) const {
+		return thunk_(object_, std::forward<Args>(args)...);
+	}
+
+private:
+	void* object_;
+	Result(*thunk_)(void*, Args...);
+};
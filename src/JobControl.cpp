@@ -0,0 +1,67 @@
+#include "JobControl.h"
+#include "CompressionExceptions.h"
+
+#include <chrono>
+
+namespace {
+
+	// A paused job is woken directly by its own control. Changes to a parent are
+	// noticed by polling, which only costs anything while the job is paused.
+	constexpr auto PAUSE_POLL_INTERVAL = std::chrono::milliseconds(50);
+
+}
+
+
+JobControl::JobControl(std::shared_ptr<const JobControl> parent)
+	: parent_(std::move(parent)) {
+}
+
+void JobControl::Cancel() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		state_.fetch_or(CANCELLED);
+	}
+	condition_.notify_all();
+}
+
+void JobControl::Pause() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	state_.fetch_or(PAUSED);
+}
+
+void JobControl::Resume() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		state_.fetch_and(static_cast<std::uint8_t>(~PAUSED));
+	}
+	condition_.notify_all();
+}
+
+void JobControl::Reset() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		state_ = 0;
+	}
+	condition_.notify_all();
+}
+
+bool JobControl::IsCancelled() const {
+	return (state_.load() & CANCELLED) != 0 || (parent_ && parent_->IsCancelled());
+}
+
+bool JobControl::IsPaused() const {
+	return (state_.load() & PAUSED) != 0 || (parent_ && parent_->IsPaused());
+}
+
+void JobControl::WaitWhilePaused() const {
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (true) {
+		if (IsCancelled()) {
+			throw OperationCancelledException();
+		}
+		if (!IsPaused()) {
+			return;
+		}
+		condition_.wait_for(lock, PAUSE_POLL_INTERVAL);
+	}
+}
@@ -0,0 +1,106 @@
+// JobControl.h
+//
+// JobControl lets another thread cancel or pause a running job. The codecs call
+// CheckPoint between blocks and I/O buffers, never inside their per-byte loops,
+// so an idle control costs one relaxed atomic load per block.
+//
+// A cancelled job throws OperationCancelledException from its next check point
+// and unwinds like any other failure, which is where partial outputs are removed
+// (see PartialOutputGuard). A paused job blocks in its next check point until it
+// is resumed or cancelled.
+//
+// Controls can be chained: a job whose control has a parent also stops when the
+// parent is cancelled or paused. BatchQueue gives every job a child of the
+// queue's control, so one speculative job can be dropped without touching the rest.
+
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+
+/**
+* @class JobControl
+* @brief Thread-safe cancellation and pause flags checked by running jobs.
+*/
+class JobControl {
+public:
+
+	/**
+	* @brief Creates a control that is neither cancelled nor paused.
+	*
+	* @param parent: Optional control whose cancellation and pause also apply to this one.
+	*/
+	explicit JobControl(std::shared_ptr<const JobControl> parent = nullptr);
+
+	JobControl(const JobControl&) = delete;
+	JobControl& operator=(const JobControl&) = delete;
+
+	/**
+	* @brief Makes jobs throw OperationCancelledException at their next check point, even if paused.
+	*/
+	void Cancel();
+
+	/**
+	* @brief Makes jobs block at their next check point until Resume or Cancel is called.
+	*/
+	void Pause();
+
+	/**
+	* @brief Lets paused jobs continue.
+	*/
+	void Resume();
+
+	/**
+	* @brief Clears cancellation and pause, so the control can be used for the next job.
+	*
+	* Must only be called while no job is using the control.
+	*/
+	void Reset();
+
+	/**
+	* @brief Checks whether this control or one of its parents was cancelled.
+	*/
+	bool IsCancelled() const;
+
+	/**
+	* @brief Checks whether this control or one of its parents is paused.
+	*/
+	bool IsPaused() const;
+
+	/**
+	* @brief Returns immediately unless the job was cancelled or paused.
+	*
+	* @throws: OperationCancelledException if the job was cancelled, also while waiting to be resumed.
+	*/
+	void CheckPoint() const {
+		if (IsInterrupted()) {
+			WaitWhilePaused();
+		}
+	}
+
+private:
+	static constexpr std::uint8_t CANCELLED = 1;
+	static constexpr std::uint8_t PAUSED = 2;
+
+	/**
+	* @brief Fast check for any flag set on this control or its parents.
+	*/
+	bool IsInterrupted() const {
+		return state_.load(std::memory_order_relaxed) != 0 || (parent_ && parent_->IsInterrupted());
+	}
+
+	/**
+	* @brief Slow path of CheckPoint: throws if cancelled, otherwise blocks while paused.
+	*/
+	void WaitWhilePaused() const;
+
+	std::atomic<std::uint8_t> state_{ 0 };
+	std::shared_ptr<const JobControl> parent_;
+	mutable std::mutex mutex_;
+	mutable std::condition_variable condition_;
+};
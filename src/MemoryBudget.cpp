@@ -0,0 +1,134 @@
+#include "MemoryBudget.h"
+#include "CompressionExceptions.h"
+#include "JobControl.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+namespace {
+
+	// Jobs waiting for memory share one condition, since bytes returned to any budget
+	// may be what a parent was short of. Waiting jobs also poll, so they notice being
+	// cancelled or paused while nothing is returned.
+	std::mutex wait_mutex;
+	std::condition_variable memory_returned;
+	constexpr auto WAIT_POLL_INTERVAL = std::chrono::milliseconds(50);
+
+}
+
+
+MemoryBudget::Reservation::Reservation(Reservation&& other) noexcept
+	: budget_(other.budget_), bytes_(other.bytes_) {
+	other.budget_ = nullptr;
+	other.bytes_ = 0;
+}
+
+MemoryBudget::Reservation& MemoryBudget::Reservation::operator=(Reservation&& other) noexcept {
+	if (this != &other) {
+		Reset();
+		budget_ = other.budget_;
+		bytes_ = other.bytes_;
+		other.budget_ = nullptr;
+		other.bytes_ = 0;
+	}
+	return *this;
+}
+
+void MemoryBudget::Reservation::Reset() {
+	if (budget_) {
+		budget_->Release(bytes_);
+		budget_ = nullptr;
+		bytes_ = 0;
+	}
+}
+
+
+MemoryBudget::MemoryBudget(size_t limit, std::shared_ptr<MemoryBudget> parent)
+	: limit_(limit), parent_(std::move(parent)) {
+}
+
+void MemoryBudget::SetLimit(size_t limit) {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		limit_ = limit;
+	}
+	// A raised limit may let waiting jobs start.
+	std::lock_guard<std::mutex> lock(wait_mutex);
+	memory_returned.notify_all();
+}
+
+size_t MemoryBudget::limit() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return limit_;
+}
+
+size_t MemoryBudget::used() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return used_;
+}
+
+size_t MemoryBudget::peak() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return peak_;
+}
+
+size_t MemoryBudget::EffectiveLimit() const {
+	size_t limit = this->limit();
+	return parent_ ? std::min(limit, parent_->EffectiveLimit()) : limit;
+}
+
+MemoryBudget::Reservation MemoryBudget::Reserve(size_t bytes, const JobControl* control) {
+	if (bytes > EffectiveLimit()) {
+		throw CompressionException("The memory budget of " + std::to_string(EffectiveLimit()) +
+			" bytes is too small, the job needs at least " + std::to_string(bytes));
+	}
+
+	std::unique_lock<std::mutex> lock(wait_mutex);
+	while (!Acquire(bytes)) {
+		memory_returned.wait_for(lock, WAIT_POLL_INTERVAL);
+		if (control) {
+			lock.unlock();
+			control->CheckPoint();
+			lock.lock();
+		}
+	}
+	return Reservation(this, bytes);
+}
+
+std::optional<MemoryBudget::Reservation> MemoryBudget::TryReserve(size_t bytes) {
+	if (!Acquire(bytes)) {
+		return std::nullopt;
+	}
+	return Reservation(this, bytes);
+}
+
+const std::shared_ptr<MemoryBudget>& MemoryBudget::Process() {
+	static const std::shared_ptr<MemoryBudget> process = std::make_shared<MemoryBudget>();
+	return process;
+}
+
+bool MemoryBudget::Acquire(size_t bytes) {
+	// Locks are taken from the child to the root, so concurrent reservations can't deadlock.
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (bytes > limit_ - std::min(used_, limit_) || (parent_ && !parent_->Acquire(bytes))) {
+		return false;
+	}
+	used_ += bytes;
+	peak_ = std::max(peak_, used_);
+	return true;
+}
+
+void MemoryBudget::Release(size_t bytes) {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		used_ -= std::min(used_, bytes);
+	}
+	if (parent_) {
+		parent_->Release(bytes);
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(wait_mutex);
+	memory_returned.notify_all();
+}
@@ -0,0 +1,151 @@
+// MemoryBudget.h
+//
+// MemoryBudget caps the memory jobs may hold for their blocks and I/O buffers.
+// Before a codec allocates a block buffer or keeps another block in flight, it
+// reserves the block's size from the job's budget, and the reservation is returned
+// when the memory is freed. The budget therefore bounds what the codecs hold at
+// once rather than counting every allocation.
+//
+// Budgets can be chained like JobControls: a reservation is charged to the budget
+// and all of its parents. BatchQueue gives every job a child of the queue's budget,
+// which itself is a child of Process(), so one limit can cap a single file, another
+// the whole batch, and a third everything the process compresses at once.
+//
+// Reserve blocks until the bytes fit, which is how jobs wait for their turn when
+// the budget is exhausted. It must only be called while the caller holds no other
+// reservation of the budget, or two jobs could wait for each other forever.
+// TryReserve never blocks and is used for optional extras, such as more blocks in
+// flight, so a job that can't get them runs with less parallelism instead.
+//
+// Every budget records its peak, the most bytes reserved from it at once.
+
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+class JobControl;
+
+
+/**
+* @class MemoryBudget
+* @brief Thread-safe limit on the bytes reserved by the jobs sharing it.
+*/
+class MemoryBudget {
+public:
+
+	static constexpr size_t UNLIMITED = std::numeric_limits<size_t>::max();
+
+	/**
+	* @class Reservation
+	* @brief Bytes reserved from a budget, returned to it when the reservation is destroyed.
+	*/
+	class Reservation {
+	public:
+		Reservation() = default;
+		~Reservation() { Reset(); }
+
+		Reservation(Reservation&& other) noexcept;
+		Reservation& operator=(Reservation&& other) noexcept;
+		Reservation(const Reservation&) = delete;
+		Reservation& operator=(const Reservation&) = delete;
+
+		/**
+		* @brief Returns the bytes to the budget early.
+		*/
+		void Reset();
+
+		size_t bytes() const { return bytes_; }
+
+	private:
+		friend class MemoryBudget;
+
+		Reservation(MemoryBudget* budget, size_t bytes) : budget_(budget), bytes_(bytes) {}
+
+		MemoryBudget* budget_ = nullptr;
+		size_t bytes_ = 0;
+	};
+
+	/**
+	* @brief Creates a budget with nothing reserved.
+	*
+	* @param limit: Most bytes that may be reserved at once, UNLIMITED to only count them.
+	* @param parent: Optional budget every reservation is also charged to. It must outlive this one.
+	*/
+	explicit MemoryBudget(size_t limit = UNLIMITED, std::shared_ptr<MemoryBudget> parent = nullptr);
+
+	MemoryBudget(const MemoryBudget&) = delete;
+	MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+	/**
+	* @brief Changes the limit. Bytes already reserved stay reserved, even above the new limit.
+	*/
+	void SetLimit(size_t limit);
+
+	size_t limit() const;
+
+	/**
+	* @brief Bytes currently reserved from this budget.
+	*/
+	size_t used() const;
+
+	/**
+	* @brief Most bytes that were reserved from this budget at once.
+	*/
+	size_t peak() const;
+
+	/**
+	* @brief The smallest limit of this budget and its parents, which bounds any single reservation.
+	*/
+	size_t EffectiveLimit() const;
+
+	/**
+	* @brief Reserves bytes, waiting until other jobs have returned enough.
+	*
+	* @param bytes: Number of bytes to reserve.
+	* @param control: Optional control of the waiting job, so it can be cancelled or paused while it waits.
+	* @return: The reservation, which returns the bytes when destroyed.
+	* @throws: CompressionException if the bytes exceed EffectiveLimit and could never be reserved.
+	* @throws: OperationCancelledException if the job is cancelled while waiting.
+	*/
+	[[nodiscard]] Reservation Reserve(size_t bytes, const JobControl* control = nullptr);
+
+	/**
+	* @brief Reserves bytes if they fit right now.
+	*
+	* @param bytes: Number of bytes to reserve.
+	* @return: The reservation, or nullopt if this budget or one of its parents has too little left.
+	*/
+	[[nodiscard]] std::optional<Reservation> TryReserve(size_t bytes);
+
+	/**
+	* @brief Returns the budget shared by everything the process runs.
+	*
+	* It is unlimited unless the application sets a limit. BatchQueue and the C API
+	* create their budgets below it.
+	*/
+	static const std::shared_ptr<MemoryBudget>& Process();
+
+private:
+
+	/**
+	* @brief Charges bytes to this budget and its parents if all of them have room.
+	*/
+	bool Acquire(size_t bytes);
+
+	/**
+	* @brief Returns bytes to this budget and its parents and wakes waiting jobs.
+	*/
+	void Release(size_t bytes);
+
+	mutable std::mutex mutex_;
+	size_t limit_;
+	size_t used_ = 0;
+	size_t peak_ = 0;
+	std::shared_ptr<MemoryBudget> parent_;
+};
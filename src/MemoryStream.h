@@ -0,0 +1,115 @@
+// MemoryStream.h
+//
+// Stream buffers over memory, used to run the stream-based codecs on single
+// blocks of data without copying them into a std::stringstream.
+//
+// MemoryInputBuffer reads from an existing byte range and supports seeking (the
+// Huffman encoder rewinds its input). MemoryOutputBuffer appends everything that
+// is written to a caller-owned vector. NullOutputBuffer discards its output and
+// only counts it, for verifying files without writing them anywhere.
+
+
+#pragma once
+
+#include <cstdint>
+#include <streambuf>
+#include <vector>
+
+
+/**
+* @class MemoryInputBuffer
+* @brief Read-only, seekable stream buffer over a byte range it does not own.
+*/
+class MemoryInputBuffer : public std::streambuf {
+public:
+
+	/**
+	* @brief Constructs a buffer reading from the given range.
+	*
+	* @param data: Start of the range. Must outlive the buffer.
+	* @param size: Number of bytes in the range.
+	*/
+	MemoryInputBuffer(const std::uint8_t* data, size_t size) {
+		// The get area is never written through, the const_cast is only to satisfy setg.
+		char* begin = const_cast<char*>(reinterpret_cast<const char*>(data));
+		setg(begin, begin, begin + size);
+	}
+
+protected:
+	pos_type seekoff(off_type off, std::ios::seekdir dir, std::ios::openmode which) override {
+		off_type base = dir == std::ios::beg ? 0 : dir == std::ios::cur ? gptr() - eback() : egptr() - eback();
+		return seekpos(pos_type(base + off), which);
+	}
+
+	pos_type seekpos(pos_type pos, std::ios::openmode /*which*/) override {
+		off_type offset = pos;
+		if (offset < 0 || offset > egptr() - eback()) {
+			return pos_type(off_type(-1));
+		}
+		setg(eback(), eback() + offset, egptr());
+		return pos;
+	}
+};
+
+
+/**
+* @class MemoryOutputBuffer
+* @brief Stream buffer that appends all output to a vector.
+*/
+class MemoryOutputBuffer : public std::streambuf {
+public:
+
+	/**
+	* @brief Constructs a buffer appending to the given vector.
+	*
+	* @param output: The vector receiving the data. Existing contents are kept.
+	*/
+	explicit MemoryOutputBuffer(std::vector<std::uint8_t>& output) : output_(output) {}
+
+protected:
+	int_type overflow(int_type ch) override {
+		if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+			output_.push_back(static_cast<std::uint8_t>(traits_type::to_char_type(ch)));
+		}
+		return traits_type::not_eof(ch);
+	}
+
+	std::streamsize xsputn(const char* data, std::streamsize count) override {
+		output_.insert(output_.end(), reinterpret_cast<const std::uint8_t*>(data),
+			reinterpret_cast<const std::uint8_t*>(data) + count);
+		return count;
+	}
+
+private:
+	std::vector<std::uint8_t>& output_;
+};
+
+
+/**
+* @class NullOutputBuffer
+* @brief Stream buffer that discards all output, counting the bytes written.
+*/
+class NullOutputBuffer : public std::streambuf {
+public:
+
+	/**
+	* @brief Returns the number of bytes written so far.
+	*/
+	std::uint64_t size() const { return size_; }
+
+protected:
+	int_type overflow(int_type ch) override {
+		if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+			++size_;
+		}
+		return traits_type::not_eof(ch);
+	}
+
+	std::streamsize xsputn(const char* /*data*/, std::streamsize count) override {
+		size_ += static_cast<std::uint64_t>(count);
+		return count;
+	}
+
+private:
+	std::uint64_t size_ = 0;
+};
@@ -0,0 +1,68 @@
+// PartialOutputGuard.h
+//
+// Removes the output of a job that didn't finish. A cancelled or failed job
+// would otherwise leave a truncated file behind that looks like a valid result.
+//
+// The guard must be declared before the stream writing the output, so that the
+// stream is closed by the time the guard's destructor removes the file.
+
+
+#pragma once
+
+#include <filesystem>
+#include <system_error>
+#include <utility>
+
+
+/**
+* @class PartialOutputGuard
+* @brief Deletes an output file or directory on destruction unless the job committed it.
+*/
+class PartialOutputGuard {
+public:
+
+	/**
+	* @brief Guards an output that is about to be written.
+	*
+	* @param path: The output to remove if the job fails. Empty guards nothing.
+	* @param directory: Whether the output is a directory the job creates, removed with everything in it.
+	*	Otherwise only a regular file is removed, never a directory that happens to have its name.
+	*/
+	explicit PartialOutputGuard(std::filesystem::path path = {}, bool directory = false)
+		: path_(std::move(path)), directory_(directory) {}
+
+	/**
+	* @brief Removes the output unless Commit was called. Errors are ignored, the job's own error matters more.
+	*/
+	~PartialOutputGuard() {
+		if (path_.empty()) {
+			return;
+		}
+		std::error_code error;
+		if (directory_) {
+			std::filesystem::remove_all(path_, error);
+		}
+		else if (std::filesystem::is_regular_file(path_, error)) {
+			std::filesystem::remove(path_, error);
+		}
+	}
+
+	PartialOutputGuard(const PartialOutputGuard&) = delete;
+	PartialOutputGuard& operator=(const PartialOutputGuard&) = delete;
+
+	/**
+	* @brief Sets the output to remove, for jobs that only know it once they have started.
+	*
+	* @param path: The file to remove if the job fails.
+	*/
+	void Guard(std::filesystem::path path) { path_ = std::move(path); }
+
+	/**
+	* @brief Keeps the output, called once the job has completed.
+	*/
+	void Commit() { path_.clear(); }
+
+private:
+	std::filesystem::path path_;
+	bool directory_;
+};
@@ -0,0 +1,160 @@
+#include "PositionalFile.h"
+#include "CompressionExceptions.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <limits>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+PositionalFile::PositionalFile(const std::filesystem::path& path, EncodingAlgorithms::IoMode io_mode)
+	: io_mode_(io_mode) {
+
+#ifdef _WIN32
+	handle_ = CreateFileW(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (handle_ == INVALID_HANDLE_VALUE) {
+		throw FileOpenException(path.string());
+	}
+#else
+	fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (fd_ < 0) {
+		throw FileOpenException(path.string());
+	}
+#endif
+}
+
+PositionalFile::~PositionalFile() {
+	try {
+		Close();
+	}
+	catch (...) {
+		// Destructors must not throw, callers that care about errors call Close() themselves.
+	}
+}
+
+void PositionalFile::WriteAt(const void* data, size_t size, std::uint64_t offset) {
+	auto bytes = static_cast<const char*>(data);
+	const std::uint64_t start = offset;
+
+	while (size > 0) {
+#ifdef _WIN32
+		// WriteFile takes a 32-bit length, and the OVERLAPPED offset makes the write positional.
+		DWORD chunk = static_cast<DWORD>(std::min<size_t>(size, std::numeric_limits<DWORD>::max()));
+		OVERLAPPED overlapped = {};
+		overlapped.Offset = static_cast<DWORD>(offset);
+		overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+		DWORD written = 0;
+		if (!WriteFile(handle_, bytes, chunk, &written, &overlapped) || written == 0) {
+			throw CompressionException("Failed to write output file");
+		}
+#else
+		auto written = ::pwrite(fd_, bytes, size, static_cast<off_t>(offset));
+		if (written < 0 && errno == EINTR) {
+			continue;
+		}
+		if (written <= 0) {
+			throw CompressionException("Failed to write output file");
+		}
+#endif
+		bytes += written;
+		size -= static_cast<size_t>(written);
+		offset += static_cast<std::uint64_t>(written);
+	}
+
+	if (io_mode_ == EncodingAlgorithms::IoMode::DropBehind && offset > start) {
+		DropWritten(start, offset);
+	}
+}
+
+void PositionalFile::DropWritten(std::uint64_t start, std::uint64_t end) {
+#ifdef POSIX_FADV_DONTNEED
+	std::uint64_t drop_start;
+	std::uint64_t drop_end;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		written_[start] = end;
+		for (auto write = written_.begin(); write != written_.end() && write->first == written_until_; write = written_.erase(write)) {
+			written_until_ = write->second;
+		}
+		if (written_until_ == dropped_until_) {
+			return;
+		}
+		// Claimed under the lock, so concurrent writers drop disjoint ranges.
+		drop_start = dropped_until_;
+		drop_end = written_until_;
+		dropped_until_ = written_until_;
+	}
+
+	auto length = static_cast<off_t>(drop_end - drop_start);
+#ifdef SYNC_FILE_RANGE_WRITE
+	// Dirty pages can't be dropped, so wait for their writeback to finish first.
+	sync_file_range(fd_, static_cast<off_t>(drop_start), length,
+		SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+#endif
+	posix_fadvise(fd_, static_cast<off_t>(drop_start), length, POSIX_FADV_DONTNEED);
+#else
+	(void)start;
+	(void)end;
+#endif
+}
+
+void PositionalFile::Preallocate(std::uint64_t size) {
+	if (size == 0) {
+		return;
+	}
+
+#ifdef _WIN32
+	FILE_ALLOCATION_INFO allocation = {};
+	allocation.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+	SetFileInformationByHandle(handle_, FileAllocationInfo, &allocation, sizeof(allocation));
+#elif defined(__linux__)
+	// Unlike ftruncate this allocates real extents, and unlike fallocate(2) it
+	// works on every filesystem (glibc emulates it where the kernel can't).
+	// An output that can't fit fails now rather than after most of it is written.
+	int result = posix_fallocate(fd_, 0, static_cast<off_t>(size));
+	if (result == ENOSPC || result == EFBIG) {
+		throw CompressionException("Not enough disk space for the output file");
+	}
+#elif defined(F_PREALLOCATE)
+	fstore_t store = { F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0, static_cast<off_t>(size), 0 };
+	if (fcntl(fd_, F_PREALLOCATE, &store) < 0) {
+		store.fst_flags = F_ALLOCATEALL;
+		fcntl(fd_, F_PREALLOCATE, &store);
+	}
+#else
+	(void)size;
+#endif
+}
+
+void PositionalFile::Close() {
+#ifdef _WIN32
+	if (handle_ == INVALID_HANDLE_VALUE) {
+		return;
+	}
+	bool ok = CloseHandle(handle_) != 0;
+	handle_ = INVALID_HANDLE_VALUE;
+#else
+	if (fd_ < 0) {
+		return;
+	}
+
+	bool ok = true;
+#ifdef POSIX_FADV_DONTNEED
+	if (io_mode_ != EncodingAlgorithms::IoMode::Buffered) {
+		// Whatever WriteAt couldn't drop yet goes now. Dirty pages can't be dropped, so write them back first.
+		ok = ::fdatasync(fd_) == 0;
+		posix_fadvise(fd_, 0, 0, POSIX_FADV_DONTNEED);
+	}
+#endif
+	ok = ::close(fd_) == 0 && ok;
+	fd_ = -1;
+#endif
+
+	if (!ok) {
+		throw CompressionException("Failed to close output file");
+	}
+}
@@ -0,0 +1,100 @@
+// PositionalFile.h
+//
+// An output file written at explicit offsets (pwrite on POSIX, WriteFile with an
+// OVERLAPPED offset on Windows) instead of through a shared cursor. Writes to
+// disjoint ranges are independent, so several threads can fill in different parts
+// of the file at the same time without any locking. The parallel block decoder
+// uses it to store every block at its known offset in the decompressed file.
+//
+// In DropBehind mode the file keeps track of how far it has been written without
+// gaps and drops that part from the page cache as it grows, like DirectFileBuffer
+// does for streams, so a large output doesn't fill the cache while it is decoded.
+
+
+#pragma once
+
+#include "CodecSettings.h"
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+
+/**
+* @class PositionalFile
+* @brief A write-only file supporting concurrent writes at explicit offsets.
+*/
+class PositionalFile {
+public:
+
+	/**
+	* @brief Creates or truncates a file for positional writes.
+	*
+	* @param path: The file to open.
+	* @param io_mode: DropBehind drops the written pages from the page cache once everything before them is written.
+	* @throws: FileOpenException if the file cannot be opened.
+	*/
+	PositionalFile(const std::filesystem::path& path, EncodingAlgorithms::IoMode io_mode = EncodingAlgorithms::IoMode::Buffered);
+
+	/**
+	* @brief Closes the file, ignoring errors. Call Close() to detect them.
+	*/
+	~PositionalFile();
+
+	PositionalFile(const PositionalFile&) = delete;
+	PositionalFile& operator=(const PositionalFile&) = delete;
+
+	/**
+	* @brief Writes data at an absolute offset. Safe to call from several threads for disjoint ranges.
+	*
+	* @param data: The bytes to write.
+	* @param size: Number of bytes.
+	* @param offset: Position in the file of the first byte.
+	* @throws: CompressionException if the write fails.
+	*/
+	void WriteAt(const void* data, size_t size, std::uint64_t offset);
+
+	/**
+	* @brief Reserves disk space for the whole file up front.
+	*
+	* Allocating the final size in one request lets the filesystem lay the file out
+	* contiguously instead of extending it write by write. This is only a hint:
+	* filesystems that can't preallocate are left alone.
+	*
+	* @param size: The final size of the file in bytes. Callers bound it, the space is really taken.
+	* @throws: CompressionException if the disk has no room for the file (Linux only).
+	*/
+	void Preallocate(std::uint64_t size);
+
+	/**
+	* @brief Flushes and closes the file.
+	*
+	* @throws: CompressionException if the final flush or close fails.
+	*/
+	void Close();
+
+private:
+	/**
+	* @brief Records a completed write and drops the pages before the end of the gapless prefix.
+	*
+	* @param start: Offset of the first byte written.
+	* @param end: Offset after the last byte written.
+	*/
+	void DropWritten(std::uint64_t start, std::uint64_t end);
+
+#ifdef _WIN32
+	HANDLE handle_ = INVALID_HANDLE_VALUE;
+#else
+	int fd_ = -1;
+#endif
+	EncodingAlgorithms::IoMode io_mode_;
+
+	std::mutex mutex_;									///< Guards the members below.
+	std::map<std::uint64_t, std::uint64_t> written_;	///< Start and end of the writes past written_until_.
+	std::uint64_t written_until_ = 0;					///< Everything before this offset has been written.
+	std::uint64_t dropped_until_ = 0;					///< Cached pages below this offset have already been dropped.
+};
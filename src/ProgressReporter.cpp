@@ -0,0 +1,73 @@
+#include "ProgressReporter.h"
+
+#include <algorithm>
+
+
+int ProgressReport::percentage() const {
+	return total > 0 ? static_cast<int>(std::min(processed, total) * 100 / total) : 0;
+}
+
+double ProgressReport::megabytes_per_second() const {
+	return seconds > 0 ? processed / 1e6 / seconds : 0;
+}
+
+std::optional<double> ProgressReport::eta_seconds() const {
+	if (total == 0 || processed == 0 || seconds <= 0) {
+		return std::nullopt;
+	}
+	if (processed >= total) {
+		return 0.0;
+	}
+	return seconds * static_cast<double>(total - processed) / static_cast<double>(processed);
+}
+
+
+ProgressReporter::ProgressReporter(std::uint64_t total, Callback callback, std::chrono::milliseconds interval)
+	: total_(total), callback_(std::move(callback)), interval_(interval),
+	start_(std::chrono::steady_clock::now()), last_report_(start_) {
+}
+
+void ProgressReporter::Finish(std::uint64_t processed, std::uint64_t bytes_in, std::uint64_t bytes_out) {
+	if (total_ == 0) {
+		total_ = processed;
+	}
+	Report(processed, bytes_in, bytes_out);
+}
+
+std::uint64_t ProgressReporter::Position(std::istream& stream) {
+	auto position = stream.tellg();
+	return position > 0 ? static_cast<std::uint64_t>(position) : 0;
+}
+
+std::uint64_t ProgressReporter::Position(std::ostream& stream) {
+	auto position = stream.tellp();
+	return position > 0 ? static_cast<std::uint64_t>(position) : 0;
+}
+
+bool ProgressReporter::IsDue(std::uint64_t processed) {
+	// The percentage is checked first, it costs a division where the clock costs a call.
+	if (total_ > 0) {
+		int percentage = static_cast<int>(std::min(processed, total_) * 100 / total_);
+		if (percentage == last_percentage_) {
+			return false;
+		}
+	}
+	return std::chrono::steady_clock::now() - last_report_ >= interval_;
+}
+
+void ProgressReporter::Report(std::uint64_t processed, std::uint64_t bytes_in, std::uint64_t bytes_out) {
+	auto now = std::chrono::steady_clock::now();
+	last_report_ = now;
+
+	ProgressReport report;
+	report.processed = processed;
+	report.total = total_;
+	report.bytes_in = bytes_in;
+	report.bytes_out = bytes_out;
+	report.seconds = std::chrono::duration<double>(now - start_).count();
+	last_percentage_ = report.percentage();
+
+	if (callback_) {
+		callback_(report);
+	}
+}
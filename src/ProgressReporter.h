@@ -0,0 +1,135 @@
+// ProgressReporter.h
+//
+// ProgressReporter turns the codecs' raw progress callbacks, which fire for every
+// I/O buffer, into occasional reports for a UI. A report is only produced when the
+// whole-number percentage has changed and at least REPORT_INTERVAL has passed since
+// the previous one, so a 1 GB job produces at most a hundred reports instead of
+// tens of thousands. Jobs of unknown size report on the interval alone.
+//
+// Every report carries the bytes read and written, the throughput and an ETA.
+// The byte counts are taken lazily through a callable, so querying a stream
+// position only happens when a report is actually due.
+//
+// A reporter is used by one thread at a time and has no Qt dependency.
+
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <utility>
+
+
+/**
+* @struct ProgressReport
+* @brief A snapshot of a running job's progress.
+*/
+struct ProgressReport {
+	std::uint64_t processed = 0;					///< Progress in the job's own unit, compared against total.
+	std::uint64_t total = 0;						///< Value of processed at completion, 0 while unknown.
+	std::uint64_t bytes_in = 0;						///< Bytes read so far.
+	std::uint64_t bytes_out = 0;					///< Bytes written so far.
+	double seconds = 0;								///< Time since the job started.
+
+	/**
+	* @brief Progress as a whole-number percentage, 0 while the total is unknown.
+	*/
+	int percentage() const;
+
+	/**
+	* @brief Average throughput of processed bytes since the job started, in MB/s.
+	*/
+	double megabytes_per_second() const;
+
+	/**
+	* @brief Estimated seconds until the job finishes at its average throughput.
+	*
+	* @return: std::nullopt while the total or the throughput is unknown.
+	*/
+	std::optional<double> eta_seconds() const;
+};
+
+
+/**
+* @class ProgressReporter
+* @brief Coalesces frequent progress updates into reports limited by time and by percentage.
+*/
+class ProgressReporter {
+public:
+
+	/**
+	* @brief Receives the coalesced reports.
+	*/
+	using Callback = std::function<void(const ProgressReport& report)>;
+
+	static constexpr std::chrono::milliseconds REPORT_INTERVAL{ 50 };	///< Minimum time between two reports.
+
+	/**
+	* @brief Starts the clock of a job.
+	*
+	* @param total: Value of processed at completion, 0 if unknown.
+	* @param callback: Receives the reports.
+	* @param interval: Minimum time between two reports.
+	*/
+	ProgressReporter(std::uint64_t total, Callback callback, std::chrono::milliseconds interval = REPORT_INTERVAL);
+
+	/**
+	* @brief Records progress and produces a report if one is due.
+	*
+	* @param processed: Progress in the job's own unit.
+	* @param count_bytes: Returns the bytes read and written as a std::pair. Only called when a report is due.
+	*/
+	template <class ByteCounter>
+	void Update(std::uint64_t processed, ByteCounter&& count_bytes) {
+		if (IsDue(processed)) {
+			auto [bytes_in, bytes_out] = count_bytes();
+			Report(processed, bytes_in, bytes_out);
+		}
+	}
+
+	/**
+	* @brief Produces the final report of a job, regardless of when the last one was.
+	*
+	* @param processed: Final progress, which becomes the total if that was unknown.
+	* @param bytes_in: Bytes read in total.
+	* @param bytes_out: Bytes written in total.
+	*/
+	void Finish(std::uint64_t processed, std::uint64_t bytes_in, std::uint64_t bytes_out);
+
+	/**
+	* @brief Returns how far a stream has been read, for the byte counts.
+	*
+	* @return: The position, or 0 if the stream can't tell.
+	*/
+	static std::uint64_t Position(std::istream& stream);
+
+	/**
+	* @brief Returns how far a stream has been written, for the byte counts.
+	*
+	* @return: The position, or 0 if the stream can't tell.
+	*/
+	static std::uint64_t Position(std::ostream& stream);
+
+private:
+
+	/**
+	* @brief Checks whether the percentage moved and the interval has passed since the last report.
+	*/
+	bool IsDue(std::uint64_t processed);
+
+	/**
+	* @brief Builds a report and passes it to the callback.
+	*/
+	void Report(std::uint64_t processed, std::uint64_t bytes_in, std::uint64_t bytes_out);
+
+	std::uint64_t total_;
+	Callback callback_;
+	std::chrono::steady_clock::duration interval_;
+	std::chrono::steady_clock::time_point start_;
+	std::chrono::steady_clock::time_point last_report_;
+	int last_percentage_ = -1;
+};
@@ -0,0 +1,170 @@
+#include "StaticHuffmanTable.h"
+#include "BitReader.h"
+#include "BitWriter.h"
+#include "Checksum.h"
+#include "CompressionExceptions.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+
+namespace EncodingAlgorithms {
+
+	namespace {
+
+		struct Registry {
+			std::mutex mutex;
+			std::unordered_map<std::uint32_t, std::shared_ptr<const StaticHuffmanTable>> tables;
+		};
+
+		Registry& GetRegistry() {
+			static Registry registry;
+			return registry;
+		}
+
+	}
+
+	StaticHuffmanTable::StaticHuffmanTable(std::unordered_map<std::uint8_t, std::string> encoding_table)
+		: encoding_table_(std::move(encoding_table)) {
+
+		// Every code must lead to its own leaf, otherwise some inputs could not be decoded.
+		std::vector<std::string> sorted;
+		for (const auto& [byte, code] : encoding_table_) {
+			if (code.empty()) {
+				throw InvalidHeaderException("Huffman table contains an empty code");
+			}
+			codes_[byte] = code;
+			sorted.push_back(code);
+		}
+		if (sorted.empty()) {
+			throw InvalidHeaderException("Huffman table is empty");
+		}
+
+		// In sorted order a code is immediately followed by the codes it is a prefix of.
+		std::sort(sorted.begin(), sorted.end());
+		for (size_t i = 1; i < sorted.size(); ++i) {
+			if (sorted[i].compare(0, sorted[i - 1].size(), sorted[i - 1]) == 0) {
+				throw InvalidHeaderException("Huffman table codes are not prefix-free");
+			}
+		}
+
+		decoding_tree_ = HuffmanCoding::BuildDecodingTree(encoding_table_);
+		id_ = ComputeId();
+	}
+
+	std::shared_ptr<const StaticHuffmanTable> StaticHuffmanTable::Train(const std::vector<std::filesystem::path>& samples,
+		const CodecSettings& settings) {
+
+		std::array<std::uint64_t, 256> counts{};
+		for (const auto& sample : samples) {
+			std::ifstream input(sample, std::ios::binary);
+			if (!input) {
+				throw FileOpenException(sample.string());
+			}
+			for (const auto& [byte, frequency] : HuffmanCoding::BuildFrequencyTable(input, settings.buffer_size)) {
+				counts[byte] += static_cast<std::uint64_t>(frequency);
+			}
+		}
+
+		// Scale large corpora down so the tree's int frequencies can't overflow, and give
+		// unseen bytes a count of one so they still get a (long) code.
+		std::uint64_t total = 0;
+		for (auto count : counts) {
+			total += count;
+		}
+		std::uint64_t divisor = total / (INT_MAX / 2) + 1;
+
+		std::unordered_map<std::uint8_t, int> freq_table;
+		for (size_t byte = 0; byte < counts.size(); ++byte) {
+			freq_table[static_cast<std::uint8_t>(byte)] = static_cast<int>(counts[byte] / divisor) + 1;
+		}
+
+		auto root = HuffmanCoding::BuildHuffmanTree(freq_table);
+		std::unordered_map<std::uint8_t, std::string> encoding_table;
+		std::vector<char> code;
+		HuffmanCoding::BuildEncodingTable(root, code, encoding_table);
+
+		return std::shared_ptr<const StaticHuffmanTable>(new StaticHuffmanTable(std::move(encoding_table)));
+	}
+
+	std::shared_ptr<const StaticHuffmanTable> StaticHuffmanTable::Load(const std::filesystem::path& path) {
+		std::ifstream input(path, std::ios::binary);
+		if (!input) {
+			throw FileOpenException(path.string());
+		}
+
+		char header[MAGIC_NUMBER.size() + 1];
+		input.read(header, sizeof(header));
+		if (input.gcount() != static_cast<std::streamsize>(sizeof(header)) ||
+			!std::equal(MAGIC_NUMBER.begin(), MAGIC_NUMBER.end(), header)) {
+			throw InvalidHeaderException("Not a Huffman table file");
+		}
+		if (static_cast<std::uint8_t>(header[MAGIC_NUMBER.size()]) != VERSION_NUMBER) {
+			throw InvalidHeaderException("Unsupported Huffman table version");
+		}
+
+		std::unordered_map<std::uint8_t, std::string> encoding_table;
+		try {
+			BitReader bit_reader(&input);
+			encoding_table = HuffmanCoding::ReadEncodingTable(bit_reader);
+		}
+		catch (const std::runtime_error& e) {
+			throw InvalidHeaderException(std::string("Corrupt Huffman table: ") + e.what());
+		}
+
+		return Register(std::shared_ptr<const StaticHuffmanTable>(new StaticHuffmanTable(std::move(encoding_table))));
+	}
+
+	void StaticHuffmanTable::Save(const std::filesystem::path& path) const {
+		std::ofstream output(path, std::ios::binary);
+		if (!output) {
+			throw FileOpenException(path.string());
+		}
+
+		output.write(MAGIC_NUMBER.data(), MAGIC_NUMBER.size());
+		output.write(reinterpret_cast<const char*>(&VERSION_NUMBER), sizeof(VERSION_NUMBER));
+		{
+			BitWriter bit_writer(&output);
+			HuffmanCoding::WriteEncodingTable(encoding_table_, bit_writer);
+			bit_writer.Flush();
+		}
+
+		if (!output.flush()) {
+			throw FileOpenException(path.string());
+		}
+	}
+
+	std::shared_ptr<const StaticHuffmanTable> StaticHuffmanTable::Register(std::shared_ptr<const StaticHuffmanTable> table) {
+		auto& registry = GetRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		return registry.tables.emplace(table->id(), table).first->second;
+	}
+
+	std::shared_ptr<const StaticHuffmanTable> StaticHuffmanTable::Find(std::uint32_t id) {
+		auto& registry = GetRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		auto it = registry.tables.find(id);
+		return it == registry.tables.end() ? nullptr : it->second;
+	}
+
+	std::string StaticHuffmanTable::FormatId(std::uint32_t id) {
+		char text[9];
+		std::snprintf(text, sizeof(text), "%08x", static_cast<unsigned>(id));
+		return text;
+	}
+
+	std::uint32_t StaticHuffmanTable::ComputeId() const {
+		std::string canonical;
+		for (size_t byte = 0; byte < codes_.size(); ++byte) {
+			if (!codes_[byte].empty()) {
+				canonical += static_cast<char>(byte);
+				canonical += static_cast<char>(codes_[byte].size());
+				canonical += codes_[byte];
+			}
+		}
+		return Checksum::Crc32c(canonical.data(), canonical.size());
+	}
+
+}
@@ -0,0 +1,126 @@
+// StaticHuffmanTable.h
+//
+// A StaticHuffmanTable is a Huffman code trained once on a sample corpus and
+// shared by everything compressed with it, instead of being built from and
+// stored with every stream. Small records are often smaller than the table
+// HuffmanCoding would otherwise write in front of them, and without the
+// frequency pass the input only has to be read once.
+//
+// Compressed files refer to a table by its ID, a CRC32C of the table's
+// canonical form, so the table itself is distributed out of band. Loaded tables
+// are kept in a process-wide registry together with their prebuilt decoding
+// tree, so decoders look a table up by ID instead of rebuilding it per block.
+//
+// Table file layout: "HTB" magic, u8 version, then the code table in the bit
+// layout HuffmanCoding writes at the start of its streams.
+
+
+#pragma once
+
+#include "CodecSettings.h"
+#include "EncodingAlgorithms.h"
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace EncodingAlgorithms {
+
+	/**
+	* @class StaticHuffmanTable
+	* @brief An immutable, pre-trained Huffman code identified by a content-derived ID.
+	*/
+	class StaticHuffmanTable {
+	public:
+
+		/**
+		* @brief Builds a table from the byte frequencies of a set of sample files.
+		*
+		* Every byte value is given a code, those never seen in the samples the
+		* longest ones, so the table can encode any input.
+		*
+		* @param samples: Files representative of the data the table will be used for.
+		* @param settings: Codec settings providing the read buffer size.
+		* @return: The trained table. It is not registered.
+		* @throws: FileOpenException if a sample cannot be opened.
+		*/
+		static std::shared_ptr<const StaticHuffmanTable> Train(const std::vector<std::filesystem::path>& samples,
+			const CodecSettings& settings = {});
+
+		/**
+		* @brief Reads a table file written by Save and registers it.
+		*
+		* @param path: The table file.
+		* @return: The registered table, which may be an identical one loaded earlier.
+		* @throws: FileOpenException if the file cannot be opened, InvalidHeaderException if it is not a valid table.
+		*/
+		static std::shared_ptr<const StaticHuffmanTable> Load(const std::filesystem::path& path);
+
+		/**
+		* @brief Writes the table to a file.
+		*
+		* @param path: The file to create.
+		* @throws: FileOpenException if the file cannot be written.
+		*/
+		void Save(const std::filesystem::path& path) const;
+
+		/**
+		* @brief Makes a table available to decoders through Find.
+		*
+		* @param table: The table to register. Registering an ID twice keeps the first table.
+		* @return: The table registered under the table's ID.
+		*/
+		static std::shared_ptr<const StaticHuffmanTable> Register(std::shared_ptr<const StaticHuffmanTable> table);
+
+		/**
+		* @brief Looks up a registered table.
+		*
+		* @param id: The ID recorded in a compressed file.
+		* @return: The table, or nullptr if no table with that ID has been registered.
+		*/
+		static std::shared_ptr<const StaticHuffmanTable> Find(std::uint32_t id);
+
+		/**
+		* @brief The ID files compressed with this table refer to it by.
+		*/
+		std::uint32_t id() const { return id_; }
+
+		/**
+		* @brief Formats a table ID for messages, as 8 hexadecimal digits.
+		*/
+		static std::string FormatId(std::uint32_t id);
+
+		/**
+		* @brief The code of a byte as a string of '0' and '1', or an empty string if the byte cannot be encoded.
+		*/
+		const std::string& code(std::uint8_t byte) const { return codes_[byte]; }
+
+		static constexpr std::array<char, 3> MAGIC_NUMBER = { 'H', 'T', 'B' };	///< Identifies a table file.
+		static constexpr std::uint8_t VERSION_NUMBER = 1;						///< Current table file version.
+
+	private:
+
+		/**
+		* @brief Takes ownership of a code table and builds its decoding tree.
+		*
+		* @throws: InvalidHeaderException if the codes are empty or not prefix-free.
+		*/
+		explicit StaticHuffmanTable(std::unordered_map<std::uint8_t, std::string> encoding_table);
+
+		/**
+		* @brief Computes the ID from the codes in byte order, so it doesn't depend on how the table is stored.
+		*/
+		std::uint32_t ComputeId() const;
+
+		std::unordered_map<std::uint8_t, std::string> encoding_table_;	///< The codes, as HuffmanCoding stores them.
+		std::array<std::string, 256> codes_;								///< The same codes indexed by byte for encoding.
+		std::shared_ptr<HuffmanCoding::Node> decoding_tree_;				///< Built once, shared by every decoder.
+		std::uint32_t id_ = 0;
+
+		friend class HuffmanCoding;
+	};
+
+}
@@ -0,0 +1,94 @@
+// StreamWindow.h
+//
+// StreamWindowBuffer presents a byte range of a seekable stream as a complete
+// stream of its own, starting at position 0 and ending at the end of the range.
+//
+// Archives store complete compressed streams back to back. Code that locates
+// trailing structures by seeking to the end of its input, like the block index,
+// can run on a single archive entry through a window without knowing it is
+// embedded in a larger file.
+
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <istream>
+#include <streambuf>
+#include <vector>
+
+
+/**
+* @class StreamWindowBuffer
+* @brief Read-only, seekable stream buffer over a range of another stream.
+*/
+class StreamWindowBuffer : public std::streambuf {
+public:
+
+	/**
+	* @brief Constructs a window over part of a stream.
+	*
+	* @param base: The underlying seekable stream. Must outlive the buffer and not be used while it is.
+	* @param offset: Absolute offset of the range in the base stream.
+	* @param size: Number of bytes in the range.
+	* @param buffer_size: Number of bytes read from the base stream at a time.
+	*/
+	StreamWindowBuffer(std::istream& base, std::uint64_t offset, std::uint64_t size, size_t buffer_size = DEFAULT_BUFFER_SIZE)
+		: base_(base), offset_(offset), size_(size), buffer_(buffer_size) {
+		setg(buffer_.data(), buffer_.data(), buffer_.data());
+	}
+
+	static constexpr size_t DEFAULT_BUFFER_SIZE = 64 * 1024;	///< Matches the codecs' default read size.
+
+protected:
+	int_type underflow() override {
+		if (gptr() < egptr()) {
+			return traits_type::to_int_type(*gptr());
+		}
+
+		// position_ tracks the start of the get area, advance it past what was consumed.
+		position_ += static_cast<std::uint64_t>(egptr() - eback());
+		setg(buffer_.data(), buffer_.data(), buffer_.data());
+		if (position_ >= size_) {
+			return traits_type::eof();
+		}
+
+		auto count = static_cast<std::streamsize>(std::min<std::uint64_t>(buffer_.size(), size_ - position_));
+		base_.clear();
+		base_.seekg(static_cast<std::streamoff>(offset_ + position_));
+		base_.read(buffer_.data(), count);
+		std::streamsize read = base_.gcount();
+		if (read <= 0) {
+			return traits_type::eof();
+		}
+
+		setg(buffer_.data(), buffer_.data(), buffer_.data() + read);
+		return traits_type::to_int_type(*gptr());
+	}
+
+	pos_type seekoff(off_type off, std::ios::seekdir dir, std::ios::openmode which) override {
+		off_type base = dir == std::ios::beg ? 0
+			: dir == std::ios::cur ? static_cast<off_type>(position_) + (gptr() - eback())
+			: static_cast<off_type>(size_);
+		return seekpos(pos_type(base + off), which);
+	}
+
+	pos_type seekpos(pos_type pos, std::ios::openmode /*which*/) override {
+		off_type offset = pos;
+		if (offset < 0 || static_cast<std::uint64_t>(offset) > size_) {
+			return pos_type(off_type(-1));
+		}
+
+		// Drop the buffered data, the next read fetches from the new position.
+		position_ = static_cast<std::uint64_t>(offset);
+		setg(buffer_.data(), buffer_.data(), buffer_.data());
+		return pos;
+	}
+
+private:
+	std::istream& base_;
+	std::uint64_t offset_;
+	std::uint64_t size_;
+	std::uint64_t position_ = 0;		///< Position of eback() within the window.
+	std::vector<char> buffer_;
+};
@@ -0,0 +1,154 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+	// The pool and worker index of the calling thread, if it is a pool worker.
+	thread_local ThreadPool* current_pool = nullptr;
+	thread_local size_t current_index = 0;
+
+	// How long Wait sleeps when there is nothing to help with before checking its future again.
+	constexpr auto WAIT_POLL_INTERVAL = std::chrono::microseconds(200);
+
+}
+
+
+ThreadPool::ThreadPool(size_t thread_count) {
+	thread_count = ResolveThreadCount(thread_count);
+	queues_.reserve(thread_count);
+	for (size_t i = 0; i < thread_count; ++i) {
+		queues_.push_back(std::make_unique<WorkerQueue>());
+	}
+
+	workers_.reserve(thread_count);
+	for (size_t i = 0; i < thread_count; ++i) {
+		workers_.emplace_back(&ThreadPool::Run, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	condition_.notify_all();
+
+	for (auto& worker : workers_) {
+		worker.join();
+	}
+}
+
+std::future<void> ThreadPool::Submit(std::function<void()> task) {
+	Task packaged(std::move(task));
+	auto future = packaged.get_future();
+
+	bool from_worker = current_pool == this;
+	if (from_worker) {
+		auto& queue = *queues_[current_index];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_front(std::move(packaged));
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (!from_worker) {
+			shared_tasks_.push_back(std::move(packaged));
+		}
+		++queued_;
+	}
+	condition_.notify_one();
+	return future;
+}
+
+void ThreadPool::Wait(const std::future<void>& future) {
+	if (current_pool != this) {
+		future.wait();
+		return;
+	}
+
+	while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+		Task task;
+		if (TakeTask(current_index, task, false)) {
+			task();
+		}
+		else {
+			future.wait_for(WAIT_POLL_INTERVAL);
+		}
+	}
+}
+
+size_t ThreadPool::ResolveThreadCount(size_t requested) {
+	if (requested == 0) {
+		// hardware_concurrency may return 0 when it can't be determined.
+		requested = std::thread::hardware_concurrency();
+	}
+	return std::max<size_t>(requested, 1);
+}
+
+ThreadPool* ThreadPool::Current() {
+	return current_pool;
+}
+
+void ThreadPool::Run(size_t index) {
+	current_pool = this;
+	current_index = index;
+
+	while (true) {
+		Task task;
+		if (TakeTask(index, task)) {
+			// Exceptions are captured by the packaged_task and rethrown from its future.
+			task();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(mutex_);
+		condition_.wait(lock, [this] { return stopping_ || queued_ > 0; });
+		if (stopping_ && queued_ == 0) {
+			return;
+		}
+	}
+}
+
+bool ThreadPool::TakeTask(size_t index, Task& task, bool include_shared) {
+	auto take = [this, &task](std::deque<Task>& tasks, bool newest) {
+		if (tasks.empty()) {
+			return false;
+		}
+		if (newest) {
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+		else {
+			task = std::move(tasks.back());
+			tasks.pop_back();
+		}
+		--queued_;
+		return true;
+	};
+
+	{
+		auto& own = *queues_[index];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (take(own.tasks, true)) {
+			return true;
+		}
+	}
+	if (include_shared) {
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (take(shared_tasks_, true)) {
+			return true;
+		}
+	}
+
+	// Steal the oldest task of the next worker that has any, starting after this one.
+	for (size_t offset = 1; offset < queues_.size(); ++offset) {
+		auto& other = *queues_[(index + offset) % queues_.size()];
+		std::lock_guard<std::mutex> lock(other.mutex);
+		if (take(other.tasks, false)) {
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,136 @@
+// ThreadPool.h
+//
+// A fixed-size, work-stealing pool of worker threads. It runs whole jobs of a
+// batch as well as the independent blocks of the block format. Tasks are
+// submitted as callables and each submission returns a std::future, so exceptions
+// thrown by a task (corrupt blocks, failed writes) surface in the submitting
+// thread when it waits for the result.
+//
+// Every worker has its own deque. Tasks submitted from a worker go to the front
+// of its deque and are run by it newest first, which keeps a job's blocks on the
+// core that read them. Idle workers steal the oldest tasks from the back of other
+// deques, and tasks submitted from outside the pool are queued in a shared FIFO.
+//
+// A task that waits for tasks it submitted itself must wait through Wait, which
+// keeps running queued tasks in the meantime. Otherwise a pool whose workers are
+// all busy running jobs would deadlock waiting for those jobs' blocks. Wait only
+// runs tasks submitted by workers, never new jobs from the shared queue, since a
+// job started there could wait for memory the waiting job holds.
+
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/**
+* @class ThreadPool
+* @brief Runs submitted tasks on a fixed number of work-stealing worker threads.
+*/
+class ThreadPool {
+public:
+
+	/**
+	* @brief Starts the worker threads.
+	*
+	* @param thread_count: Number of workers. 0 uses the hardware concurrency.
+	*/
+	explicit ThreadPool(size_t thread_count = 0);
+
+	/**
+	* @brief Finishes all queued tasks and joins the workers.
+	*/
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/**
+	* @brief Queues a task for execution on a worker.
+	*
+	* Called from one of this pool's workers, the task is queued on that worker's
+	* own deque, otherwise on the shared queue.
+	*
+	* @param task: The callable to run.
+	* @return: A future that becomes ready when the task has run, rethrowing anything it threw.
+	*/
+	std::future<void> Submit(std::function<void()> task);
+
+	/**
+	* @brief Waits for a future, running queued tasks meanwhile if called from one of this pool's workers.
+	*
+	* The result is not consumed, call get() afterwards to rethrow a task's exception.
+	*
+	* @param future: The future to wait for.
+	*/
+	void Wait(const std::future<void>& future);
+
+	/**
+	* @brief Returns the number of worker threads.
+	*/
+	size_t size() const { return workers_.size(); }
+
+	/**
+	* @brief Resolves a requested thread count, mapping 0 to the hardware concurrency.
+	*
+	* @param requested: The requested number of threads.
+	* @return: At least 1.
+	*/
+	static size_t ResolveThreadCount(size_t requested);
+
+	/**
+	* @brief Returns the pool the calling thread is a worker of.
+	*
+	* Lets code running as a task submit its own subtasks to the same pool
+	* instead of starting another set of threads.
+	*
+	* @return: The pool, or nullptr if the caller is not a pool worker.
+	*/
+	static ThreadPool* Current();
+
+private:
+	using Task = std::packaged_task<void()>;
+
+	/**
+	* @struct WorkerQueue
+	* @brief The deque of tasks submitted by one worker.
+	*/
+	struct WorkerQueue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	/**
+	* @brief Worker loop: runs tasks until the pool is stopped and no task is queued.
+	*
+	* @param index: Index of the worker, which owns queues_[index].
+	*/
+	void Run(size_t index);
+
+	/**
+	* @brief Takes one task, from the worker's own deque first, then the shared queue, then other workers.
+	*
+	* @param index: Index of the calling worker.
+	* @param task: Receives the task.
+	* @param include_shared: false to skip the shared queue and only take tasks submitted by workers.
+	* @return: false if no task was queued anywhere.
+	*/
+	bool TakeTask(size_t index, Task& task, bool include_shared = true);
+
+	std::vector<std::unique_ptr<WorkerQueue>> queues_;
+	std::deque<Task> shared_tasks_;				///< Tasks submitted from outside the pool, guarded by mutex_.
+	std::atomic<size_t> queued_{ 0 };			///< Tasks in all queues, incremented under mutex_ so sleeping workers can't miss one.
+	std::vector<std::thread> workers_;
+	std::mutex mutex_;
+	std::condition_variable condition_;
+	bool stopping_ = false;
+};
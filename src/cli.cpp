@@ -0,0 +1,24 @@
+#include "CommandLine.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <stdio.h>
+#endif
+
+// Entry point of CompressionToolCli, the headless build that doesn't link Qt.
+int main(int argc, char* argv[])
+{
+#ifdef _WIN32
+    // Keep the CRT from translating line endings in binary data.
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    std::ios::sync_with_stdio(false);
+
+    std::vector<std::string> args(argv + 1, argv + argc);
+    return CommandLine::Run(args, std::cin, std::cout, std::cerr);
+}
@@ -1,8 +1,76 @@
 #include "CompressionTool.h"
+#include "CommandLine.h"
 #include <QtWidgets/QApplication>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <stdio.h>
+#endif
+
+namespace {
+
+    // Translates the pipe and training flags of earlier versions into CommandLine arguments, e.g.
+    //   producer | CompressionTool --compress huffman | ssh host 'CompressionTool --decompress > file'
+    //   CompressionTool --train-table events.htb samples/*.json
+    // Returns an empty list if the arguments should start the GUI instead.
+    std::vector<std::string> CommandLineArguments(int argc, char* argv[]) {
+        std::vector<std::string> args(argv + 1, argv + argc);
+        if (args.empty()) {
+            return args;
+        }
+
+        if (args[0] == "--compress" || args[0] == "--decompress") {
+            std::vector<std::string> translated = { args[0].substr(2) };
+            // Pipe mode used Huffman unless an algorithm was given.
+            std::string algorithm = args[0] == "--compress" ? "huffman" : "";
+            for (size_t i = 1; i < args.size(); ++i) {
+                if (args[i] == "--table" && i + 1 < args.size()) {
+                    translated.push_back(args[i]);
+                    translated.push_back(args[++i]);
+                }
+                else {
+                    algorithm = args[i];
+                }
+            }
+            if (!algorithm.empty()) {
+                translated.push_back("--algorithm");
+                translated.push_back(algorithm);
+            }
+            return translated;
+        }
+        if (args[0] == "--train-table") {
+            args[0] = "train-table";
+            return args;
+        }
+
+        // The subcommands of CompressionToolCli work here as well.
+        for (const char* command : { "compress", "decompress", "verify", "benchmark", "train-table" }) {
+            if (args[0] == command) {
+                return args;
+            }
+        }
+        return {};
+    }
+
+}
 
 int main(int argc, char *argv[])
 {
+    auto args = CommandLineArguments(argc, argv);
+    if (!args.empty()) {
+#ifdef _WIN32
+        // Keep the CRT from translating line endings in binary data.
+        _setmode(_fileno(stdin), _O_BINARY);
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        std::ios::sync_with_stdio(false);
+        return CommandLine::Run(args, std::cin, std::cout, std::cerr);
+    }
+
     QApplication a(argc, argv);
     CompressionTool w;
     w.show();
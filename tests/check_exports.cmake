@@ -0,0 +1,29 @@
+# Fails unless the shared library exports the ct_* functions of CompressionApi.h and nothing else.
+# Run by ctest as: cmake -DNM=<nm> -DLIBRARY=<libcompressiontool.so> -P check_exports.cmake
+
+execute_process(
+    COMMAND ${NM} -D --defined-only ${LIBRARY}
+    OUTPUT_VARIABLE SYMBOLS
+    RESULT_VARIABLE RESULT
+)
+if(NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "${NM} failed on ${LIBRARY}")
+endif()
+
+string(REPLACE "\n" ";" LINES "${SYMBOLS}")
+set(EXPORTED 0)
+foreach(LINE IN LISTS LINES)
+    # Absolute symbols (type A) name the version nodes of the export map, not code.
+    if(LINE STREQUAL "" OR LINE MATCHES " A ")
+        continue()
+    endif()
+    if(NOT LINE MATCHES " ct_[a-z_]+(@|$)")
+        message(FATAL_ERROR "Unexpected exported symbol: ${LINE}")
+    endif()
+    math(EXPR EXPORTED "${EXPORTED} + 1")
+endforeach()
+
+if(EXPORTED EQUAL 0)
+    message(FATAL_ERROR "${LIBRARY} exports no ct_* functions")
+endif()
+message(STATUS "${LIBRARY} exports ${EXPORTED} ct_* functions")
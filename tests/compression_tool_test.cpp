@@ -1,11 +1,50 @@
 #include <gtest/gtest.h>
 #include "../src/EncodingAlgorithms.h"
+#include "../src/DirectFileBuffer.h"
+#include "../src/CompressionEngine.h"
+#include "../src/Archive.h"
+#include "../src/BatchQueue.h"
+#include "../src/BlockCoding.h"
+#include "../src/BlockSplitter.h"
+#include "../src/Checksum.h"
+#include "../src/CommandLine.h"
+#include "../src/CompressionApi.h"
+#include "../src/CodecContext.h"
+#include "../src/CodecSelector.h"
+#include "../src/CompressionExceptions.h"
+#include "../src/ContextHuffmanCoding.h"
+#include "../src/JobControl.h"
+#include "../src/MemoryBudget.h"
+#include "../src/PositionalFile.h"
+#include "../src/ProgressReporter.h"
+#include "../src/StaticHuffmanTable.h"
+#include "../src/ThreadPool.h"
 #include <fstream>
 #include <string>
 #include <filesystem>
 #include <chrono>
+#include <future>
+#include <memory>
 #include <random>
 #include <iostream>
+#include <map>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+// Counts the allocations of the current thread, to check that warmed-up codec contexts don't allocate.
+namespace {
+    thread_local size_t allocation_count = 0;
+}
+
+void* operator new(size_t size) {
+    ++allocation_count;
+    if (void* memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
 
 /// Not checking for empty file because in our main application, empty files
 /// are checked in CompressionTool and not within the encoding classes themselves.
@@ -143,4 +182,1455 @@ TEST_F(CompressionTest, HuffmanRuntimeTest) {
     std::cout << "Huffman compression and decompression of 1MB took " << diff.count() << " seconds" << std::endl;
 
     EXPECT_EQ(input, readOutputFile(decompressed_file));
-}
\ No newline at end of file
+}
+
+// Codec settings tests
+TEST_F(CompressionTest, CustomBufferSizeRoundTrip) {
+    std::string input = generateRandomString(100000);
+    std::string input_file = createInputFile(input);
+    std::string output_file = (temp_dir_ / "output.huff").string();
+    std::string decompressed_file = (temp_dir_ / "decompressed.txt").string();
+
+    // An odd-sized buffer exercises partial fills in both codecs and the bit reader/writer.
+    EncodingAlgorithms::CodecSettings settings;
+    settings.buffer_size = 4099;
+
+    std::ifstream input_stream(input_file, std::ios::binary);
+    std::ofstream output_stream(output_file, std::ios::binary);
+    EncodingAlgorithms::HuffmanCoding::encode(input_stream, output_stream, std::nullopt, settings);
+    output_stream.close();
+
+    std::ifstream compressed_stream(output_file, std::ios::binary);
+    std::ofstream decompressed_stream(decompressed_file, std::ios::binary);
+    EncodingAlgorithms::HuffmanCoding::decode(compressed_stream, decompressed_stream, std::nullopt, settings);
+    decompressed_stream.close();
+
+    EXPECT_EQ(input, readOutputFile(decompressed_file));
+}
+
+TEST_F(CompressionTest, RLECustomBufferSizeWithLongRuns) {
+    // Runs longer than 255 produce escape sequences, which an odd buffer size splits across reads.
+    std::string input;
+    for (int i = 0; i < 2000; ++i) {
+        input += std::string(300 + i % 7, static_cast<char>('a' + i % 26));
+        input += static_cast<char>(255);
+    }
+    std::string input_file = createInputFile(input);
+    std::string output_file = (temp_dir_ / "output.rle").string();
+    std::string decompressed_file = (temp_dir_ / "decompressed.txt").string();
+
+    EncodingAlgorithms::CodecSettings settings;
+    settings.buffer_size = 4097;
+
+    std::ifstream input_stream(input_file, std::ios::binary);
+    std::ofstream output_stream(output_file, std::ios::binary);
+    EncodingAlgorithms::RLECoding::encode(input_stream, output_stream, std::nullopt, settings);
+    output_stream.close();
+
+    std::ifstream compressed_stream(output_file, std::ios::binary);
+    std::ofstream decompressed_stream(decompressed_file, std::ios::binary);
+    EncodingAlgorithms::RLECoding::decode(compressed_stream, decompressed_stream, std::nullopt, settings);
+    decompressed_stream.close();
+
+    EXPECT_EQ(input, readOutputFile(decompressed_file));
+}
+
+TEST_F(CompressionTest, AutoTunedBufferSize) {
+    using EncodingAlgorithms::CodecSettings;
+
+    // Small files never get a buffer much larger than themselves.
+    EXPECT_EQ(CodecSettings::AutoTuneBufferSize(1000, 4096), 4096u);
+
+    // Large files scale up to the cap, always in whole filesystem blocks.
+    size_t large = CodecSettings::AutoTuneBufferSize(std::uint64_t{ 100 } * 1024 * 1024 * 1024, 4096);
+    EXPECT_EQ(large, CodecSettings::AUTO_TUNE_MAX_SIZE);
+
+    size_t medium = CodecSettings::AutoTuneBufferSize(64 * 1024 * 1024, 12288);
+    EXPECT_EQ(medium % 12288, 0u);
+    EXPECT_GE(medium, CodecSettings::AUTO_TUNE_MIN_SIZE);
+}
+
+// Page-cache-friendly I/O tests
+TEST_F(CompressionTest, HuffmanRoundTripWithCacheFriendlyIo) {
+    std::string input = generateRandomString(300000);
+    std::string input_file = createInputFile(input);
+
+    for (auto mode : { EncodingAlgorithms::IoMode::DropBehind, EncodingAlgorithms::IoMode::Direct }) {
+        std::string output_file = (temp_dir_ / "output.huff").string();
+        std::string decompressed_file = (temp_dir_ / "decompressed.txt").string();
+
+        EncodingAlgorithms::CodecSettings settings;
+        settings.io_mode = mode;
+        settings.buffer_size = 8192;
+
+        {
+            // The Huffman encoder rewinds its input, which exercises seeking in the buffer.
+            auto input_stream = DirectFileBuffer::OpenInput(input_file, settings);
+            auto output_stream = DirectFileBuffer::OpenOutput(output_file, settings);
+            ASSERT_TRUE(*input_stream && *output_stream);
+            EncodingAlgorithms::HuffmanCoding::encode(*input_stream, *output_stream, std::nullopt, settings);
+        }
+        {
+            auto compressed_stream = DirectFileBuffer::OpenInput(output_file, settings);
+            auto decompressed_stream = DirectFileBuffer::OpenOutput(decompressed_file, settings);
+            EncodingAlgorithms::HuffmanCoding::decode(*compressed_stream, *decompressed_stream, std::nullopt, settings);
+        }
+
+        EXPECT_EQ(input, readOutputFile(decompressed_file));
+    }
+}
+
+TEST_F(CompressionTest, ReadErrorsFailTheJob) {
+    // Reading a directory fails with EISDIR, like a disk failing with EIO would.
+    EncodingAlgorithms::CodecSettings settings;
+    settings.io_mode = EncodingAlgorithms::IoMode::DropBehind;
+    auto input_stream = DirectFileBuffer::OpenInput(temp_dir_, settings);
+    ASSERT_TRUE(*input_stream);
+
+    std::ostringstream output;
+    EXPECT_THROW(CompressionEngine::Compress(*input_stream, output, EncodingAlgorithms::CodecId::RLE, "", settings),
+        CompressionException);
+    EXPECT_TRUE(input_stream->bad());
+}
+
+TEST_F(CompressionTest, WriteErrorsOnCloseFailTheJob) {
+    // Writes to /dev/full fail with ENOSPC, like a disk filling up during the last buffer.
+    if (!std::filesystem::exists("/dev/full")) {
+        GTEST_SKIP();
+    }
+    for (auto mode : { EncodingAlgorithms::IoMode::Buffered, EncodingAlgorithms::IoMode::DropBehind,
+                       EncodingAlgorithms::IoMode::Direct }) {
+        EncodingAlgorithms::CodecSettings settings;
+        settings.io_mode = mode;
+        auto output = DirectFileBuffer::OpenOutput("/dev/full", settings);
+        ASSERT_TRUE(*output);
+        // Less than a buffer, so nothing is written before the stream is closed.
+        *output << "unaligned tail";
+        EXPECT_THROW(DirectFileBuffer::CloseOutput(*output), CompressionException) << static_cast<int>(mode);
+    }
+}
+
+// Block format and streaming tests
+
+// Reads from a string but refuses to seek, like a pipe.
+class PipeBuffer : public std::stringbuf {
+public:
+    explicit PipeBuffer(const std::string& data) : std::stringbuf(data, std::ios::in) {}
+
+protected:
+    pos_type seekoff(off_type, std::ios::seekdir, std::ios::openmode) override { return pos_type(off_type(-1)); }
+    pos_type seekpos(pos_type, std::ios::openmode) override { return pos_type(off_type(-1)); }
+};
+
+TEST_F(CompressionTest, BlockFormatStreamsWithoutSeeking) {
+    std::string input = generateRandomString(50000) + std::string(20000, 'x') + generateRandomString(3000);
+
+    EncodingAlgorithms::CodecSettings settings;
+    settings.block_size = EncodingAlgorithms::MIN_BLOCK_SIZE;
+
+    for (auto codec : { EncodingAlgorithms::CodecId::RLE, EncodingAlgorithms::CodecId::Huffman }) {
+        PipeBuffer input_pipe(input);
+        std::istream input_stream(&input_pipe);
+        std::ostringstream compressed;
+        CompressionEngine::Compress(input_stream, compressed, codec, std::string(), settings);
+
+        PipeBuffer compressed_pipe(compressed.str());
+        std::istream compressed_stream(&compressed_pipe);
+        std::ostringstream decompressed;
+        FileHeader header = CompressionEngine::Decompress(compressed_stream, decompressed, codec, settings);
+
+        EXPECT_TRUE(header.is_block_format());
+        EXPECT_EQ(input, decompressed.str());
+    }
+}
+
+TEST_F(CompressionTest, HuffmanSingleSymbolInput) {
+    // A block of one repeated byte builds a Huffman tree that is a single leaf.
+    std::string input(10000, '\0');
+
+    EncodingAlgorithms::CodecSettings settings;
+    std::istringstream input_stream(input);
+    std::ostringstream compressed;
+    CompressionEngine::Compress(input_stream, compressed, EncodingAlgorithms::CodecId::Huffman, ".bin", settings);
+
+    std::istringstream compressed_stream(compressed.str());
+    std::ostringstream decompressed;
+    CompressionEngine::Decompress(compressed_stream, decompressed, std::nullopt, settings);
+
+    EXPECT_EQ(input, decompressed.str());
+}
+
+TEST_F(CompressionTest, LegacyFormatStillDecodes) {
+    std::string input = "legacy single stream files must keep working";
+
+    EncodingAlgorithms::CodecSettings settings;
+    settings.block_format = false;
+
+    std::istringstream input_stream(input);
+    std::ostringstream compressed;
+    CompressionEngine::Compress(input_stream, compressed, EncodingAlgorithms::CodecId::Huffman, ".txt", settings);
+
+    std::istringstream compressed_stream(compressed.str());
+    std::ostringstream decompressed;
+    FileHeader header = CompressionEngine::Decompress(compressed_stream, decompressed, std::nullopt, {});
+
+    EXPECT_EQ(header.version_, FileHeader::LEGACY_VERSION);
+    EXPECT_EQ(header.original_extension_, ".txt");
+    EXPECT_EQ(input, decompressed.str());
+}
+
+TEST_F(CompressionTest, HeaderBlockSizeIsBoundedBeforeDecoding) {
+    std::string input = generateRandomString(1000);
+    std::vector<std::uint8_t> compressed;
+    CompressionEngine::CompressBuffer(reinterpret_cast<const std::uint8_t*>(input.data()), input.size(), compressed,
+        EncodingAlgorithms::CodecId::RLE, {});
+
+    // Without an extension, the block size follows the magic number, version, extension length and flags.
+    const size_t block_size_offset = FileHeader::MAGIC_NUMBER_SIZE + FileHeader::VERSION_SIZE +
+        FileHeader::EXTENSION_LENGTH_SIZE + FileHeader::FLAGS_SIZE;
+    for (std::uint32_t block_size : { std::uint32_t{ 0xFFFFFFFF }, std::uint32_t{ 64 * 1024 * 1024 + 1 }, std::uint32_t{ 1024 } }) {
+        auto crafted = compressed;
+        std::memcpy(crafted.data() + block_size_offset, &block_size, sizeof(block_size));
+
+        std::vector<std::uint8_t> output;
+        EXPECT_THROW(CompressionEngine::DecompressBuffer(crafted.data(), crafted.size(), output, std::nullopt, {}),
+            InvalidHeaderException) << block_size;
+
+        ct_context* context = ct_context_create();
+        const void* data = nullptr;
+        size_t size = 0;
+        EXPECT_EQ(ct_decompress(context, crafted.data(), crafted.size(), &data, &size), CT_ERROR_INVALID_DATA);
+        ct_context_free(context);
+    }
+
+    std::vector<std::uint8_t> output;
+    CompressionEngine::DecompressBuffer(compressed.data(), compressed.size(), output, std::nullopt, {});
+    EXPECT_EQ(std::string(output.begin(), output.end()), input);
+}
+
+TEST_F(CompressionTest, BlockIndexDecompressesByteRange) {
+    std::string input = generateRandomString(5 * EncodingAlgorithms::MIN_BLOCK_SIZE + 123);
+
+    EncodingAlgorithms::CodecSettings settings;
+    settings.block_size = EncodingAlgorithms::MIN_BLOCK_SIZE;
+
+    std::istringstream input_stream(input);
+    std::stringstream compressed;
+    CompressionEngine::Compress(input_stream, compressed, EncodingAlgorithms::CodecId::Huffman, ".txt", settings);
+
+    // A slice spanning three blocks, the last byte, and a range running past the end.
+    struct Range { std::uint64_t offset, length; };
+    for (Range range : { Range{ 3000, 3 * EncodingAlgorithms::MIN_BLOCK_SIZE }, Range{ input.size() - 1, 1 },
+                         Range{ input.size() - 50, 1000 } }) {
+        compressed.clear();
+        compressed.seekg(0);
+        std::ostringstream slice;
+        std::uint64_t written = CompressionEngine::DecompressRange(compressed, slice, range.offset, range.length, {});
+
+        std::string expected = input.substr(range.offset, range.length);
+        EXPECT_EQ(written, expected.size());
+        EXPECT_EQ(expected, slice.str());
+    }
+}
+
+TEST_F(CompressionTest, ParallelBlockDecompression) {
+    // Mix runs and random text so both codecs produce blocks of varying encoded size.
+    std::string input;
+    for (int i = 0; i < 40; ++i) {
+        input += generateRandomString(3000) + std::string(2000 + i * 97, static_cast<char>('a' + i % 26));
+    }
+
+    for (auto codec : { EncodingAlgorithms::CodecId::RLE, EncodingAlgorithms::CodecId::Huffman }) {
+        EncodingAlgorithms::CodecSettings settings;
+        settings.block_size = EncodingAlgorithms::MIN_BLOCK_SIZE;
+        settings.threads = 4;
+        // DropBehind drops the decoded blocks from the page cache as they complete.
+        settings.io_mode = codec == EncodingAlgorithms::CodecId::RLE ? EncodingAlgorithms::IoMode::DropBehind
+            : EncodingAlgorithms::IoMode::Buffered;
+
+        std::istringstream input_stream(input);
+        std::ostringstream compressed;
+        CompressionEngine::Compress(input_stream, compressed, codec, ".txt", settings);
+
+        std::string output_file = (temp_dir_ / "parallel.txt").string();
+        std::istringstream compressed_stream(compressed.str());
+        std::int64_t last_progress = 0;
+        CompressionEngine::DecompressToFile(compressed_stream, output_file, codec, settings,
+            [&last_progress](std::int64_t processed) {
+                EXPECT_GT(processed, last_progress);
+                last_progress = processed;
+            });
+
+        EXPECT_EQ(input, readOutputFile(output_file));
+    }
+
+    // Blocks completing out of order are only dropped once the gap before them is filled.
+    std::string output_file = (temp_dir_ / "positional.txt").string();
+    {
+        PositionalFile output(output_file, EncodingAlgorithms::IoMode::DropBehind);
+        output.WriteAt(input.data() + 8192, input.size() - 8192, 8192);
+        output.WriteAt(input.data() + 4096, 4096, 4096);
+        output.WriteAt(input.data(), 4096, 0);
+        output.Close();
+    }
+    EXPECT_EQ(input, readOutputFile(output_file));
+}
+
+TEST_F(CompressionTest, Crc32cMatchesReferenceAndCombines) {
+    // Standard CRC32C check value.
+    EXPECT_EQ(Checksum::Crc32c("123456789", 9), 0xE3069283u);
+
+    std::string first = generateRandomString(1000);
+    std::string second = generateRandomString(777);
+    std::string both = first + second;
+
+    std::uint32_t expected = Checksum::Crc32cSoftware(both.data(), both.size());
+    EXPECT_EQ(Checksum::Crc32c(both.data(), both.size()), expected);
+    EXPECT_EQ(Checksum::Crc32c(second.data(), second.size(), Checksum::Crc32c(first.data(), first.size())), expected);
+    EXPECT_EQ(Checksum::Crc32cCombine(Checksum::Crc32c(first.data(), first.size()),
+        Checksum::Crc32c(second.data(), second.size()), second.size()), expected);
+}
+
+TEST_F(CompressionTest, ChecksumDetectsSilentCorruption) {
+    // Flipping a run's byte value keeps every size intact, so only the checksum notices.
+    std::string input = std::string(5000, 'A') + std::string(5000, 'B');
+
+    EncodingAlgorithms::CodecSettings settings;
+    std::istringstream input_stream(input);
+    std::ostringstream compressed;
+    CompressionEngine::Compress(input_stream, compressed, EncodingAlgorithms::CodecId::RLE, ".txt", settings);
+
+    // Skip the file header and the first frame header to land in the RLE payload.
+    size_t payload_offset = FileHeader::MAGIC_NUMBER_SIZE + FileHeader::VERSION_SIZE + FileHeader::EXTENSION_LENGTH_SIZE +
+        4 + FileHeader::FLAGS_SIZE + FileHeader::BLOCK_SIZE_SIZE + EncodingAlgorithms::BlockCoding::FrameHeaderSize(settings);
+
+    std::string corrupted = compressed.str();
+    size_t pos = corrupted.find('B', payload_offset);
+    ASSERT_NE(pos, std::string::npos);
+    corrupted[pos] = 'C';
+
+    std::istringstream corrupted_stream(corrupted);
+    std::ostringstream decompressed;
+    try {
+        CompressionEngine::Decompress(corrupted_stream, decompressed, std::nullopt, settings);
+        FAIL() << "Corruption was not detected";
+    }
+    catch (const CompressionException& e) {
+        EXPECT_NE(std::string(e.what()).find("checksum"), std::string::npos);
+    }
+}
+
+TEST_F(CompressionTest, OriginalSizeRecordedForSeekableInput) {
+    std::string input = generateRandomString(3 * EncodingAlgorithms::MIN_BLOCK_SIZE + 10);
+
+    EncodingAlgorithms::CodecSettings settings;
+    settings.threads = 2;
+    std::istringstream input_stream(input);
+    std::stringstream compressed;
+    CompressionEngine::Compress(input_stream, compressed, EncodingAlgorithms::CodecId::Huffman, ".txt", settings);
+
+    FileHeader header = CompressionEngine::ReadHeader(compressed, std::nullopt);
+    ASSERT_TRUE(header.has_original_size());
+    EXPECT_EQ(header.original_size_, input.size());
+    // Small inputs shrink the block so neither side allocates a full default block.
+    EXPECT_EQ(header.block_size_, input.size());
+
+    // Progress is reported in decompressed bytes and ends exactly at the original size.
+    std::string output_file = (temp_dir_ / "sized.txt").string();
+    std::int64_t last_progress = 0;
+    CompressionEngine::DecompressToFile(compressed, header, output_file, settings,
+        [&last_progress](std::int64_t processed) { last_progress = processed; });
+
+    EXPECT_EQ(last_progress, static_cast<std::int64_t>(input.size()));
+    EXPECT_EQ(input, readOutputFile(output_file));
+
+    // A forged size far beyond what the blocks can hold isn't preallocated, only rejected at the end.
+    compressed.clear();
+    compressed.seekg(0);
+    header = CompressionEngine::ReadHeader(compressed, std::nullopt);
+    header.original_size_ = std::uint64_t{ 1 } << 40;
+    try {
+        CompressionEngine::DecompressToFile(compressed, header, output_file, settings);
+        FAIL() << "The forged size was not detected";
+    }
+    catch (const CompressionException& e) {
+        EXPECT_NE(std::string(e.what()).find("does not match"), std::string::npos) << e.what();
+    }
+    EXPECT_EQ(std::filesystem::file_size(output_file), input.size());
+
+    // Streams that can't seek have no size to record.
+    PipeBuffer pipe(input);
+    std::istream pipe_stream(&pipe);
+    std::ostringstream streamed;
+    CompressionEngine::Compress(pipe_stream, streamed, EncodingAlgorithms::CodecId::Huffman, "", settings);
+
+    std::istringstream streamed_stream(streamed.str());
+    EXPECT_FALSE(CompressionEngine::ReadHeader(streamed_stream, std::nullopt).has_original_size());
+}
+
+TEST_F(CompressionTest, VerifyChecksWithoutWritingOutput) {
+    std::string input = generateRandomString(4 * EncodingAlgorithms::MIN_BLOCK_SIZE) + std::string(9000, 'z');
+
+    EncodingAlgorithms::CodecSettings settings;
+    settings.block_size = EncodingAlgorithms::MIN_BLOCK_SIZE;
+    settings.threads = 3;
+
+    std::istringstream input_stream(input);
+    std::ostringstream compressed;
+    CompressionEngine::Compress(input_stream, compressed, EncodingAlgorithms::CodecId::RLE, ".txt", settings);
+
+    std::istringstream compressed_stream(compressed.str());
+    VerificationResult result = CompressionEngine::Verify(compressed_stream, EncodingAlgorithms::CodecId::RLE, settings);
+    EXPECT_EQ(result.decompressed_size, input.size());
+    EXPECT_TRUE(result.checksums_verified());
+
+    // A header claiming one byte more than the blocks hold must fail, even with every block intact.
+    size_t size_offset = FileHeader::MAGIC_NUMBER_SIZE + FileHeader::VERSION_SIZE + FileHeader::EXTENSION_LENGTH_SIZE +
+        4 + FileHeader::FLAGS_SIZE + FileHeader::BLOCK_SIZE_SIZE;
+    std::string corrupted = compressed.str();
+    corrupted[size_offset] = static_cast<char>(corrupted[size_offset] + 1);
+
+    std::istringstream corrupted_stream(corrupted);
+    EXPECT_THROW(CompressionEngine::Verify(corrupted_stream, std::nullopt, settings), CompressionException);
+}
+
+TEST_F(CompressionTest, ArchiveRoundTripAndSingleEntryExtraction) {
+    auto source_dir = temp_dir_ / "tree";
+    std::filesystem::create_directories(source_dir / "sub" / "deeper");
+
+    std::map<std::string, std::string> files = {
+        { "a.txt", generateRandomString(3000) },
+        { "runs.bin", std::string(20000, 'r') + std::string(5000, 's') },
+        { "sub/b.txt", generateRandomString(12345) },
+        { "sub/deeper/c.log", generateRandomString(70000) },
+        { "sub/empty.dat", "" },
+    };
+    for (const auto& [name, content] : files) {
+        std::ofstream(source_dir / std::filesystem::u8path(name), std::ios::binary) << content;
+    }
+
+    EncodingAlgorithms::CodecSettings settings;
+    settings.threads = 4;
+    settings.block_size = EncodingAlgorithms::MIN_BLOCK_SIZE;
+
+    auto sources = Archive::ListSources(source_dir);
+    ASSERT_EQ(sources.size(), files.size());
+
+    auto archive_path = temp_dir_ / "tree.cta";
+    {
+        std::ofstream archive(archive_path, std::ios::binary);
+        Archive::Create(sources, archive, EncodingAlgorithms::CodecId::Huffman, settings);
+    }
+
+    // A single entry is found through the trailing directory and extracted on its own.
+    std::ifstream archive(archive_path, std::ios::binary);
+    ArchiveDirectory directory = Archive::ReadDirectory(archive);
+    ASSERT_EQ(directory.size(), files.size());
+    const ArchiveEntry* entry = directory.Find("sub/b.txt");
+    ASSERT_NE(entry, nullptr);
+    EXPECT_EQ(entry->original_size, files["sub/b.txt"].size());
+    EXPECT_EQ(directory.Find("missing.txt"), nullptr);
+
+    auto single = temp_dir_ / "single.txt";
+    Archive::ExtractEntry(archive, *entry, single, settings);
+    EXPECT_EQ(readOutputFile(single.string()), files["sub/b.txt"]);
+
+    auto output_dir = temp_dir_ / "restored";
+    Archive::ExtractAll(archive_path, output_dir, settings);
+    for (const auto& [name, content] : files) {
+        EXPECT_EQ(readOutputFile((output_dir / std::filesystem::u8path(name)).string()), content) << name;
+    }
+
+    // Names that would escape the extraction directory are refused.
+    EXPECT_THROW(Archive::EntryPath(output_dir, "../evil.txt"), CompressionException);
+    EXPECT_THROW(Archive::EntryPath(output_dir, "/etc/passwd"), CompressionException);
+}
+
+TEST_F(CompressionTest, SolidArchiveSharesStreamsAndExtractsSingleFiles) {
+    auto source_dir = temp_dir_ / "small";
+    std::filesystem::create_directories(source_dir);
+
+    // Many small, similar files: separately each pays for its own header and table.
+    std::map<std::string, std::string> files;
+    for (int i = 0; i < 60; ++i) {
+        std::string record = "id=" + std::to_string(i) + ";name=item" + std::to_string(i * 7) + ";";
+        std::string content;
+        while (content.size() < 1500 + static_cast<size_t>(i) * 40) {
+            content += record;
+        }
+        files[std::to_string(i) + (i % 3 == 0 ? ".log" : ".cfg")] = content;
+    }
+    files["empty.cfg"] = "";
+    for (const auto& [name, content] : files) {
+        std::ofstream(source_dir / name, std::ios::binary) << content;
+    }
+
+    EncodingAlgorithms::CodecSettings settings;
+    settings.threads = 4;
+    settings.block_size = EncodingAlgorithms::MIN_BLOCK_SIZE;
+
+    ArchiveOptions options;
+    options.solid = true;
+    options.solid_group_size = 40000;
+
+    auto sources = Archive::ListSources(source_dir);
+    auto solid_path = temp_dir_ / "solid.cta";
+    auto separate_path = temp_dir_ / "separate.cta";
+    {
+        std::ofstream solid(solid_path, std::ios::binary);
+        Archive::Create(sources, solid, EncodingAlgorithms::CodecId::Huffman, settings, options);
+        std::ofstream separate(separate_path, std::ios::binary);
+        Archive::Create(sources, separate, EncodingAlgorithms::CodecId::Huffman, settings);
+    }
+    EXPECT_LT(std::filesystem::file_size(solid_path), std::filesystem::file_size(separate_path));
+
+    std::ifstream archive(solid_path, std::ios::binary);
+    ArchiveDirectory directory = Archive::ReadDirectory(archive);
+    ASSERT_EQ(directory.size(), files.size());
+
+    // Files are grouped by extension, and large sets are split into several groups.
+    std::map<std::uint64_t, std::string> group_extensions;
+    for (const auto& entry : directory.entries()) {
+        EXPECT_TRUE(entry.solid) << entry.name;
+        auto extension = std::filesystem::path(entry.name).extension().string();
+        auto [it, inserted] = group_extensions.emplace(entry.offset, extension);
+        EXPECT_EQ(it->second, extension) << entry.name;
+    }
+    EXPECT_GT(group_extensions.size(), 2u);
+
+    // Single files are decoded from their group's block index, including ones spanning blocks.
+    for (const char* name : { "0.log", "37.cfg", "59.cfg", "empty.cfg" }) {
+        const ArchiveEntry* entry = directory.Find(name);
+        ASSERT_NE(entry, nullptr);
+        auto single = temp_dir_ / "single.out";
+        Archive::ExtractEntry(archive, *entry, single, settings);
+        EXPECT_EQ(readOutputFile(single.string()), files[name]) << name;
+    }
+
+    auto output_dir = temp_dir_ / "restored";
+    Archive::ExtractAll(solid_path, output_dir, settings);
+    for (const auto& [name, content] : files) {
+        EXPECT_EQ(readOutputFile((output_dir / name).string()), content) << name;
+    }
+}
+
+TEST_F(CompressionTest, StaticHuffmanTableForSmallRecords) {
+    auto makeEvent = [](int i) {
+        return "{\"device\":\"sensor-" + std::to_string(i % 17) + "\",\"temperature\":" + std::to_string(20 + i % 9) +
+            ".5,\"humidity\":" + std::to_string(40 + i % 23) + ",\"status\":\"ok\",\"seq\":" + std::to_string(i) + "}";
+    };
+
+    std::vector<std::filesystem::path> samples;
+    for (int i = 0; i < 4; ++i) {
+        auto path = temp_dir_ / ("sample" + std::to_string(i) + ".json");
+        std::ofstream sample(path, std::ios::binary);
+        for (int j = 0; j < 200; ++j) {
+            sample << makeEvent(i * 200 + j) << '\n';
+        }
+        samples.push_back(path);
+    }
+
+    // The ID survives saving and loading, and loading registers the table for decoders.
+    auto trained = EncodingAlgorithms::StaticHuffmanTable::Train(samples);
+    auto table_path = temp_dir_ / "events.htb";
+    trained->Save(table_path);
+    auto table = EncodingAlgorithms::StaticHuffmanTable::Load(table_path);
+    EXPECT_EQ(table->id(), trained->id());
+    EXPECT_EQ(EncodingAlgorithms::StaticHuffmanTable::Find(table->id()), table);
+
+    // A single event is cheaper to encode with the shared table than with its own.
+    std::string event = makeEvent(5000);
+    std::ostringstream with_table, without_table;
+    {
+        std::istringstream input(event);
+        EncodingAlgorithms::HuffmanCoding::encode(input, with_table, *table);
+        std::istringstream again(event);
+        EncodingAlgorithms::HuffmanCoding::encode(again, without_table);
+    }
+    EXPECT_LT(with_table.str().size(), event.size());
+    EXPECT_LT(with_table.str().size() * 2, without_table.str().size());
+
+    std::istringstream encoded(with_table.str());
+    std::ostringstream decoded;
+    EncodingAlgorithms::HuffmanCoding::decode(encoded, decoded, *table, event.size());
+    EXPECT_EQ(decoded.str(), event);
+
+    // Through the C API, a 200-byte record framed as a compact message is much smaller than the record,
+    // where a file coded with the same table barely is.
+    std::string record;
+    for (int i = 6000; record.size() < 200; ++i) {
+        record += makeEvent(i) + '\n';
+    }
+    record.resize(200);
+    ct_context* context = ct_context_create();
+    unsigned int table_id = 0;
+    ASSERT_EQ(ct_context_load_table(context, table_path.string().c_str(), &table_id), CT_OK) << ct_context_error(context);
+    EXPECT_EQ(table_id, table->id());
+    const void* compact = nullptr;
+    size_t compact_size = 0;
+    ASSERT_EQ(ct_compress(context, record.data(), record.size(), &compact, &compact_size), CT_OK) << ct_context_error(context);
+    std::string message(static_cast<const char*>(compact), compact_size);
+    EXPECT_LT(message.size(), record.size() * 3 / 4);
+    std::vector<std::uint8_t> file;
+    EncodingAlgorithms::CodecSettings file_settings;
+    file_settings.static_table = table;
+    CompressionEngine::CompressBuffer(reinterpret_cast<const std::uint8_t*>(record.data()), record.size(), file,
+        EncodingAlgorithms::CodecId::Huffman, file_settings);
+    EXPECT_LT(message.size() + 50, file.size());
+
+    const void* restored = nullptr;
+    size_t restored_size = 0;
+    ASSERT_EQ(ct_decompress(context, message.data(), message.size(), &restored, &restored_size), CT_OK) << ct_context_error(context);
+    EXPECT_EQ(std::string(static_cast<const char*>(restored), restored_size), record);
+    message[message.size() / 2] = static_cast<char>(message[message.size() / 2] ^ 0x10);
+    EXPECT_EQ(ct_decompress(context, message.data(), message.size(), &restored, &restored_size), CT_ERROR_INVALID_DATA);
+    EXPECT_EQ(ct_context_set_option(context, CT_OPTION_TABLE_ID, table_id ^ 1), CT_ERROR_INVALID_ARGUMENT);
+    ct_context_free(context);
+
+    // Files record the table's ID, and every block of them is coded with it.
+    EncodingAlgorithms::CodecSettings settings;
+    settings.static_table = table;
+    settings.block_size = EncodingAlgorithms::MIN_BLOCK_SIZE;
+    std::string data;
+    for (int i = 0; i < 300; ++i) {
+        data += makeEvent(i * 3) + "\n";
+    }
+    std::istringstream input(data);
+    std::stringstream compressed;
+    CompressionEngine::Compress(input, compressed, EncodingAlgorithms::CodecId::Huffman, "json", settings);
+
+    std::ostringstream output;
+    FileHeader header = CompressionEngine::Decompress(compressed, output, std::nullopt, EncodingAlgorithms::CodecSettings{});
+    EXPECT_TRUE(header.has_static_table());
+    EXPECT_EQ(header.table_id_, table->id());
+    EXPECT_EQ(output.str(), data);
+
+    // A file referring to a table that was never loaded fails with a clear error.
+    std::string unknown = compressed.str();
+    size_t id_offset = FileHeader::MAGIC_NUMBER_SIZE + FileHeader::VERSION_SIZE + FileHeader::EXTENSION_LENGTH_SIZE + 4 +
+        FileHeader::FLAGS_SIZE + FileHeader::BLOCK_SIZE_SIZE + FileHeader::ORIGINAL_SIZE_SIZE;
+    unknown[id_offset] = static_cast<char>(unknown[id_offset] ^ 0x5A);
+    std::istringstream unknown_stream(unknown);
+    std::ostringstream discarded;
+    EXPECT_THROW(CompressionEngine::Decompress(unknown_stream, discarded, std::nullopt, EncodingAlgorithms::CodecSettings{}),
+        CompressionException);
+
+    // The job fails before it touches the output, so the file it would have replaced is kept.
+    auto unknown_path = temp_dir_ / "unknown.huff";
+    auto existing_path = temp_dir_ / "unknown.json";
+    std::ofstream(unknown_path, std::ios::binary) << unknown;
+    std::ofstream(existing_path, std::ios::binary) << event;
+    BatchQueue queue(EncodingAlgorithms::CodecSettings{}, nullptr, 1);
+    queue.Add({ BatchOperation::Decompress, unknown_path, existing_path, std::nullopt });
+    queue.Wait();
+    EXPECT_EQ(queue.Status(0).state, BatchJobState::Failed);
+    EXPECT_EQ(readOutputFile(existing_path.string()), event);
+}
+
+TEST_F(CompressionTest, AutomaticCodecSelection) {
+    using EncodingAlgorithms::CodecId;
+    using EncodingAlgorithms::CodecSelector;
+
+    std::string runs;
+    for (int i = 0; i < 2000; ++i) {
+        runs += std::string(100 + i % 50, static_cast<char>('a' + i % 26));
+    }
+    std::string text;
+    while (text.size() < 300000) {
+        text += "The quick brown fox jumps over the lazy dog while the cat sleeps. ";
+    }
+
+    auto runs_stats = CodecSelector::Analyze(reinterpret_cast<const std::uint8_t*>(runs.data()), runs.size());
+    EXPECT_GT(runs_stats.average_run_length, 100.0);
+    auto text_stats = CodecSelector::Analyze(reinterpret_cast<const std::uint8_t*>(text.data()), text.size());
+    EXPECT_LT(text_stats.entropy, 5.0);
+    EXPECT_GT(text_stats.match_density, 0.9);
+
+    // Sampling leaves the stream where it was, so compression can start right after.
+    EncodingAlgorithms::CodecSettings settings;
+    std::istringstream runs_stream(runs);
+    EXPECT_EQ(CodecSelector::Select(runs_stream, settings), CodecId::RLE);
+    EXPECT_EQ(runs_stream.tellg(), 0);
+    std::istringstream text_stream(text);
+    EXPECT_EQ(CodecSelector::Select(text_stream, settings), CodecId::Huffman);
+    EXPECT_EQ(CodecSelector::Choose({}, settings), CodecId::Huffman);
+
+    // Archives choose per entry and record each choice in the directory.
+    auto source_dir = temp_dir_ / "mixed";
+    std::filesystem::create_directories(source_dir);
+    std::ofstream(source_dir / "runs.bmp", std::ios::binary) << runs;
+    std::ofstream(source_dir / "text.txt", std::ios::binary) << text;
+
+    ArchiveOptions options;
+    options.auto_codec = true;
+    auto archive_path = temp_dir_ / "mixed.cta";
+    {
+        std::ofstream archive(archive_path, std::ios::binary);
+        Archive::Create(Archive::ListSources(source_dir), archive, CodecId::Huffman, settings, options);
+    }
+    auto output_dir = temp_dir_ / "restored";
+    ArchiveDirectory directory = Archive::ExtractAll(archive_path, output_dir, settings);
+    EXPECT_EQ(directory.Find("runs.bmp")->codec, CodecId::RLE);
+    EXPECT_EQ(directory.Find("text.txt")->codec, CodecId::Huffman);
+    EXPECT_EQ(readOutputFile((output_dir / "runs.bmp").string()), runs);
+    EXPECT_EQ(readOutputFile((output_dir / "text.txt").string()), text);
+}
+
+TEST_F(CompressionTest, IncompressibleBlocksAreStored) {
+    // Three blocks of random bytes, as in already compressed media, followed by two of text.
+    std::mt19937 gen(42);
+    std::string input(3 * EncodingAlgorithms::MIN_BLOCK_SIZE, 0);
+    std::generate(input.begin(), input.end(), [&gen]() { return static_cast<char>(gen() & 0xFF); });
+    std::string random_part = input;
+    while (input.size() < 5 * EncodingAlgorithms::MIN_BLOCK_SIZE) {
+        input += "All work and no play makes Jack a dull boy. ";
+    }
+
+    for (auto codec : { EncodingAlgorithms::CodecId::RLE, EncodingAlgorithms::CodecId::Huffman }) {
+        EncodingAlgorithms::CodecSettings settings;
+        settings.block_size = EncodingAlgorithms::MIN_BLOCK_SIZE;
+        settings.threads = 4;
+
+        // Random data never comes out more than the framing larger.
+        std::istringstream random_stream(random_part);
+        std::ostringstream random_compressed;
+        CompressionEngine::Compress(random_stream, random_compressed, codec, ".bin", settings);
+        EXPECT_LT(random_compressed.str().size(), random_part.size() + 200);
+
+        std::istringstream input_stream(input);
+        std::stringstream compressed;
+        CompressionEngine::Compress(input_stream, compressed, codec, ".bin", settings);
+
+        std::ostringstream restored;
+        compressed.seekg(0);
+        CompressionEngine::Decompress(compressed, restored, codec, settings);
+        EXPECT_EQ(input, restored.str());
+
+        std::string output_file = (temp_dir_ / "stored.bin").string();
+        std::istringstream compressed_stream(compressed.str());
+        CompressionEngine::DecompressToFile(compressed_stream, output_file, codec, settings);
+        EXPECT_EQ(input, readOutputFile(output_file));
+
+        // A range spanning the last stored block and the first encoded one.
+        std::uint64_t offset = 3 * EncodingAlgorithms::MIN_BLOCK_SIZE - 100;
+        compressed.clear();
+        compressed.seekg(0);
+        std::ostringstream slice;
+        CompressionEngine::DecompressRange(compressed, slice, offset, 200, settings);
+        EXPECT_EQ(input.substr(offset, 200), slice.str());
+    }
+}
+
+TEST_F(CompressionTest, HuffmanBlocksSplitWhereContentChanges) {
+    using EncodingAlgorithms::BlockSplitter;
+
+    // Like a tar file: text, then a narrow-alphabet binary section, then text again.
+    std::string text;
+    while (text.size() < 96 * 1024) {
+        text += "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor. ";
+    }
+    text.resize(96 * 1024);
+    std::mt19937 gen(7);
+    std::string binary(128 * 1024, 0);
+    std::generate(binary.begin(), binary.end(), [&gen]() { return static_cast<char>(0x80 + (gen() & 0x0F)); });
+    std::string input = text + binary + text;
+
+    auto segments = BlockSplitter::Split(reinterpret_cast<const std::uint8_t*>(input.data()), input.size());
+    ASSERT_EQ(segments.size(), 3u);
+    EXPECT_EQ(segments[0], text.size());
+    EXPECT_EQ(segments[1], binary.size());
+
+    // Uniform content stays in one segment.
+    EXPECT_EQ(BlockSplitter::Split(reinterpret_cast<const std::uint8_t*>(binary.data()), binary.size()).size(), 1u);
+
+    EncodingAlgorithms::CodecSettings settings;
+    std::string sizes[2];
+    for (bool split : { false, true }) {
+        settings.split_blocks = split;
+        std::istringstream input_stream(input);
+        std::stringstream compressed;
+        CompressionEngine::Compress(input_stream, compressed, EncodingAlgorithms::CodecId::Huffman, ".tar", settings);
+        sizes[split] = compressed.str();
+
+        std::ostringstream restored;
+        compressed.seekg(0);
+        CompressionEngine::Decompress(compressed, restored, EncodingAlgorithms::CodecId::Huffman, settings);
+        EXPECT_EQ(input, restored.str());
+
+        compressed.clear();
+        compressed.seekg(0);
+        std::ostringstream slice;
+        CompressionEngine::DecompressRange(compressed, slice, text.size() - 10, 20, settings);
+        EXPECT_EQ(input.substr(text.size() - 10, 20), slice.str());
+    }
+    EXPECT_LT(sizes[true].size(), sizes[false].size());
+}
+
+TEST_F(CompressionTest, ContextHuffmanUsesPreviousByte) {
+    using EncodingAlgorithms::CodecId;
+
+    std::mt19937 gen(3);
+    std::string csv = "id,name,amount,date\n";
+    const char* names[] = { "alice", "bob", "carol", "dave", "eve", "mallory" };
+    while (csv.size() < 600000) {
+        csv += std::to_string(gen() % 100000) + "," + names[gen() % 6] + "," + std::to_string(gen() % 1000) + "." +
+            std::to_string(gen() % 100) + ",2024-0" + std::to_string(1 + gen() % 9) + "-1" + std::to_string(gen() % 10) + "\n";
+    }
+
+    EncodingAlgorithms::CodecSettings settings;
+    settings.threads = 4;
+    std::map<CodecId, size_t> sizes;
+    for (auto codec : { CodecId::Huffman, CodecId::ContextHuffman }) {
+        std::istringstream input_stream(csv);
+        std::stringstream compressed;
+        CompressionEngine::Compress(input_stream, compressed, codec, ".csv", settings);
+        sizes[codec] = compressed.str().size();
+
+        std::string output_file = (temp_dir_ / "restored.csv").string();
+        std::istringstream compressed_stream(compressed.str());
+        CompressionEngine::DecompressToFile(compressed_stream, output_file, codec, settings);
+        EXPECT_EQ(csv, readOutputFile(output_file));
+
+        compressed.clear();
+        compressed.seekg(0);
+        std::ostringstream slice;
+        CompressionEngine::DecompressRange(compressed, slice, 100000, 50, settings);
+        EXPECT_EQ(csv.substr(100000, 50), slice.str());
+    }
+    EXPECT_LT(sizes[CodecId::ContextHuffman] * 10, sizes[CodecId::Huffman] * 8);
+
+    // Single-symbol, short and mixed blocks round trip through the codec directly.
+    for (std::string block : { std::string(5000, 'x'), std::string("a"), generateRandomString(30000) + std::string(9000, '\0') }) {
+        std::vector<std::uint8_t> encoded;
+        EncodingAlgorithms::ContextHuffmanCoding::encode(reinterpret_cast<const std::uint8_t*>(block.data()), block.size(), encoded);
+        std::vector<std::uint8_t> decoded;
+        EncodingAlgorithms::ContextHuffmanCoding::decode(encoded.data(), encoded.size(), decoded, block.size());
+        EXPECT_EQ(block, std::string(decoded.begin(), decoded.end()));
+
+        // Asking for more bytes than were encoded runs out of bits.
+        decoded.clear();
+        EXPECT_THROW(EncodingAlgorithms::ContextHuffmanCoding::decode(encoded.data(), encoded.size(), decoded, block.size() + 64),
+            CompressionException);
+    }
+
+    // There is no streaming form of the codec.
+    settings.block_format = false;
+    std::istringstream input_stream(csv);
+    std::ostringstream compressed;
+    EXPECT_THROW(CompressionEngine::Compress(input_stream, compressed, CodecId::ContextHuffman, ".csv", settings), CompressionException);
+}
+
+TEST_F(CompressionTest, CompressionLevelsTradeSpeedForRatio) {
+    using EncodingAlgorithms::CodecId;
+    using EncodingAlgorithms::CodecSelector;
+
+    std::mt19937 gen(5);
+    std::string csv;
+    const char* cities[] = { "berlin", "lisbon", "oslo", "quito", "seoul" };
+    while (csv.size() < 400000) {
+        csv += std::to_string(gen() % 10000) + ";" + cities[gen() % 5] + ";" + std::to_string(gen() % 500) + "\n";
+    }
+
+    EncodingAlgorithms::CodecSettings settings;
+    settings.threads = 1;
+    EXPECT_EQ(settings.level, EncodingAlgorithms::DEFAULT_LEVEL);
+    settings.SetLevel(42);
+    EXPECT_EQ(settings.level, EncodingAlgorithms::MAX_LEVEL);
+    EXPECT_TRUE(settings.context_modeling);
+
+    // Automatic selection only models contexts at the higher levels.
+    std::istringstream text_stream(csv);
+    EXPECT_EQ(CodecSelector::Select(text_stream, settings), CodecId::ContextHuffman);
+    settings.SetLevel(EncodingAlgorithms::DEFAULT_LEVEL);
+    EXPECT_EQ(CodecSelector::Select(text_stream, settings), CodecId::Huffman);
+
+    // Higher levels never compress worse, and every level decodes with default settings. The levels
+    // spend their effort on data whose distribution changes, so the CSV is followed by a log and
+    // by small numbers in binary.
+    std::string mixed = csv;
+    while (mixed.size() < 700000) {
+        mixed += "[worker " + std::to_string(gen() % 8) + "] request " + std::to_string(gen()) + " done in "
+            + std::to_string(gen() % 900) + " ms\n";
+    }
+    while (mixed.size() < 1000000) {
+        mixed += static_cast<char>(gen() % 7);
+    }
+    for (CodecId codec : { CodecId::Huffman, CodecId::ContextHuffman }) {
+        std::map<int, size_t> sizes;
+        for (int level = EncodingAlgorithms::MIN_LEVEL; level <= EncodingAlgorithms::MAX_LEVEL; ++level) {
+            settings.SetLevel(level);
+            std::vector<std::uint8_t> compressed, restored;
+            CompressionEngine::CompressBuffer(reinterpret_cast<const std::uint8_t*>(mixed.data()), mixed.size(), compressed,
+                codec, settings);
+            CompressionEngine::DecompressBuffer(compressed.data(), compressed.size(), restored, codec, {});
+            EXPECT_EQ(mixed, std::string(restored.begin(), restored.end()));
+            sizes[level] = compressed.size();
+            if (level > EncodingAlgorithms::MIN_LEVEL) {
+                EXPECT_LE(sizes[level], sizes[level - 1]) << "level " << level;
+            }
+        }
+        EXPECT_LT(sizes[EncodingAlgorithms::MAX_LEVEL], sizes[EncodingAlgorithms::MIN_LEVEL]);
+    }
+
+    // Front ends accept the level, explicit block sizes override the level's.
+    std::istringstream no_input, pipe_input(csv);
+    std::ostringstream out, err;
+    EXPECT_EQ(CommandLine::Run({ "compress", "-9", "-b", "64K", "-a", "auto" }, pipe_input, out, err), CommandLine::EXIT_OK)
+        << err.str();
+    EXPECT_EQ(CommandLine::Run({ "compress", "--level", "0" }, no_input, out, err), CommandLine::EXIT_USAGE);
+    ct_context* context = ct_context_create();
+    EXPECT_EQ(ct_context_set_option(context, CT_OPTION_LEVEL, 9), CT_OK);
+    EXPECT_EQ(ct_context_set_option(context, CT_OPTION_LEVEL, 10), CT_ERROR_INVALID_ARGUMENT);
+    ct_context_free(context);
+}
+
+TEST_F(CompressionTest, MemoryBudgetBoundsJobs) {
+    using EncodingAlgorithms::CodecId;
+
+    // Reservations are charged to the budget and its parents, and returned when destroyed.
+    auto process = std::make_shared<MemoryBudget>(1000);
+    MemoryBudget job(600, process), other_job(MemoryBudget::UNLIMITED, process);
+    {
+        auto reservation = job.Reserve(500);
+        EXPECT_FALSE(job.TryReserve(200));
+        EXPECT_FALSE(other_job.TryReserve(600));
+        auto more = other_job.TryReserve(400);
+        ASSERT_TRUE(more);
+        EXPECT_EQ(process->used(), 900u);
+    }
+    EXPECT_EQ(process->used(), 0u);
+    EXPECT_EQ(process->peak(), 900u);
+    EXPECT_EQ(job.peak(), 500u);
+    EXPECT_THROW(static_cast<void>(job.Reserve(700)), CompressionException);
+
+    // A job waits until another one returns enough.
+    auto held = std::make_unique<MemoryBudget::Reservation>(other_job.Reserve(800));
+    auto waiting = std::async(std::launch::async, [&job]() { return job.Reserve(500).bytes(); });
+    EXPECT_EQ(waiting.wait_for(std::chrono::milliseconds(100)), std::future_status::timeout);
+    held.reset();
+    EXPECT_EQ(waiting.get(), 500u);
+
+    // Blocks written shrink to fit the budget, parallel decoding keeps to it.
+    std::string content = generateRandomString(2 * 1024 * 1024) + std::string(1024 * 1024, 'a');
+    const auto* data = reinterpret_cast<const std::uint8_t*>(content.data());
+    EncodingAlgorithms::CodecSettings settings;
+    settings.threads = 4;
+    settings.memory = std::make_shared<MemoryBudget>(1024 * 1024);
+    std::vector<std::uint8_t> compressed, restored;
+    CompressionEngine::CompressBuffer(data, content.size(), compressed, CodecId::Huffman, settings);
+    auto header = CompressionEngine::DecompressBuffer(compressed.data(), compressed.size(), restored, CodecId::Huffman, {});
+    EXPECT_EQ(header.block_size_, 256u * 1024);
+    EXPECT_LE(settings.memory->peak(), 1024u * 1024);
+
+    std::string compressed_file = (temp_dir_ / "budget.huff").string();
+    std::ofstream(compressed_file, std::ios::binary).write(reinterpret_cast<const char*>(compressed.data()), compressed.size());
+    settings.memory = std::make_shared<MemoryBudget>(1536 * 1024);
+    std::ifstream compressed_stream(compressed_file, std::ios::binary);
+    std::string output_file = (temp_dir_ / "budget.bin").string();
+    CompressionEngine::DecompressToFile(compressed_stream, output_file, CodecId::Huffman, settings);
+    EXPECT_EQ(readOutputFile(output_file), content);
+    EXPECT_GT(settings.memory->peak(), 512u * 1024);
+    EXPECT_LE(settings.memory->peak(), 1536u * 1024);
+
+    // A queue reports the peak of each job and of all of them together.
+    settings.memory = std::make_shared<MemoryBudget>(8 * 1024 * 1024);
+    {
+        BatchQueue queue(settings, nullptr, 4);
+        for (int i = 0; i < 6; ++i) {
+            BatchJob batch_job;
+            batch_job.input = temp_dir_ / ("budget" + std::to_string(i) + ".bin");
+            std::ofstream(batch_job.input, std::ios::binary) << content.substr(i * 100000);
+            batch_job.output = temp_dir_ / ("budget" + std::to_string(i) + ".huff");
+            batch_job.codec = CodecId::Huffman;
+            batch_job.memory_limit = 3 * 1024 * 1024;
+            queue.Add(std::move(batch_job));
+        }
+        queue.Wait();
+        for (size_t i = 0; i < 6; ++i) {
+            auto status = queue.Status(i);
+            EXPECT_EQ(status.state, BatchJobState::Completed) << status.error;
+            EXPECT_GT(status.peak_memory, 0u);
+            EXPECT_LE(status.peak_memory, 3u * 1024 * 1024);
+        }
+        EXPECT_LE(queue.Progress().peak_memory, 8u * 1024 * 1024);
+        EXPECT_GE(queue.Progress().peak_memory, queue.Status(0).peak_memory);
+    }
+
+    // Front ends take limits too.
+    std::istringstream no_input;
+    std::ostringstream out, err;
+    EXPECT_EQ(CommandLine::Run({ "compress", "-m", "512K" }, no_input, out, err), CommandLine::EXIT_USAGE);
+    ct_context* context = ct_context_create();
+    const void* output = nullptr;
+    size_t output_size = 0;
+    EXPECT_EQ(ct_context_set_option(context, CT_OPTION_MEMORY_LIMIT, -1), CT_ERROR_INVALID_ARGUMENT);
+    ASSERT_EQ(ct_context_set_option(context, CT_OPTION_MEMORY_LIMIT, 2 * 1024 * 1024), CT_OK);
+    ASSERT_EQ(ct_compress(context, content.data(), content.size(), &output, &output_size), CT_OK) << ct_context_error(context);
+    EXPECT_GT(ct_context_peak_memory(context), 0u);
+    EXPECT_LE(ct_context_peak_memory(context), 2u * 1024 * 1024);
+    ct_context_free(context);
+}
+
+TEST_F(CompressionTest, WorkStealingPoolRunsNestedTasks) {
+    // Every worker runs an outer task that waits for inner tasks on the same pool,
+    // which only completes if waiting workers run queued tasks themselves.
+    ThreadPool pool(2);
+    std::atomic<int> inner_runs{ 0 };
+    std::vector<std::future<void>> outer;
+    for (int i = 0; i < 8; ++i) {
+        outer.push_back(pool.Submit([&pool, &inner_runs]() {
+            EXPECT_EQ(ThreadPool::Current(), &pool);
+            std::vector<std::future<void>> inner;
+            for (int j = 0; j < 16; ++j) {
+                inner.push_back(pool.Submit([&inner_runs]() { ++inner_runs; }));
+            }
+            for (auto& task : inner) {
+                pool.Wait(task);
+                task.get();
+            }
+        }));
+    }
+    for (auto& task : outer) {
+        pool.Wait(task);
+        task.get();
+    }
+    EXPECT_EQ(inner_runs, 8 * 16);
+    EXPECT_EQ(ThreadPool::Current(), nullptr);
+}
+
+TEST_F(CompressionTest, BatchQueueCompressesAndDecompressesFolders) {
+    auto source_dir = temp_dir_ / "batch";
+    std::filesystem::create_directories(source_dir / "nested");
+    std::map<std::filesystem::path, std::string> files;
+    for (int i = 0; i < 20; ++i) {
+        auto path = source_dir / (i % 2 ? "nested" : "") / ("file" + std::to_string(i) + ".txt");
+        files[path] = generateRandomString(1000 + i * 5000) + std::string(3000, 'z');
+        std::ofstream(path, std::ios::binary) << files[path];
+    }
+    // Large enough to be decoded block-parallel on the batch's own pool.
+    auto large = source_dir / "large.bin";
+    files[large] = generateRandomString(3 * EncodingAlgorithms::DEFAULT_BLOCK_SIZE);
+    std::ofstream(large, std::ios::binary) << files[large];
+    // Fails without stopping the others.
+    auto missing = source_dir / "missing.txt";
+
+    EncodingAlgorithms::CodecSettings settings;
+    std::mutex mutex;
+    std::map<size_t, int> last_percentage;
+    BatchProgress final_progress;
+    BatchQueue::StatusCallback callback = [&](size_t job, const BatchJobStatus& status, const BatchProgress& progress) {
+        std::lock_guard<std::mutex> lock(mutex);
+        EXPECT_GE(status.percentage(), last_percentage[job]);
+        last_percentage[job] = status.percentage();
+        if (progress.finished()) {
+            final_progress = progress;
+        }
+    };
+
+    auto inputs = BatchQueue::ExpandPaths({ source_dir, missing });
+    ASSERT_EQ(inputs.size(), files.size() + 1);
+    {
+        BatchQueue queue(settings, callback, 4);
+        for (const auto& input : inputs) {
+            queue.Add({ BatchOperation::Compress, input, {}, EncodingAlgorithms::CodecId::Huffman });
+        }
+        queue.Wait();
+        EXPECT_EQ(queue.Status(inputs.size() - 1).state, BatchJobState::Failed);
+        EXPECT_FALSE(queue.Status(inputs.size() - 1).error.empty());
+    }
+    EXPECT_EQ(final_progress.completed, files.size());
+    EXPECT_EQ(final_progress.failed, 1u);
+    EXPECT_EQ(final_progress.percentage(), 100);
+
+    // Remove the originals, then restore them from the compressed files next to them.
+    for (const auto& [path, content] : files) {
+        std::filesystem::remove(path);
+    }
+    BatchQueue queue(settings, nullptr, 4);
+    for (const auto& [path, content] : files) {
+        auto compressed = path.parent_path() / (path.stem().string() + ".huff");
+        queue.Add({ BatchOperation::Decompress, compressed, {}, std::nullopt });
+    }
+    queue.Wait();
+    EXPECT_EQ(queue.Progress().completed, files.size());
+    for (const auto& [path, content] : files) {
+        EXPECT_EQ(readOutputFile(path.string()), content);
+    }
+}
+
+TEST_F(CompressionTest, CancelAndPauseStopJobsBetweenBlocks) {
+    std::string data = generateRandomString(8 * EncodingAlgorithms::MIN_BLOCK_SIZE);
+    EncodingAlgorithms::CodecSettings settings;
+    settings.block_size = EncodingAlgorithms::MIN_BLOCK_SIZE;
+    auto control = std::make_shared<JobControl>();
+    settings.control = control;
+
+    // A paused job waits at its next block until it is resumed.
+    control->Pause();
+    auto paused = std::async(std::launch::async, [&]() {
+        std::istringstream input(data);
+        std::ostringstream output;
+        CompressionEngine::Compress(input, output, EncodingAlgorithms::CodecId::Huffman, ".txt", settings);
+        return output.str().size();
+    });
+    EXPECT_EQ(paused.wait_for(std::chrono::milliseconds(200)), std::future_status::timeout);
+    control->Resume();
+    EXPECT_GT(paused.get(), 0u);
+
+    // A cancelled job throws instead of finishing.
+    control->Cancel();
+    {
+        std::istringstream input(data);
+        std::ostringstream output;
+        EXPECT_THROW(CompressionEngine::Compress(input, output, EncodingAlgorithms::CodecId::Huffman, ".txt", settings),
+            OperationCancelledException);
+    }
+    control->Reset();
+
+    // Cancelling one job of a batch removes its partial output and leaves the others alone.
+    std::vector<std::filesystem::path> inputs;
+    for (int i = 0; i < 3; ++i) {
+        inputs.push_back(temp_dir_ / ("cancel" + std::to_string(i) + ".txt"));
+        std::ofstream(inputs.back(), std::ios::binary) << data;
+    }
+    std::unique_ptr<BatchQueue> queue;
+    BatchQueue::StatusCallback callback = [&](size_t job, const BatchJobStatus& status, const BatchProgress&) {
+        if (job == 0 && status.state == BatchJobState::Running) {
+            queue->Cancel(0);
+        }
+    };
+    queue = std::make_unique<BatchQueue>(settings, callback, 2);
+    queue->Pause();
+    for (const auto& input : inputs) {
+        queue->Add({ BatchOperation::Compress, input, {}, EncodingAlgorithms::CodecId::Huffman });
+    }
+    queue->Cancel(2);
+    queue->Resume();
+    queue->Wait();
+
+    EXPECT_EQ(queue->Status(0).state, BatchJobState::Cancelled);
+    EXPECT_EQ(queue->Status(1).state, BatchJobState::Completed);
+    EXPECT_EQ(queue->Status(2).state, BatchJobState::Cancelled);
+    EXPECT_FALSE(std::filesystem::exists(temp_dir_ / "cancel0.huff"));
+    EXPECT_TRUE(std::filesystem::exists(temp_dir_ / "cancel1.huff"));
+    EXPECT_FALSE(std::filesystem::exists(temp_dir_ / "cancel2.huff"));
+    EXPECT_EQ(queue->Progress().cancelled, 2u);
+
+    // Destroying a paused queue lets its jobs finish instead of waiting forever.
+    queue = std::make_unique<BatchQueue>(settings, nullptr, 2);
+    queue->Pause();
+    queue->Add({ BatchOperation::Compress, inputs[0], {}, EncodingAlgorithms::CodecId::Huffman });
+    queue.reset();
+    EXPECT_TRUE(std::filesystem::exists(temp_dir_ / "cancel0.huff"));
+}
+
+TEST_F(CompressionTest, ProgressReportsAreCoalesced) {
+    // Without a time limit, only whole-percent changes produce a report, 0% through 100%.
+    const std::uint64_t total = 10'000'000;
+    std::vector<ProgressReport> reports;
+    size_t counted = 0;
+    {
+        ProgressReporter reporter(total, [&reports](const ProgressReport& report) { reports.push_back(report); },
+            std::chrono::milliseconds(0));
+        for (std::uint64_t processed = 1000; processed <= total; processed += 1000) {
+            reporter.Update(processed, [&]() {
+                ++counted;
+                return std::make_pair(processed, processed / 2);
+            });
+        }
+    }
+    ASSERT_EQ(reports.size(), 101u);
+    EXPECT_EQ(counted, reports.size());
+    for (size_t i = 1; i < reports.size(); ++i) {
+        EXPECT_EQ(reports[i].percentage(), reports[i - 1].percentage() + 1);
+    }
+    EXPECT_EQ(reports.back().bytes_out, total / 2);
+
+    // The time limit holds back everything but the final report.
+    reports.clear();
+    ProgressReporter reporter(0, [&reports](const ProgressReport& report) { reports.push_back(report); },
+        std::chrono::milliseconds(60'000));
+    std::string input = generateRandomString(4 * EncodingAlgorithms::DEFAULT_BLOCK_SIZE);
+    std::istringstream input_stream(input);
+    std::ostringstream compressed;
+    CompressionEngine::Compress(input_stream, compressed, EncodingAlgorithms::CodecId::Huffman, ".txt", {},
+        [&](std::int64_t processed) {
+            reporter.Update(static_cast<std::uint64_t>(processed), [&]() {
+                return std::make_pair(static_cast<std::uint64_t>(processed), ProgressReporter::Position(compressed));
+            });
+        });
+    EXPECT_TRUE(reports.empty());
+
+    reporter.Finish(input.size(), input.size(), ProgressReporter::Position(compressed));
+    ASSERT_EQ(reports.size(), 1u);
+    EXPECT_EQ(reports[0].percentage(), 100);
+    EXPECT_EQ(reports[0].bytes_out, compressed.str().size());
+    EXPECT_EQ(reports[0].eta_seconds().value_or(-1), 0.0);
+}
+
+TEST_F(CompressionTest, CommandLineCompressesVerifiesAndPipes) {
+    std::string content = generateRandomString(100000) + std::string(50000, 'a');
+    auto input = std::filesystem::path(createInputFile(content));
+    auto compressed = temp_dir_ / "input.rle";
+    std::istringstream no_input;
+    std::ostringstream out, err;
+
+    // Files are compressed next to themselves and only replaced with --force.
+    EXPECT_EQ(CommandLine::Run({ "compress", "-a", "rle", "-t", "2", "-b", "64K", input.string() }, no_input, out, err),
+        CommandLine::EXIT_OK) << err.str();
+    ASSERT_TRUE(std::filesystem::exists(compressed));
+    EXPECT_EQ(CommandLine::Run({ "compress", "-q", "-a", "rle", input.string() }, no_input, out, err), CommandLine::EXIT_FAILED);
+    EXPECT_EQ(CommandLine::Run({ "compress", "-q", "-f", "-a", "rle", input.string() }, no_input, out, err), CommandLine::EXIT_OK);
+
+    out.str("");
+    EXPECT_EQ(CommandLine::Run({ "verify", compressed.string() }, no_input, out, err), CommandLine::EXIT_OK);
+    EXPECT_NE(out.str().find(": OK, " + std::to_string(content.size()) + " bytes"), std::string::npos);
+
+    std::filesystem::remove(input);
+    EXPECT_EQ(CommandLine::Run({ "decompress", "-q", compressed.string() }, no_input, out, err), CommandLine::EXIT_OK);
+    EXPECT_EQ(readOutputFile(input.string()), content);
+
+    // Without files, stdin is compressed to stdout and back.
+    std::istringstream pipe_input(content);
+    std::ostringstream pipe_compressed;
+    EXPECT_EQ(CommandLine::Run({ "compress", "-a", "huffman" }, pipe_input, pipe_compressed, err), CommandLine::EXIT_OK);
+    std::istringstream pipe_compressed_input(pipe_compressed.str());
+    std::ostringstream pipe_output;
+    EXPECT_EQ(CommandLine::Run({ "decompress", "-" }, pipe_compressed_input, pipe_output, err), CommandLine::EXIT_OK);
+    EXPECT_EQ(pipe_output.str(), content);
+
+    // Invalid arguments are usage errors, a corrupt file fails verification.
+    EXPECT_EQ(CommandLine::Run({ "compress", "--block-size", "1K" }, no_input, out, err), CommandLine::EXIT_USAGE);
+    EXPECT_EQ(CommandLine::Run({ "shrink" }, no_input, out, err), CommandLine::EXIT_USAGE);
+    EXPECT_EQ(CommandLine::ParseSize("4M"), 4u * 1024 * 1024);
+    EXPECT_THROW(CommandLine::ParseSize("4X"), std::invalid_argument);
+    EXPECT_EQ(CommandLine::Run({ "verify", input.string() }, no_input, out, err), CommandLine::EXIT_FAILED);
+}
+
+TEST_F(CompressionTest, CApiRoundTripAndErrors) {
+    ASSERT_EQ(ct_api_version(), CT_API_VERSION);
+    ct_context* context = ct_context_create();
+    ASSERT_NE(context, nullptr);
+
+    std::string content = generateRandomString(300000);
+    for (int algorithm : { CT_ALGORITHM_RLE, CT_ALGORITHM_HUFFMAN, CT_ALGORITHM_CONTEXT_HUFFMAN }) {
+        ASSERT_EQ(ct_context_set_option(context, CT_OPTION_ALGORITHM, algorithm), CT_OK);
+        ASSERT_EQ(ct_context_set_option(context, CT_OPTION_BLOCK_SIZE, 64 * 1024), CT_OK);
+
+        const void* compressed = nullptr;
+        size_t compressed_size = 0;
+        ASSERT_EQ(ct_compress(context, content.data(), content.size(), &compressed, &compressed_size), CT_OK)
+            << ct_context_error(context);
+        // The output belongs to the context and is replaced by the next call.
+        std::string compressed_copy(static_cast<const char*>(compressed), compressed_size);
+
+        const void* restored = nullptr;
+        size_t restored_size = 0;
+        ASSERT_EQ(ct_decompress(context, compressed_copy.data(), compressed_copy.size(), &restored, &restored_size), CT_OK)
+            << ct_context_error(context);
+        EXPECT_EQ(std::string(static_cast<const char*>(restored), restored_size), content);
+        EXPECT_STREQ(ct_context_error(context), "");
+    }
+
+    const void* output = nullptr;
+    size_t output_size = 0;
+    EXPECT_EQ(ct_context_set_option(context, CT_OPTION_BLOCK_SIZE, 1), CT_ERROR_INVALID_ARGUMENT);
+    EXPECT_EQ(ct_context_set_option(context, static_cast<ct_option>(99), 0), CT_ERROR_INVALID_ARGUMENT);
+    EXPECT_EQ(ct_decompress(context, "not a compressed file", 21, &output, &output_size), CT_ERROR_INVALID_DATA);
+    EXPECT_STRNE(ct_context_error(context), "");
+    EXPECT_EQ(ct_compress(context, nullptr, 0, &output, &output_size), CT_OK);
+    EXPECT_EQ(ct_compress(nullptr, nullptr, 0, &output, &output_size), CT_ERROR_INVALID_ARGUMENT);
+
+    ct_context_free(context);
+}
+
+TEST_F(CompressionTest, ReusedContextsDoNotAllocate) {
+    std::string content;
+    for (int i = 0; i < 3000; ++i) {
+        content += "record " + std::to_string(i * 7919 % 1000) + std::string(i % 40, 'x') + "\n";
+    }
+    auto data = reinterpret_cast<const std::uint8_t*>(content.data());
+
+    EncodingAlgorithms::CodecSettings settings;
+    settings.block_size = 64 * 1024;
+    for (auto codec : { EncodingAlgorithms::CodecId::RLE, EncodingAlgorithms::CodecId::Huffman,
+        EncodingAlgorithms::CodecId::ContextHuffman }) {
+        EncodingAlgorithms::CompressContext compress_context;
+        EncodingAlgorithms::DecompressContext decompress_context;
+        compress_context.UseHugePages(true);
+        std::vector<std::uint8_t> compressed;
+        std::vector<std::uint8_t> restored;
+
+        // The first call sizes the buffers, later ones only reuse them.
+        for (int call = 0; call < 3; ++call) {
+            size_t before = allocation_count;
+            CompressionEngine::CompressBuffer(data, content.size(), compressed, codec, settings, &compress_context);
+            CompressionEngine::DecompressBuffer(compressed.data(), compressed.size(), restored, codec, settings, &decompress_context);
+            if (call > 0) {
+                EXPECT_EQ(allocation_count - before, 0u) << "codec " << static_cast<int>(codec) << ", call " << call;
+            }
+            ASSERT_EQ(std::string(restored.begin(), restored.end()), content);
+        }
+        EXPECT_GE(compress_context.capacity(), settings.block_size);
+
+        compress_context.Release();
+        EXPECT_EQ(compress_context.capacity(), 0u);
+        CompressionEngine::CompressBuffer(data, content.size(), compressed, codec, settings, &compress_context);
+        CompressionEngine::DecompressBuffer(compressed.data(), compressed.size(), restored, codec, settings);
+        EXPECT_EQ(std::string(restored.begin(), restored.end()), content);
+    }
+
+    // Parallel RLE keeps the context's threads, only a call without a context starts new ones.
+    std::string runs;
+    while (runs.size() < 2 * 1024 * 1024) {
+        runs.append(runs.size() % 700 + 1, static_cast<char>('a' + runs.size() % 3));
+    }
+    data = reinterpret_cast<const std::uint8_t*>(runs.data());
+    settings.block_size = 1024 * 1024;
+    settings.threads = 4;
+    EncodingAlgorithms::CompressContext compress_context;
+    std::vector<std::uint8_t> compressed, restored;
+    CompressionEngine::CompressBuffer(data, runs.size(), compressed, EncodingAlgorithms::CodecId::RLE, settings, &compress_context);
+    size_t before = allocation_count;
+    CompressionEngine::CompressBuffer(data, runs.size(), compressed, EncodingAlgorithms::CodecId::RLE, settings, &compress_context);
+    size_t with_context = allocation_count - before;
+    before = allocation_count;
+    CompressionEngine::CompressBuffer(data, runs.size(), compressed, EncodingAlgorithms::CodecId::RLE, settings);
+    size_t without_context = allocation_count - before;
+    before = allocation_count;
+    {
+        ThreadPool pool(settings.threads);
+    }
+    EXPECT_LE(with_context + (allocation_count - before), without_context);
+    CompressionEngine::DecompressBuffer(compressed.data(), compressed.size(), restored, EncodingAlgorithms::CodecId::RLE, settings);
+    EXPECT_EQ(std::string(restored.begin(), restored.end()), runs);
+}
+
+TEST_F(CompressionTest, ParallelRleMatchesSerialEncoder) {
+    // Runs of every length up to a few full runs, and one run across the middle of the input,
+    // so chunk and window boundaries fall inside runs.
+    std::mt19937 gen(49);
+    std::uniform_int_distribution<> length(1, 800);
+    std::uniform_int_distribution<> character(0, 3);
+    std::string content;
+    while (content.size() < 3 * 1024 * 1024) {
+        content.append(length(gen), static_cast<char>('a' + character(gen)));
+    }
+    std::fill_n(content.begin() + content.size() / 2 - 300, 1000, 'z');
+    content.append(255 * 4, 'y');
+    auto data = reinterpret_cast<const std::uint8_t*>(content.data());
+
+    ThreadPool pool(4);
+    std::vector<std::uint8_t> serial;
+    EncodingAlgorithms::RLECoding::encode(data, content.size(), serial);
+    std::vector<std::uint8_t> parallel{ 42 };
+    EncodingAlgorithms::RLECoding::encode(data, content.size(), parallel, pool);
+    ASSERT_EQ(parallel.size(), serial.size() + 1);
+    EXPECT_TRUE(std::equal(serial.begin(), serial.end(), parallel.begin() + 1));
+
+    // The stream encoder keeps the last run of every window for the next one.
+    std::istringstream serial_input(content);
+    std::ostringstream serial_stream;
+    EncodingAlgorithms::RLECoding::encode(serial_input, serial_stream);
+    std::istringstream parallel_input(content);
+    std::ostringstream parallel_stream;
+    EncodingAlgorithms::RLECoding::encode(parallel_input, parallel_stream, std::nullopt, {}, &pool);
+    EXPECT_EQ(parallel_stream.str(), serial_stream.str());
+    EXPECT_EQ(parallel_stream.str(), std::string(serial.begin(), serial.end()));
+
+    // Both formats write the same files on any number of threads.
+    for (bool block_format : { true, false }) {
+        EncodingAlgorithms::CodecSettings settings;
+        settings.block_format = block_format;
+        settings.block_size = 2 * 1024 * 1024;
+        std::map<size_t, std::string> files;
+        for (size_t threads : { 1, 4 }) {
+            settings.threads = threads;
+            std::istringstream input(content);
+            std::ostringstream output;
+            CompressionEngine::Compress(input, output, EncodingAlgorithms::CodecId::RLE, "bin", settings);
+            files[threads] = output.str();
+        }
+        EXPECT_EQ(files[4], files[1]);
+
+        std::istringstream compressed(files[4]);
+        std::ostringstream decompressed;
+        CompressionEngine::Decompress(compressed, decompressed, EncodingAlgorithms::CodecId::RLE, settings);
+        EXPECT_EQ(decompressed.str(), content);
+    }
+}
+
+TEST_F(CompressionTest, ParallelHuffmanWritesTheSingleStreamFormat) {
+    // Skewed bytes give codes of many lengths, so chunks end in the middle of bytes.
+    std::mt19937 gen(50);
+    std::geometric_distribution<> symbol(0.2);
+    std::string content(2 * 1024 * 1024 + 12345, '\0');
+    for (auto& c : content) {
+        c = static_cast<char>(std::min(symbol(gen), 255));
+    }
+
+    std::istringstream serial_input(content);
+    std::ostringstream serial;
+    EncodingAlgorithms::HuffmanCoding::encode(serial_input, serial);
+
+    for (size_t threads : { 2, 3, 8 }) {
+        ThreadPool pool(threads);
+        std::istringstream input(content);
+        std::ostringstream parallel;
+        EncodingAlgorithms::HuffmanCoding::encode(input, parallel, std::nullopt, {}, &pool);
+        EXPECT_EQ(parallel.str(), serial.str()) << threads << " threads";
+    }
+
+    // The legacy decoder reads it, and files are the same on any number of threads.
+    std::istringstream encoded(serial.str());
+    std::ostringstream decoded;
+    EncodingAlgorithms::HuffmanCoding::decode(encoded, decoded);
+    EXPECT_EQ(decoded.str(), content);
+
+    EncodingAlgorithms::CodecSettings settings;
+    settings.block_format = false;
+    std::map<size_t, std::string> files;
+    for (size_t threads : { 1, 4 }) {
+        settings.threads = threads;
+        std::istringstream input(content);
+        std::ostringstream output;
+        CompressionEngine::Compress(input, output, EncodingAlgorithms::CodecId::Huffman, "bin", settings);
+        files[threads] = output.str();
+    }
+    EXPECT_EQ(files[4], files[1]);
+}
+
+TEST_F(CompressionTest, InMemoryCodecsMatchStreamFormats) {
+    std::string content = generateRandomString(20000) + std::string(1000, 'a') + std::string(255, 'b') + "c";
+    auto data = reinterpret_cast<const std::uint8_t*>(content.data());
+
+    // RLE has a single encoding, both variants write the same bytes.
+    std::vector<std::uint8_t> rle;
+    EncodingAlgorithms::RLECoding::encode(data, content.size(), rle);
+    std::istringstream rle_input(content);
+    std::ostringstream rle_stream;
+    EncodingAlgorithms::RLECoding::encode(rle_input, rle_stream);
+    EXPECT_EQ(std::string(rle.begin(), rle.end()), rle_stream.str());
+
+    // Huffman codes may differ, but each variant decodes what the other writes.
+    std::vector<std::uint8_t> huffman;
+    EncodingAlgorithms::HuffmanCoding::encode(data, content.size(), huffman);
+    std::istringstream huffman_input(std::string(huffman.begin(), huffman.end()));
+    std::ostringstream huffman_output;
+    EncodingAlgorithms::HuffmanCoding::decode(huffman_input, huffman_output);
+    EXPECT_EQ(huffman_output.str(), content);
+
+    std::istringstream stream_input(content);
+    std::ostringstream stream_encoded;
+    EncodingAlgorithms::HuffmanCoding::encode(stream_input, stream_encoded);
+    std::string encoded = stream_encoded.str();
+    std::vector<std::uint8_t> decoded;
+    EncodingAlgorithms::HuffmanCoding::decode(reinterpret_cast<const std::uint8_t*>(encoded.data()), encoded.size(),
+        decoded, content.size());
+    EXPECT_EQ(std::string(decoded.begin(), decoded.end()), content);
+
+    // Truncated input is rejected rather than decoded past its end.
+    decoded.clear();
+    EXPECT_THROW(EncodingAlgorithms::HuffmanCoding::decode(reinterpret_cast<const std::uint8_t*>(encoded.data()),
+        encoded.size() / 2, decoded, content.size()), CompressionException);
+}